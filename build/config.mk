@@ -21,8 +21,9 @@
 
 DEFAULT_BUILD = release
 
-# returns i386, x86_64, powerpc, etc.
-PROC := $(shell uname -p)
+# returns i386, x86_64, aarch64, powerpc, etc.; uname -p says "unknown" on
+# many Linux systems, so use the machine name and fold it the way configure does
+PROC := $(shell uname -m | sed -e 's/^i[3-9]86$$/i386/' -e 's/^amd64$$/x86_64/' -e 's/^arm64$$/aarch64/')
 # returns Linux, Darwin, FreeBSD, etc.
 OS := $(shell uname -s)
 
@@ -48,10 +49,13 @@ all default: $(DEFAULT_BUILD)
 VERSION=\"1.2.1\"
 
 ifeq ($(OS),Darwin)
-CONFIG_CFLAGS=-DHAVE_STDINT_H -DHAVE_ICONV -DHAVE_CXX_VARARRAYS -DHAVE_LANGINFO_CODESET -DFLAC__HAS_OGG -D_LARGEFILE_SOURCE -D_FILE_OFFSET_BITS=64 -DFLAC__SYS_DARWIN -DWORDS_BIGENDIAN
+CONFIG_CFLAGS=-DHAVE_STDINT_H -DHAVE_ICONV -DHAVE_CXX_VARARRAYS -DHAVE_LANGINFO_CODESET -DFLAC__HAS_OGG -DFLAC__HAS_PTHREAD -D_LARGEFILE_SOURCE -D_FILE_OFFSET_BITS=64 -DFLAC__SYS_DARWIN -DWORDS_BIGENDIAN -pthread
 else
-CONFIG_CFLAGS=-DHAVE_STDINT_H -DHAVE_ICONV -DHAVE_CXX_VARARRAYS -DHAVE_LANGINFO_CODESET -DHAVE_SOCKLEN_T -DFLAC__HAS_OGG -D_LARGEFILE_SOURCE -D_FILE_OFFSET_BITS=64
+CONFIG_CFLAGS=-DHAVE_STDINT_H -DHAVE_ICONV -DHAVE_CXX_VARARRAYS -DHAVE_LANGINFO_CODESET -DHAVE_SOCKLEN_T -DFLAC__HAS_OGG -DFLAC__HAS_PTHREAD -D_LARGEFILE_SOURCE -D_FILE_OFFSET_BITS=64 -pthread
 endif
 
+# for the threaded encoder and decoder (FLAC__HAS_PTHREAD above) and flac --jobs
+CONFIG_LFLAGS=-pthread
+
 OGG_INCLUDE_DIR=$(HOME)/local/include
 OGG_LIB_DIR=$(HOME)/local/lib
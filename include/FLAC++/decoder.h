@@ -69,14 +69,63 @@
  * is used for the same cases that FLAC__stream_decoder_init_stream() /
  * FLAC__stream_decoder_init_ogg_stream() are used, and FLAC::Decoder::File
  * is used for the same cases that
- * FLAC__stream_decoder_init_FILE() and FLAC__stream_decoder_init_file() /
- * FLAC__stream_decoder_init_ogg_FILE() and FLAC__stream_decoder_init_ogg_file()
+ * FLAC__stream_decoder_init_FILE(), FLAC__stream_decoder_init_file() and
+ * FLAC__stream_decoder_init_mmap() / FLAC__stream_decoder_init_ogg_FILE(),
+ * FLAC__stream_decoder_init_ogg_file() and FLAC__stream_decoder_init_ogg_mmap()
  * are used.
  */
 
 namespace FLAC {
 	namespace Decoder {
 
+		/** \ingroup flacpp_decoder
+		 *  \brief
+		 *  A pool of ::FLAC__StreamDecoder instances that
+		 *  FLAC::Decoder::Stream and FLAC::Decoder::File objects can
+		 *  borrow, for programs that decode many streams one after the
+		 *  other and do not want to create and delete a decoder for each.
+		 *
+		 * Construct the decoder object with the pool instead of with the
+		 * default constructor.  It then takes an idle decoder from the
+		 * pool if there is one, and when it is destroyed the decoder is
+		 * finished with FLAC__stream_decoder_recycle(), which keeps its
+		 * buffers, and goes back to the pool.  At most \a max_idle
+		 * decoders are kept; any more are deleted.
+		 *
+		 * The pool may be shared between threads, but it must outlive
+		 * every decoder object constructed with it.
+		 */
+		class FLACPP_API Pool {
+		public:
+			Pool(unsigned max_idle = 16);
+			virtual ~Pool();
+
+			/** Take an idle decoder from the pool, or create a new one
+			 *  if there is none.
+			 *
+			 * \retval ::FLAC__StreamDecoder*
+			 *    An uninitialized decoder, or \c NULL if creating one
+			 *    failed.
+			 */
+			virtual ::FLAC__StreamDecoder *acquire();
+
+			/** Recycle a decoder from acquire() and keep it for the next
+			 *  acquire(), or delete it if the pool is full.
+			 *
+			 * \param decoder  The decoder; it need not be finished.
+			 */
+			virtual void release(::FLAC__StreamDecoder *decoder);
+
+			virtual unsigned get_num_idle() const; ///< The number of decoders waiting in the pool
+		protected:
+			struct Private;
+			Private *private_;
+		private:
+			// Private and undefined so you can't use them:
+			Pool(const Pool &);
+			void operator=(const Pool &);
+		};
+
 		/** \ingroup flacpp_decoder
 		 *  \brief
 		 *  This class wraps the ::FLAC__StreamDecoder.  If you are
@@ -111,6 +160,7 @@ namespace FLAC {
 			};
 
 			Stream();
+			explicit Stream(Pool &pool); ///< Uses a decoder from \a pool and hands it back when destroyed; see FLAC::Decoder::Pool
 			virtual ~Stream();
 
 			//@{
@@ -123,6 +173,10 @@ namespace FLAC {
 
 			virtual bool set_ogg_serial_number(long value);                        ///< See FLAC__stream_decoder_set_ogg_serial_number()
 			virtual bool set_md5_checking(bool value);                             ///< See FLAC__stream_decoder_set_md5_checking()
+			virtual bool set_num_threads(unsigned value);                          ///< See FLAC__stream_decoder_set_num_threads()
+			virtual bool set_pipeline_depth(unsigned value);                       ///< See FLAC__stream_decoder_set_pipeline_depth()
+			virtual bool set_frame_indexing(bool value);                           ///< See FLAC__stream_decoder_set_frame_indexing()
+			virtual bool set_frame_index(const ::FLAC__StreamMetadata *frame_index); ///< See FLAC__stream_decoder_set_frame_index()
 			virtual bool set_metadata_respond(::FLAC__MetadataType type);          ///< See FLAC__stream_decoder_set_metadata_respond()
 			virtual bool set_metadata_respond_application(const FLAC__byte id[4]); ///< See FLAC__stream_decoder_set_metadata_respond_application()
 			virtual bool set_metadata_respond_all();                               ///< See FLAC__stream_decoder_set_metadata_respond_all()
@@ -133,6 +187,9 @@ namespace FLAC {
 			/* get_state() is not virtual since we want subclasses to be able to return their own state */
 			State get_state() const;                                          ///< See FLAC__stream_decoder_get_state()
 			virtual bool get_md5_checking() const;                            ///< See FLAC__stream_decoder_get_md5_checking()
+			virtual unsigned get_num_threads() const;                         ///< See FLAC__stream_decoder_get_num_threads()
+			virtual unsigned get_pipeline_depth() const;                      ///< See FLAC__stream_decoder_get_pipeline_depth()
+			virtual bool get_frame_indexing() const;                          ///< See FLAC__stream_decoder_get_frame_indexing()
 			virtual FLAC__uint64 get_total_samples() const;                   ///< See FLAC__stream_decoder_get_total_samples()
 			virtual unsigned get_channels() const;                            ///< See FLAC__stream_decoder_get_channels()
 			virtual ::FLAC__ChannelAssignment get_channel_assignment() const; ///< See FLAC__stream_decoder_get_channel_assignment()
@@ -144,7 +201,8 @@ namespace FLAC {
 			virtual ::FLAC__StreamDecoderInitStatus init();      ///< Seek FLAC__stream_decoder_init_stream()
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg();  ///< Seek FLAC__stream_decoder_init_ogg_stream()
 
-			virtual bool finish(); ///< See FLAC__stream_decoder_finish()
+			virtual bool finish();  ///< See FLAC__stream_decoder_finish()
+			virtual bool recycle(); ///< See FLAC__stream_decoder_recycle()
 
 			virtual bool flush(); ///< See FLAC__stream_decoder_flush()
 			virtual bool reset(); ///< See FLAC__stream_decoder_reset()
@@ -155,6 +213,11 @@ namespace FLAC {
 			virtual bool skip_single_frame();             ///< See FLAC__stream_decoder_skip_single_frame()
 
 			virtual bool seek_absolute(FLAC__uint64 sample); ///< See FLAC__stream_decoder_seek_absolute()
+			virtual bool process_range(FLAC__uint64 first_sample, FLAC__uint64 last_sample, FLAC__int32 buffer[], bool *md5_checked); ///< See FLAC__stream_decoder_process_range()
+			virtual bool read_samples_interleaved(FLAC__int32 buffer[], unsigned samples, unsigned *samples_read); ///< See FLAC__stream_decoder_read_samples_interleaved()
+			virtual bool read_samples_interleaved(FLAC__int16 buffer[], unsigned samples, unsigned *samples_read); ///< See FLAC__stream_decoder_read_samples_interleaved_int16()
+			virtual bool scan_frames(::FLAC__StreamMetadata **frame_index); ///< See FLAC__stream_decoder_scan_frames()
+			virtual bool get_frame_index(::FLAC__StreamMetadata **frame_index) const; ///< See FLAC__stream_decoder_get_frame_index()
 		protected:
 			/// see FLAC__StreamDecoderReadCallback
 			virtual ::FLAC__StreamDecoderReadStatus read_callback(FLAC__byte buffer[], size_t *bytes) = 0;
@@ -185,6 +248,7 @@ namespace FLAC {
 			friend State;
 #endif
 			::FLAC__StreamDecoder *decoder_;
+			Pool *pool_; ///< where decoder_ came from, or \c NULL
 
 			static ::FLAC__StreamDecoderReadStatus read_callback_(const ::FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 			static ::FLAC__StreamDecoderSeekStatus seek_callback_(const ::FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -222,6 +286,7 @@ namespace FLAC {
 		class FLACPP_API File: public Stream {
 		public:
 			File();
+			explicit File(Pool &pool); ///< Uses a decoder from \a pool and hands it back when destroyed; see FLAC::Decoder::Pool
 			virtual ~File();
 
 			virtual ::FLAC__StreamDecoderInitStatus init(FILE *file);                      ///< See FLAC__stream_decoder_init_FILE()
@@ -230,6 +295,10 @@ namespace FLAC {
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(FILE *file);                  ///< See FLAC__stream_decoder_init_ogg_FILE()
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(const char *filename);        ///< See FLAC__stream_decoder_init_ogg_file()
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(const std::string &filename); ///< See FLAC__stream_decoder_init_ogg_file()
+			virtual ::FLAC__StreamDecoderInitStatus init_mmap(const char *filename);       ///< See FLAC__stream_decoder_init_mmap()
+			virtual ::FLAC__StreamDecoderInitStatus init_mmap(const std::string &filename); ///< See FLAC__stream_decoder_init_mmap()
+			virtual ::FLAC__StreamDecoderInitStatus init_ogg_mmap(const char *filename);   ///< See FLAC__stream_decoder_init_ogg_mmap()
+			virtual ::FLAC__StreamDecoderInitStatus init_ogg_mmap(const std::string &filename); ///< See FLAC__stream_decoder_init_ogg_mmap()
 		protected:
 			// this is a dummy implementation to satisfy the pure virtual in Stream that is actually supplied internally by the C layer
 			virtual ::FLAC__StreamDecoderReadStatus read_callback(FLAC__byte buffer[], size_t *bytes);
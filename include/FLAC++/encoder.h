@@ -132,8 +132,10 @@ namespace FLAC {
 			virtual bool set_sample_rate(unsigned value);                   ///< See FLAC__stream_encoder_set_sample_rate()
 			virtual bool set_compression_level(unsigned value);             ///< See FLAC__stream_encoder_set_compression_level()
 			virtual bool set_blocksize(unsigned value);                     ///< See FLAC__stream_encoder_set_blocksize()
+			virtual bool set_variable_blocksize(bool value);                ///< See FLAC__stream_encoder_set_variable_blocksize()
 			virtual bool set_do_mid_side_stereo(bool value);                ///< See FLAC__stream_encoder_set_do_mid_side_stereo()
 			virtual bool set_loose_mid_side_stereo(bool value);             ///< See FLAC__stream_encoder_set_loose_mid_side_stereo()
+			virtual bool set_fast_mid_side_stereo(bool value);              ///< See FLAC__stream_encoder_set_fast_mid_side_stereo()
 			virtual bool set_apodization(const char *specification);        ///< See FLAC__stream_encoder_set_apodization()
 			virtual bool set_max_lpc_order(unsigned value);                 ///< See FLAC__stream_encoder_set_max_lpc_order()
 			virtual bool set_qlp_coeff_precision(unsigned value);           ///< See FLAC__stream_encoder_set_qlp_coeff_precision()
@@ -144,6 +146,9 @@ namespace FLAC {
 			virtual bool set_max_residual_partition_order(unsigned value);  ///< See FLAC__stream_encoder_set_max_residual_partition_order()
 			virtual bool set_rice_parameter_search_dist(unsigned value);    ///< See FLAC__stream_encoder_set_rice_parameter_search_dist()
 			virtual bool set_total_samples_estimate(FLAC__uint64 value);    ///< See FLAC__stream_encoder_set_total_samples_estimate()
+			virtual bool set_num_threads(unsigned value);                   ///< See FLAC__stream_encoder_set_num_threads()
+			virtual bool set_workspace(void *workspace, size_t size);       ///< See FLAC__stream_encoder_set_workspace()
+			virtual bool set_frame_indexing(bool value);                    ///< See FLAC__stream_encoder_set_frame_indexing()
 			virtual bool set_metadata(::FLAC__StreamMetadata **metadata, unsigned num_blocks);    ///< See FLAC__stream_encoder_set_metadata()
 			virtual bool set_metadata(FLAC::Metadata::Prototype **metadata, unsigned num_blocks); ///< See FLAC__stream_encoder_set_metadata()
 
@@ -155,10 +160,13 @@ namespace FLAC {
 			virtual bool     get_streamable_subset() const;            ///< See FLAC__stream_encoder_get_streamable_subset()
 			virtual bool     get_do_mid_side_stereo() const;           ///< See FLAC__stream_encoder_get_do_mid_side_stereo()
 			virtual bool     get_loose_mid_side_stereo() const;        ///< See FLAC__stream_encoder_get_loose_mid_side_stereo()
+			virtual bool     get_fast_mid_side_stereo() const;         ///< See FLAC__stream_encoder_get_fast_mid_side_stereo()
+			virtual void     get_fast_mid_side_stats(FLAC__uint64 *frames, FLAC__uint64 *searched_frames, FLAC__uint64 *missed_frames) const; ///< See FLAC__stream_encoder_get_fast_mid_side_stats()
 			virtual unsigned get_channels() const;                     ///< See FLAC__stream_encoder_get_channels()
 			virtual unsigned get_bits_per_sample() const;              ///< See FLAC__stream_encoder_get_bits_per_sample()
 			virtual unsigned get_sample_rate() const;                  ///< See FLAC__stream_encoder_get_sample_rate()
 			virtual unsigned get_blocksize() const;                    ///< See FLAC__stream_encoder_get_blocksize()
+			virtual bool     get_variable_blocksize() const;           ///< See FLAC__stream_encoder_get_variable_blocksize()
 			virtual unsigned get_max_lpc_order() const;                ///< See FLAC__stream_encoder_get_max_lpc_order()
 			virtual unsigned get_qlp_coeff_precision() const;          ///< See FLAC__stream_encoder_get_qlp_coeff_precision()
 			virtual bool     get_do_qlp_coeff_prec_search() const;     ///< See FLAC__stream_encoder_get_do_qlp_coeff_prec_search()
@@ -168,11 +176,16 @@ namespace FLAC {
 			virtual unsigned get_max_residual_partition_order() const; ///< See FLAC__stream_encoder_get_max_residual_partition_order()
 			virtual unsigned get_rice_parameter_search_dist() const;   ///< See FLAC__stream_encoder_get_rice_parameter_search_dist()
 			virtual FLAC__uint64 get_total_samples_estimate() const;   ///< See FLAC__stream_encoder_get_total_samples_estimate()
+			virtual unsigned get_num_threads() const;                  ///< See FLAC__stream_encoder_get_num_threads()
+			virtual bool     get_frame_indexing() const;               ///< See FLAC__stream_encoder_get_frame_indexing()
+			virtual size_t   get_workspace_size() const;               ///< See FLAC__stream_encoder_get_workspace_size()
+			virtual bool     get_frame_index(::FLAC__StreamMetadata **frame_index) const; ///< See FLAC__stream_encoder_get_frame_index()
 
 			virtual ::FLAC__StreamEncoderInitStatus init();            ///< See FLAC__stream_encoder_init_stream()
 			virtual ::FLAC__StreamEncoderInitStatus init_ogg();        ///< See FLAC__stream_encoder_init_ogg_stream()
 
-			virtual bool finish(); ///< See FLAC__stream_encoder_finish()
+			virtual bool finish();  ///< See FLAC__stream_encoder_finish()
+			virtual bool recycle(); ///< See FLAC__stream_encoder_recycle()
 
 			virtual bool process(const FLAC__int32 * const buffer[], unsigned samples);     ///< See FLAC__stream_encoder_process()
 			virtual bool process_interleaved(const FLAC__int32 buffer[], unsigned samples); ///< See FLAC__stream_encoder_process_interleaved()
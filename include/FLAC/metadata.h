@@ -135,6 +135,9 @@ extern "C" {
  *
  *  They try to skip any ID3v2 tag at the head of the file.
  *
+ *  There are also routines to read and write a frame index file, a
+ *  sidecar that holds a seek point for every frame of a FLAC file.
+ *
  * \{
  */
 
@@ -235,6 +238,51 @@ FLAC_API FLAC__bool FLAC__metadata_get_cuesheet(const char *filename, FLAC__Stre
  */
 FLAC_API FLAC__bool FLAC__metadata_get_picture(const char *filename, FLAC__StreamMetadata **picture, FLAC__StreamMetadata_Picture_Type type, const char *mime_type, const FLAC__byte *description, unsigned max_width, unsigned max_height, unsigned max_depth, unsigned max_colors);
 
+/** Read a frame index file written by FLAC__metadata_write_frame_index().
+ *  The index is returned as a SEEKTABLE object which can be handed to
+ *  FLAC__stream_decoder_set_frame_index().
+ *
+ *  A frame index file is the four bytes \c "fLaI" followed by one or
+ *  more SEEKTABLE metadata blocks, encoded exactly as they would be in a
+ *  FLAC file, the last one with its "is last" flag set.  Several blocks
+ *  are only needed when there are more seek points than fit in one.
+ *
+ * \param filename     The path to the frame index file to read.
+ * \param frame_index  The address where the returned pointer will be
+ *                     stored.  The \a frame_index object must be deleted
+ *                     by the caller using FLAC__metadata_object_delete().
+ * \assert
+ *    \code filename != NULL \endcode
+ *    \code frame_index != NULL \endcode
+ * \retval FLAC__bool
+ *    \c true if a valid frame index was read from \a filename, and
+ *    \a *frame_index will be set to the address of the metadata
+ *    structure.  Returns \c false if there was a memory allocation
+ *    error, a read error, or the file is not a frame index file or
+ *    holds an illegal seek table, and \a *frame_index will be set to
+ *    \c NULL.
+ */
+FLAC_API FLAC__bool FLAC__metadata_read_frame_index(const char *filename, FLAC__StreamMetadata **frame_index);
+
+/** Write a frame index file; see FLAC__metadata_read_frame_index() for
+ *  the format.  The index usually comes from
+ *  FLAC__stream_encoder_get_frame_index(),
+ *  FLAC__stream_decoder_get_frame_index() or
+ *  FLAC__stream_decoder_scan_frames(), but any SEEKTABLE object will do.
+ *  An existing file is overwritten.
+ *
+ * \param filename     The path to the frame index file to write.
+ * \param frame_index  The frame index to write.
+ * \assert
+ *    \code filename != NULL \endcode
+ *    \code frame_index != NULL \endcode
+ *    \code frame_index->type == FLAC__METADATA_TYPE_SEEKTABLE \endcode
+ * \retval FLAC__bool
+ *    \c true if the file was written, \c false if it could not be
+ *    (in which case it is removed).
+ */
+FLAC_API FLAC__bool FLAC__metadata_write_frame_index(const char *filename, const FLAC__StreamMetadata *frame_index);
+
 /* \} */
 
 
@@ -87,9 +87,11 @@ extern "C" {
  * - The program initializes the instance to validate the settings and
  *   prepare for decoding using
  *   - FLAC__stream_decoder_init_stream() or FLAC__stream_decoder_init_FILE()
- *     or FLAC__stream_decoder_init_file() for native FLAC,
+ *     or FLAC__stream_decoder_init_file() or FLAC__stream_decoder_init_mmap()
+ *     for native FLAC,
  *   - FLAC__stream_decoder_init_ogg_stream() or FLAC__stream_decoder_init_ogg_FILE()
- *     or FLAC__stream_decoder_init_ogg_file() for Ogg FLAC
+ *     or FLAC__stream_decoder_init_ogg_file() or FLAC__stream_decoder_init_ogg_mmap()
+ *     for Ogg FLAC
  * - The program calls the FLAC__stream_decoder_process_*() functions
  *   to decode data, which subsequently calls the callbacks.
  * - The program finishes the decoding with FLAC__stream_decoder_finish(),
@@ -103,9 +105,9 @@ extern "C" {
  * functions to override the default decoder options, and call
  * one of the FLAC__stream_decoder_init_*() functions.
  *
- * There are three initialization functions for native FLAC, one for
+ * There are four initialization functions for native FLAC, one for
  * setting up the decoder to decode FLAC data from the client via
- * callbacks, and two for decoding directly from a FLAC file.
+ * callbacks, and three for decoding directly from a FLAC file.
  *
  * For decoding via callbacks, use FLAC__stream_decoder_init_stream().
  * You must also supply several callbacks for handling I/O.  Some (like
@@ -114,9 +116,12 @@ extern "C" {
  * For decoding directly from a file, use FLAC__stream_decoder_init_FILE()
  * or FLAC__stream_decoder_init_file().  Then you must only supply an open
  * \c FILE* or filename and fewer callbacks; the decoder will handle
- * the other callbacks internally.
+ * the other callbacks internally.  FLAC__stream_decoder_init_mmap() is
+ * like FLAC__stream_decoder_init_file() but maps the file into memory
+ * where the system supports it, which saves copying the data through
+ * stdio.
  *
- * There are three similarly-named init functions for decoding from Ogg
+ * There are four similarly-named init functions for decoding from Ogg
  * FLAC streams.  Check \c FLAC_API_SUPPORTS_OGG_FLAC to find out if the
  * library has been built with Ogg support.
  *
@@ -143,12 +148,23 @@ extern "C" {
  * ensures the decoder is in the correct state and frees memory.  Then the
  * instance may be deleted with FLAC__stream_decoder_delete() or initialized
  * again to decode another stream.
+ * If the instance is going to decode another stream,
+ * FLAC__stream_decoder_recycle() can be called instead; it keeps the
+ * buffers so the next init does not have to allocate them again.
  *
  * Seeking is exposed through the FLAC__stream_decoder_seek_absolute() method.
  * At any point after the stream decoder has been initialized, the client can
  * call this function to seek to an exact sample within the stream.
  * Subsequently, the first time the write callback is called it will be
  * passed a (possibly partial) block starting at that sample.
+ * To decode just part of a stream, FLAC__stream_decoder_process_range()
+ * seeks to a range of samples, decodes only the frames holding it and
+ * can write the samples straight into a client buffer.
+ *
+ * Instead of having each frame passed to the write callback, the client
+ * can also pull the decoded samples into its own buffer with
+ * FLAC__stream_decoder_read_samples_interleaved() or
+ * FLAC__stream_decoder_read_samples_interleaved_int16().
  *
  * If the client cannot seek via the callback interface provided, but still
  * has another way of seeking, it can flush the decoder using
@@ -270,7 +286,9 @@ typedef enum {
 
 	FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE,
 	/**< fopen() failed in FLAC__stream_decoder_init_file() or
-	 * FLAC__stream_decoder_init_ogg_file(). */
+	 * FLAC__stream_decoder_init_ogg_file(), or the file could not be
+	 * opened in FLAC__stream_decoder_init_mmap() or
+	 * FLAC__stream_decoder_init_ogg_mmap(). */
 
 	FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED
 	/**< FLAC__stream_decoder_init_*() was called when the decoder was
@@ -796,6 +814,115 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_ogg_serial_number(FLAC__StreamDecod
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_set_md5_checking(FLAC__StreamDecoder *decoder, FLAC__bool value);
 
+/** Set the number of threads used to decode frames.  With more than
+ *  one thread, FLAC__stream_decoder_process_until_end_of_stream() reads
+ *  ahead in the input, finds where each frame starts and ends, and
+ *  decodes several frames at once on a pool of worker threads started by
+ *  the init function.  The frames are still delivered to the write
+ *  callback in order, from the calling thread.  From a damaged frame
+ *  on, the calling thread decodes by itself until it finds good frames
+ *  again, so the output and the calls to the error callback are the
+ *  same as when decoding single-threaded.  The other processing and
+ *  seeking functions always decode on the calling thread.
+ *
+ *  Multithreaded decoding needs the \c STREAMINFO block and is not
+ *  done for Ogg FLAC; the decoder falls back to a single thread in those
+ *  cases.  Not all builds of libFLAC support multithreading; in that
+ *  case only a value of \c 1 is accepted.
+ *
+ * \default \c 1
+ * \param  decoder  A decoder instance to set.
+ * \param  value    The number of threads, between \c 1 and \c 64.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized or \a value is not
+ *    supported, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value);
+
+/** Set the number of decoded frames that may be waiting to be delivered
+ *  to the client.  With a depth greater than one,
+ *  FLAC__stream_decoder_process_until_end_of_stream() copies each decoded
+ *  frame into a small ring of buffers and goes on decoding while a helper
+ *  thread started by the init function does the MD5 checking and calls
+ *  the write callback.  Frames are still delivered in order, and all of
+ *  them have been delivered by the time the function returns.  The error
+ *  callback is called from the calling thread, after the frames before
+ *  the error have been delivered.
+ *
+ *  Note that the write callback is then called from the helper thread,
+ *  while the decoder is busy on the calling thread, so it must not call
+ *  decoder functions other than the get_*() functions for values that
+ *  do not change during decoding; in particular,
+ *  FLAC__stream_decoder_get_decode_position() is not meaningful there.
+ *  The other processing and seeking functions always deliver frames from
+ *  the calling thread.  Not all builds of libFLAC support this; in that
+ *  case only a value of \c 1 is accepted.
+ *
+ * \default \c 1
+ * \param  decoder  A decoder instance to set.
+ * \param  value    The number of frames, between \c 1 and \c 16.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized or \a value is not
+ *    supported, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_pipeline_depth(FLAC__StreamDecoder *decoder, unsigned value);
+
+/** Set whether the decoder builds a frame index while decoding.  When
+ *  set, every frame the decoder reads is recorded with its first sample,
+ *  its offset and its blocksize, for FLAC__stream_decoder_get_frame_index()
+ *  to return, e.g. to be saved with FLAC__metadata_write_frame_index()
+ *  so that later decoders of the same file can seek with
+ *  FLAC__stream_decoder_set_frame_index().  A frame is only indexed when
+ *  the decoder knows where it starts, i.e. when it directly follows the
+ *  metadata or the previous frame read, so decoding the whole stream
+ *  from the start gives a complete index, while seeking leaves gaps for
+ *  the frames skipped over.
+ *  The decoder must be able to tell its position in the input; nothing
+ *  is indexed for Ogg FLAC.
+ *
+ * \default \c false
+ * \param  decoder  A decoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_indexing(FLAC__StreamDecoder *decoder, FLAC__bool value);
+
+/** Give the decoder a frame index of the stream to seek with, usually
+ *  one read with FLAC__metadata_read_frame_index() or built by an
+ *  earlier FLAC__stream_decoder_get_frame_index(),
+ *  FLAC__stream_decoder_scan_frames() or
+ *  FLAC__stream_encoder_get_frame_index().  FLAC__stream_decoder_seek_absolute()
+ *  then looks up the frame holding the target sample and goes straight
+ *  to it, reading only that frame, instead of searching the stream.  If
+ *  the target is not covered by the index, or the index turns out not
+ *  to match the stream, the usual search is done.  The index is not
+ *  used for Ogg FLAC.
+ *
+ *  Any SEEKTABLE will do, but it only helps where it has a point for
+ *  the frame holding the target sample, i.e. one with the exact
+ *  \a frame_samples of that frame.  The decoder keeps a copy of
+ *  \a frame_index until FLAC__stream_decoder_finish().
+ *
+ * \default \c NULL
+ * \param  decoder      A decoder instance to set.
+ * \param  frame_index  A legal SEEKTABLE (see
+ *                      FLAC__format_seektable_is_legal()) or \c NULL
+ *                      for none.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, \a frame_index is
+ *    not a legal SEEKTABLE, or memory allocation fails, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_index(FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *frame_index);
+
 /** Direct the decoder to pass on all metadata blocks of type \a type.
  *
  * \default By default, only the \c STREAMINFO block is returned via the
@@ -912,6 +1039,36 @@ FLAC_API const char *FLAC__stream_decoder_get_resolved_state_string(const FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDecoder *decoder);
 
+/** Get the number of threads used to decode frames.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_decoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder);
+
+/** Get the number of decoded frames that may be waiting to be delivered.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_decoder_set_pipeline_depth().
+ */
+FLAC_API unsigned FLAC__stream_decoder_get_pipeline_depth(const FLAC__StreamDecoder *decoder);
+
+/** Get the frame indexing flag.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_decoder_set_frame_indexing().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_indexing(const FLAC__StreamDecoder *decoder);
+
 /** Get the total number of samples in the stream being decoded.
  *  Will only be valid after decoding has started and will contain the
  *  value from the \c STREAMINFO block.  A value of \c 0 means "unknown".
@@ -1347,6 +1504,99 @@ FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_file(
 	void *client_data
 );
 
+/** Initialize the decoder instance to decode native FLAC files through
+ *  a memory mapping.
+ *
+ *  This flavor of initialization is like FLAC__stream_decoder_init_file(),
+ *  but where the system supports it the file is mapped into memory and
+ *  the decoder reads the frames straight out of the mapping instead of
+ *  copying them through stdio, and seeks without any system calls.
+ *  If the file cannot be mapped (for example, if it is not a regular
+ *  file, or on systems without mmap()), or \a filename is \c NULL, this
+ *  falls back to exactly what FLAC__stream_decoder_init_file() does.
+ *
+ *  The file must not be truncated while it is being decoded.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  filename           The name of the file to decode from.  Use
+ *                            \c NULL to decode from \c stdin.  Note that
+ *                            \c stdin is not seekable.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_mmap(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
+/** Initialize the decoder instance to decode Ogg FLAC files through a
+ *  memory mapping.
+ *
+ *  This flavor of initialization is like FLAC__stream_decoder_init_ogg_file(),
+ *  but where the system supports it the file is mapped into memory and
+ *  the Ogg pages are read from the mapping instead of through stdio.
+ *  The same fallbacks as for FLAC__stream_decoder_init_mmap() apply.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ *  \note Support for Ogg FLAC in the library is optional.  If this
+ *  library has been built without support for Ogg FLAC, this function
+ *  will return \c FLAC__STREAM_DECODER_INIT_STATUS_UNSUPPORTED_CONTAINER.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  filename           The name of the file to decode from.  Use
+ *                            \c NULL to decode from \c stdin.  Note that
+ *                            \c stdin is not seekable.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_mmap(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
 /** Finish the decoding process.
  *  Flushes the decoding buffer, releases resources, resets the decoder
  *  settings to their defaults, and returns the decoder state to
@@ -1368,6 +1618,29 @@ FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_file(
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder);
 
+/** Finish the decoding process but keep the decoder's buffers for the
+ *  next stream.
+ *  This does everything FLAC__stream_decoder_finish() does, including
+ *  resetting the settings to their defaults, except that the input
+ *  buffer and the sample and residual buffers stay allocated.  CPU
+ *  detection is done once when the instance is created either way.
+ *  The next FLAC__stream_decoder_init_*() then only has to reset the
+ *  stream state, which makes a pool of recycled decoders much cheaper
+ *  than creating and deleting one per stream.  The buffers are freed
+ *  by FLAC__stream_decoder_finish() or FLAC__stream_decoder_delete().
+ *
+ *  The MD5 workspace and, when decoding with several threads, the
+ *  worker threads and their per-frame workspaces are still set up
+ *  anew for every stream.
+ *
+ * \param  decoder  An uninitialized decoder instance.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    The same as for FLAC__stream_decoder_finish().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_recycle(FLAC__StreamDecoder *decoder);
+
 /** Flush the stream input.
  *  The decoder's input buffer will be cleared and the state set to
  *  \c FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC.  This will also turn
@@ -1550,6 +1823,192 @@ FLAC_API FLAC__bool FLAC__stream_decoder_skip_single_frame(FLAC__StreamDecoder *
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *decoder, FLAC__uint64 sample);
 
+/** Decode the samples \a first_sample through \a last_sample and
+ *  nothing else.  Unless the range starts with the next frame to be
+ *  decoded, the decoder first seeks to the frame holding \a first_sample
+ *  as FLAC__stream_decoder_seek_absolute() does, and in either case it
+ *  stops after the frame holding \a last_sample.  Only those frames are
+ *  decoded, and the samples of the last one past the range are not
+ *  restored, only skipped over.
+ *
+ *  If \a buffer is not \c NULL the samples are written to it, interleaved
+ *  by channel like FLAC__stream_encoder_process_interleaved() takes
+ *  them, and the write callback is not called at all.  It must have
+ *  room for (\a last_sample - \a first_sample + 1) * channels samples,
+ *  where channels is the number of channels in the STREAMINFO block (see
+ *  FLAC__stream_decoder_get_channels()); a stream whose number of
+ *  channels changes within the range is not supported this way and
+ *  makes the function fail.  If frames are lost to a bad sync (reported
+ *  through the error callback as usual), their part of \a buffer is
+ *  filled with silence.  If \a buffer is \c NULL the samples go through
+ *  the write callback instead, with the first and last frame shortened
+ *  to the range the same way FLAC__stream_decoder_seek_absolute()
+ *  shortens the frame it lands on.
+ *
+ *  The MD5 signature in the STREAMINFO block covers the whole stream,
+ *  so it can only be checked when the range is all of the stream,
+ *  decoded from the start with MD5 checking on (see
+ *  FLAC__stream_decoder_set_md5_checking()).  Otherwise, as after a
+ *  seek, MD5 checking is turned off for the rest of the stream.
+ *  \a md5_checked says which happened.
+ *
+ *  If the metadata has not been processed yet it is processed first.
+ *  Afterwards decoding continues with the frame after the one holding
+ *  \a last_sample, so consecutive ranges are decoded without seeking
+ *  only if each ends with the last sample of a frame.
+ *
+ * \param  decoder       An initialized decoder instance.
+ * \param  first_sample  The number of the first sample to decode.
+ * \param  last_sample   The number of the last sample to decode; must
+ *                       not be less than \a first_sample or, if the total
+ *                       number of samples is known, past the end of the
+ *                       stream.
+ * \param  buffer        Where to write the interleaved samples, or
+ *                       \c NULL to have them go through the write
+ *                       callback.
+ * \param  md5_checked   If not \c NULL, set to \c true if the MD5
+ *                       signature of the stream will be checked by
+ *                       FLAC__stream_decoder_finish(), else \c false.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c true if all of the range was decoded, else \c false, e.g.
+ *    because the range is not valid, the input cannot be seeked, the
+ *    stream ended before \a last_sample, or a fatal error occurred; check
+ *    the decoder state with FLAC__stream_decoder_get_state().  If the
+ *    state is \c FLAC__STREAM_DECODER_SEEK_ERROR the decoder must be
+ *    flushed or reset as after FLAC__stream_decoder_seek_absolute().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_process_range(FLAC__StreamDecoder *decoder, FLAC__uint64 first_sample, FLAC__uint64 last_sample, FLAC__int32 buffer[], FLAC__bool *md5_checked);
+
+/** Decode into a client buffer.  This pulls the next \a samples samples
+ *  per channel from the stream and writes them to \a buffer,
+ *  interleaved by channel like
+ *  FLAC__stream_encoder_process_interleaved() takes them, decoding as
+ *  many frames as needed.  The frames are not passed to the write
+ *  callback.  Instead the stereo decorrelation is done while the
+ *  samples are interleaved into \a buffer, so no copy of a frame has
+ *  to be made.  Whatever is left of the last frame is returned by the
+ *  next call.
+ *
+ *  The samples are written as they are in the write callback's
+ *  buffers, i.e. right-justified; see
+ *  FLAC__stream_decoder_read_samples_interleaved_int16() for 16-bit
+ *  samples.  One call only returns samples with the same number of
+ *  channels and bits per sample, so it returns early when a frame
+ *  changes them; FLAC__stream_decoder_get_channels() and
+ *  FLAC__stream_decoder_get_bits_per_sample() tell what was read, unless
+ *  the call read nothing.  It also returns early at the end of the
+ *  stream, in the \c FLAC__STREAM_DECODER_END_OF_STREAM state.
+ *
+ *  Errors in the stream go to the error callback as usual.  MD5
+ *  checking works as with the other process functions.  The rest of a
+ *  frame that was only partly read is dropped if the decoder is
+ *  flushed, reset or seeked, or goes on with another process function.
+ *  If the metadata has not been processed yet, it is processed first.
+ *
+ * \param  decoder       An initialized decoder instance.
+ * \param  buffer        Where to write the samples; room for
+ *                       \a samples * channels samples is needed.
+ * \param  samples       The number of samples per channel to read.
+ * \param  samples_read  Set to the number of samples per channel
+ *                       written to \a buffer.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code buffer != NULL \endcode
+ *    \code samples_read != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if any fatal read, write, or memory allocation error
+ *    occurred (meaning decoding must stop), else \c true; for more
+ *    information about the decoder, check the decoder state with
+ *    FLAC__stream_decoder_get_state().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_read_samples_interleaved(FLAC__StreamDecoder *decoder, FLAC__int32 buffer[], unsigned samples, unsigned *samples_read);
+
+/** Like FLAC__stream_decoder_read_samples_interleaved(), but write the
+ *  samples as 16-bit words.  Samples of fewer than 16 bits are shifted
+ *  up to 16 bits, and samples of more are truncated to their upper 16
+ *  bits, without dithering.
+ *
+ * \param  decoder       An initialized decoder instance.
+ * \param  buffer        Where to write the samples; room for
+ *                       \a samples * channels samples is needed.
+ * \param  samples       The number of samples per channel to read.
+ * \param  samples_read  Set to the number of samples per channel
+ *                       written to \a buffer.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code buffer != NULL \endcode
+ *    \code samples_read != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_decoder_read_samples_interleaved().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_read_samples_interleaved_int16(FLAC__StreamDecoder *decoder, FLAC__int16 buffer[], unsigned samples, unsigned *samples_read);
+
+/** Index the rest of the stream without decoding it.
+ *  Starting from the current position, this function walks the frames
+ *  by their headers alone, finding where each one ends from where the
+ *  next one starts, and checking it against the frame CRC-16.  No
+ *  subframe is decoded and the write callback is never called, which
+ *  makes it many times faster than decoding the stream when only the
+ *  frame boundaries are needed, e.g. to fill in a SEEKTABLE.
+ *
+ *  The result is a new SEEKTABLE metadata object with one seek point
+ *  per frame: the sample number of its first sample, its byte offset
+ *  from the first frame header (like
+ *  FLAC__StreamMetadata_SeekPoint::stream_offset) and its blocksize.
+ *  The caller owns it and must free it with
+ *  FLAC__metadata_object_delete().
+ *
+ *  Problems with the stream are reported through the error callback
+ *  the same way as while decoding: bytes between frames that belong to
+ *  no frame with \c FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC, and a
+ *  frame that fails its CRC (which is still indexed) with
+ *  \c FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH.  As with
+ *  FLAC__stream_decoder_process_until_end_of_stream(), a last frame cut
+ *  short by the end of the input makes it return \c false in the
+ *  \c FLAC__STREAM_DECODER_END_OF_STREAM state.  On success the decoder
+ *  is also left in that state, and since no audio was decoded, the MD5
+ *  signature is not checked by FLAC__stream_decoder_finish().
+ *
+ *  If the metadata has not been processed yet it is processed first.
+ *  The stream must have a STREAMINFO block and the decoder must be
+ *  able to tell its position in the input, i.e. a tell callback must
+ *  have been supplied; Ogg FLAC is not supported.
+ *
+ * \param  decoder      An initialized decoder instance.
+ * \param  frame_index  Address of a pointer that is set to the new
+ *                      SEEKTABLE object on success, else \c NULL.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code frame_index != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if a fatal read or memory allocation error occurred, if
+ *    the input ended in the middle of a frame, or if the decoder cannot
+ *    index the stream (see above), else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_scan_frames(FLAC__StreamDecoder *decoder, FLAC__StreamMetadata **frame_index);
+
+/** Get the frame index built so far; see
+ *  FLAC__stream_decoder_set_frame_indexing().  The result is a SEEKTABLE
+ *  metadata object in the same form as the one from
+ *  FLAC__stream_decoder_scan_frames().  The index is kept after
+ *  FLAC__stream_decoder_finish() until the decoder is initialized again
+ *  or deleted, so it can be fetched once the stream is done.
+ *
+ * \param  decoder      A decoder instance.
+ * \param  frame_index  Address of a pointer that is set to the new
+ *                      SEEKTABLE object, which the caller must free with
+ *                      FLAC__metadata_object_delete(), on success, else
+ *                      \c NULL.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code frame_index != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if memory allocation fails, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_index(const FLAC__StreamDecoder *decoder, FLAC__StreamMetadata **frame_index);
+
 /* \} */
 
 #ifdef __cplusplus
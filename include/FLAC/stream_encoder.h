@@ -878,6 +878,33 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_compression_level(FLAC__StreamEncod
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_blocksize(FLAC__StreamEncoder *encoder, unsigned value);
 
+/** Set to \c true to let the encoder pick the blocksize of each frame.
+ *  The blocksize set with FLAC__stream_encoder_set_blocksize() is then
+ *  the largest frame the encoder will make; each block of that many
+ *  samples may be split in halves, and those again, up to three times
+ *  but not into frames of fewer than 256 samples, wherever an estimate
+ *  of the encoded size says the smaller frames would be smaller
+ *  overall.  This mostly pays off around transients, where a short
+ *  frame keeps the onset from inflating the residual of a whole
+ *  block.  The estimate is cheap next to encoding the frames, so the
+ *  encoder is only a little slower.
+ *
+ *  The frames of such a stream are numbered by their first sample
+ *  instead of by frame, and the STREAMINFO block gives the smallest
+ *  candidate blocksize as the minimum blocksize; all FLAC decoders
+ *  are required to handle this.  The number of samples in each frame
+ *  is passed to the write callback as usual.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_variable_blocksize(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
 /** Set to \c true to enable mid-side encoding on stereo input.  The
  *  number of channels must be 2 for this to have any effect.  Set to
  *  \c false to use only independent channel coding.
@@ -908,6 +935,27 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_do_mid_side_stereo(FLAC__StreamEnco
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_loose_mid_side_stereo(FLAC__StreamEncoder *encoder, FLAC__bool value);
 
+/** Set to \c true to have the encoder estimate the size of each channel
+ *  assignment of a stereo frame from a fixed predictor, and only encode
+ *  the subframes of the assignments that come close to the best
+ *  estimate.  Usually that is a single assignment, which saves encoding
+ *  two of the four subframes.  Set to \c false to encode left, right,
+ *  mid and side for every frame.  This only has an effect when
+ *  FLAC__stream_encoder_set_do_mid_side_stereo() is \c true and
+ *  FLAC__stream_encoder_set_loose_mid_side_stereo() is \c false.  See
+ *  FLAC__stream_encoder_get_fast_mid_side_stats() for how well the
+ *  estimates do.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_fast_mid_side_stereo(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
 /** Sets the apodization function(s) the encoder will use when windowing
  *  audio data for LPC analysis.
  *
@@ -1069,7 +1117,15 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_min_residual_partition_order(FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_max_residual_partition_order(FLAC__StreamEncoder *encoder, unsigned value);
 
-/** Deprecated.  Setting this value has no effect.
+/** Set how far from the estimated Rice parameter of each residual
+ *  partition the encoder searches.  The estimate comes from the mean
+ *  magnitude of the partition's residual.  With a nonzero distance,
+ *  every parameter within that distance of the estimate is also tried,
+ *  and the sizes of all of them are counted exactly.  This usually
+ *  gains a few hundredths of a percent.  It costs an extra pass over
+ *  the residual for every partition order and every model tried, so
+ *  it slows down the high compression levels the most.  Distances
+ *  beyond 1 or 2 rarely find anything better.
  *
  * \default \c 0
  * \param  encoder  An encoder instance to set.
@@ -1097,6 +1153,95 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_rice_parameter_search_dist(FLAC__St
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_total_samples_estimate(FLAC__StreamEncoder *encoder, FLAC__uint64 value);
 
+/** Set the number of threads used to encode frames.  With more than
+ *  one thread, consecutive blocks are encoded in parallel on a pool of
+ *  worker threads started by the init function.  The frames are still
+ *  delivered to the write callback in order, from the thread calling
+ *  FLAC__stream_encoder_process(), FLAC__stream_encoder_process_interleaved()
+ *  or FLAC__stream_encoder_finish(), and the resulting stream is
+ *  identical to the one encoded with a single thread.  Since several
+ *  blocks are in flight at once, the write callback may be called a few
+ *  blocks later than when encoding single-threaded, and the encoder
+ *  uses a proportionally larger amount of memory.
+ *
+ *  With more than one thread, MD5 accumulation and (if enabled with
+ *  FLAC__stream_encoder_set_verify()) verification of the encoded frames
+ *  also run on helper threads of their own.  A verify error is then
+ *  reported by a later call to FLAC__stream_encoder_process(),
+ *  FLAC__stream_encoder_process_interleaved() or
+ *  FLAC__stream_encoder_finish() than the one that encoded the frame,
+ *  but with the same state and error statistics.
+ *
+ *  Not all builds of libFLAC support multithreading; in that case only
+ *  a value of \c 1 is accepted.
+ *
+ * \default \c 1
+ * \param  encoder  An encoder instance to set.
+ * \param  value    The number of threads, between \c 1 and \c 64.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized or \a value is not
+ *    supported, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value);
+
+/** Set a block of memory for the encoder to use for its signal,
+ *  residual and Rice parameter buffers instead of allocating them
+ *  itself.  These are the
+ *  bulk of the memory an encoder needs; with a workspace the init
+ *  function makes only a few small allocations for the rest.  The
+ *  memory must stay valid and unused by anything else until
+ *  FLAC__stream_encoder_finish() returns, and remains owned by the
+ *  client, so one workspace can be reused by one encoder after another.
+ *  Use FLAC__stream_encoder_get_workspace_size() to find out how much
+ *  is needed; if the workspace is too small, the init function fails
+ *  and the state is #FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR.
+ *
+ *  Whether or not a workspace is set, everything the encoder grows
+ *  while encoding is sized for the worst case by the init function, so
+ *  FLAC__stream_encoder_process() and
+ *  FLAC__stream_encoder_process_interleaved() do not allocate memory
+ *  when encoding to native FLAC.
+ *
+ *  Like the other settings, the workspace is forgotten by
+ *  FLAC__stream_encoder_finish().
+ *
+ * \default \c NULL, \c 0
+ * \param  encoder    An encoder instance to set.
+ * \param  workspace  The memory to use, or \c NULL to let the encoder
+ *                    allocate its buffers.  It need not be aligned.
+ * \param  size       The size of \a workspace in bytes.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_workspace(FLAC__StreamEncoder *encoder, void *workspace, size_t size);
+
+/** Set whether the encoder builds a frame index while encoding.  When
+ *  set, every frame written is recorded with its first sample, its byte
+ *  offset from the first frame and its blocksize, for
+ *  FLAC__stream_encoder_get_frame_index() to return.  Saved with
+ *  FLAC__metadata_write_frame_index() next to the output, it lets
+ *  decoders go straight to any frame with
+ *  FLAC__stream_decoder_set_frame_index(), without the file needing a
+ *  dense SEEKTABLE.  Nothing is indexed for Ogg FLAC.
+ *
+ *  The offsets only match the file if the metadata is not changed in
+ *  size afterwards, i.e. as long as the encoder can rewrite it in
+ *  place or it is padded.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_frame_indexing(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
 /** Set the metadata blocks to be emitted to the stream before encoding.
  *  A value of \c NULL, \c 0 implies no metadata; otherwise, supply an
  *  array of pointers to metadata blocks.  The array is non-const since
@@ -1294,6 +1439,16 @@ FLAC_API unsigned FLAC__stream_encoder_get_sample_rate(const FLAC__StreamEncoder
  */
 FLAC_API unsigned FLAC__stream_encoder_get_blocksize(const FLAC__StreamEncoder *encoder);
 
+/** Get the "variable blocksize" flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_variable_blocksize().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_variable_blocksize(const FLAC__StreamEncoder *encoder);
+
 /** Get the "mid/side stereo coding" flag.
  *
  * \param  encoder  An encoder instance to query.
@@ -1314,6 +1469,38 @@ FLAC_API FLAC__bool FLAC__stream_encoder_get_do_mid_side_stereo(const FLAC__Stre
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_get_loose_mid_side_stereo(const FLAC__StreamEncoder *encoder);
 
+/** Get the "fast mid/side stereo" flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_fast_mid_side_stereo().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_fast_mid_side_stereo(const FLAC__StreamEncoder *encoder);
+
+/** Get how the channel assignment estimates of fast mid/side stereo
+ *  did since the encoder was initialized.  A frame whose estimates were
+ *  close for more than one channel assignment has all of those encoded,
+ *  which shows whether the best estimate was right; for the other frames
+ *  only the estimated assignment is encoded, so there is nothing to
+ *  compare it with.  The arguments should be addresses in which the
+ *  stats will be returned, or NULL if value is not desired.  The stats
+ *  stay valid after FLAC__stream_encoder_finish().
+ *
+ * \param  encoder          An encoder instance to query.
+ * \param  frames           The number of frames whose channel assignment
+ *                          was estimated.
+ * \param  searched_frames  The number of those that had more than one
+ *                          channel assignment encoded.
+ * \param  missed_frames    The number of searched frames that ended up
+ *                          with another channel assignment than the
+ *                          estimated one.
+ * \assert
+ *    \code encoder != NULL \endcode
+ */
+FLAC_API void FLAC__stream_encoder_get_fast_mid_side_stats(const FLAC__StreamEncoder *encoder, FLAC__uint64 *frames, FLAC__uint64 *searched_frames, FLAC__uint64 *missed_frames);
+
 /** Get the maximum LPC order setting.
  *
  * \param  encoder  An encoder instance to query.
@@ -1407,6 +1594,61 @@ FLAC_API unsigned FLAC__stream_encoder_get_rice_parameter_search_dist(const FLAC
  */
 FLAC_API FLAC__uint64 FLAC__stream_encoder_get_total_samples_estimate(const FLAC__StreamEncoder *encoder);
 
+/** Get the number of threads used to encode frames.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_encoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder);
+
+/** Get the frame indexing flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_frame_indexing().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_frame_indexing(const FLAC__StreamEncoder *encoder);
+
+/** Get the size of the workspace the encoder needs with its current
+ *  settings; see FLAC__stream_encoder_set_workspace().  The size
+ *  depends on the number of channels, the blocksize, the maximum LPC
+ *  order, the apodization functions, the number of threads and on
+ *  whether mid-side stereo and escape coding are enabled, so it should
+ *  be queried after these have been set.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval size_t
+ *    The workspace size in bytes.
+ */
+FLAC_API size_t FLAC__stream_encoder_get_workspace_size(const FLAC__StreamEncoder *encoder);
+
+/** Get the frame index built so far; see
+ *  FLAC__stream_encoder_set_frame_indexing().  The result is a SEEKTABLE
+ *  metadata object with one seek point per frame, in the same form as
+ *  the one from FLAC__stream_decoder_scan_frames().  The index is kept
+ *  after FLAC__stream_encoder_finish(), which writes the last frame,
+ *  until the encoder is initialized again or deleted.
+ *
+ * \param  encoder      An encoder instance.
+ * \param  frame_index  Address of a pointer that is set to the new
+ *                      SEEKTABLE object, which the caller must free with
+ *                      FLAC__metadata_object_delete(), on success, else
+ *                      \c NULL.
+ * \assert
+ *    \code encoder != NULL \endcode
+ *    \code frame_index != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if memory allocation fails, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_frame_index(const FLAC__StreamEncoder *encoder, FLAC__StreamMetadata **frame_index);
+
 /** Initialize the encoder instance to encode native FLAC streams.
  *
  *  This flavor of initialization sets up the encoder to encode to a
@@ -1700,6 +1942,30 @@ FLAC_API FLAC__StreamEncoderInitStatus FLAC__stream_encoder_init_ogg_file(FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder);
 
+/** Finish the encoding process but keep the encoder's buffers for the
+ *  next stream.
+ *  This does everything FLAC__stream_encoder_finish() does, including
+ *  resetting the settings to their defaults, except that the buffers
+ *  allocated by init (and the verify decoder's) stay allocated.  If the
+ *  next FLAC__stream_encoder_init_*() uses the same number of channels,
+ *  bits per sample, blocksize, apodizations, thread count, workspace,
+ *  and so on, it uses them as they are; otherwise they are freed and
+ *  allocated again for the new settings.  CPU detection is done once
+ *  when the instance is created either way.  The buffers are freed by
+ *  FLAC__stream_encoder_finish() or FLAC__stream_encoder_delete().
+ *
+ *  If a workspace was set with FLAC__stream_encoder_set_workspace(), the
+ *  buffers in it are only used again if the same workspace is set
+ *  before the next init.
+ *
+ * \param  encoder  An uninitialized encoder instance.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    The same as for FLAC__stream_encoder_finish().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_recycle(FLAC__StreamEncoder *encoder);
+
 /** Submit data for encoding.
  *  This version allows you to supply the input data via an array of
  *  pointers, each pointer pointing to an array of \a samples samples
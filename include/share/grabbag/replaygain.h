@@ -51,8 +51,28 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 void grabbag__replaygain_get_album(float *gain, float *peak);
 void grabbag__replaygain_get_title(float *gain, float *peak);
 
-/* These three functions return an error string on error, or NULL if successful */
+/*
+ * The functions above all work on a single shared analysis state.  The
+ * _context variants below do the same on a private state, so several
+ * tracks can be analyzed at once, e.g. one per thread.  An album gain
+ * is had by merging each finished track into an album context with
+ * grabbag__replaygain_merge_album(); a track context is merged after
+ * grabbag__replaygain_get_title_context() (or _analyze_file_context())
+ * and before it is re-initialized.
+ */
+typedef struct grabbag__ReplayGainContext grabbag__ReplayGainContext;
+
+grabbag__ReplayGainContext *grabbag__replaygain_context_new(void);
+void grabbag__replaygain_context_delete(grabbag__ReplayGainContext *context);
+FLAC__bool grabbag__replaygain_init_context(grabbag__ReplayGainContext *context, unsigned sample_frequency);
+FLAC__bool grabbag__replaygain_analyze_context(grabbag__ReplayGainContext *context, const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples);
+void grabbag__replaygain_get_album_context(grabbag__ReplayGainContext *context, float *gain, float *peak);
+void grabbag__replaygain_get_title_context(grabbag__ReplayGainContext *context, float *gain, float *peak);
+void grabbag__replaygain_merge_album(grabbag__ReplayGainContext *album, const grabbag__ReplayGainContext *track);
+
+/* These four functions return an error string on error, or NULL if successful */
 const char *grabbag__replaygain_analyze_file(const char *filename, float *title_gain, float *title_peak);
+const char *grabbag__replaygain_analyze_file_context(grabbag__ReplayGainContext *context, const char *filename, float *title_gain, float *title_peak);
 const char *grabbag__replaygain_store_to_vorbiscomment(FLAC__StreamMetadata *block, float album_gain, float album_peak, float title_gain, float title_peak);
 const char *grabbag__replaygain_store_to_vorbiscomment_reference(FLAC__StreamMetadata *block);
 const char *grabbag__replaygain_store_to_vorbiscomment_album(FLAC__StreamMetadata *block, float album_gain, float album_peak);
@@ -0,0 +1,655 @@
+/* pcm - Routines for converting between planar and interleaved PCM
+ * Copyright (C) 2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef FLAC__SHARE__PCM_H
+#define FLAC__SHARE__PCM_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stddef.h> /* for size_t */
+#include "FLAC/ordinals.h"
+
+/*
+ * Everything here is static so that libFLAC, the command-line tools
+ * and the plugins can all use it without sharing a library.  The
+ * conversion routines are too big to inline, so they are plain static
+ * functions, and only the two entry points are inline wrappers around
+ * them; that way a file that only packs or only unpacks does not get
+ * warnings about the other direction being unused.
+ *
+ * pcm__pack_interleaved() turns one signal per channel into
+ * interleaved little- or big-endian words of 1 to 4 bytes, the way
+ * WAVE, AIFF and raw files and the MD5 signature store them, and
+ * pcm__unpack_interleaved() does the reverse.  Unsigned words are
+ * stored with the top bit flipped, so 8-bit 0x80 is silence.
+ *
+ * Both work on chunks of up to PCM__CHUNK_WORDS interleaved words: the
+ * channels are (de)interleaved as 32-bit words in a buffer on the
+ * stack, and the words are converted to or from bytes in a separate
+ * pass, so each step has one vector kernel per width instead of one
+ * per width and channel count.  The vector kernels are picked when
+ * compiling: SSE2 and NEON are part of the x86_64 and AArch64
+ * baselines, and the SSSE3 and AVX2 kernels are used when building
+ * with e.g. -mssse3 or -mavx2.  Whatever they do not handle goes
+ * through the plain C loops, which give the same results.
+ */
+
+#if defined _MSC_VER
+#define PCM__INLINE __inline
+#elif defined __GNUC__
+#define PCM__INLINE __inline__
+#else
+#define PCM__INLINE
+#endif
+
+#if !defined FLAC__NO_ASM && (defined __SSE2__ || defined _M_X64)
+#include <emmintrin.h>
+#define PCM__SSE2
+#if defined __SSSE3__
+#include <tmmintrin.h>
+#define PCM__SSSE3
+#endif
+#if defined __AVX2__
+#include <immintrin.h>
+#define PCM__AVX2
+#endif
+#elif !defined FLAC__NO_ASM && defined __aarch64__ && defined __ARM_NEON && !defined __ARM_BIG_ENDIAN
+#include <arm_neon.h>
+#define PCM__NEON
+#endif
+
+#if defined PCM__SSE2 || defined PCM__NEON
+#define PCM__CHUNK_WORDS 512
+#endif
+
+/*
+ * Writes 'count' samples from 'in' as words of 'bytes_per_sample'
+ * bytes, 'stride' bytes apart.  Each sample is shifted left by 'shift'
+ * and XORed with 'bias' first.
+ */
+static void pcm__narrow_scalar_(FLAC__byte *out, unsigned stride, const FLAC__int32 *in, unsigned count, unsigned bytes_per_sample, unsigned shift, FLAC__bool is_big_endian, FLAC__uint32 bias)
+{
+	FLAC__uint32 x;
+	unsigned i;
+
+	switch(bytes_per_sample) {
+		case 1:
+			for(i = 0; i < count; i++, out += stride)
+				out[0] = (FLAC__byte)(((FLAC__uint32)in[i] << shift) ^ bias);
+			break;
+		case 2:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)(x >> 8);
+					out[1] = (FLAC__byte)x;
+				}
+			}
+			else {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)x;
+					out[1] = (FLAC__byte)(x >> 8);
+				}
+			}
+			break;
+		case 3:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)(x >> 16);
+					out[1] = (FLAC__byte)(x >> 8);
+					out[2] = (FLAC__byte)x;
+				}
+			}
+			else {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)x;
+					out[1] = (FLAC__byte)(x >> 8);
+					out[2] = (FLAC__byte)(x >> 16);
+				}
+			}
+			break;
+		case 4:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)(x >> 24);
+					out[1] = (FLAC__byte)(x >> 16);
+					out[2] = (FLAC__byte)(x >> 8);
+					out[3] = (FLAC__byte)x;
+				}
+			}
+			else {
+				for(i = 0; i < count; i++, out += stride) {
+					x = ((FLAC__uint32)in[i] << shift) ^ bias;
+					out[0] = (FLAC__byte)x;
+					out[1] = (FLAC__byte)(x >> 8);
+					out[2] = (FLAC__byte)(x >> 16);
+					out[3] = (FLAC__byte)(x >> 24);
+				}
+			}
+			break;
+	}
+}
+
+/*
+ * Reads 'count' words of 'bytes_per_sample' bytes, 'stride' bytes
+ * apart, XORs each with 'bias' and sign-extends it into 'out'.
+ */
+static void pcm__widen_scalar_(FLAC__int32 *out, const FLAC__byte *in, unsigned stride, unsigned count, unsigned bytes_per_sample, FLAC__bool is_big_endian, FLAC__uint32 bias)
+{
+	unsigned i;
+
+	/* the words are built in the top bits and shifted down, which sign-extends them */
+	switch(bytes_per_sample) {
+		case 1:
+			for(i = 0; i < count; i++, in += stride)
+				out[i] = (FLAC__int32)(((FLAC__uint32)in[0] ^ bias) << 24) >> 24;
+			break;
+		case 2:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)(((((FLAC__uint32)in[0] << 8) | in[1]) ^ bias) << 16) >> 16;
+			}
+			else {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)(((((FLAC__uint32)in[1] << 8) | in[0]) ^ bias) << 16) >> 16;
+			}
+			break;
+		case 3:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)(((((FLAC__uint32)in[0] << 16) | ((FLAC__uint32)in[1] << 8) | in[2]) ^ bias) << 8) >> 8;
+			}
+			else {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)(((((FLAC__uint32)in[2] << 16) | ((FLAC__uint32)in[1] << 8) | in[0]) ^ bias) << 8) >> 8;
+			}
+			break;
+		case 4:
+			if(is_big_endian) {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)((((FLAC__uint32)in[0] << 24) | ((FLAC__uint32)in[1] << 16) | ((FLAC__uint32)in[2] << 8) | in[3]) ^ bias);
+			}
+			else {
+				for(i = 0; i < count; i++, in += stride)
+					out[i] = (FLAC__int32)((((FLAC__uint32)in[3] << 24) | ((FLAC__uint32)in[2] << 16) | ((FLAC__uint32)in[1] << 8) | in[0]) ^ bias);
+			}
+			break;
+	}
+}
+
+#if defined PCM__SSE2 || defined PCM__NEON
+
+/* The vector version of pcm__narrow_scalar_() for contiguous words. */
+static void pcm__narrow_(FLAC__byte *out, const FLAC__int32 *in, unsigned count, unsigned bytes_per_sample, unsigned shift, FLAC__bool is_big_endian, FLAC__uint32 bias)
+{
+	unsigned i = 0;
+
+#if defined PCM__SSE2
+	const __m128i vshift = _mm_cvtsi32_si128((int)shift);
+	const __m128i vbias = _mm_set1_epi32((int)bias);
+	__m128i a, b, c, d;
+
+	switch(bytes_per_sample) {
+		case 1:
+			for( ; i + 16 <= count; i += 16, out += 16) {
+				const __m128i low_byte = _mm_set1_epi32(0xff);
+				a = _mm_and_si128(_mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i)), vshift), vbias), low_byte);
+				b = _mm_and_si128(_mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i+4)), vshift), vbias), low_byte);
+				c = _mm_and_si128(_mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i+8)), vshift), vbias), low_byte);
+				d = _mm_and_si128(_mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i+12)), vshift), vbias), low_byte);
+				/* every word is 0..255 now so neither pack saturates */
+				_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			}
+			break;
+		case 2:
+#if defined PCM__AVX2
+			{
+				const __m128i vshift_ = _mm_cvtsi32_si128((int)shift);
+				const __m256i vbias_ = _mm256_set1_epi32((int)bias);
+				__m256i a_, b_;
+				for( ; i + 16 <= count; i += 16, out += 32) {
+					a_ = _mm256_xor_si256(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(in+i)), vshift_), vbias_);
+					b_ = _mm256_xor_si256(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(in+i+8)), vshift_), vbias_);
+					/* keep the low 16 bits, sign-extended, so the pack truncates instead of saturating */
+					a_ = _mm256_srai_epi32(_mm256_slli_epi32(a_, 16), 16);
+					b_ = _mm256_srai_epi32(_mm256_slli_epi32(b_, 16), 16);
+					a_ = _mm256_permute4x64_epi64(_mm256_packs_epi32(a_, b_), 0xd8);
+					if(is_big_endian)
+						a_ = _mm256_or_si256(_mm256_slli_epi16(a_, 8), _mm256_srli_epi16(a_, 8));
+					_mm256_storeu_si256((__m256i*)out, a_);
+				}
+			}
+#endif
+			for( ; i + 8 <= count; i += 8, out += 16) {
+				a = _mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i)), vshift), vbias);
+				b = _mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i+4)), vshift), vbias);
+				/* keep the low 16 bits, sign-extended, so the pack truncates instead of saturating */
+				a = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+				if(is_big_endian)
+					a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+				_mm_storeu_si128((__m128i*)out, a);
+			}
+			break;
+		case 3:
+			/* each step stores 4 bytes past its 12; the loop leaves room for that */
+#if defined PCM__SSSE3
+			{
+				const __m128i order = is_big_endian?
+					_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+					_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+				for( ; i + 6 <= count; i += 4, out += 12) {
+					a = _mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i)), vshift), vbias);
+					_mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(a, order));
+				}
+			}
+#else
+			{
+				const __m128i low_word = _mm_set_epi32(0, 0xffffff, 0, 0xffffff);
+				const __m128i high_word = _mm_set_epi32(0xffffff, 0, 0xffffff, 0);
+				for( ; i + 6 <= count; i += 4, out += 12) {
+					a = _mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i)), vshift), vbias);
+					if(is_big_endian) {
+						/* reverse the bytes of each word, then drop the (now lowest) unused byte */
+						a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+						a = _mm_or_si128(_mm_slli_epi32(a, 16), _mm_srli_epi32(a, 16));
+						a = _mm_srli_epi32(a, 8);
+					}
+					/* squeeze each pair of 24-bit words into the low 48 bits of its half */
+					a = _mm_or_si128(_mm_and_si128(a, low_word), _mm_srli_epi64(_mm_and_si128(a, high_word), 8));
+					_mm_storel_epi64((__m128i*)out, a);
+					_mm_storel_epi64((__m128i*)(out+6), _mm_srli_si128(a, 8));
+				}
+			}
+#endif
+			break;
+		case 4:
+			for( ; i + 4 <= count; i += 4, out += 16) {
+				a = _mm_xor_si128(_mm_sll_epi32(_mm_loadu_si128((const __m128i*)(in+i)), vshift), vbias);
+				if(is_big_endian) {
+					a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+					a = _mm_or_si128(_mm_slli_epi32(a, 16), _mm_srli_epi32(a, 16));
+				}
+				_mm_storeu_si128((__m128i*)out, a);
+			}
+			break;
+	}
+#elif defined PCM__NEON
+	const int32x4_t vshift = vdupq_n_s32((int)shift);
+	const uint32x4_t vbias = vdupq_n_u32(bias);
+	uint32x4_t a, b, c, d;
+
+	switch(bytes_per_sample) {
+		case 1:
+			for( ; i + 16 <= count; i += 16, out += 16) {
+				a = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i)), vshift), vbias);
+				b = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i+4)), vshift), vbias);
+				c = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i+8)), vshift), vbias);
+				d = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i+12)), vshift), vbias);
+				vst1q_u8(out, vcombine_u8(
+					vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))),
+					vmovn_u16(vcombine_u16(vmovn_u32(c), vmovn_u32(d)))
+				));
+			}
+			break;
+		case 2:
+			for( ; i + 8 <= count; i += 8, out += 16) {
+				uint8x16_t v;
+				a = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i)), vshift), vbias);
+				b = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i+4)), vshift), vbias);
+				v = vreinterpretq_u8_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b)));
+				if(is_big_endian)
+					v = vrev16q_u8(v);
+				vst1q_u8(out, v);
+			}
+			break;
+		case 3:
+			{
+				/* each step stores 4 bytes past its 12; the loop leaves room for that */
+				static const FLAC__byte big_endian_order[16] = { 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 255, 255, 255, 255 };
+				static const FLAC__byte little_endian_order[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255 };
+				const uint8x16_t order = vld1q_u8(is_big_endian? big_endian_order : little_endian_order);
+				for( ; i + 6 <= count; i += 4, out += 12) {
+					a = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i)), vshift), vbias);
+					vst1q_u8(out, vqtbl1q_u8(vreinterpretq_u8_u32(a), order));
+				}
+			}
+			break;
+		case 4:
+			for( ; i + 4 <= count; i += 4, out += 16) {
+				uint8x16_t v;
+				a = veorq_u32(vshlq_u32(vreinterpretq_u32_s32(vld1q_s32(in+i)), vshift), vbias);
+				v = vreinterpretq_u8_u32(a);
+				if(is_big_endian)
+					v = vrev32q_u8(v);
+				vst1q_u8(out, v);
+			}
+			break;
+	}
+#endif
+
+	pcm__narrow_scalar_(out, bytes_per_sample, in+i, count-i, bytes_per_sample, shift, is_big_endian, bias);
+}
+
+/* The vector version of pcm__widen_scalar_() for contiguous words. */
+static void pcm__widen_(FLAC__int32 *out, const FLAC__byte *in, unsigned count, unsigned bytes_per_sample, FLAC__bool is_big_endian, FLAC__uint32 bias)
+{
+	unsigned i = 0;
+
+#if defined PCM__SSE2
+	const __m128i vbias = _mm_set1_epi32((int)bias);
+	__m128i a, b;
+
+	switch(bytes_per_sample) {
+		case 1:
+			for( ; i + 16 <= count; i += 16, in += 16) {
+				a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_set1_epi8((char)bias));
+				/* duplicate each byte into both halves of a 16-bit word and shift it back down, sign-extending */
+				b = _mm_srai_epi16(_mm_unpackhi_epi8(a, a), 8);
+				a = _mm_srai_epi16(_mm_unpacklo_epi8(a, a), 8);
+				_mm_storeu_si128((__m128i*)(out+i), _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16));
+				_mm_storeu_si128((__m128i*)(out+i+4), _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16));
+				_mm_storeu_si128((__m128i*)(out+i+8), _mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16));
+				_mm_storeu_si128((__m128i*)(out+i+12), _mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16));
+			}
+			break;
+		case 2:
+			for( ; i + 8 <= count; i += 8, in += 16) {
+				a = _mm_loadu_si128((const __m128i*)in);
+				if(is_big_endian)
+					a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+				a = _mm_xor_si128(a, _mm_set1_epi16((short)bias));
+#if defined PCM__AVX2
+				_mm256_storeu_si256((__m256i*)(out+i), _mm256_cvtepi16_epi32(a));
+#else
+				_mm_storeu_si128((__m128i*)(out+i), _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16));
+				_mm_storeu_si128((__m128i*)(out+i+4), _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16));
+#endif
+			}
+			break;
+		case 3:
+#if defined PCM__SSSE3
+			{
+				/* put the 3 bytes in the top of each word and shift them back down, sign-extending */
+				const __m128i order = is_big_endian?
+					_mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9) :
+					_mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+				const __m128i vbias_ = _mm_slli_epi32(vbias, 8);
+				/* each step loads 4 bytes past its 12; the loop stays clear of the end */
+				for( ; i + 6 <= count; i += 4, in += 12) {
+					a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), order);
+					_mm_storeu_si128((__m128i*)(out+i), _mm_srai_epi32(_mm_xor_si128(a, vbias_), 8));
+				}
+			}
+#endif
+			break;
+		case 4:
+			for( ; i + 4 <= count; i += 4, in += 16) {
+				a = _mm_loadu_si128((const __m128i*)in);
+				if(is_big_endian) {
+					a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+					a = _mm_or_si128(_mm_slli_epi32(a, 16), _mm_srli_epi32(a, 16));
+				}
+				_mm_storeu_si128((__m128i*)(out+i), _mm_xor_si128(a, vbias));
+			}
+			break;
+	}
+#elif defined PCM__NEON
+	switch(bytes_per_sample) {
+		case 1:
+			for( ; i + 16 <= count; i += 16, in += 16) {
+				const int8x16_t v = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(in), vdupq_n_u8((FLAC__byte)bias)));
+				const int16x8_t lo = vmovl_s8(vget_low_s8(v)), hi = vmovl_s8(vget_high_s8(v));
+				vst1q_s32(out+i, vmovl_s16(vget_low_s16(lo)));
+				vst1q_s32(out+i+4, vmovl_s16(vget_high_s16(lo)));
+				vst1q_s32(out+i+8, vmovl_s16(vget_low_s16(hi)));
+				vst1q_s32(out+i+12, vmovl_s16(vget_high_s16(hi)));
+			}
+			break;
+		case 2:
+			for( ; i + 8 <= count; i += 8, in += 16) {
+				uint8x16_t v = vld1q_u8(in);
+				int16x8_t w;
+				if(is_big_endian)
+					v = vrev16q_u8(v);
+				w = vreinterpretq_s16_u16(veorq_u16(vreinterpretq_u16_u8(v), vdupq_n_u16((FLAC__uint16)bias)));
+				vst1q_s32(out+i, vmovl_s16(vget_low_s16(w)));
+				vst1q_s32(out+i+4, vmovl_s16(vget_high_s16(w)));
+			}
+			break;
+		case 3:
+			{
+				/* put the 3 bytes in the top of each word and shift them back down, sign-extending */
+				static const FLAC__byte big_endian_order[16] = { 255, 2, 1, 0, 255, 5, 4, 3, 255, 8, 7, 6, 255, 11, 10, 9 };
+				static const FLAC__byte little_endian_order[16] = { 255, 0, 1, 2, 255, 3, 4, 5, 255, 6, 7, 8, 255, 9, 10, 11 };
+				const uint8x16_t order = vld1q_u8(is_big_endian? big_endian_order : little_endian_order);
+				const uint32x4_t vbias = vdupq_n_u32(bias << 8);
+				/* each step loads 4 bytes past its 12; the loop stays clear of the end */
+				for( ; i + 6 <= count; i += 4, in += 12) {
+					const uint32x4_t v = veorq_u32(vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(in), order)), vbias);
+					vst1q_s32(out+i, vshrq_n_s32(vreinterpretq_s32_u32(v), 8));
+				}
+			}
+			break;
+		case 4:
+			for( ; i + 4 <= count; i += 4, in += 16) {
+				uint8x16_t v = vld1q_u8(in);
+				if(is_big_endian)
+					v = vrev32q_u8(v);
+				vst1q_s32(out+i, vreinterpretq_s32_u32(veorq_u32(vreinterpretq_u32_u8(v), vdupq_n_u32(bias))));
+			}
+			break;
+	}
+#endif
+
+	pcm__widen_scalar_(out+i, in, bytes_per_sample, count-i, bytes_per_sample, is_big_endian, bias);
+}
+
+/* Interleaves 'count' samples starting at 'offset' of each channel into 'out'. */
+static PCM__INLINE void pcm__interleave_(FLAC__int32 *out, const FLAC__int32 * const in[], unsigned channels, unsigned offset, unsigned count)
+{
+	unsigned i = 0, channel;
+
+	if(channels == 2) {
+		const FLAC__int32 *left = in[0] + offset, *right = in[1] + offset;
+#if defined PCM__AVX2
+		for( ; i + 8 <= count; i += 8) {
+			const __m256i l = _mm256_loadu_si256((const __m256i*)(left+i)), r = _mm256_loadu_si256((const __m256i*)(right+i));
+			const __m256i lo = _mm256_unpacklo_epi32(l, r), hi = _mm256_unpackhi_epi32(l, r);
+			_mm256_storeu_si256((__m256i*)(out+2*i), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(out+2*i+8), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+#endif
+#if defined PCM__SSE2
+		for( ; i + 4 <= count; i += 4) {
+			const __m128i l = _mm_loadu_si128((const __m128i*)(left+i)), r = _mm_loadu_si128((const __m128i*)(right+i));
+			_mm_storeu_si128((__m128i*)(out+2*i), _mm_unpacklo_epi32(l, r));
+			_mm_storeu_si128((__m128i*)(out+2*i+4), _mm_unpackhi_epi32(l, r));
+		}
+#elif defined PCM__NEON
+		for( ; i + 4 <= count; i += 4) {
+			int32x4x2_t v;
+			v.val[0] = vld1q_s32(left+i);
+			v.val[1] = vld1q_s32(right+i);
+			vst2q_s32(out+2*i, v);
+		}
+#endif
+		for( ; i < count; i++) {
+			out[2*i] = left[i];
+			out[2*i+1] = right[i];
+		}
+	}
+	else {
+		for( ; i < count; i++)
+			for(channel = 0; channel < channels; channel++)
+				*out++ = in[channel][offset+i];
+	}
+}
+
+/* The reverse of pcm__interleave_(). */
+static PCM__INLINE void pcm__deinterleave_(FLAC__int32 * const out[], const FLAC__int32 *in, unsigned channels, unsigned offset, unsigned count)
+{
+	unsigned i = 0, channel;
+
+	if(channels == 2) {
+		FLAC__int32 *left = out[0] + offset, *right = out[1] + offset;
+#if defined PCM__SSE2
+		for( ; i + 4 <= count; i += 4) {
+			/* l0 l1 r0 r1 and l2 l3 r2 r3 */
+			const __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(in+2*i)), 0xd8);
+			const __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(in+2*i+4)), 0xd8);
+			_mm_storeu_si128((__m128i*)(left+i), _mm_unpacklo_epi64(a, b));
+			_mm_storeu_si128((__m128i*)(right+i), _mm_unpackhi_epi64(a, b));
+		}
+#elif defined PCM__NEON
+		for( ; i + 4 <= count; i += 4) {
+			const int32x4x2_t v = vld2q_s32(in+2*i);
+			vst1q_s32(left+i, v.val[0]);
+			vst1q_s32(right+i, v.val[1]);
+		}
+#endif
+		for( ; i < count; i++) {
+			left[i] = in[2*i];
+			right[i] = in[2*i+1];
+		}
+	}
+	else {
+		for( ; i < count; i++)
+			for(channel = 0; channel < channels; channel++)
+				out[channel][offset+i] = *in++;
+	}
+}
+
+#endif /* PCM__SSE2 || PCM__NEON */
+
+/* The body of pcm__pack_interleaved() below. */
+static size_t pcm__pack_interleaved_(FLAC__byte *out, const FLAC__int32 * const in[], unsigned channels, unsigned wide_samples, unsigned bytes_per_sample, unsigned shift, FLAC__bool is_big_endian, FLAC__bool is_unsigned)
+{
+	const FLAC__uint32 bias = is_unsigned? (FLAC__uint32)1 << (8 * bytes_per_sample - 1) : 0;
+	const size_t bytes = (size_t)wide_samples * channels * bytes_per_sample;
+#if defined PCM__SSE2 || defined PCM__NEON
+	FLAC__int32 chunk[PCM__CHUNK_WORDS];
+	const unsigned chunk_samples = PCM__CHUNK_WORDS / channels;
+	unsigned done, n;
+
+	if(channels == 1) {
+		pcm__narrow_(out, in[0], wide_samples, bytes_per_sample, shift, is_big_endian, bias);
+		return bytes;
+	}
+	for(done = 0; done < wide_samples; done += n, out += n * channels * bytes_per_sample) {
+		n = wide_samples - done < chunk_samples? wide_samples - done : chunk_samples;
+		pcm__interleave_(chunk, in, channels, done, n);
+		pcm__narrow_(out, chunk, n * channels, bytes_per_sample, shift, is_big_endian, bias);
+	}
+#else
+	unsigned channel;
+
+	for(channel = 0; channel < channels; channel++)
+		pcm__narrow_scalar_(out + channel * bytes_per_sample, channels * bytes_per_sample, in[channel], wide_samples, bytes_per_sample, shift, is_big_endian, bias);
+#endif
+	return bytes;
+}
+
+/*
+ *	pcm__pack_interleaved()
+ *	--------------------------------------------------------------------
+ *	Interleave 'wide_samples' samples of each of 'channels' signals
+ *	into words of 'bytes_per_sample' bytes.  Each sample is shifted
+ *	left by 'shift' and then truncated to the word size.
+ *
+ *	OUT out                the packed bytes
+ *	IN in[]                one signal per channel
+ *	IN channels
+ *	IN wide_samples
+ *	IN bytes_per_sample    1 to 4
+ *	IN shift               for left-justifying samples that are not a whole number of bytes
+ *	IN is_big_endian
+ *	IN is_unsigned
+ *	RETURN                 the number of bytes written
+ */
+static PCM__INLINE size_t pcm__pack_interleaved(FLAC__byte *out, const FLAC__int32 * const in[], unsigned channels, unsigned wide_samples, unsigned bytes_per_sample, unsigned shift, FLAC__bool is_big_endian, FLAC__bool is_unsigned)
+{
+	return pcm__pack_interleaved_(out, in, channels, wide_samples, bytes_per_sample, shift, is_big_endian, is_unsigned);
+}
+
+/* The body of pcm__unpack_interleaved() below. */
+static void pcm__unpack_interleaved_(FLAC__int32 * const out[], const FLAC__byte *in, unsigned channels, unsigned wide_samples, unsigned bytes_per_sample, FLAC__bool is_big_endian, FLAC__bool is_unsigned)
+{
+	const FLAC__uint32 bias = is_unsigned? (FLAC__uint32)1 << (8 * bytes_per_sample - 1) : 0;
+#if defined PCM__SSE2 || defined PCM__NEON
+	FLAC__int32 chunk[PCM__CHUNK_WORDS];
+	const unsigned chunk_samples = PCM__CHUNK_WORDS / channels;
+	unsigned done, n;
+
+	if(channels == 1) {
+		pcm__widen_(out[0], in, wide_samples, bytes_per_sample, is_big_endian, bias);
+		return;
+	}
+	for(done = 0; done < wide_samples; done += n, in += n * channels * bytes_per_sample) {
+		n = wide_samples - done < chunk_samples? wide_samples - done : chunk_samples;
+		pcm__widen_(chunk, in, n * channels, bytes_per_sample, is_big_endian, bias);
+		pcm__deinterleave_(out, chunk, channels, done, n);
+	}
+#else
+	unsigned channel;
+
+	for(channel = 0; channel < channels; channel++)
+		pcm__widen_scalar_(out[channel], in + channel * bytes_per_sample, channels * bytes_per_sample, wide_samples, bytes_per_sample, is_big_endian, bias);
+#endif
+}
+
+/*
+ *	pcm__unpack_interleaved()
+ *	--------------------------------------------------------------------
+ *	The reverse of pcm__pack_interleaved() with no shift: split
+ *	interleaved words of 'bytes_per_sample' bytes into one signal per
+ *	channel, sign-extended to 32 bits.
+ *
+ *	OUT out[]              one signal per channel
+ *	IN in                  the packed bytes
+ *	IN channels
+ *	IN wide_samples
+ *	IN bytes_per_sample    1 to 4
+ *	IN is_big_endian
+ *	IN is_unsigned
+ */
+static PCM__INLINE void pcm__unpack_interleaved(FLAC__int32 * const out[], const FLAC__byte *in, unsigned channels, unsigned wide_samples, unsigned bytes_per_sample, FLAC__bool is_big_endian, FLAC__bool is_unsigned)
+{
+	pcm__unpack_interleaved_(out, in, channels, wide_samples, bytes_per_sample, is_big_endian, is_unsigned);
+}
+
+#endif
@@ -52,6 +52,18 @@ int		ResetSampleFrequency ( long samplefreq );
 Float_t GetTitleGain     ( void );
 Float_t GetAlbumGain     ( void );
 
+/* the same as above, on a separate analysis state; see replaygain_analysis.c */
+typedef struct ReplayGainContext ReplayGainContext;
+
+ReplayGainContext* CreateGainAnalysis ( void );
+void    DestroyGainAnalysis ( ReplayGainContext* ctx );
+int     InitGainAnalysisCtx ( ReplayGainContext* ctx, long samplefreq );
+int     AnalyzeSamplesCtx   ( ReplayGainContext* ctx, const Float_t* left_samples, const Float_t* right_samples, size_t num_samples, int num_channels );
+int     ResetSampleFrequencyCtx ( ReplayGainContext* ctx, long samplefreq );
+Float_t GetTitleGainCtx     ( ReplayGainContext* ctx );
+Float_t GetAlbumGainCtx     ( const ReplayGainContext* ctx );
+void    MergeGainAnalysis   ( ReplayGainContext* album, const ReplayGainContext* songs );
+
 #ifdef __cplusplus
 }
 #endif
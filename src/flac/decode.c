@@ -43,9 +43,11 @@
 #include <errno.h>
 #include <math.h> /* for floor() */
 #include <stdio.h> /* for FILE etc. */
+#include <stdlib.h> /* for malloc() */
 #include <string.h> /* for strcmp(), strerror() */
 #include "FLAC/all.h"
 #include "share/grabbag.h"
+#include "share/pcm.h"
 #include "share/replaygain_synthesis.h"
 #include "decode.h"
 
@@ -60,6 +62,8 @@ typedef struct {
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool continue_through_decode_errors;
 	FLAC__bool channel_map_none;
+	unsigned num_threads;
+	unsigned pipeline_depth;
 
 	struct {
 		replaygain_synthesis_spec_t spec;
@@ -104,19 +108,22 @@ typedef struct {
 	FLAC__StreamDecoder *decoder;
 
 	FILE *fout;
+	FLAC__int8 *s8buffer; /* samples converted for writing; WATCHOUT: can be up to 2 megs */
 
 	foreign_metadata_t *foreign_metadata; /* NULL unless --keep-foreign-metadata requested */
 	off_t fm_offset1, fm_offset2, fm_offset3;
 } DecoderSession;
 
 
-static FLAC__bool is_big_endian_host_;
+/* const so that it is safe to share between the sessions of flac --jobs */
+static const union { FLAC__uint32 value; FLAC__byte bytes[4]; } host_byte_order_ = { 1 };
+#define is_big_endian_host_ (host_byte_order_.bytes[0] == 0)
 
 
 /*
  * local routines
  */
-static FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename);
+static FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, unsigned num_threads, unsigned pipeline_depth, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename);
 static void DecoderSession_destroy(DecoderSession *d, FLAC__bool error_occurred);
 static FLAC__bool DecoderSession_init_decoder(DecoderSession *d, const char *infilename);
 static FLAC__bool DecoderSession_process(DecoderSession *d);
@@ -178,6 +185,8 @@ int flac__decode_file(const char *infilename, const char *outfilename, FLAC__boo
 			options.treat_warnings_as_errors,
 			options.continue_through_decode_errors,
 			options.channel_map_none,
+			options.num_threads,
+			options.pipeline_depth,
 			options.replaygain_synthesis_spec,
 			analysis_mode,
 			aopts,
@@ -200,7 +209,7 @@ int flac__decode_file(const char *infilename, const char *outfilename, FLAC__boo
 	return DecoderSession_finish_ok(&decoder_session);
 }
 
-FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename)
+FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, unsigned num_threads, unsigned pipeline_depth, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename)
 {
 #if FLAC__HAS_OGG
 	d->is_ogg = is_ogg;
@@ -216,6 +225,8 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 	d->treat_warnings_as_errors = treat_warnings_as_errors;
 	d->continue_through_decode_errors = continue_through_decode_errors;
 	d->channel_map_none = channel_map_none;
+	d->num_threads = num_threads;
+	d->pipeline_depth = pipeline_depth;
 	d->replaygain.spec = replaygain_synthesis_spec;
 	d->replaygain.apply = false;
 	d->replaygain.scale = 0.0;
@@ -253,11 +264,19 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 	d->decoder = 0;
 
 	d->fout = 0; /* initialized with an open file later if necessary */
+	d->s8buffer = 0;
 
 	d->foreign_metadata = foreign_metadata;
 
 	FLAC__ASSERT(!(d->test_only && d->analysis_mode));
 
+	if(!d->test_only && !d->analysis_mode) {
+		if(0 == (d->s8buffer = (FLAC__int8*)malloc(FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)))) {
+			flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for the output buffer\n", d->inbasefilename);
+			return false;
+		}
+	}
+
 	if(!d->test_only) {
 		if(0 == strcmp(outfilename, "-")) {
 			d->fout = grabbag__file_get_binary_stdout();
@@ -284,14 +303,15 @@ void DecoderSession_destroy(DecoderSession *d, FLAC__bool error_occurred)
 		if(error_occurred)
 			unlink(d->outfilename);
 	}
+	if(0 != d->s8buffer) {
+		free(d->s8buffer);
+		d->s8buffer = 0;
+	}
 }
 
 FLAC__bool DecoderSession_init_decoder(DecoderSession *decoder_session, const char *infilename)
 {
 	FLAC__StreamDecoderInitStatus init_status;
-	FLAC__uint32 test = 1;
-
-	is_big_endian_host_ = (*((FLAC__byte*)(&test)))? false : true;
 
 	if(!decoder_session->analysis_mode && !decoder_session->test_only && decoder_session->foreign_metadata) {
 		const char *error;
@@ -309,6 +329,11 @@ FLAC__bool DecoderSession_init_decoder(DecoderSession *decoder_session, const ch
 	}
 
 	FLAC__stream_decoder_set_md5_checking(decoder_session->decoder, true);
+	/* the analysis output needs FLAC__stream_decoder_get_decode_position() in the write callback */
+	if(!decoder_session->analysis_mode && decoder_session->num_threads > 1)
+		FLAC__stream_decoder_set_num_threads(decoder_session->decoder, decoder_session->num_threads);
+	if(!decoder_session->analysis_mode && decoder_session->pipeline_depth > 1)
+		FLAC__stream_decoder_set_pipeline_depth(decoder_session->decoder, decoder_session->pipeline_depth);
 	if (0 != decoder_session->cue_specification)
 		FLAC__stream_decoder_set_metadata_respond(decoder_session->decoder, FLAC__METADATA_TYPE_CUESHEET);
 	if (decoder_session->replaygain.spec.apply)
@@ -977,14 +1002,9 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 		decoder_session->format == FORMAT_WAVE || decoder_session->format == FORMAT_WAVE64 || decoder_session->format == FORMAT_RF64 ? bps<=8 :
 		decoder_session->is_unsigned_samples
 	));
-	unsigned wide_samples = frame->header.blocksize, wide_sample, sample, channel, byte;
+	unsigned wide_samples = frame->header.blocksize;
 	unsigned frame_bytes = 0;
-	static FLAC__int8 s8buffer[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)]; /* WATCHOUT: can be up to 2 megs */
-	FLAC__uint8  *u8buffer  = (FLAC__uint8  *)s8buffer;
-	FLAC__int16  *s16buffer = (FLAC__int16  *)s8buffer;
-	FLAC__uint16 *u16buffer = (FLAC__uint16 *)s8buffer;
-	FLAC__int32  *s32buffer = (FLAC__int32  *)s8buffer;
-	FLAC__uint32 *u32buffer = (FLAC__uint32 *)s8buffer;
+	FLAC__uint8 *u8buffer = (FLAC__uint8 *)decoder_session->s8buffer;
 	size_t bytes_to_write = 0;
 
 	(void)decoder;
@@ -1098,11 +1118,6 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 			flac__analyze_frame(frame, decoder_session->frame_counter-1, decoder_session->decode_position-frame_bytes, frame_bytes, decoder_session->aopts, fout);
 		}
 		else if(!decoder_session->test_only) {
-			if(shift && !decoder_session->replaygain.apply) {
-				for(wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-					for(channel = 0; channel < channels; channel++)
-						((FLAC__int32**)buffer)[channel][wide_sample] <<= shift;/*@@@@@@un-const'ing the buffer is hacky but safe*/
-			}
 			if(decoder_session->replaygain.apply) {
 				bytes_to_write = FLAC__replaygain_synthesis__apply_gain(
 					u8buffer,
@@ -1119,127 +1134,8 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 					&decoder_session->replaygain.dither_context
 				);
 			}
-			/* first some special code for common cases */
-			else if(is_big_endian == is_big_endian_host_ && !is_unsigned_samples && channels == 2 && bps+shift == 16) {
-				FLAC__int16 *buf1_ = s16buffer + 1;
-				if(is_big_endian)
-					memcpy(s16buffer, ((FLAC__byte*)(buffer[0]))+2, sizeof(FLAC__int32) * wide_samples - 2);
-				else
-					memcpy(s16buffer, buffer[0], sizeof(FLAC__int32) * wide_samples);
-				for(sample = 0; sample < wide_samples; sample++, buf1_+=2)
-					*buf1_ = (FLAC__int16)buffer[1][sample];
-				bytes_to_write = 4 * sample;
-			}
-			else if(is_big_endian == is_big_endian_host_ && !is_unsigned_samples && channels == 1 && bps+shift == 16) {
-				FLAC__int16 *buf1_ = s16buffer;
-				for(sample = 0; sample < wide_samples; sample++)
-					*buf1_++ = (FLAC__int16)buffer[0][sample];
-				bytes_to_write = 2 * sample;
-			}
-			/* generic code for the rest */
-			else if(bps+shift == 16) {
-				if(is_unsigned_samples) {
-					if(channels == 2) {
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
-							u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
-							u16buffer[sample++] = (FLAC__uint16)(buffer[1][wide_sample] + 0x8000);
-						}
-					}
-					else if(channels == 1) {
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
-					}
-					else { /* works for any 'channels' but above flavors are faster for 1 and 2 */
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							for(channel = 0; channel < channels; channel++, sample++)
-								u16buffer[sample] = (FLAC__uint16)(buffer[channel][wide_sample] + 0x8000);
-					}
-				}
-				else {
-					if(channels == 2) {
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
-							s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
-							s16buffer[sample++] = (FLAC__int16)(buffer[1][wide_sample]);
-						}
-					}
-					else if(channels == 1) {
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
-					}
-					else { /* works for any 'channels' but above flavors are faster for 1 and 2 */
-						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							for(channel = 0; channel < channels; channel++, sample++)
-								s16buffer[sample] = (FLAC__int16)(buffer[channel][wide_sample]);
-					}
-				}
-				if(is_big_endian != is_big_endian_host_) {
-					unsigned char tmp;
-					const unsigned bytes = sample * 2;
-					for(byte = 0; byte < bytes; byte += 2) {
-						tmp = u8buffer[byte];
-						u8buffer[byte] = u8buffer[byte+1];
-						u8buffer[byte+1] = tmp;
-					}
-				}
-				bytes_to_write = 2 * sample;
-			}
-			else if(bps+shift == 24) {
-				if(is_unsigned_samples) {
-					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-						for(channel = 0; channel < channels; channel++, sample++)
-							u32buffer[sample] = buffer[channel][wide_sample] + 0x800000;
-				}
-				else {
-					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-						for(channel = 0; channel < channels; channel++, sample++)
-							s32buffer[sample] = buffer[channel][wide_sample];
-				}
-				if(is_big_endian != is_big_endian_host_) {
-					unsigned char tmp;
-					const unsigned bytes = sample * 4;
-					for(byte = 0; byte < bytes; byte += 4) {
-						tmp = u8buffer[byte];
-						u8buffer[byte] = u8buffer[byte+3];
-						u8buffer[byte+3] = tmp;
-						tmp = u8buffer[byte+1];
-						u8buffer[byte+1] = u8buffer[byte+2];
-						u8buffer[byte+2] = tmp;
-					}
-				}
-				if(is_big_endian) {
-					unsigned lbyte;
-					const unsigned bytes = sample * 4;
-					for(lbyte = byte = 0; byte < bytes; ) {
-						byte++;
-						u8buffer[lbyte++] = u8buffer[byte++];
-						u8buffer[lbyte++] = u8buffer[byte++];
-						u8buffer[lbyte++] = u8buffer[byte++];
-					}
-				}
-				else {
-					unsigned lbyte;
-					const unsigned bytes = sample * 4;
-					for(lbyte = byte = 0; byte < bytes; ) {
-						u8buffer[lbyte++] = u8buffer[byte++];
-						u8buffer[lbyte++] = u8buffer[byte++];
-						u8buffer[lbyte++] = u8buffer[byte++];
-						byte++;
-					}
-				}
-				bytes_to_write = 3 * sample;
-			}
-			else if(bps+shift == 8) {
-				if(is_unsigned_samples) {
-					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-						for(channel = 0; channel < channels; channel++, sample++)
-							u8buffer[sample] = (FLAC__uint8)(buffer[channel][wide_sample] + 0x80);
-				}
-				else {
-					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-						for(channel = 0; channel < channels; channel++, sample++)
-							s8buffer[sample] = (FLAC__int8)(buffer[channel][wide_sample]);
-				}
-				bytes_to_write = sample;
+			else if(bps+shift == 8 || bps+shift == 16 || bps+shift == 24) {
+				bytes_to_write = pcm__pack_interleaved(u8buffer, buffer, channels, wide_samples, (bps+shift)/8, shift, is_big_endian, is_unsigned_samples);
 			}
 			else {
 				FLAC__ASSERT(0);
@@ -1433,6 +1329,11 @@ void print_error_with_state(const DecoderSession *d, const char *message)
 
 void print_stats(const DecoderSession *decoder_session)
 {
+#ifdef FLAC__HAS_PTHREAD
+	/* a --jobs worker only reports once the file is done */
+	if(flac__utils_output_is_buffered())
+		return;
+#endif
 	if(flac__utils_verbosity_ >= 2) {
 #if defined _MSC_VER || defined __MINGW32__
 		/* with MSVC you have to spoon feed it the casting */
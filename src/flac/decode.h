@@ -51,6 +51,8 @@ typedef struct {
 	FLAC__bool has_cue_specification;
 	utils__CueSpecification cue_specification;
 	FLAC__bool channel_map_none; /* --channel-map=none specified, eventually will expand to take actual channel map */
+	unsigned num_threads; /* see FLAC__stream_decoder_set_num_threads(); ignored in analysis mode */
+	unsigned pipeline_depth; /* see FLAC__stream_decoder_set_pipeline_depth(); ignored in analysis mode */
 
 	FileFormat format;
 	union {
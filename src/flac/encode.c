@@ -49,6 +49,7 @@
 #include "FLAC/all.h"
 #include "share/alloc.h"
 #include "share/grabbag.h"
+#include "share/pcm.h"
 #include "encode.h"
 
 #ifdef min
@@ -100,6 +101,7 @@ typedef struct {
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool continue_through_decode_errors;
 	FLAC__bool replay_gain;
+	grabbag__ReplayGainContext *replay_gain_context;
 	FLAC__uint64 total_samples_to_encode; /* (i.e. "wide samples" aka "sample frames") WATCHOUT: may be 0 to mean 'unknown' */
 	FLAC__uint64 unencoded_size; /* an estimate of the input size, only used in the progress indicator */
 	FLAC__uint64 bytes_written;
@@ -123,19 +125,17 @@ typedef struct {
 
 	FILE *fin;
 	FLAC__StreamMetadata *seek_table_template;
+
+	/* per session rather than static so that flac --jobs can run several at once */
+	unsigned char *ucbuffer; /* raw input, up to CHUNK_OF_SAMPLES wide samples */
+	FLAC__int32 *input[FLAC__MAX_CHANNELS]; /* ucbuffer deinterleaved for the encoder, CHUNK_OF_SAMPLES each */
 } EncoderSession;
 
 const int FLAC_ENCODE__DEFAULT_PADDING = 8192;
 
-static FLAC__bool is_big_endian_host_;
-
-static unsigned char ucbuffer_[CHUNK_OF_SAMPLES*FLAC__MAX_CHANNELS*((FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE+7)/8)];
-static signed char *scbuffer_ = (signed char *)ucbuffer_;
-static FLAC__uint16 *usbuffer_ = (FLAC__uint16 *)ucbuffer_;
-static FLAC__int16 *ssbuffer_ = (FLAC__int16 *)ucbuffer_;
-
-static FLAC__int32 in_[FLAC__MAX_CHANNELS][CHUNK_OF_SAMPLES];
-static FLAC__int32 *input_[FLAC__MAX_CHANNELS];
+/* const so that it is safe to share between the sessions of flac --jobs */
+static const union { FLAC__uint32 value; FLAC__byte bytes[4]; } host_byte_order_ = { 1 };
+#define is_big_endian_host_ (host_byte_order_.bytes[0] == 0)
 
 
 /*
@@ -159,7 +159,7 @@ static FLAC__bool EncoderSession_format_is_iff(const EncoderSession *e);
 static FLAC__bool convert_to_seek_table_template(const char *requested_seek_points, int num_requested_seek_points, FLAC__StreamMetadata *cuesheet, EncoderSession *e);
 static FLAC__bool canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input);
 static FLAC__bool verify_metadata(const EncoderSession *e, FLAC__StreamMetadata **metadata, unsigned num_metadata);
-static FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map);
+static FLAC__bool format_input(unsigned char *ucbuffer, FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map);
 static void encoder_progress_callback(const FLAC__StreamEncoder *encoder, FLAC__uint64 bytes_written, FLAC__uint64 samples_written, unsigned frames_written, unsigned total_frames_estimate, void *client_data);
 static FLAC__StreamDecoderReadStatus flac_decoder_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 static FLAC__StreamDecoderSeekStatus flac_decoder_seek_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -1296,8 +1296,8 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 					while(!feof(infile)) {
 						if(lookahead_length > 0) {
 							FLAC__ASSERT(lookahead_length < CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample);
-							memcpy(ucbuffer_, lookahead, lookahead_length);
-							bytes_read = fread(ucbuffer_+lookahead_length, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample - lookahead_length, infile) + lookahead_length;
+							memcpy(encoder_session.ucbuffer, lookahead, lookahead_length);
+							bytes_read = fread(encoder_session.ucbuffer+lookahead_length, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample - lookahead_length, infile) + lookahead_length;
 							if(ferror(infile)) {
 								flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 								return EncoderSession_finish_error(&encoder_session);
@@ -1305,7 +1305,7 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 							lookahead_length = 0;
 						}
 						else
-							bytes_read = fread(ucbuffer_, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, infile);
+							bytes_read = fread(encoder_session.ucbuffer, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, infile);
 
 						if(bytes_read == 0) {
 							if(ferror(infile)) {
@@ -1319,10 +1319,10 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 						}
 						else {
 							unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-							if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+							if(!format_input(encoder_session.ucbuffer, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 								return EncoderSession_finish_error(&encoder_session);
 
-							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 								print_error_with_state(&encoder_session, "ERROR during encoding");
 								return EncoderSession_finish_error(&encoder_session);
 							}
@@ -1340,11 +1340,11 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 
 							if(lookahead_length > 0) {
 								FLAC__ASSERT(lookahead_length <= wanted);
-								memcpy(ucbuffer_, lookahead, lookahead_length);
+								memcpy(encoder_session.ucbuffer, lookahead, lookahead_length);
 								wanted -= lookahead_length;
 								bytes_read = lookahead_length;
 								if(wanted > 0) {
-									bytes_read += fread(ucbuffer_+lookahead_length, sizeof(unsigned char), wanted, infile);
+									bytes_read += fread(encoder_session.ucbuffer+lookahead_length, sizeof(unsigned char), wanted, infile);
 									if(ferror(infile)) {
 										flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 										return EncoderSession_finish_error(&encoder_session);
@@ -1353,7 +1353,7 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 								lookahead_length = 0;
 							}
 							else
-								bytes_read = fread(ucbuffer_, sizeof(unsigned char), wanted, infile);
+								bytes_read = fread(encoder_session.ucbuffer, sizeof(unsigned char), wanted, infile);
 						}
 
 						if(bytes_read == 0) {
@@ -1375,10 +1375,10 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 							}
 							else {
 								unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-								if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+								if(!format_input(encoder_session.ucbuffer, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 									return EncoderSession_finish_error(&encoder_session);
 
-								if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+								if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 									print_error_with_state(&encoder_session, "ERROR during encoding");
 									return EncoderSession_finish_error(&encoder_session);
 								}
@@ -1398,7 +1398,7 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 						encoder_session.fmt.iff.data_bytes,
 						(FLAC__uint64)CHUNK_OF_SAMPLES * (FLAC__uint64)encoder_session.info.bytes_per_wide_sample
 					);
-					size_t bytes_read = fread(ucbuffer_, sizeof(unsigned char), bytes_to_read, infile);
+					size_t bytes_read = fread(encoder_session.ucbuffer, sizeof(unsigned char), bytes_to_read, infile);
 					if(bytes_read == 0) {
 						if(ferror(infile)) {
 							flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
@@ -1423,10 +1423,10 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 						}
 						else {
 							unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-							if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+							if(!format_input(encoder_session.ucbuffer, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 								return EncoderSession_finish_error(&encoder_session);
 
-							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 								print_error_with_state(&encoder_session, "ERROR during encoding");
 								return EncoderSession_finish_error(&encoder_session);
 							}
@@ -1471,9 +1471,9 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 
 					info_align_zero = wide_samples;
 					for(channel = 0; channel < encoder_session.info.channels; channel++)
-						memset(input_[channel], 0, sizeof(input_[0][0]) * wide_samples);
+						memset(encoder_session.input[channel], 0, sizeof(encoder_session.input[0][0]) * wide_samples);
 
-					if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+					if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 						print_error_with_state(&encoder_session, "ERROR during encoding");
 						return EncoderSession_finish_error(&encoder_session);
 					}
@@ -1483,7 +1483,7 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 				if(*options.align_reservoir_samples > 0) {
 					size_t bytes_read;
 					FLAC__ASSERT(CHUNK_OF_SAMPLES >= 588);
-					bytes_read = fread(ucbuffer_, sizeof(unsigned char), (*options.align_reservoir_samples) * encoder_session.info.bytes_per_wide_sample, infile);
+					bytes_read = fread(encoder_session.ucbuffer, sizeof(unsigned char), (*options.align_reservoir_samples) * encoder_session.info.bytes_per_wide_sample, infile);
 					if(bytes_read == 0 && ferror(infile)) {
 						flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 						return EncoderSession_finish_error(&encoder_session);
@@ -1495,7 +1495,7 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 					}
 					else {
 						info_align_carry = *options.align_reservoir_samples;
-						if(!format_input(options.align_reservoir, *options.align_reservoir_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+						if(!format_input(encoder_session.ucbuffer, options.align_reservoir, *options.align_reservoir_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 							return EncoderSession_finish_error(&encoder_session);
 					}
 				}
@@ -1514,21 +1514,6 @@ int flac__encode_file(FILE *infile, off_t infilesize, const char *infilename, co
 FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options, off_t infilesize, FILE *infile, const char *infilename, const char *outfilename, const FLAC__byte *lookahead, unsigned lookahead_length)
 {
 	unsigned i;
-	FLAC__uint32 test = 1;
-
-	/*
-	 * initialize globals
-	 */
-
-	is_big_endian_host_ = (*((FLAC__byte*)(&test)))? false : true;
-
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
-		input_[i] = &(in_[i][0]);
-
-
-	/*
-	 * initialize instance
-	 */
 
 #if FLAC__HAS_OGG
 	e->use_ogg = options.use_ogg;
@@ -1585,6 +1570,10 @@ FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options,
 	e->fin = infile;
 	e->seek_table_template = 0;
 
+	e->ucbuffer = 0;
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
+		e->input[i] = 0;
+
 	if(0 == (e->seek_table_template = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE))) {
 		flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for seek table\n", e->inbasefilename);
 		return false;
@@ -1597,6 +1586,17 @@ FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options,
 		return false;
 	}
 
+	if(
+		0 == (e->ucbuffer = (unsigned char*)safe_malloc_mul_2op_(CHUNK_OF_SAMPLES, /*times*/FLAC__MAX_CHANNELS*((FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE+7)/8))) ||
+		0 == (e->input[0] = (FLAC__int32*)safe_malloc_mul_2op_(CHUNK_OF_SAMPLES, /*times*/FLAC__MAX_CHANNELS*sizeof(FLAC__int32)))
+	) {
+		flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for the sample buffers\n", e->inbasefilename);
+		EncoderSession_destroy(e);
+		return false;
+	}
+	for(i = 1; i < FLAC__MAX_CHANNELS; i++)
+		e->input[i] = e->input[0] + i * CHUNK_OF_SAMPLES;
+
 	return true;
 }
 
@@ -1624,6 +1624,15 @@ void EncoderSession_destroy(EncoderSession *e)
 		FLAC__metadata_object_delete(e->seek_table_template);
 		e->seek_table_template = 0;
 	}
+
+	if(0 != e->ucbuffer) {
+		free(e->ucbuffer);
+		e->ucbuffer = 0;
+	}
+	if(0 != e->input[0]) {
+		free(e->input[0]);
+		e->input[0] = 0;
+	}
 }
 
 int EncoderSession_finish_ok(EncoderSession *e, int info_align_carry, int info_align_zero, foreign_metadata_t *foreign_metadata)
@@ -1631,9 +1640,11 @@ int EncoderSession_finish_ok(EncoderSession *e, int info_align_carry, int info_a
 	FLAC__StreamEncoderState fse_state = FLAC__STREAM_ENCODER_OK;
 	int ret = 0;
 	FLAC__bool verify_error = false;
+	FLAC__bool fast_mid_side = false;
 
 	if(e->encoder) {
 		fse_state = FLAC__stream_encoder_get_state(e->encoder);
+		fast_mid_side = FLAC__stream_encoder_get_fast_mid_side_stereo(e->encoder); /* finish() resets it */
 		ret = FLAC__stream_encoder_finish(e->encoder)? 0 : 1;
 		verify_error =
 			fse_state == FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA ||
@@ -1646,6 +1657,11 @@ int EncoderSession_finish_ok(EncoderSession *e, int info_align_carry, int info_a
 	else if(e->total_samples_to_encode > 0) {
 		print_stats(e);
 		flac__utils_printf(stderr, 2, "\n");
+		if(fast_mid_side) {
+			FLAC__uint64 frames, searched_frames, missed_frames;
+			FLAC__stream_encoder_get_fast_mid_side_stats(e->encoder, &frames, &searched_frames, &missed_frames);
+			flac__utils_printf(stderr, 2, "%s: fast mid-side: %u frames estimated, %u searched, %u of those missed\n", e->inbasefilename, (unsigned)frames, (unsigned)searched_frames, (unsigned)missed_frames);
+		}
 	}
 
 	if(verify_error) {
@@ -1757,6 +1773,7 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 	static_metadata_init(&static_metadata);
 
 	e->replay_gain = options.replay_gain;
+	e->replay_gain_context = options.replay_gain_context;
 
 	apodizations[0] = '\0';
 
@@ -1769,11 +1786,9 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 			flac__utils_printf(stderr, 1, "%s: ERROR, invalid sample rate (%u) for --replay-gain\n", e->inbasefilename, sample_rate);
 			return false;
 		}
-		if(options.is_first_file) {
-			if(!grabbag__replaygain_init(sample_rate)) {
-				flac__utils_printf(stderr, 1, "%s: ERROR initializing ReplayGain stage\n", e->inbasefilename);
-				return false;
-			}
+		if(!grabbag__replaygain_init_context(e->replay_gain_context, sample_rate)) {
+			flac__utils_printf(stderr, 1, "%s: ERROR initializing ReplayGain stage\n", e->inbasefilename);
+			return false;
 		}
 	}
 
@@ -2064,6 +2079,7 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 	}
 
 	FLAC__stream_encoder_set_verify(e->encoder, options.verify);
+	FLAC__stream_encoder_set_num_threads(e->encoder, options.num_threads);
 	FLAC__stream_encoder_set_streamable_subset(e->encoder, !options.lax);
 	FLAC__stream_encoder_set_channels(e->encoder, channels);
 	FLAC__stream_encoder_set_bits_per_sample(e->encoder, bps);
@@ -2073,6 +2089,9 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 			case CST_BLOCKSIZE:
 				FLAC__stream_encoder_set_blocksize(e->encoder, options.compression_settings[i].value.t_unsigned);
 				break;
+			case CST_VARIABLE_BLOCKSIZE:
+				FLAC__stream_encoder_set_variable_blocksize(e->encoder, options.compression_settings[i].value.t_bool);
+				break;
 			case CST_COMPRESSION_LEVEL:
 				FLAC__stream_encoder_set_compression_level(e->encoder, options.compression_settings[i].value.t_unsigned);
 				apodizations[0] = '\0';
@@ -2083,6 +2102,9 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 			case CST_LOOSE_MID_SIDE:
 				FLAC__stream_encoder_set_loose_mid_side_stereo(e->encoder, options.compression_settings[i].value.t_bool);
 				break;
+			case CST_FAST_MID_SIDE:
+				FLAC__stream_encoder_set_fast_mid_side_stereo(e->encoder, options.compression_settings[i].value.t_bool);
+				break;
 			case CST_APODIZATION:
 				if(strlen(apodizations)+strlen(options.compression_settings[i].value.t_string)+2 >= sizeof(apodizations)) {
 					flac__utils_printf(stderr, 1, "%s: ERROR: too many apodization functions requested\n", e->inbasefilename);
@@ -2172,7 +2194,7 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 FLAC__bool EncoderSession_process(EncoderSession *e, const FLAC__int32 * const buffer[], unsigned samples)
 {
 	if(e->replay_gain) {
-		if(!grabbag__replaygain_analyze(buffer, e->info.channels==2, e->info.bits_per_sample, samples)) {
+		if(!grabbag__replaygain_analyze_context(e->replay_gain_context, buffer, e->info.channels==2, e->info.bits_per_sample, samples)) {
 			flac__utils_printf(stderr, 1, "%s: WARNING, error while calculating ReplayGain\n", e->inbasefilename);
 			if(e->treat_warnings_as_errors)
 				return false;
@@ -2335,9 +2357,9 @@ FLAC__bool verify_metadata(const EncoderSession *e, FLAC__StreamMetadata **metad
 	return true;
 }
 
-FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map)
+FLAC__bool format_input(unsigned char *ucbuffer, FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map)
 {
-	unsigned wide_sample, sample, channel, byte;
+	unsigned wide_sample, channel;
 	FLAC__int32 *out[FLAC__MAX_CHANNELS];
 
 	if(0 == channel_map) {
@@ -2349,66 +2371,8 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			out[channel] = dest[channel_map[channel]];
 	}
 
-	if(bps == 8) {
-		if(is_unsigned_samples) {
-			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)ucbuffer_[sample] - 0x80;
-		}
-		else {
-			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)scbuffer_[sample];
-		}
-	}
-	else if(bps == 16) {
-		if(is_big_endian != is_big_endian_host_) {
-			unsigned char tmp;
-			const unsigned bytes = wide_samples * channels * (bps >> 3);
-			for(byte = 0; byte < bytes; byte += 2) {
-				tmp = ucbuffer_[byte];
-				ucbuffer_[byte] = ucbuffer_[byte+1];
-				ucbuffer_[byte+1] = tmp;
-			}
-		}
-		if(is_unsigned_samples) {
-			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)usbuffer_[sample] - 0x8000;
-		}
-		else {
-			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)ssbuffer_[sample];
-		}
-	}
-	else if(bps == 24) {
-		if(!is_big_endian) {
-			unsigned char tmp;
-			const unsigned bytes = wide_samples * channels * (bps >> 3);
-			for(byte = 0; byte < bytes; byte += 3) {
-				tmp = ucbuffer_[byte];
-				ucbuffer_[byte] = ucbuffer_[byte+2];
-				ucbuffer_[byte+2] = tmp;
-			}
-		}
-		if(is_unsigned_samples) {
-			for(byte = sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++) {
-					out[channel][wide_sample]  = ucbuffer_[byte++]; out[channel][wide_sample] <<= 8;
-					out[channel][wide_sample] |= ucbuffer_[byte++]; out[channel][wide_sample] <<= 8;
-					out[channel][wide_sample] |= ucbuffer_[byte++];
-					out[channel][wide_sample] -= 0x800000;
-				}
-		}
-		else {
-			for(byte = sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-				for(channel = 0; channel < channels; channel++, sample++) {
-					out[channel][wide_sample]  = scbuffer_[byte++]; out[channel][wide_sample] <<= 8;
-					out[channel][wide_sample] |= ucbuffer_[byte++]; out[channel][wide_sample] <<= 8;
-					out[channel][wide_sample] |= ucbuffer_[byte++];
-				}
-		}
+	if(bps == 8 || bps == 16 || bps == 24) {
+		pcm__unpack_interleaved(out, ucbuffer, channels, wide_samples, bps >> 3, is_big_endian, is_unsigned_samples);
 	}
 	else {
 		FLAC__ASSERT(0);
@@ -24,6 +24,7 @@
 #endif
 
 #include "FLAC/metadata.h"
+#include "share/grabbag.h"
 #include "foreign_metadata.h"
 #include "utils.h"
 
@@ -31,9 +32,11 @@ extern const int FLAC_ENCODE__DEFAULT_PADDING;
 
 typedef enum {
 	CST_BLOCKSIZE,
+	CST_VARIABLE_BLOCKSIZE,
 	CST_COMPRESSION_LEVEL,
 	CST_DO_MID_SIDE,
 	CST_LOOSE_MID_SIDE,
+	CST_FAST_MID_SIDE,
 	CST_APODIZATION,
 	CST_MAX_LPC_ORDER,
 	CST_QLP_COEFF_PRECISION,
@@ -58,6 +61,7 @@ typedef struct {
 	utils__SkipUntilSpecification skip_specification;
 	utils__SkipUntilSpecification until_specification;
 	FLAC__bool verify;
+	unsigned num_threads;
 #if FLAC__HAS_OGG
 	FLAC__bool use_ogg;
 	long serial_number;
@@ -75,11 +79,11 @@ typedef struct {
 	FLAC__bool channel_map_none; /* --channel-map=none specified, eventually will expand to take actual channel map */
 
 	/* options related to --replay-gain and --sector-align */
-	FLAC__bool is_first_file;
 	FLAC__bool is_last_file;
 	FLAC__int32 **align_reservoir;
 	unsigned *align_reservoir_samples;
 	FLAC__bool replay_gain;
+	grabbag__ReplayGainContext *replay_gain_context; /* analysis state for this file; the caller collects the title gain and merges the album */
 	FLAC__bool ignore_chunk_sizes;
 	FLAC__bool sector_align;
 
@@ -28,6 +28,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef FLAC__HAS_PTHREAD
+#include <pthread.h>
+#endif
 
 #if !defined _MSC_VER && !defined __MINGW32__
 /* unlink is in stdio.h in VC++ */
@@ -57,6 +60,19 @@
 #  include "share/getopt.h"
 #endif
 
+/* one input file to encode or decode; see process_files() */
+typedef struct {
+	const char *infilename;
+	FLAC__bool is_last_file;
+	long serial_number; /* only used when encoding to Ogg FLAC */
+#ifdef FLAC__HAS_PTHREAD
+	/* used when processing files in parallel with --jobs */
+	int retval;
+	FLAC__bool done;
+	utils__OutputBuffer output;
+#endif
+} file_job_t;
+
 static int do_it(void);
 
 static FLAC__bool init_options(void);
@@ -74,12 +90,21 @@ static void show_help(void);
 static void show_explain(void);
 static void format_mistake(const char *infilename, FileFormat wrong, FileFormat right);
 
-static int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file);
+static int process_files(void);
+static int process_file(const file_job_t *job, grabbag__ReplayGainContext *replay_gain_context);
+#ifdef FLAC__HAS_PTHREAD
+static int process_files_in_parallel(file_job_t *jobs, unsigned num_jobs, unsigned num_threads, grabbag__ReplayGainContext *album_replay_gain_context);
+#endif
+static int encode_file(const char *infilename, FLAC__bool is_last_file, long serial_number, grabbag__ReplayGainContext *replay_gain_context);
 static int decode_file(const char *infilename);
+static FLAC__bool copy_file_metadata(encode_options_t *encode_options);
+static void delete_file_metadata(encode_options_t *encode_options);
 
-static const char *get_encoded_outfilename(const char *infilename);
-static const char *get_decoded_outfilename(const char *infilename);
-static const char *get_outfilename(const char *infilename, const char *suffix);
+/* the output name is written to 'buffer', which must be OUTFILENAME_BUFFER_SIZE bytes */
+#define OUTFILENAME_BUFFER_SIZE 4096 /* @@@ bad MAGIC NUMBER */
+static const char *get_encoded_outfilename(const char *infilename, char *buffer);
+static const char *get_decoded_outfilename(const char *infilename, char *buffer);
+static const char *get_outfilename(const char *infilename, const char *suffix, char *buffer);
 
 static void die(const char *message);
 static int conditional_fclose(FILE *f);
@@ -116,6 +141,8 @@ static struct share__option long_options_[] = {
 	{ "output-name"           , share__required_argument, 0, 'o' },
 	{ "skip"                  , share__required_argument, 0, 0 },
 	{ "until"                 , share__required_argument, 0, 0 },
+	{ "jobs"                  , share__required_argument, 0, 0 },
+	{ "threads"               , share__required_argument, 0, 0 },
 	{ "channel-map"           , share__required_argument, 0, 0 }, /* undocumented */
 
 	/*
@@ -161,14 +188,17 @@ static struct share__option long_options_[] = {
 	{ "serial-number"             , share__required_argument, 0, 0 },
 #endif
 	{ "blocksize"                 , share__required_argument, 0, 'b' },
+	{ "variable-blocksize"        , share__no_argument, 0, 0 },
 	{ "exhaustive-model-search"   , share__no_argument, 0, 'e' },
 	{ "max-lpc-order"             , share__required_argument, 0, 'l' },
 	{ "apodization"               , share__required_argument, 0, 'A' },
 	{ "mid-side"                  , share__no_argument, 0, 'm' },
 	{ "adaptive-mid-side"         , share__no_argument, 0, 'M' },
+	{ "fast-mid-side"             , share__no_argument, 0, 0 },
 	{ "qlp-coeff-precision-search", share__no_argument, 0, 'p' },
 	{ "qlp-coeff-precision"       , share__required_argument, 0, 'q' },
 	{ "rice-partition-order"      , share__required_argument, 0, 'r' },
+	{ "rice-parameter-search-dist", share__required_argument, 0, 'R' },
 	{ "endian"                    , share__required_argument, 0, 0 },
 	{ "channels"                  , share__required_argument, 0, 0 },
 	{ "bps"                       , share__required_argument, 0, 0 },
@@ -201,8 +231,10 @@ static struct share__option long_options_[] = {
 	{ "no-ogg"                    , share__no_argument, 0, 0 },
 #endif
 	{ "no-exhaustive-model-search", share__no_argument, 0, 0 },
+	{ "no-variable-blocksize"     , share__no_argument, 0, 0 },
 	{ "no-mid-side"               , share__no_argument, 0, 0 },
 	{ "no-adaptive-mid-side"      , share__no_argument, 0, 0 },
+	{ "no-fast-mid-side"          , share__no_argument, 0, 0 },
 	{ "no-qlp-coeff-prec-search"  , share__no_argument, 0, 0 },
 	{ "no-padding"                , share__no_argument, 0, 0 },
 	{ "no-verify"                 , share__no_argument, 0, 0 },
@@ -255,6 +287,8 @@ static struct {
 	FLAC__bool utf8_convert; /* true by default, to convert tag strings from locale to utf-8, false if --no-utf8-convert used */
 	const char *cmdline_forced_outfilename;
 	const char *output_prefix;
+	unsigned num_jobs; /* how many files to process at once */
+	unsigned num_threads; /* how many threads to encode or decode each file with */
 	analysis_options aopts;
 	int padding; /* -1 => no -P options were given, 0 => -P- was given, else -P value */
 	size_t num_compression_settings;
@@ -298,6 +332,11 @@ static FLAC__int32 align_reservoir_0[588], align_reservoir_1[588]; /* for carryi
 static FLAC__int32 *align_reservoir[2] = { align_reservoir_0, align_reservoir_1 };
 static unsigned align_reservoir_samples = 0; /* 0 .. 587 */
 
+#ifdef FLAC__HAS_PTHREAD
+/* writing ReplayGain tags switches the (process-wide) locale, so it must not happen in two files at once */
+static pthread_mutex_t replaygain_tag_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 
 int main(int argc, char *argv[])
 {
@@ -452,6 +491,14 @@ int do_it(void)
 				option_values.padding += GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED;
 			}
 		}
+		if(option_values.num_jobs > 1) {
+			if(option_values.force_to_stdout)
+				return usage_error("ERROR: --jobs not allowed with -c/--stdout\n");
+			if(option_values.analyze)
+				return usage_error("ERROR: --jobs not allowed with -a/--analyze\n");
+			if(option_values.sector_align)
+				return usage_error("ERROR: --jobs not allowed with --sector-align\n");
+		}
 		if(option_values.num_files > 1 && option_values.cmdline_forced_outfilename) {
 			return usage_error("ERROR: -o/--output-name cannot be used with multiple files\n");
 		}
@@ -478,61 +525,21 @@ int do_it(void)
 	flac__utils_printf(stderr, 2, "flac comes with ABSOLUTELY NO WARRANTY.  This is free software, and you are\n");
 	flac__utils_printf(stderr, 2, "welcome to redistribute it under certain conditions.  Type `flac' for details.\n\n");
 
-	if(option_values.mode_decode) {
-		FLAC__bool first = true;
-
-		if(option_values.num_files == 0) {
-			retval = decode_file("-");
-		}
-		else {
-			unsigned i;
-			if(option_values.num_files > 1)
-				option_values.cmdline_forced_outfilename = 0;
-			for(i = 0, retval = 0; i < option_values.num_files; i++) {
-				if(0 == strcmp(option_values.filenames[i], "-") && !first)
-					continue;
-				retval |= decode_file(option_values.filenames[i]);
-				first = false;
-			}
-		}
-	}
-	else { /* encode */
-		FLAC__bool first = true;
-
+	if(!option_values.mode_decode) {
 		if(option_values.ignore_chunk_sizes)
 			flac__utils_printf(stderr, 1, "INFO: Make sure you know what you're doing when using --ignore-chunk-sizes.\n      Improper use can cause flac to encode non-audio data as audio.\n");
 
-		if(option_values.num_files == 0) {
-			retval = encode_file("-", first, true);
-		}
-		else {
-			unsigned i;
-			if(option_values.num_files > 1)
-				option_values.cmdline_forced_outfilename = 0;
-			for(i = 0, retval = 0; i < option_values.num_files; i++) {
-				if(0 == strcmp(option_values.filenames[i], "-") && !first)
-					continue;
-				retval |= encode_file(option_values.filenames[i], first, i == (option_values.num_files-1));
-				first = false;
-			}
-			if(option_values.replay_gain && retval == 0) {
-				float album_gain, album_peak;
-				grabbag__replaygain_get_album(&album_gain, &album_peak);
-				for(i = 0; i < option_values.num_files; i++) {
-					const char *error, *outfilename = get_encoded_outfilename(option_values.filenames[i]);
-					if(0 == outfilename) {
-						flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", option_values.filenames[i]);
-						return 1;
-					}
-					if(0 != (error = grabbag__replaygain_store_to_file_album(outfilename, album_gain, album_peak, option_values.preserve_modtime))) {
-						flac__utils_printf(stderr, 1, "%s: ERROR writing ReplayGain album tags (%s)\n", outfilename, error);
-						retval = 1;
-					}
-				}
-			}
+#if FLAC__HAS_OGG
+		/* set a random serial number if one has not yet been specified */
+		if(!option_values.has_serial_number) {
+			option_values.serial_number = rand();
+			option_values.has_serial_number = true;
 		}
+#endif
 	}
 
+	retval = process_files();
+
 	return retval;
 }
 
@@ -570,6 +577,8 @@ FLAC__bool init_options(void)
 	option_values.utf8_convert = true;
 	option_values.cmdline_forced_outfilename = 0;
 	option_values.output_prefix = 0;
+	option_values.num_jobs = 1;
+	option_values.num_threads = 1;
 	option_values.aopts.do_residual_text = false;
 	option_values.aopts.do_residual_gnuplot = false;
 	option_values.padding = -1;
@@ -611,7 +620,7 @@ int parse_options(int argc, char *argv[])
 	int short_option;
 	int option_index = 1;
 	FLAC__bool had_error = false;
-	const char *short_opts = "0123456789aA:b:cdefFhHl:mMo:pP:q:r:sS:tT:vVw";
+	const char *short_opts = "0123456789aA:b:cdefFhHl:mMo:pP:q:r:R:sS:tT:vVw";
 
 	while ((short_option = share__getopt_long(argc, argv, short_opts, long_options_, &option_index)) != -1) {
 		switch (short_option) {
@@ -679,6 +688,28 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 			FLAC__ASSERT(0 != option_argument);
 			option_values.until_specification = option_argument;
 		}
+		else if(0 == strcmp(long_option, "jobs")) {
+			FLAC__ASSERT(0 != option_argument);
+			i = atoi(option_argument);
+			if(i < 1)
+				return usage_error("ERROR: argument to --%s must be >= 1\n", long_option);
+#ifndef FLAC__HAS_PTHREAD
+			if(i > 1)
+				return usage_error("ERROR: thread support has not been built into this copy of flac, --%s must be 1\n", long_option);
+#endif
+			option_values.num_jobs = (unsigned)i;
+		}
+		else if(0 == strcmp(long_option, "threads")) {
+			FLAC__ASSERT(0 != option_argument);
+			i = atoi(option_argument);
+			if(i < 1)
+				return usage_error("ERROR: argument to --%s must be >= 1\n", long_option);
+#ifndef FLAC__HAS_PTHREAD
+			if(i > 1)
+				return usage_error("ERROR: thread support has not been built into this copy of flac, --%s must be 1\n", long_option);
+#endif
+			option_values.num_threads = (unsigned)i;
+		}
 		else if(0 == strcmp(long_option, "input-size")) {
 			FLAC__ASSERT(0 != option_argument);
 			{
@@ -819,6 +850,14 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 			else
 				return usage_error("ERROR: argument to --sign must be \"signed\" or \"unsigned\"\n");
 		}
+		else if(0 == strcmp(long_option, "variable-blocksize")) {
+			add_compression_setting_bool(CST_VARIABLE_BLOCKSIZE, true);
+		}
+		else if(0 == strcmp(long_option, "fast-mid-side")) {
+			add_compression_setting_bool(CST_DO_MID_SIDE, true);
+			add_compression_setting_bool(CST_LOOSE_MID_SIDE, false);
+			add_compression_setting_bool(CST_FAST_MID_SIDE, true);
+		}
 		else if(0 == strcmp(long_option, "residual-gnuplot")) {
 			option_values.aopts.do_residual_gnuplot = true;
 		}
@@ -873,6 +912,9 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 		else if(0 == strcmp(long_option, "no-exhaustive-model-search")) {
 			add_compression_setting_bool(CST_DO_EXHAUSTIVE_MODEL_SEARCH, false);
 		}
+		else if(0 == strcmp(long_option, "no-variable-blocksize")) {
+			add_compression_setting_bool(CST_VARIABLE_BLOCKSIZE, false);
+		}
 		else if(0 == strcmp(long_option, "no-mid-side")) {
 			add_compression_setting_bool(CST_DO_MID_SIDE, false);
 			add_compression_setting_bool(CST_LOOSE_MID_SIDE, false);
@@ -881,6 +923,9 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 			add_compression_setting_bool(CST_DO_MID_SIDE, false);
 			add_compression_setting_bool(CST_LOOSE_MID_SIDE, false);
 		}
+		else if(0 == strcmp(long_option, "no-fast-mid-side")) {
+			add_compression_setting_bool(CST_FAST_MID_SIDE, false);
+		}
 		else if(0 == strcmp(long_option, "no-qlp-coeff-prec-search")) {
 			add_compression_setting_bool(CST_DO_QLP_COEFF_PREC_SEARCH, false);
 		}
@@ -1225,6 +1270,9 @@ void show_help(void)
 	printf("      --keep-foreign-metadata  Save/restore WAVE or AIFF non-audio chunks\n");
 	printf("      --skip={#|mm:ss.ss}      Skip the given initial samples for each input\n");
 	printf("      --until={#|[+|-]mm:ss.ss}  Stop at the given sample for each input file\n");
+	printf("      --jobs=#                 Encode or decode up to # files at once\n");
+	printf("      --threads=#              Encode, decode or test each file with up to\n");
+	printf("                               # threads\n");
 #if FLAC__HAS_OGG
 	printf("      --ogg                    Use Ogg as transport layer\n");
 	printf("      --serial-number          Serial number to use for the FLAC stream\n");
@@ -1259,14 +1307,17 @@ void show_help(void)
 	printf("  -7, --compression-level-7          Synonymous with -l 8 -b 4096 -m -e -r 6\n");
 	printf("  -8, --compression-level-8, --best  Synonymous with -l 12 -b 4096 -m -e -r 6\n");
 	printf("  -b, --blocksize=#                  Specify blocksize in samples\n");
+	printf("      --variable-blocksize           Split blocks into smaller frames if it helps\n");
 	printf("  -m, --mid-side                     Try mid-side coding for each frame\n");
 	printf("  -M, --adaptive-mid-side            Adaptive mid-side coding for all frames\n");
+	printf("      --fast-mid-side                Like -m but only encode the likely best pair\n");
 	printf("  -e, --exhaustive-model-search      Do exhaustive model search (expensive!)\n");
 	printf("  -A, --apodization=\"function\"       Window audio data with given the function\n");
 	printf("  -l, --max-lpc-order=#              Max LPC order; 0 => only fixed predictors\n");
 	printf("  -p, --qlp-coeff-precision-search   Exhaustively search LP coeff quantization\n");
 	printf("  -q, --qlp-coeff-precision=#        Specify precision in bits\n");
 	printf("  -r, --rice-partition-order=[#,]#   Set [min,]max residual partition order\n");
+	printf("  -R, --rice-parameter-search-dist=# Also try Rice parameters up to # away\n");
 	printf("format options:\n");
 	printf("      --endian={big|little}    Set byte order for samples\n");
 	printf("      --channels=#             Number of channels\n");
@@ -1285,6 +1336,7 @@ void show_help(void)
 	printf("      --no-preserve-modtime\n");
 	printf("      --no-keep-foreign-metadata\n");
 	printf("      --no-exhaustive-model-search\n");
+	printf("      --no-fast-mid-side\n");
 	printf("      --no-lax\n");
 	printf("      --no-mid-side\n");
 #if FLAC__HAS_OGG
@@ -1295,6 +1347,7 @@ void show_help(void)
 	printf("      --no-replay-gain\n");
 	printf("      --no-residual-gnuplot\n");
 	printf("      --no-residual-text\n");
+	printf("      --no-variable-blocksize\n");
 #if 0 /*@@@ currently undocumented */
 	printf("      --no-ignore-chunk-sizes\n");
 #endif
@@ -1386,6 +1439,20 @@ void show_explain(void)
 	printf("                               relative to the --skip point.  If a `-' sign is\n");
 	printf("                               at the beginning, the --until point is relative\n");
 	printf("                               to end of the audio.\n");
+	printf("      --jobs=#                 Encode or decode up to # of the input files at\n");
+	printf("                               once, each on its own thread.  Messages for\n");
+	printf("                               each file are still printed in the order the\n");
+	printf("                               files were given, but only once the file is\n");
+	printf("                               done.  Not allowed with -c, -a, or\n");
+	printf("                               --sector-align.  The default is 1.\n");
+	printf("      --threads=#              Encode, decode or test each file with up to #\n");
+	printf("                               threads.  When encoding, whole frames are\n");
+	printf("                               encoded in parallel and, with -V, verification\n");
+	printf("                               and the MD5 signature are computed on threads\n");
+	printf("                               of their own.  When decoding or testing, whole\n");
+	printf("                               frames are decoded in parallel and written out\n");
+	printf("                               on a thread of their own.  The output is the\n");
+	printf("                               same as with one thread.  The default is 1.\n");
 #if FLAC__HAS_OGG
 	printf("      --ogg                    When encoding, generate Ogg FLAC output instead\n");
 	printf("                               of native FLAC.  Ogg FLAC streams are FLAC\n");
@@ -1552,6 +1619,10 @@ void show_explain(void)
 	printf("                               576, 1152, 2304, 4608, 256, 512, 1024, 2048,\n");
 	printf("                               4096 (and 8192 or 16384 if the sample rate is\n");
 	printf("                               >48kHz) for Subset streams.\n");
+	printf("      --variable-blocksize     Let the encoder split each block into smaller\n");
+	printf("                               frames, down to 1/8 of the blocksize (but no\n");
+	printf("                               less than 256 samples), where that is estimated\n");
+	printf("                               to compress better, e.g. around transients.\n");
 	printf("  -0, --compression-level-0, --fast  Synonymous with -l 0 -b 1152 -r 3\n");
 	printf("  -1, --compression-level-1          Synonymous with -l 0 -b 1152 -M -r 3\n");
 	printf("  -2, --compression-level-2          Synonymous with -l 0 -b 1152 -m -r 3\n");
@@ -1566,6 +1637,10 @@ void show_explain(void)
 	printf("                                     (stereo only)\n");
 	printf("  -M, --adaptive-mid-side            Adaptive mid-side coding for all frames\n");
 	printf("                                     (stereo only)\n");
+	printf("      --fast-mid-side                Like -m, but estimate the size of each\n");
+	printf("                                     channel assignment first and only encode\n");
+	printf("                                     the subframes of the ones close to the\n");
+	printf("                                     best estimate (stereo only)\n");
 	printf("  -e, --exhaustive-model-search      Do exhaustive model search (expensive!)\n");
 	printf("  -A, --apodization=\"function\"       Window audio data with given the function.\n");
 	printf("                                     The functions are: bartlett, bartlett_hann,\n");
@@ -1592,6 +1667,10 @@ void show_explain(void)
 	printf("                                     (# is 0..16; min defaults to 0; the\n");
 	printf("                                     default is -r 0; above 4 doesn't usually\n");
 	printf("                                     help much)\n");
+	printf("  -R, --rice-parameter-search-dist=# Also try the Rice parameters up to # away\n");
+	printf("                                     from the estimated one for each partition,\n");
+	printf("                                     counting their sizes exactly (the default\n");
+	printf("                                     is -R 0; 1 or 2 is usually enough)\n");
 	printf("format options:\n");
 	printf("      --endian={big|little}    Set byte order for samples\n");
 	printf("      --channels=#             Number of channels\n");
@@ -1631,6 +1710,7 @@ void show_explain(void)
 	printf("      --no-preserve-modtime\n");
 	printf("      --no-keep-foreign-metadata\n");
 	printf("      --no-exhaustive-model-search\n");
+	printf("      --no-fast-mid-side\n");
 	printf("      --no-lax\n");
 	printf("      --no-mid-side\n");
 #if FLAC__HAS_OGG
@@ -1640,6 +1720,7 @@ void show_explain(void)
 	printf("      --no-qlp-coeff-prec-search\n");
 	printf("      --no-residual-gnuplot\n");
 	printf("      --no-residual-text\n");
+	printf("      --no-variable-blocksize\n");
 #if 0 /*@@@ currently undocumented */
 	printf("      --no-ignore-chunk-sizes\n");
 #endif
@@ -1658,7 +1739,204 @@ void format_mistake(const char *infilename, FileFormat wrong, FileFormat right)
 	flac__utils_printf(stderr, 1, "WARNING: %s is not a%s file; treating as a%s file\n", infilename, ff[wrong], ff[right]);
 }
 
-int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file)
+int process_files(void)
+{
+	file_job_t *jobs;
+	unsigned num_jobs = 0, i;
+	grabbag__ReplayGainContext *album_replay_gain_context = 0;
+	int retval = 0;
+
+	if(0 == (jobs = (file_job_t*)safe_calloc_(option_values.num_files? option_values.num_files : 1, sizeof(file_job_t))))
+		die("out of memory allocating file list");
+
+	if(option_values.num_files == 0) {
+		jobs[num_jobs].infilename = "-";
+		jobs[num_jobs++].is_last_file = true;
+	}
+	else {
+		FLAC__bool first = true;
+		if(option_values.num_files > 1)
+			option_values.cmdline_forced_outfilename = 0;
+		for(i = 0; i < option_values.num_files; i++) {
+			if(0 == strcmp(option_values.filenames[i], "-") && !first)
+				continue;
+			jobs[num_jobs].infilename = option_values.filenames[i];
+			jobs[num_jobs++].is_last_file = (i == option_values.num_files-1);
+			first = false;
+		}
+	}
+	/* encoding bumps the Ogg serial number for each file */
+	for(i = 0; i < num_jobs; i++)
+		jobs[i].serial_number = option_values.serial_number + (long)i;
+
+	/* each file is analyzed on its own and then merged into the album */
+	if(option_values.replay_gain && 0 == (album_replay_gain_context = grabbag__replaygain_context_new()))
+		die("out of memory allocating ReplayGain state");
+
+#ifdef FLAC__HAS_PTHREAD
+	if(option_values.num_jobs > 1 && num_jobs > 1) {
+		retval = process_files_in_parallel(jobs, num_jobs, option_values.num_jobs < num_jobs? option_values.num_jobs : num_jobs, album_replay_gain_context);
+	}
+	else
+#endif
+	{
+		grabbag__ReplayGainContext *replay_gain_context = 0;
+		if(option_values.replay_gain && 0 == (replay_gain_context = grabbag__replaygain_context_new()))
+			die("out of memory allocating ReplayGain state");
+		for(i = 0; i < num_jobs; i++) {
+			const int ret = process_file(&jobs[i], replay_gain_context);
+			if(ret == 0 && 0 != replay_gain_context)
+				grabbag__replaygain_merge_album(album_replay_gain_context, replay_gain_context);
+			retval |= ret;
+		}
+		grabbag__replaygain_context_delete(replay_gain_context);
+	}
+
+	if(option_values.replay_gain && option_values.num_files > 0 && retval == 0) {
+		float album_gain, album_peak;
+		grabbag__replaygain_get_album_context(album_replay_gain_context, &album_gain, &album_peak);
+		for(i = 0; i < num_jobs; i++) {
+			char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+			const char *error, *outfilename = get_encoded_outfilename(jobs[i].infilename, outfilename_buffer);
+			if(0 == outfilename) {
+				flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", jobs[i].infilename);
+				retval = 1;
+				break;
+			}
+			if(0 != (error = grabbag__replaygain_store_to_file_album(outfilename, album_gain, album_peak, option_values.preserve_modtime))) {
+				flac__utils_printf(stderr, 1, "%s: ERROR writing ReplayGain album tags (%s)\n", outfilename, error);
+				retval = 1;
+			}
+		}
+	}
+
+	grabbag__replaygain_context_delete(album_replay_gain_context);
+	free(jobs);
+
+	return retval;
+}
+
+int process_file(const file_job_t *job, grabbag__ReplayGainContext *replay_gain_context)
+{
+	if(option_values.mode_decode)
+		return decode_file(job->infilename);
+	else
+		return encode_file(job->infilename, job->is_last_file, job->serial_number, replay_gain_context);
+}
+
+#ifdef FLAC__HAS_PTHREAD
+typedef struct {
+	file_job_t *jobs;
+	unsigned num_jobs;
+	unsigned next_job;
+	grabbag__ReplayGainContext *album_replay_gain_context;
+	pthread_mutex_t mutex; /* protects next_job, the jobs' 'done' flags, and the album ReplayGain */
+	pthread_cond_t cond_done; /* signalled when a job is done */
+} job_pool_t;
+
+typedef struct {
+	job_pool_t *pool;
+	pthread_t thread;
+	grabbag__ReplayGainContext *replay_gain_context;
+} job_worker_t;
+
+static void *job_worker_thread_(void *arg)
+{
+	job_worker_t *worker = (job_worker_t*)arg;
+	job_pool_t *pool = worker->pool;
+
+	for(;;) {
+		file_job_t *job;
+
+		pthread_mutex_lock(&pool->mutex);
+		if(pool->next_job == pool->num_jobs) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		job = &pool->jobs[pool->next_job++];
+		pthread_mutex_unlock(&pool->mutex);
+
+		flac__utils_set_output_buffer(&job->output);
+		job->retval = process_file(job, worker->replay_gain_context);
+		flac__utils_set_output_buffer(0);
+
+		pthread_mutex_lock(&pool->mutex);
+		if(job->retval == 0 && 0 != worker->replay_gain_context)
+			grabbag__replaygain_merge_album(pool->album_replay_gain_context, worker->replay_gain_context);
+		job->done = true;
+		pthread_cond_signal(&pool->cond_done);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the jobs on 'num_threads' worker threads, each taking the next
+ * file as soon as it is free.  Meanwhile this thread prints each job's
+ * buffered messages in file order as the jobs finish.
+ */
+int process_files_in_parallel(file_job_t *jobs, unsigned num_jobs, unsigned num_threads, grabbag__ReplayGainContext *album_replay_gain_context)
+{
+	job_pool_t pool;
+	job_worker_t *workers;
+	unsigned i, num_started;
+	int retval = 0;
+
+	FLAC__ASSERT(num_threads > 1);
+	FLAC__ASSERT(num_threads <= num_jobs);
+
+	if(0 == (workers = (job_worker_t*)safe_calloc_(num_threads, sizeof(job_worker_t))))
+		die("out of memory allocating worker threads");
+
+	pool.jobs = jobs;
+	pool.num_jobs = num_jobs;
+	pool.next_job = 0;
+	pool.album_replay_gain_context = album_replay_gain_context;
+	pthread_mutex_init(&pool.mutex, 0);
+	pthread_cond_init(&pool.cond_done, 0);
+
+	for(num_started = 0; num_started < num_threads; num_started++) {
+		workers[num_started].pool = &pool;
+		if(option_values.replay_gain && 0 == (workers[num_started].replay_gain_context = grabbag__replaygain_context_new()))
+			die("out of memory allocating ReplayGain state");
+		if(0 != pthread_create(&workers[num_started].thread, 0, job_worker_thread_, &workers[num_started])) {
+			grabbag__replaygain_context_delete(workers[num_started].replay_gain_context);
+			break;
+		}
+	}
+	if(num_started == 0) {
+		/* could not start any thread; do it all here */
+		job_worker_t worker;
+		worker.pool = &pool;
+		if(option_values.replay_gain && 0 == (worker.replay_gain_context = grabbag__replaygain_context_new()))
+			die("out of memory allocating ReplayGain state");
+		(void)job_worker_thread_(&worker);
+		grabbag__replaygain_context_delete(worker.replay_gain_context);
+	}
+
+	for(i = 0; i < num_jobs; i++) {
+		pthread_mutex_lock(&pool.mutex);
+		while(!jobs[i].done)
+			pthread_cond_wait(&pool.cond_done, &pool.mutex);
+		pthread_mutex_unlock(&pool.mutex);
+		flac__utils_flush_output_buffer(&jobs[i].output, stderr);
+		retval |= jobs[i].retval;
+	}
+
+	for(i = 0; i < num_started; i++) {
+		pthread_join(workers[i].thread, 0);
+		grabbag__replaygain_context_delete(workers[i].replay_gain_context);
+	}
+	pthread_cond_destroy(&pool.cond_done);
+	pthread_mutex_destroy(&pool.mutex);
+	free(workers);
+
+	return retval;
+}
+#endif
+
+int encode_file(const char *infilename, FLAC__bool is_last_file, long serial_number, grabbag__ReplayGainContext *replay_gain_context)
 {
 	FILE *encode_infile;
 	FLAC__byte lookahead[12];
@@ -1667,7 +1945,8 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	int retval;
 	off_t infilesize;
 	encode_options_t encode_options;
-	const char *outfilename = get_encoded_outfilename(infilename); /* the final name of the encoded file */
+	char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+	const char *outfilename = get_encoded_outfilename(infilename, outfilename_buffer); /* the final name of the encoded file */
 	/* internal_outfilename is the file we will actually write to; it will be a temporary name if infilename==outfilename */
 	char *internal_outfilename = 0; /* NULL implies 'use outfilename' */
 
@@ -1853,15 +2132,13 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 		encode_options.until_specification.is_relative = true;
 
 	encode_options.verify = option_values.verify;
+	encode_options.num_threads = option_values.num_threads;
 	encode_options.treat_warnings_as_errors = option_values.treat_warnings_as_errors;
 #if FLAC__HAS_OGG
 	encode_options.use_ogg = option_values.use_ogg;
-	/* set a random serial number if one has not yet been specified */
-	if(!option_values.has_serial_number) {
-		option_values.serial_number = rand();
-		option_values.has_serial_number = true;
-	}
-	encode_options.serial_number = option_values.serial_number++;
+	encode_options.serial_number = serial_number;
+#else
+	(void)serial_number;
 #endif
 	encode_options.lax = option_values.lax;
 	encode_options.padding = option_values.padding;
@@ -1874,17 +2151,15 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	encode_options.continue_through_decode_errors = option_values.continue_through_decode_errors;
 	encode_options.cued_seekpoints = option_values.cued_seekpoints;
 	encode_options.channel_map_none = option_values.channel_map_none;
-	encode_options.is_first_file = is_first_file;
 	encode_options.is_last_file = is_last_file;
 	encode_options.align_reservoir = align_reservoir;
 	encode_options.align_reservoir_samples = &align_reservoir_samples;
 	encode_options.replay_gain = option_values.replay_gain;
+	encode_options.replay_gain_context = replay_gain_context;
 	encode_options.ignore_chunk_sizes = option_values.ignore_chunk_sizes;
 	encode_options.sector_align = option_values.sector_align;
-	encode_options.vorbis_comment = option_values.vorbis_comment;
-	FLAC__ASSERT(sizeof(encode_options.pictures) >= sizeof(option_values.pictures));
-	memcpy(encode_options.pictures, option_values.pictures, sizeof(option_values.pictures));
-	encode_options.num_pictures = option_values.num_pictures;
+	encode_options.vorbis_comment = 0; /* copied below */
+	encode_options.num_pictures = 0;
 	encode_options.format = input_format;
 	encode_options.debug.disable_constant_subframes = option_values.debug.disable_constant_subframes;
 	encode_options.debug.disable_fixed_subframes = option_values.debug.disable_fixed_subframes;
@@ -1904,6 +2179,14 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 		strcat(internal_outfilename, tmp_suffix);
 	}
 
+	if(!copy_file_metadata(&encode_options)) {
+		flac__utils_printf(stderr, 1, "ERROR allocating memory for tags and pictures\n");
+		conditional_fclose(encode_infile);
+		if(internal_outfilename != 0)
+			free(internal_outfilename);
+		return 1;
+	}
+
 	if(input_format == FORMAT_RAW) {
 		encode_options.format_options.raw.is_big_endian = option_values.format_is_big_endian;
 		encode_options.format_options.raw.is_unsigned_samples = option_values.format_is_unsigned_samples;
@@ -1932,6 +2215,9 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 			if(0 == encode_options.format_options.iff.foreign_metadata) {
 				flac__utils_printf(stderr, 1, "ERROR: creating foreign metadata object\n");
 				conditional_fclose(encode_infile);
+				delete_file_metadata(&encode_options);
+				if(internal_outfilename != 0)
+					free(internal_outfilename);
 				return 1;
 			}
 		}
@@ -1946,12 +2232,17 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 		retval = 1; /* double protection */
 	}
 
+	delete_file_metadata(&encode_options);
+
 	if(retval == 0) {
 		if(strcmp(outfilename, "-")) {
 			if(option_values.replay_gain) {
 				float title_gain, title_peak;
 				const char *error;
-				grabbag__replaygain_get_title(&title_gain, &title_peak);
+				grabbag__replaygain_get_title_context(replay_gain_context, &title_gain, &title_peak);
+#ifdef FLAC__HAS_PTHREAD
+				pthread_mutex_lock(&replaygain_tag_mutex);
+#endif
 				if(
 					0 != (error = grabbag__replaygain_store_to_file_reference(internal_outfilename? internal_outfilename : outfilename, option_values.preserve_modtime)) ||
 					0 != (error = grabbag__replaygain_store_to_file_title(internal_outfilename? internal_outfilename : outfilename, title_gain, title_peak, option_values.preserve_modtime))
@@ -1959,6 +2250,9 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 					flac__utils_printf(stderr, 1, "%s: ERROR writing ReplayGain reference/title tags (%s)\n", outfilename, error);
 					retval = 1;
 				}
+#ifdef FLAC__HAS_PTHREAD
+				pthread_mutex_unlock(&replaygain_tag_mutex);
+#endif
 			}
 			if(option_values.preserve_modtime && strcmp(infilename, "-"))
 				grabbag__file_copy_metadata(infilename, internal_outfilename? internal_outfilename : outfilename);
@@ -2001,7 +2295,8 @@ int decode_file(const char *infilename)
 	FLAC__bool treat_as_ogg = false;
 	FileFormat output_format = FORMAT_WAVE;
 	decode_options_t decode_options;
-	const char *outfilename = get_decoded_outfilename(infilename);
+	char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+	const char *outfilename = get_decoded_outfilename(infilename, outfilename_buffer);
 
 	if(0 == outfilename) {
 		flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", infilename);
@@ -2092,6 +2387,13 @@ int decode_file(const char *infilename)
 	decode_options.serial_number = option_values.serial_number;
 #endif
 	decode_options.channel_map_none = option_values.channel_map_none;
+	decode_options.num_threads = option_values.num_threads;
+#ifdef FLAC__HAS_PTHREAD
+	/* only with --threads: deliver frames from a helper thread while the next ones decode */
+	decode_options.pipeline_depth = option_values.num_threads > 1? 4 : 1;
+#else
+	decode_options.pipeline_depth = 1;
+#endif
 	decode_options.format = output_format;
 
 	if(output_format == FORMAT_RAW) {
@@ -2135,13 +2437,49 @@ int decode_file(const char *infilename)
 	return retval;
 }
 
-const char *get_encoded_outfilename(const char *infilename)
+/*
+ * The encoder modifies the tags (e.g. adding a channel mask) and sets the
+ * is_last flags of the blocks it is given, so each file gets its own copy.
+ */
+FLAC__bool copy_file_metadata(encode_options_t *encode_options)
+{
+	unsigned i;
+
+	FLAC__ASSERT(sizeof(encode_options->pictures) >= sizeof(option_values.pictures));
+
+	encode_options->num_pictures = 0;
+	if(0 == (encode_options->vorbis_comment = FLAC__metadata_object_clone(option_values.vorbis_comment)))
+		return false;
+	for(i = 0; i < option_values.num_pictures; i++) {
+		if(0 == (encode_options->pictures[i] = FLAC__metadata_object_clone(option_values.pictures[i]))) {
+			delete_file_metadata(encode_options);
+			return false;
+		}
+		encode_options->num_pictures++;
+	}
+	return true;
+}
+
+void delete_file_metadata(encode_options_t *encode_options)
+{
+	unsigned i;
+
+	if(0 != encode_options->vorbis_comment) {
+		FLAC__metadata_object_delete(encode_options->vorbis_comment);
+		encode_options->vorbis_comment = 0;
+	}
+	for(i = 0; i < encode_options->num_pictures; i++)
+		FLAC__metadata_object_delete(encode_options->pictures[i]);
+	encode_options->num_pictures = 0;
+}
+
+const char *get_encoded_outfilename(const char *infilename, char *buffer)
 {
 	const char *suffix = (option_values.use_ogg? ".oga" : ".flac");
-	return get_outfilename(infilename, suffix);
+	return get_outfilename(infilename, suffix, buffer);
 }
 
-const char *get_decoded_outfilename(const char *infilename)
+const char *get_decoded_outfilename(const char *infilename, char *buffer)
 {
 	const char *suffix;
 	if(option_values.analyze) {
@@ -2162,31 +2500,29 @@ const char *get_decoded_outfilename(const char *infilename)
 	else {
 		suffix = ".wav";
 	}
-	return get_outfilename(infilename, suffix);
+	return get_outfilename(infilename, suffix, buffer);
 }
 
-const char *get_outfilename(const char *infilename, const char *suffix)
+const char *get_outfilename(const char *infilename, const char *suffix, char *buffer)
 {
 	if(0 == option_values.cmdline_forced_outfilename) {
-		static char buffer[4096]; /* @@@ bad MAGIC NUMBER */
-
 		if(0 == strcmp(infilename, "-") || option_values.force_to_stdout) {
 			strcpy(buffer, "-");
 		}
 		else {
 			char *p;
-			if (flac__strlcpy(buffer, option_values.output_prefix? option_values.output_prefix : "", sizeof buffer) >= sizeof buffer)
+			if (flac__strlcpy(buffer, option_values.output_prefix? option_values.output_prefix : "", OUTFILENAME_BUFFER_SIZE) >= OUTFILENAME_BUFFER_SIZE)
 				return 0;
-			if (flac__strlcat(buffer, infilename, sizeof buffer) >= sizeof buffer)
+			if (flac__strlcat(buffer, infilename, OUTFILENAME_BUFFER_SIZE) >= OUTFILENAME_BUFFER_SIZE)
 				return 0;
 			/* the . must come after any / to avoid problems with, e.g. "some.directory/extensionless-filename" */
 			if(0 == (p = strrchr(buffer, '.')) || strchr(p, '/')) {
-				if (flac__strlcat(buffer, suffix, sizeof buffer) >= sizeof buffer)
+				if (flac__strlcat(buffer, suffix, OUTFILENAME_BUFFER_SIZE) >= OUTFILENAME_BUFFER_SIZE)
 					return 0;
 			}
 			else {
 				*p = '\0';
-				if (flac__strlcat(buffer, suffix, sizeof buffer) >= sizeof buffer)
+				if (flac__strlcat(buffer, suffix, OUTFILENAME_BUFFER_SIZE) >= OUTFILENAME_BUFFER_SIZE)
 					return 0;
 			}
 		}
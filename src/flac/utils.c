@@ -28,11 +28,58 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef FLAC__HAS_PTHREAD
+#include <pthread.h>
+#endif
 
 const char *CHANNEL_MASK_TAG = "WAVEFORMATEXTENSIBLE_CHANNEL_MASK";
 
 int flac__utils_verbosity_ = 2;
 
+#ifdef FLAC__HAS_PTHREAD
+static pthread_once_t output_buffer_once_ = PTHREAD_ONCE_INIT;
+static pthread_key_t output_buffer_key_;
+
+static void output_buffer_key_create_(void)
+{
+	(void)pthread_key_create(&output_buffer_key_, 0);
+}
+
+static utils__OutputBuffer *get_output_buffer_(void)
+{
+	(void)pthread_once(&output_buffer_once_, output_buffer_key_create_);
+	return (utils__OutputBuffer*)pthread_getspecific(output_buffer_key_);
+}
+
+static FLAC__bool output_buffer_reserve_(utils__OutputBuffer *buffer, size_t length)
+{
+	if(buffer->length + length >= buffer->capacity) {
+		size_t capacity = buffer->capacity? buffer->capacity : 256;
+		char *text;
+		while(buffer->length + length >= capacity)
+			capacity *= 2;
+		if(0 == (text = (char*)realloc(buffer->text, capacity)))
+			return false;
+		buffer->text = text;
+		buffer->capacity = capacity;
+	}
+	return true;
+}
+
+/* the new text has been vsnprintf()ed at buffer->text + buffer->length */
+static void output_buffer_commit_(utils__OutputBuffer *buffer, size_t length)
+{
+	if(buffer->text[buffer->length] == '\r') {
+		size_t line = buffer->length;
+		while(line > 0 && buffer->text[line-1] != '\n')
+			line--;
+		memmove(buffer->text + line, buffer->text + buffer->length, length + 1);
+		buffer->length = line;
+	}
+	buffer->length += length;
+}
+#endif
+
 static FLAC__bool local__parse_uint64_(const char *s, FLAC__uint64 *value)
 {
 	FLAC__uint64 ret = 0;
@@ -141,9 +188,30 @@ void flac__utils_printf(FILE *stream, int level, const char *format, ...)
 {
 	if(flac__utils_verbosity_ >= level) {
 		va_list args;
+#ifdef FLAC__HAS_PTHREAD
+		utils__OutputBuffer *buffer = (stream == stderr)? get_output_buffer_() : 0;
+#endif
 
 		FLAC__ASSERT(0 != format);
 
+#ifdef FLAC__HAS_PTHREAD
+		if(0 != buffer) {
+			int length;
+
+			va_start(args, format);
+			length = vsnprintf(0, 0, format, args);
+			va_end(args);
+
+			if(length > 0 && output_buffer_reserve_(buffer, (size_t)length)) {
+				va_start(args, format);
+				(void) vsnprintf(buffer->text + buffer->length, (size_t)length + 1, format, args);
+				va_end(args);
+				output_buffer_commit_(buffer, (size_t)length);
+			}
+			return;
+		}
+#endif
+
 		va_start(args, format);
 
 		(void) vfprintf(stream, format, args);
@@ -157,6 +225,32 @@ void flac__utils_printf(FILE *stream, int level, const char *format, ...)
 	}
 }
 
+#ifdef FLAC__HAS_PTHREAD
+void flac__utils_set_output_buffer(utils__OutputBuffer *buffer)
+{
+	(void)pthread_once(&output_buffer_once_, output_buffer_key_create_);
+	(void)pthread_setspecific(output_buffer_key_, buffer);
+}
+
+FLAC__bool flac__utils_output_is_buffered(void)
+{
+	return 0 != get_output_buffer_();
+}
+
+void flac__utils_flush_output_buffer(utils__OutputBuffer *buffer, FILE *stream)
+{
+	FLAC__ASSERT(0 != buffer);
+
+	if(buffer->length > 0) {
+		(void) fwrite(buffer->text, 1, buffer->length, stream);
+		fflush(stream);
+	}
+	free(buffer->text);
+	buffer->text = 0;
+	buffer->length = buffer->capacity = 0;
+}
+#endif
+
 #ifdef FLAC__VALGRIND_TESTING
 size_t flac__utils_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
@@ -53,6 +53,25 @@ size_t flac__utils_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stre
 extern int flac__utils_verbosity_;
 void flac__utils_printf(FILE *stream, int level, const char *format, ...);
 
+#ifdef FLAC__HAS_PTHREAD
+/*
+ * While a thread has an output buffer set, what it flac__utils_printf()s
+ * to stderr is collected there instead, so that --jobs can print each
+ * file's messages together and in order.  Text starting with '\r' (the
+ * progress indicator) replaces the last unfinished line, as it would on
+ * a terminal.
+ */
+typedef struct {
+	char *text;
+	size_t length;
+	size_t capacity;
+} utils__OutputBuffer;
+
+void flac__utils_set_output_buffer(utils__OutputBuffer *buffer); /* 0 to print directly again */
+void flac__utils_flush_output_buffer(utils__OutputBuffer *buffer, FILE *stream); /* also frees the text */
+FLAC__bool flac__utils_output_is_buffered(void); /* true while the calling thread has an output buffer set */
+#endif
+
 FLAC__bool flac__utils_parse_skip_until_specification(const char *s, utils__SkipUntilSpecification *spec);
 void flac__utils_canonicalize_skip_until_specification(utils__SkipUntilSpecification *spec, unsigned sample_rate);
 
@@ -29,8 +29,15 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include "FLAC++/decoder.h"
 #include "FLAC/assert.h"
+#ifdef FLAC__HAS_PTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef _MSC_VER
 // warning C4800: 'int' : forcing to bool 'true' or 'false' (performance warning)
@@ -40,6 +47,89 @@
 namespace FLAC {
 	namespace Decoder {
 
+		// ------------------------------------------------------------
+		//
+		// Pool
+		//
+		// ------------------------------------------------------------
+
+		struct Pool::Private {
+			::FLAC__StreamDecoder **idle;
+			unsigned num_idle, max_idle;
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_t mutex; // protects idle[] and num_idle
+#endif
+		};
+
+		Pool::Pool(unsigned max_idle):
+		private_(new Private)
+		{
+			private_->idle = max_idle > 0? new ::FLAC__StreamDecoder*[max_idle] : 0;
+			private_->num_idle = 0;
+			private_->max_idle = max_idle;
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_init(&private_->mutex, 0);
+#endif
+		}
+
+		Pool::~Pool()
+		{
+			for(unsigned i = 0; i < private_->num_idle; i++)
+				::FLAC__stream_decoder_delete(private_->idle[i]);
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_destroy(&private_->mutex);
+#endif
+			delete [] private_->idle;
+			delete private_;
+		}
+
+		::FLAC__StreamDecoder *Pool::acquire()
+		{
+			::FLAC__StreamDecoder *decoder = 0;
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_lock(&private_->mutex);
+#endif
+			if(private_->num_idle > 0)
+				decoder = private_->idle[--private_->num_idle];
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_unlock(&private_->mutex);
+#endif
+			if(0 == decoder)
+				decoder = ::FLAC__stream_decoder_new();
+			return decoder;
+		}
+
+		void Pool::release(::FLAC__StreamDecoder *decoder)
+		{
+			FLAC__ASSERT(0 != decoder);
+			(void)::FLAC__stream_decoder_recycle(decoder);
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_lock(&private_->mutex);
+#endif
+			if(private_->num_idle < private_->max_idle) {
+				private_->idle[private_->num_idle++] = decoder;
+				decoder = 0;
+			}
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_unlock(&private_->mutex);
+#endif
+			if(0 != decoder)
+				::FLAC__stream_decoder_delete(decoder);
+		}
+
+		unsigned Pool::get_num_idle() const
+		{
+			unsigned num_idle;
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_lock(&private_->mutex);
+#endif
+			num_idle = private_->num_idle;
+#ifdef FLAC__HAS_PTHREAD
+			pthread_mutex_unlock(&private_->mutex);
+#endif
+			return num_idle;
+		}
+
 		// ------------------------------------------------------------
 		//
 		// Stream
@@ -47,14 +137,24 @@ namespace FLAC {
 		// ------------------------------------------------------------
 
 		Stream::Stream():
-		decoder_(::FLAC__stream_decoder_new())
+		decoder_(::FLAC__stream_decoder_new()),
+		pool_(0)
+		{ }
+
+		Stream::Stream(Pool &pool):
+		decoder_(pool.acquire()),
+		pool_(&pool)
 		{ }
 
 		Stream::~Stream()
 		{
 			if(0 != decoder_) {
-				(void)::FLAC__stream_decoder_finish(decoder_);
-				::FLAC__stream_decoder_delete(decoder_);
+				if(0 != pool_)
+					pool_->release(decoder_);
+				else {
+					(void)::FLAC__stream_decoder_finish(decoder_);
+					::FLAC__stream_decoder_delete(decoder_);
+				}
 			}
 		}
 
@@ -75,6 +175,30 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_set_md5_checking(decoder_, value);
 		}
 
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_num_threads(decoder_, value);
+		}
+
+		bool Stream::set_pipeline_depth(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_pipeline_depth(decoder_, value);
+		}
+
+		bool Stream::set_frame_indexing(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_frame_indexing(decoder_, value);
+		}
+
+		bool Stream::set_frame_index(const ::FLAC__StreamMetadata *frame_index)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_frame_index(decoder_, frame_index);
+		}
+
 		bool Stream::set_metadata_respond(::FLAC__MetadataType type)
 		{
 			FLAC__ASSERT(is_valid());
@@ -123,6 +247,24 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_get_md5_checking(decoder_);
 		}
 
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_num_threads(decoder_);
+		}
+
+		unsigned Stream::get_pipeline_depth() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_pipeline_depth(decoder_);
+		}
+
+		bool Stream::get_frame_indexing() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_get_frame_indexing(decoder_);
+		}
+
 		FLAC__uint64 Stream::get_total_samples() const
 		{
 			FLAC__ASSERT(is_valid());
@@ -183,6 +325,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_finish(decoder_);
 		}
 
+		bool Stream::recycle()
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_recycle(decoder_);
+		}
+
 		bool Stream::flush()
 		{
 			FLAC__ASSERT(is_valid());
@@ -225,6 +373,40 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_seek_absolute(decoder_, sample);
 		}
 
+		bool Stream::process_range(FLAC__uint64 first_sample, FLAC__uint64 last_sample, FLAC__int32 buffer[], bool *md5_checked)
+		{
+			FLAC__ASSERT(is_valid());
+			::FLAC__bool checked;
+			const bool ok = (bool)::FLAC__stream_decoder_process_range(decoder_, first_sample, last_sample, buffer, &checked);
+			if(0 != md5_checked)
+				*md5_checked = (bool)checked;
+			return ok;
+		}
+
+		bool Stream::read_samples_interleaved(FLAC__int32 buffer[], unsigned samples, unsigned *samples_read)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_read_samples_interleaved(decoder_, buffer, samples, samples_read);
+		}
+
+		bool Stream::read_samples_interleaved(FLAC__int16 buffer[], unsigned samples, unsigned *samples_read)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_read_samples_interleaved_int16(decoder_, buffer, samples, samples_read);
+		}
+
+		bool Stream::scan_frames(::FLAC__StreamMetadata **frame_index)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_scan_frames(decoder_, frame_index);
+		}
+
+		bool Stream::get_frame_index(::FLAC__StreamMetadata **frame_index) const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_get_frame_index(decoder_, frame_index);
+		}
+
 		::FLAC__StreamDecoderSeekStatus Stream::seek_callback(FLAC__uint64 absolute_byte_offset)
 		{
 			(void)absolute_byte_offset;
@@ -335,6 +517,10 @@ namespace FLAC {
 			Stream()
 		{ }
 
+		File::File(Pool &pool):
+			Stream(pool)
+		{ }
+
 		File::~File()
 		{
 		}
@@ -373,6 +559,28 @@ namespace FLAC {
 			return init_ogg(filename.c_str());
 		}
 
+		::FLAC__StreamDecoderInitStatus File::init_mmap(const char *filename)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_mmap(decoder_, filename, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_mmap(const std::string &filename)
+		{
+			return init_mmap(filename.c_str());
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_ogg_mmap(const char *filename)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_ogg_mmap(decoder_, filename, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_ogg_mmap(const std::string &filename)
+		{
+			return init_ogg_mmap(filename.c_str());
+		}
+
 		// This is a dummy to satisfy the pure virtual from Stream; the
 		// read callback will never be called since we are initializing
 		// with FLAC__stream_decoder_init_FILE() or
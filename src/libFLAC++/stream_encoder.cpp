@@ -112,6 +112,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_set_blocksize(encoder_, value);
 		}
 
+		bool Stream::set_variable_blocksize(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_variable_blocksize(encoder_, value);
+		}
+
 		bool Stream::set_do_mid_side_stereo(bool value)
 		{
 			FLAC__ASSERT(is_valid());
@@ -124,6 +130,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_set_loose_mid_side_stereo(encoder_, value);
 		}
 
+		bool Stream::set_fast_mid_side_stereo(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_fast_mid_side_stereo(encoder_, value);
+		}
+
 		bool Stream::set_apodization(const char *specification)
 		{
 			FLAC__ASSERT(is_valid());
@@ -184,6 +196,24 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_set_total_samples_estimate(encoder_, value);
 		}
 
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_num_threads(encoder_, value);
+		}
+
+		bool Stream::set_workspace(void *workspace, size_t size)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_workspace(encoder_, workspace, size);
+		}
+
+		bool Stream::set_frame_indexing(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_frame_indexing(encoder_, value);
+		}
+
 		bool Stream::set_metadata(::FLAC__StreamMetadata **metadata, unsigned num_blocks)
 		{
 			FLAC__ASSERT(is_valid());
@@ -257,6 +287,18 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_get_loose_mid_side_stereo(encoder_);
 		}
 
+		bool Stream::get_fast_mid_side_stereo() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_fast_mid_side_stereo(encoder_);
+		}
+
+		void Stream::get_fast_mid_side_stats(FLAC__uint64 *frames, FLAC__uint64 *searched_frames, FLAC__uint64 *missed_frames) const
+		{
+			FLAC__ASSERT(is_valid());
+			::FLAC__stream_encoder_get_fast_mid_side_stats(encoder_, frames, searched_frames, missed_frames);
+		}
+
 		unsigned Stream::get_channels() const
 		{
 			FLAC__ASSERT(is_valid());
@@ -281,6 +323,12 @@ namespace FLAC {
 			return ::FLAC__stream_encoder_get_blocksize(encoder_);
 		}
 
+		bool Stream::get_variable_blocksize() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_variable_blocksize(encoder_);
+		}
+
 		unsigned Stream::get_max_lpc_order() const
 		{
 			FLAC__ASSERT(is_valid());
@@ -335,6 +383,30 @@ namespace FLAC {
 			return ::FLAC__stream_encoder_get_total_samples_estimate(encoder_);
 		}
 
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_encoder_get_num_threads(encoder_);
+		}
+
+		bool Stream::get_frame_indexing() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_frame_indexing(encoder_);
+		}
+
+		size_t Stream::get_workspace_size() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_encoder_get_workspace_size(encoder_);
+		}
+
+		bool Stream::get_frame_index(::FLAC__StreamMetadata **frame_index) const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_frame_index(encoder_, frame_index);
+		}
+
 		::FLAC__StreamEncoderInitStatus Stream::init()
 		{
 			FLAC__ASSERT(is_valid());
@@ -353,6 +425,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_finish(encoder_);
 		}
 
+		bool Stream::recycle()
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_recycle(encoder_);
+		}
+
 		bool Stream::process(const FLAC__int32 * const buffer[], unsigned samples)
 		{
 			FLAC__ASSERT(is_valid());
@@ -36,6 +36,7 @@
 #include <stdlib.h> /* for malloc() */
 #include <string.h> /* for memcpy(), memset() */
 #ifdef _MSC_VER
+# include <intrin.h> /* for _BitScanReverse64() */
 # include <winsock.h> /* for ntohl() */
 # if _MSC_VER >= 1310
 #  include <winsock2.h> /* for ntohl(), sometimes it is not in winsock.h */
@@ -52,10 +53,50 @@
 #include "private/crc.h"
 #include "FLAC/assert.h"
 
+/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
+#ifdef _MSC_VER
+#define FLAC__U64L(x) x
+#else
+#define FLAC__U64L(x) x##LLU
+#endif
+
 /* Things should be fastest when this matches the machine word size */
 /* WATCHOUT: if you change this you must also change the following #defines down to COUNT_ZERO_MSBS below to match */
 /* WATCHOUT: there are a few places where the code will not work unless brword is >= 32 bits wide */
 /*           also, some sections currently only have fast versions for 4 or 8 bytes per word */
+/* WATCHOUT: the ia32 assembly routines only work with 32-bit words */
+#if defined FLAC__CPU_X86_64 || defined FLAC__CPU_ARM64
+typedef FLAC__uint64 brword;
+#define FLAC__BYTES_PER_WORD 8
+#define FLAC__BITS_PER_WORD 64
+#define FLAC__WORD_ALL_ONES ((FLAC__uint64)FLAC__U64L(0xffffffffffffffff))
+/* SWAP_BE_WORD_TO_HOST swaps bytes in a brword (which is always big-endian) if necessary to match host byte order */
+#if WORDS_BIGENDIAN
+#define SWAP_BE_WORD_TO_HOST(x) (x)
+#elif defined _MSC_VER
+#define SWAP_BE_WORD_TO_HOST(x) _byteswap_uint64(x)
+#elif defined __GNUC__
+#define SWAP_BE_WORD_TO_HOST(x) __builtin_bswap64(x)
+#else
+#define SWAP_BE_WORD_TO_HOST(x) local_swap64_(x)
+#endif
+/* counts the # of zero MSBs in a word */
+#if defined __GNUC__
+#define COUNT_ZERO_MSBS(word) ((unsigned)__builtin_clzll(word))
+#elif defined _MSC_VER
+#define COUNT_ZERO_MSBS(word) local_clz64_(word)
+#else
+#define COUNT_ZERO_MSBS(word) ( \
+	(word) <= FLAC__U64L(0xffffffff) ? \
+		( (word) <= 0xffff ? \
+			( (word) <= 0xff? byte_to_unary_table[word] + 56 : byte_to_unary_table[(word) >> 8] + 48 ) : \
+			( (word) <= 0xffffff? byte_to_unary_table[(word) >> 16] + 40 : byte_to_unary_table[(word) >> 24] + 32 ) ) : \
+		( (word) <= FLAC__U64L(0xffffffffffff) ? \
+			( (word) <= FLAC__U64L(0xffffffffff)? byte_to_unary_table[(word) >> 32] + 24 : byte_to_unary_table[(word) >> 40] + 16 ) : \
+			( (word) <= FLAC__U64L(0xffffffffffffff)? byte_to_unary_table[(word) >> 48] + 8 : byte_to_unary_table[(word) >> 56] ) ) \
+)
+#endif
+#else
 typedef FLAC__uint32 brword;
 #define FLAC__BYTES_PER_WORD 4
 #define FLAC__BITS_PER_WORD 32
@@ -71,14 +112,18 @@ typedef FLAC__uint32 brword;
 #endif
 #endif
 /* counts the # of zero MSBs in a word */
+#if defined __GNUC__
+#define COUNT_ZERO_MSBS(word) ((unsigned)__builtin_clz(word))
+#else
 #define COUNT_ZERO_MSBS(word) ( \
 	(word) <= 0xffff ? \
 		( (word) <= 0xff? byte_to_unary_table[word] + 24 : byte_to_unary_table[(word) >> 8] + 16 ) : \
 		( (word) <= 0xffffff? byte_to_unary_table[word >> 16] + 8 : byte_to_unary_table[(word) >> 24] ) \
 )
+#endif
 /* this alternate might be slightly faster on some systems/compilers: */
 #define COUNT_ZERO_MSBS2(word) ( (word) <= 0xff ? byte_to_unary_table[word] + 24 : ((word) <= 0xffff ? byte_to_unary_table[(word) >> 8] + 16 : ((word) <= 0xffffff ? byte_to_unary_table[(word) >> 16] + 8 : byte_to_unary_table[(word) >> 24])) )
-
+#endif
 
 /*
  * This should be at least twice as large as the largest number of words
@@ -96,6 +141,7 @@ typedef FLAC__uint32 brword;
  */
 static const unsigned FLAC__BITREADER_DEFAULT_CAPACITY = 65536u / FLAC__BITS_PER_WORD; /* in words */
 
+#if !defined __GNUC__ && !(FLAC__BYTES_PER_WORD == 8 && defined _MSC_VER)
 static const unsigned char byte_to_unary_table[] = {
 	8, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
 	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
@@ -114,6 +160,7 @@ static const unsigned char byte_to_unary_table[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
+#endif
 
 #ifdef min
 #undef min
@@ -124,13 +171,6 @@ static const unsigned char byte_to_unary_table[] = {
 #endif
 #define max(x,y) ((x)>(y)?(x):(y))
 
-/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
-#ifdef _MSC_VER
-#define FLAC__U64L(x) x
-#else
-#define FLAC__U64L(x) x##LLU
-#endif
-
 #ifndef FLaC__INLINE
 #define FLaC__INLINE
 #endif
@@ -150,8 +190,29 @@ struct FLAC__BitReader {
 	FLAC__BitReaderReadCallback read_callback;
 	void *client_data;
 	FLAC__CPUInfo cpu_info;
+	const FLAC__byte *source; /* if set, bytes are taken straight from here instead of from the read callback... */
+	size_t source_length;
+	size_t *source_position; /* ...starting at *source_position, until the source runs out */
 };
 
+#if FLAC__BYTES_PER_WORD == 8
+#ifdef _MSC_VER
+static _inline unsigned local_clz64_(FLAC__uint64 x)
+{
+	unsigned long idx;
+	_BitScanReverse64(&idx, x);
+	return 63 - (unsigned)idx;
+}
+#elif !defined __GNUC__ && !WORDS_BIGENDIAN
+static FLaC__INLINE FLAC__uint64 local_swap64_(FLAC__uint64 x)
+{
+	x = ((x<<8)&FLAC__U64L(0xFF00FF00FF00FF00)) | ((x>>8)&FLAC__U64L(0x00FF00FF00FF00FF));
+	x = ((x<<16)&FLAC__U64L(0xFFFF0000FFFF0000)) | ((x>>16)&FLAC__U64L(0x0000FFFF0000FFFF));
+	return (x>>32) | (x<<32);
+}
+#endif
+#endif
+
 #ifdef _MSC_VER
 /* OPT: an MSVC built-in would be better */
 /* OPT: use _byteswap_ulong intrinsic? */
@@ -182,32 +243,46 @@ done1:
 #endif
 #endif
 
-static FLaC__INLINE void crc16_update_word_(FLAC__BitReader *br, brword word)
+/* CRCs a whole word at once, slice-by-4 or slice-by-8; kept out of line
+ * so crc16_update_word_() stays small enough to inline */
+static void crc16_update_aligned_word_(FLAC__BitReader *br, brword word)
 {
-	register unsigned crc = br->read_crc16;
+	unsigned crc = br->read_crc16;
 #if FLAC__BYTES_PER_WORD == 4
-	switch(br->crc16_align) {
-		case  0: crc = FLAC__CRC16_UPDATE((unsigned)(word >> 24), crc);
-		case  8: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 16) & 0xff), crc);
-		case 16: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 8) & 0xff), crc);
-		case 24: br->read_crc16 = FLAC__CRC16_UPDATE((unsigned)(word & 0xff), crc);
-	}
+	br->read_crc16 =
+		FLAC__crc16_slice_table[3][(crc >> 8) ^ (unsigned)(word >> 24)] ^
+		FLAC__crc16_slice_table[2][(crc & 0xff) ^ (unsigned)((word >> 16) & 0xff)] ^
+		FLAC__crc16_slice_table[1][(unsigned)((word >> 8) & 0xff)] ^
+		FLAC__crc16_slice_table[0][(unsigned)(word & 0xff)];
 #elif FLAC__BYTES_PER_WORD == 8
-	switch(br->crc16_align) {
-		case  0: crc = FLAC__CRC16_UPDATE((unsigned)(word >> 56), crc);
-		case  8: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 48) & 0xff), crc);
-		case 16: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 40) & 0xff), crc);
-		case 24: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 32) & 0xff), crc);
-		case 32: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 24) & 0xff), crc);
-		case 40: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 16) & 0xff), crc);
-		case 48: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 8) & 0xff), crc);
-		case 56: br->read_crc16 = FLAC__CRC16_UPDATE((unsigned)(word & 0xff), crc);
-	}
+	br->read_crc16 =
+		FLAC__crc16_slice_table[7][(crc >> 8) ^ (unsigned)(word >> 56)] ^
+		FLAC__crc16_slice_table[6][(crc & 0xff) ^ (unsigned)((word >> 48) & 0xff)] ^
+		FLAC__crc16_slice_table[5][(unsigned)((word >> 40) & 0xff)] ^
+		FLAC__crc16_slice_table[4][(unsigned)((word >> 32) & 0xff)] ^
+		FLAC__crc16_slice_table[3][(unsigned)((word >> 24) & 0xff)] ^
+		FLAC__crc16_slice_table[2][(unsigned)((word >> 16) & 0xff)] ^
+		FLAC__crc16_slice_table[1][(unsigned)((word >> 8) & 0xff)] ^
+		FLAC__crc16_slice_table[0][(unsigned)(word & 0xff)];
 #else
+	unsigned align;
+	for(align = 0; align < FLAC__BITS_PER_WORD; align += 8)
+		crc = FLAC__CRC16_UPDATE((unsigned)((word >> (FLAC__BITS_PER_WORD-8-align)) & 0xff), crc);
+	br->read_crc16 = crc;
+#endif
+}
+
+static FLaC__INLINE void crc16_update_word_(FLAC__BitReader *br, brword word)
+{
+	register unsigned crc = br->read_crc16;
+	if(br->crc16_align == 0) {
+		/* the usual case: do the whole word at once */
+		crc16_update_aligned_word_(br, word);
+		return;
+	}
 	for( ; br->crc16_align < FLAC__BITS_PER_WORD; br->crc16_align += 8)
 		crc = FLAC__CRC16_UPDATE((unsigned)((word >> (FLAC__BITS_PER_WORD-8-br->crc16_align)) & 0xff), crc);
 	br->read_crc16 = crc;
-#endif
 	br->crc16_align = 0;
 }
 
@@ -258,8 +333,21 @@ FLAC__bool bitreader_read_from_client_(FLAC__BitReader *br)
 	 */
 
 	/* read in the data; note that the callback may return a smaller number of bytes */
-	if(!br->read_callback(target, &bytes, br->client_data))
+	if(0 != br->source && *br->source_position < br->source_length) {
+		if(bytes > br->source_length - *br->source_position)
+			bytes = br->source_length - *br->source_position;
+		memcpy(target, br->source + *br->source_position, bytes);
+		*br->source_position += bytes;
+	}
+	else if(!br->read_callback(target, &bytes, br->client_data)) {
+		/* put the odd tail word back so the bytes already buffered can still be read */
+#if WORDS_BIGENDIAN
+#else
+		if(br->bytes)
+			br->buffer[br->words] = SWAP_BE_WORD_TO_HOST(br->buffer[br->words]);
+#endif
 		return false;
+	}
 
 	/* after reading bytes 66 77 88 99 AA BB CC DD EE FF from the client:
 	 *   bitstream :  11 22 33 44 55 66 77 88 99 AA BB CC DD EE FF
@@ -312,6 +400,7 @@ FLAC__BitReader *FLAC__bitreader_new(void)
 		br->consumed_words = br->consumed_bits = 0;
 		br->read_callback = 0;
 		br->client_data = 0;
+		br->source = 0;
 	*/
 	return br;
 }
@@ -336,13 +425,17 @@ FLAC__bool FLAC__bitreader_init(FLAC__BitReader *br, FLAC__CPUInfo cpu, FLAC__Bi
 
 	br->words = br->bytes = 0;
 	br->consumed_words = br->consumed_bits = 0;
-	br->capacity = FLAC__BITREADER_DEFAULT_CAPACITY;
-	br->buffer = (brword*)malloc(sizeof(brword) * br->capacity);
-	if(br->buffer == 0)
-		return false;
+	/* a buffer left over from a previous init is reused as is */
+	if(br->buffer == 0) {
+		br->capacity = FLAC__BITREADER_DEFAULT_CAPACITY;
+		br->buffer = (brword*)malloc(sizeof(brword) * br->capacity);
+		if(br->buffer == 0)
+			return false;
+	}
 	br->read_callback = rcb;
 	br->client_data = cd;
 	br->cpu_info = cpu;
+	br->source = 0;
 
 	return true;
 }
@@ -359,6 +452,17 @@ void FLAC__bitreader_free(FLAC__BitReader *br)
 	br->consumed_words = br->consumed_bits = 0;
 	br->read_callback = 0;
 	br->client_data = 0;
+	br->source = 0;
+}
+
+void FLAC__bitreader_set_source(FLAC__BitReader *br, const FLAC__byte *source, size_t length, size_t *position)
+{
+	FLAC__ASSERT(0 != br);
+	FLAC__ASSERT(0 == source || 0 != position);
+
+	br->source = source;
+	br->source_length = length;
+	br->source_position = position;
 }
 
 FLAC__bool FLAC__bitreader_clear(FLAC__BitReader *br)
@@ -383,7 +487,7 @@ void FLAC__bitreader_dump(const FLAC__BitReader *br, FILE *out)
 				if(i < br->consumed_words || (i == br->consumed_words && j < br->consumed_bits))
 					fprintf(out, ".");
 				else
-					fprintf(out, "%01u", br->buffer[i] & (1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
+					fprintf(out, "%01u", br->buffer[i] & ((brword)1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 		if(br->bytes > 0) {
@@ -392,7 +496,7 @@ void FLAC__bitreader_dump(const FLAC__BitReader *br, FILE *out)
 				if(i < br->consumed_words || (i == br->consumed_words && j < br->consumed_bits))
 					fprintf(out, ".");
 				else
-					fprintf(out, "%01u", br->buffer[i] & (1 << (br->bytes*8-j-1)) ? 1:0);
+					fprintf(out, "%01u", br->buffer[i] & ((brword)1 << (br->bytes*8-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 	}
@@ -491,7 +595,7 @@ FLaC__INLINE FLAC__bool FLAC__bitreader_read_raw_uint32(FLAC__BitReader *br, FLA
 				return true;
 			}
 			/* at this point 'bits' must be == FLAC__BITS_PER_WORD; because of previous assertions, it can't be larger */
-			*val = word;
+			*val = (FLAC__uint32)word;
 			crc16_update_word_(br, word);
 			br->consumed_words++;
 			return true;
@@ -646,22 +750,34 @@ FLAC__bool FLAC__bitreader_skip_byte_block_aligned_no_crc(FLAC__BitReader *br, u
 }
 
 FLAC__bool FLAC__bitreader_read_byte_block_aligned_no_crc(FLAC__BitReader *br, FLAC__byte *val, unsigned nvals)
+{
+	unsigned nread;
+	return FLAC__bitreader_read_byte_block_aligned_no_crc_upto(br, val, nvals, &nread);
+}
+
+FLAC__bool FLAC__bitreader_read_byte_block_aligned_no_crc_upto(FLAC__BitReader *br, FLAC__byte *val, unsigned nvals, unsigned *nread)
 {
 	FLAC__uint32 x;
+	const FLAC__byte * const start = val;
+	FLAC__bool at_end_of_input = false;
 
 	FLAC__ASSERT(0 != br);
 	FLAC__ASSERT(0 != br->buffer);
+	FLAC__ASSERT(0 != nread);
 	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(br));
 
+	*nread = 0;
 	/* step 1: read from partial head word to get word aligned */
 	while(nvals && br->consumed_bits) { /* i.e. run until we read 'nvals' bytes or we hit the end of the head word */
 		if(!FLAC__bitreader_read_raw_uint32(br, &x, 8))
-			return false;
+			goto end_of_input;
 		*val++ = (FLAC__byte)x;
 		nvals--;
 	}
-	if(0 == nvals)
+	if(0 == nvals) {
+		*nread = (unsigned)(val - start);
 		return true;
+	}
 	/* step 2: read whole words in chunks */
 	while(nvals >= FLAC__BYTES_PER_WORD) {
 		if(br->consumed_words < br->words) {
@@ -687,18 +803,28 @@ FLAC__bool FLAC__bitreader_read_byte_block_aligned_no_crc(FLAC__BitReader *br, F
 			val += FLAC__BYTES_PER_WORD;
 			nvals -= FLAC__BYTES_PER_WORD;
 		}
-		else if(!bitreader_read_from_client_(br))
-			return false;
+		else if(!bitreader_read_from_client_(br)) {
+			at_end_of_input = true;
+			break;
+		}
 	}
-	/* step 3: read any remainder from partial tail bytes */
+	/* step 3: read any remainder from partial tail bytes; at the end of the input, only those still in the buffer */
 	while(nvals) {
+		if(at_end_of_input && FLAC__bitreader_get_input_bits_unconsumed(br) < 8)
+			goto end_of_input;
 		if(!FLAC__bitreader_read_raw_uint32(br, &x, 8))
-			return false;
+			goto end_of_input;
 		*val++ = (FLAC__byte)x;
 		nvals--;
 	}
 
+	*nread = (unsigned)(val - start);
 	return true;
+
+end_of_input:
+	/* the bytes already in the buffer were all handed out before the read callback failed */
+	*nread = (unsigned)(val - start);
+	return false;
 }
 
 FLAC__bool FLAC__bitreader_read_unary_unsigned(FLAC__BitReader *br, unsigned *val)
@@ -811,9 +937,9 @@ FLAC__bool FLAC__bitreader_read_rice_signed(FLAC__BitReader *br, int *val, unsig
 
 /* this is by far the most heavily used reader call.  it ain't pretty but it's fast */
 /* a lot of the logic is copied, then adapted, from FLAC__bitreader_read_unary_unsigned() and FLAC__bitreader_read_raw_uint32() */
-FLAC__bool FLAC__bitreader_read_rice_signed_block(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
 /* OPT: possibly faster version for use with MSVC */
 #ifdef _MSC_VER
+FLAC__bool FLAC__bitreader_read_rice_signed_block(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
 {
 	unsigned i;
 	unsigned uval = 0;
@@ -996,6 +1122,13 @@ break2:
 	}
 }
 #else
+/* the body is forced inline so that the BMI2 version below gets its own
+ * copy, compiled to use LZCNT and the BMI2 shifts */
+#ifdef __GNUC__
+static FLaC__INLINE __attribute__((__always_inline__)) FLAC__bool read_rice_signed_block_(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
+#else
+static FLaC__INLINE FLAC__bool read_rice_signed_block_(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
+#endif
 {
 	unsigned i;
 	unsigned uval = 0;
@@ -1023,6 +1156,45 @@ break2:
 
 	while(1) {
 
+		/* fast path: as long as the whole codeword (unary part, stop bit
+		 * and binary part) lies inside the current whole word, decode it
+		 * right out of that word.  with 64-bit words and the small
+		 * parameters typical of real residuals this decodes several values
+		 * per word.  anything that straddles a word boundary or runs into
+		 * the partial tail word is left to the general code below.
+		 */
+		while(cwords < br->words) {
+			const brword word = br->buffer[cwords];
+			const brword b = word << cbits;
+			unsigned v;
+			if(!b)
+				break;
+			i = COUNT_ZERO_MSBS(b);
+			if(cbits + i + 1 + parameter > FLAC__BITS_PER_WORD)
+				break;
+			cbits += i + 1; /* skip over unary part and stop bit */
+			v = i;
+			if(parameter) {
+				/* cbits < FLAC__BITS_PER_WORD here since the binary part still fits in the word */
+				v <<= parameter;
+				v |= (unsigned)((word << cbits) >> (FLAC__BITS_PER_WORD-parameter));
+				cbits += parameter;
+			}
+			ucbits -= i + 1 + parameter;
+			if(cbits == FLAC__BITS_PER_WORD) {
+				crc16_update_word_(br, word);
+				cwords++;
+				cbits = 0;
+			}
+			*vals = (int)(v >> 1 ^ -(int)(v & 1));
+			if(--nvals == 0) {
+				br->consumed_bits = cbits;
+				br->consumed_words = cwords;
+				return true;
+			}
+			++vals;
+		}
+
 		/* read unary part */
 		while(1) {
 			while(cwords < br->words) { /* if we've not consumed up to a partial tail word... */
@@ -1182,6 +1354,20 @@ break1:
 
 	}
 }
+
+FLAC__bool FLAC__bitreader_read_rice_signed_block(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
+{
+	return read_rice_signed_block_(br, vals, nvals, parameter);
+}
+
+#ifdef FLAC__X86_64_INTRIN
+/* every CPU with BMI2 also has LZCNT */
+FLAC__INTRIN_TARGET("bmi2,lzcnt")
+FLAC__bool FLAC__bitreader_read_rice_signed_block_bmi2(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
+{
+	return read_rice_signed_block_(br, vals, nvals, parameter);
+}
+#endif
 #endif
 
 #if 0 /* UNUSED */
@@ -186,10 +186,13 @@ FLAC__bool FLAC__bitwriter_init(FLAC__BitWriter *bw)
 	FLAC__ASSERT(0 != bw);
 
 	bw->words = bw->bits = 0;
-	bw->capacity = FLAC__BITWRITER_DEFAULT_CAPACITY;
-	bw->buffer = (bwword*)malloc(sizeof(bwword) * bw->capacity);
-	if(bw->buffer == 0)
-		return false;
+	/* a buffer left over from a previous init is reused as is */
+	if(bw->buffer == 0) {
+		bw->capacity = FLAC__BITWRITER_DEFAULT_CAPACITY;
+		bw->buffer = (bwword*)malloc(sizeof(bwword) * bw->capacity);
+		if(bw->buffer == 0)
+			return false;
+	}
 
 	return true;
 }
@@ -210,6 +213,14 @@ void FLAC__bitwriter_clear(FLAC__BitWriter *bw)
 	bw->words = bw->bits = 0;
 }
 
+FLAC__bool FLAC__bitwriter_reserve(FLAC__BitWriter *bw, unsigned bits)
+{
+	FLAC__ASSERT(0 != bw);
+	FLAC__ASSERT(0 != bw->buffer);
+
+	return bitwriter_grow_(bw, bits);
+}
+
 void FLAC__bitwriter_dump(const FLAC__BitWriter *bw, FILE *out)
 {
 	unsigned i, j;
@@ -34,11 +34,22 @@
 #endif
 
 #include "private/cpu.h"
+#include <stddef.h> /* for offsetof() */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#if defined HAVE_GETAUXVAL && defined HAVE_SYS_AUXV_H
+# include <sys/auxv.h>
+# define FLAC__HAS_GETAUXVAL
+#endif
 
 #if defined FLAC__CPU_IA32
 # include <signal.h>
+#elif defined FLAC__CPU_X86_64
+# if defined __GNUC__
+#  include <cpuid.h>
+# endif
 #elif defined FLAC__CPU_PPC
 # if !defined FLAC__NO_ASM
 #  if defined FLAC__SYS_DARWIN
@@ -50,7 +61,7 @@
 #   ifndef CPU_SUBTYPE_POWERPC_970
 #    define CPU_SUBTYPE_POWERPC_970 ((cpu_subtype_t) 100)
 #   endif
-#  else /* FLAC__SYS_DARWIN */
+#  elif !defined FLAC__HAS_GETAUXVAL
 
 #   include <signal.h>
 #   include <setjmp.h>
@@ -100,6 +111,102 @@ static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_3DNOW = 0x80000000;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_EXT3DNOW = 0x40000000;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_EXTMMX = 0x00400000;
 
+#if defined FLAC__CPU_X86_64 && defined __GNUC__
+/* these are flags in ECX of CPUID AX=00000001 */
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_PCLMUL = 0x00000002;
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_FMA = 0x00001000;
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_SSE41 = 0x00080000;
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_OSXSAVE = 0x08000000;
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_AVX = 0x10000000;
+/* these are flags in EBX of CPUID AX=00000007, CX=00000000 */
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_AVX2 = 0x00000020;
+static const unsigned FLAC__CPUINFO_X86_64_CPUID_BMI2 = 0x00000100;
+/* these are flags in XCR0 */
+static const unsigned FLAC__CPUINFO_X86_64_XCR0_SSE = 0x00000002;
+static const unsigned FLAC__CPUINFO_X86_64_XCR0_AVX = 0x00000004;
+
+/*
+ * Reads extended control register 0, which tells us which register
+ * sets the OS saves on a context switch.  Only call if CPUID says
+ * OSXSAVE is set.
+ */
+static FLAC__uint32 x86_64_xgetbv_(void)
+{
+	FLAC__uint32 lo, hi;
+	__asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	(void)hi;
+	return lo;
+}
+#endif
+
+#if defined FLAC__HAS_GETAUXVAL
+/* these are flags in AT_HWCAP on Linux */
+# if defined FLAC__CPU_PPC
+static const unsigned long FLAC__CPUINFO_PPC_HWCAP_64 = 0x40000000;
+static const unsigned long FLAC__CPUINFO_PPC_HWCAP_ALTIVEC = 0x10000000;
+# elif defined FLAC__CPU_ARM64
+static const unsigned long FLAC__CPUINFO_ARM64_HWCAP_ASIMD = 0x00000002;
+static const unsigned long FLAC__CPUINFO_ARM64_HWCAP_PMULL = 0x00000010;
+static const unsigned long FLAC__CPUINFO_ARM64_HWCAP_CRC32 = 0x00000080;
+# endif
+#endif
+
+/*
+ * Names accepted in FLAC_CPU_DISABLE, and where the corresponding flag
+ * lives in FLAC__CPUInfo.
+ */
+typedef struct {
+	const char *name;
+	FLAC__CPUInfo_Type type;
+	size_t offset;
+} CPUFeatureName;
+
+static const CPUFeatureName cpu_feature_names_[] = {
+	{ "cmov", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.cmov) },
+	{ "bswap", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.bswap) },
+	{ "mmx", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.mmx) },
+	{ "sse", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.sse) },
+	{ "sse2", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.sse2) },
+	{ "sse3", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.sse3) },
+	{ "ssse3", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.ssse3) },
+	{ "3dnow", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32._3dnow) },
+	{ "ext3dnow", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.ext3dnow) },
+	{ "extmmx", FLAC__CPUINFO_TYPE_IA32, offsetof(FLAC__CPUInfo, data.ia32.extmmx) },
+	{ "altivec", FLAC__CPUINFO_TYPE_PPC, offsetof(FLAC__CPUInfo, data.ppc.altivec) },
+	{ "sse2", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.sse2) },
+	{ "sse3", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.sse3) },
+	{ "ssse3", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.ssse3) },
+	{ "sse41", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.sse41) },
+	{ "avx", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.avx) },
+	{ "avx2", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.avx2) },
+	{ "fma", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.fma) },
+	{ "bmi2", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.bmi2) },
+	{ "pclmul", FLAC__CPUINFO_TYPE_X86_64, offsetof(FLAC__CPUInfo, data.x86_64.pclmul) },
+	{ "neon", FLAC__CPUINFO_TYPE_ARM64, offsetof(FLAC__CPUInfo, data.arm64.neon) },
+	{ "crc32", FLAC__CPUINFO_TYPE_ARM64, offsetof(FLAC__CPUInfo, data.arm64.crc32) },
+	{ "pmull", FLAC__CPUINFO_TYPE_ARM64, offsetof(FLAC__CPUInfo, data.arm64.pmull) }
+};
+
+static void cpu_disable_features_(FLAC__CPUInfo *info, const char *list)
+{
+	while(*list) {
+		const size_t len = strcspn(list, ", ");
+		unsigned i;
+		if(len == 3 && 0 == strncmp(list, "asm", 3))
+			info->use_asm = false;
+		for(i = 0; i < sizeof(cpu_feature_names_)/sizeof(cpu_feature_names_[0]); i++) {
+			if(cpu_feature_names_[i].type == info->type && strlen(cpu_feature_names_[i].name) == len && 0 == strncmp(list, cpu_feature_names_[i].name, len))
+				*(FLAC__bool*)((char*)info + cpu_feature_names_[i].offset) = false;
+		}
+		list += len;
+		if(*list)
+			list++;
+	}
+	/* the AVX extensions can't be used without AVX itself */
+	if(info->type == FLAC__CPUINFO_TYPE_X86_64 && !info->data.x86_64.avx)
+		info->data.x86_64.avx2 = info->data.x86_64.fma = false;
+}
+
 
 /*
  * Extra stuff needed for detection of OS support for SSE on IA-32
@@ -366,9 +473,15 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 
 		info->data.ppc.ppc64 = (hostInfo.cpu_type == CPU_TYPE_POWERPC) && (hostInfo.cpu_subtype == CPU_SUBTYPE_POWERPC_970);
 	}
-#   else /* FLAC__USE_ALTIVEC && !FLAC__SYS_DARWIN */
+#   elif defined FLAC__HAS_GETAUXVAL
 	{
-		/* no Darwin, do it the brute-force way */
+		const unsigned long hwcap = getauxval(AT_HWCAP);
+		info->data.ppc.altivec = (hwcap & FLAC__CPUINFO_PPC_HWCAP_ALTIVEC)? true : false;
+		info->data.ppc.ppc64 = (hwcap & FLAC__CPUINFO_PPC_HWCAP_64)? true : false;
+	}
+#   else /* FLAC__USE_ALTIVEC && !FLAC__SYS_DARWIN && !FLAC__HAS_GETAUXVAL */
+	{
+		/* no Darwin or getauxval(), do it the brute-force way */
 		/* @@@@@@ this is not thread-safe; replace with SSE OS method above or remove */
 		info->data.ppc.altivec = 0;
 		info->data.ppc.ppc64 = 0;
@@ -408,6 +521,103 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 	info->use_asm = false;
 # endif
 
+/*
+ * x86_64-specific
+ */
+#elif defined FLAC__CPU_X86_64
+	info->type = FLAC__CPUINFO_TYPE_X86_64;
+# if defined FLAC__X86_64_INTRIN
+	info->use_asm = true;
+# else
+	info->use_asm = false;
+# endif
+	/* SSE2 is part of the x86_64 baseline; everything else must be asked for */
+	info->data.x86_64.sse2 = true;
+	info->data.x86_64.sse3 = false;
+	info->data.x86_64.ssse3 = false;
+	info->data.x86_64.sse41 = false;
+	info->data.x86_64.avx = false;
+	info->data.x86_64.avx2 = false;
+	info->data.x86_64.fma = false;
+	info->data.x86_64.bmi2 = false;
+	info->data.x86_64.pclmul = false;
+# if defined __GNUC__
+	{
+		unsigned max_level, eax, ebx, ecx, edx;
+		max_level = __get_cpuid_max(0, 0);
+		if(max_level >= 1) {
+			__cpuid_count(1, 0, eax, ebx, ecx, edx);
+			info->data.x86_64.sse3  = (ecx & FLAC__CPUINFO_IA32_CPUID_SSE3 )? true : false;
+			info->data.x86_64.ssse3 = (ecx & FLAC__CPUINFO_IA32_CPUID_SSSE3)? true : false;
+			info->data.x86_64.sse41 = (ecx & FLAC__CPUINFO_X86_64_CPUID_SSE41)? true : false;
+			info->data.x86_64.pclmul = (ecx & FLAC__CPUINFO_X86_64_CPUID_PCLMUL)? true : false;
+			/*
+			 * AVX registers are only usable if the OS saves the upper
+			 * halves of the YMM registers on a context switch
+			 */
+			if((ecx & FLAC__CPUINFO_X86_64_CPUID_OSXSAVE) && (ecx & FLAC__CPUINFO_X86_64_CPUID_AVX)) {
+				const FLAC__uint32 xcr0 = x86_64_xgetbv_();
+				info->data.x86_64.avx = ((xcr0 & (FLAC__CPUINFO_X86_64_XCR0_SSE | FLAC__CPUINFO_X86_64_XCR0_AVX)) == (FLAC__CPUINFO_X86_64_XCR0_SSE | FLAC__CPUINFO_X86_64_XCR0_AVX))? true : false;
+			}
+			info->data.x86_64.fma = (info->data.x86_64.avx && (ecx & FLAC__CPUINFO_X86_64_CPUID_FMA))? true : false;
+		}
+		if(max_level >= 7) {
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			info->data.x86_64.avx2 = (info->data.x86_64.avx && (ebx & FLAC__CPUINFO_X86_64_CPUID_AVX2))? true : false;
+			info->data.x86_64.bmi2 = (ebx & FLAC__CPUINFO_X86_64_CPUID_BMI2)? true : false;
+		}
+	}
+# endif
+#ifdef DEBUG
+	fprintf(stderr, "CPU info (x86-64):\n");
+	fprintf(stderr, "  SSE2 ....... %c\n", info->data.x86_64.sse2 ? 'Y' : 'n');
+	fprintf(stderr, "  SSE3 ....... %c\n", info->data.x86_64.sse3 ? 'Y' : 'n');
+	fprintf(stderr, "  SSSE3 ...... %c\n", info->data.x86_64.ssse3? 'Y' : 'n');
+	fprintf(stderr, "  SSE4.1 ..... %c\n", info->data.x86_64.sse41? 'Y' : 'n');
+	fprintf(stderr, "  AVX ........ %c\n", info->data.x86_64.avx  ? 'Y' : 'n');
+	fprintf(stderr, "  AVX2 ....... %c\n", info->data.x86_64.avx2 ? 'Y' : 'n');
+	fprintf(stderr, "  FMA ........ %c\n", info->data.x86_64.fma  ? 'Y' : 'n');
+	fprintf(stderr, "  BMI2 ....... %c\n", info->data.x86_64.bmi2 ? 'Y' : 'n');
+	fprintf(stderr, "  PCLMUL ..... %c\n", info->data.x86_64.pclmul? 'Y' : 'n');
+#endif
+
+/*
+ * AArch64-specific
+ */
+#elif defined FLAC__CPU_ARM64
+	info->type = FLAC__CPUINFO_TYPE_ARM64;
+# if !defined FLAC__NO_ASM
+	info->use_asm = true;
+# else
+	info->use_asm = false;
+# endif
+	/* NEON is part of the AArch64 baseline but the kernel can still tell us otherwise */
+	info->data.arm64.neon = true;
+# if defined __ARM_FEATURE_CRC32
+	info->data.arm64.crc32 = true;
+# else
+	info->data.arm64.crc32 = false;
+# endif
+# if defined __ARM_FEATURE_CRYPTO || defined __ARM_FEATURE_AES
+	info->data.arm64.pmull = true;
+# else
+	info->data.arm64.pmull = false;
+# endif
+# if defined FLAC__HAS_GETAUXVAL
+	{
+		const unsigned long hwcap = getauxval(AT_HWCAP);
+		info->data.arm64.neon = (hwcap & FLAC__CPUINFO_ARM64_HWCAP_ASIMD)? true : false;
+		info->data.arm64.crc32 = (hwcap & FLAC__CPUINFO_ARM64_HWCAP_CRC32)? true : false;
+		info->data.arm64.pmull = (hwcap & FLAC__CPUINFO_ARM64_HWCAP_PMULL)? true : false;
+	}
+# endif
+#ifdef DEBUG
+	fprintf(stderr, "CPU info (AArch64):\n");
+	fprintf(stderr, "  NEON ....... %c\n", info->data.arm64.neon ? 'Y' : 'n');
+	fprintf(stderr, "  CRC32 ...... %c\n", info->data.arm64.crc32? 'Y' : 'n');
+	fprintf(stderr, "  PMULL ...... %c\n", info->data.arm64.pmull? 'Y' : 'n');
+#endif
+
 /*
  * unknown CPI
  */
@@ -415,4 +625,10 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 	info->type = FLAC__CPUINFO_TYPE_UNKNOWN;
 	info->use_asm = false;
 #endif
+
+	{
+		const char *disable = getenv("FLAC_CPU_DISABLE");
+		if(0 != disable)
+			cpu_disable_features_(info, disable);
+	}
 }
@@ -0,0 +1,110 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__ARM64_PMULL
+
+#include <arm_neon.h>
+#include <string.h> /* for memcpy() */
+#include "private/crc.h"
+
+/*
+ * This is the PMULL version of FLAC__crc16_intrin_pclmul() in
+ * crc_intrin_pclmul.c; see there for how the folding works.  Vectors
+ * are kept with the first message byte in the most significant byte of
+ * lane 1, i.e. as one big-endian 128-bit number.
+ */
+
+static uint64x2_t load_be_(const FLAC__byte *data)
+{
+	const uint8x16_t x = vrev64q_u8(vld1q_u8(data));
+	return vreinterpretq_u64_u8(vextq_u8(x, x, 8));
+}
+
+static void store_be_(FLAC__byte *data, uint64x2_t x)
+{
+	const uint8x16_t y = vrev64q_u8(vreinterpretq_u8_u64(x));
+	vst1q_u8(data, vextq_u8(y, y, 8));
+}
+
+static uint64x2_t fold_(uint64x2_t x, poly64_t k_hi, poly64_t k_lo, uint64x2_t next)
+{
+	const uint64x2_t hi = vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x, 1), k_hi));
+	const uint64x2_t lo = vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x, 0), k_lo));
+	return veorq_u64(veorq_u64(next, hi), lo);
+}
+
+unsigned FLAC__crc16_intrin_neon_pmull(const FLAC__byte *data, unsigned len)
+{
+	uint64x2_t x0, x1, x2, x3;
+	FLAC__byte tail[32];
+
+	if(len < 128)
+		return FLAC__crc16(data, len);
+
+	x0 = load_be_(data+ 0);
+	x1 = load_be_(data+16);
+	x2 = load_be_(data+32);
+	x3 = load_be_(data+48);
+	data += 64;
+	len -= 64;
+
+	while(len >= 64) {
+		x0 = fold_(x0, 0x1446, 0x8107, load_be_(data+ 0));
+		x1 = fold_(x1, 0x1446, 0x8107, load_be_(data+16));
+		x2 = fold_(x2, 0x1446, 0x8107, load_be_(data+32));
+		x3 = fold_(x3, 0x1446, 0x8107, load_be_(data+48));
+		data += 64;
+		len -= 64;
+	}
+
+	x1 = fold_(x0, 0x1666, 0x0106, x1);
+	x2 = fold_(x1, 0x1666, 0x0106, x2);
+	x3 = fold_(x2, 0x1666, 0x0106, x3);
+
+	while(len >= 16) {
+		x3 = fold_(x3, 0x1666, 0x0106, load_be_(data));
+		data += 16;
+		len -= 16;
+	}
+
+	store_be_(tail, x3);
+	memcpy(tail+16, data, len);
+	return FLAC__crc16(tail, 16+len);
+}
+
+#endif /* FLAC__ARM64_PMULL */
@@ -0,0 +1,106 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+
+#include <immintrin.h>
+#include <string.h> /* for memcpy() */
+#include "private/crc.h"
+
+/*
+ * CRC-16 by carry-less multiplication.  The message is treated as one
+ * big polynomial, most significant bit first, and since init = 0 the
+ * CRC only depends on that polynomial modulo P = x^16 + x^15 + x^2 + 1.
+ * A 128-bit block X that is followed by D more bits of message can be
+ * replaced by
+ *   hi(X) * (x^(D+64) mod P) + lo(X) * (x^D mod P)
+ * which is congruent and fits in 80 bits, and added to the block D bits
+ * further on.  Four blocks are folded at a time 512 bits ahead, then
+ * folded into each other, and the 16 bytes that are left plus the tail
+ * go through the table version.
+ *
+ * The constants are x^128, x^192, x^512 and x^576 modulo P.
+ */
+
+#define FOLD_(x, k, next) _mm_xor_si128(_mm_xor_si128(next, _mm_clmulepi64_si128(x, k, 0x11)), _mm_clmulepi64_si128(x, k, 0x00))
+
+FLAC__INTRIN_TARGET("pclmul,ssse3")
+unsigned FLAC__crc16_intrin_pclmul(const FLAC__byte *data, unsigned len)
+{
+	/* byte-reverses a 16-byte load so that the first byte ends up in the most significant bits */
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k128 = _mm_set_epi32(0, 0x1666, 0, 0x0106);
+	const __m128i k512 = _mm_set_epi32(0, 0x1446, 0, 0x8107);
+	__m128i x0, x1, x2, x3;
+	FLAC__byte tail[32];
+
+	if(len < 128)
+		return FLAC__crc16(data, len);
+
+	x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+ 0)), bswap);
+	x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+16)), bswap);
+	x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+32)), bswap);
+	x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+48)), bswap);
+	data += 64;
+	len -= 64;
+
+	while(len >= 64) {
+		x0 = FOLD_(x0, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+ 0)), bswap));
+		x1 = FOLD_(x1, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+16)), bswap));
+		x2 = FOLD_(x2, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+32)), bswap));
+		x3 = FOLD_(x3, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data+48)), bswap));
+		data += 64;
+		len -= 64;
+	}
+
+	x1 = FOLD_(x0, k128, x1);
+	x2 = FOLD_(x1, k128, x2);
+	x3 = FOLD_(x2, k128, x3);
+
+	while(len >= 16) {
+		x3 = FOLD_(x3, k128, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), bswap));
+		data += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i*)tail, _mm_shuffle_epi8(x3, bswap));
+	memcpy(tail+16, data, len);
+	return FLAC__crc16(tail, 16+len);
+}
+
+#endif /* FLAC__X86_64_INTRIN */
@@ -0,0 +1,231 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "FLAC/assert.h"
+#include "private/bitreader.h"
+#include "private/crc.h"
+#include "private/dispatch.h"
+#include "private/fixed.h"
+#include "private/lpc.h"
+#include "private/stream_encoder.h"
+
+void FLAC__cpu_dispatch(const FLAC__CPUInfo *info, FLAC__CPUDispatch *dispatch)
+{
+	FLAC__ASSERT(0 != info);
+	FLAC__ASSERT(0 != dispatch);
+
+	/* first default to the non-asm routines */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	dispatch->lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation;
+	dispatch->lpc_compute_autocorrelation_windowed = 0;
+	dispatch->lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients;
+	dispatch->lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide;
+	dispatch->lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients;
+#endif
+	dispatch->fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor;
+	dispatch->fixed_compute_best_predictor_wide = FLAC__fixed_compute_best_predictor_wide;
+	dispatch->fixed_compute_total_errors = FLAC__fixed_compute_total_errors;
+	dispatch->fixed_compute_residual = FLAC__fixed_compute_residual;
+	dispatch->fixed_restore_signal = FLAC__fixed_restore_signal;
+	dispatch->lpc_restore_signal = FLAC__lpc_restore_signal;
+	dispatch->lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide;
+	dispatch->lpc_restore_signal_16bit = FLAC__lpc_restore_signal;
+	dispatch->lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal;
+	dispatch->bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block;
+	dispatch->crc16 = FLAC__crc16;
+	dispatch->precompute_partition_info_sums = FLAC__precompute_partition_info_sums;
+	dispatch->precompute_partition_info_escapes = FLAC__precompute_partition_info_escapes;
+	dispatch->count_rice_msbs = FLAC__count_rice_msbs;
+
+	/* now override with asm where appropriate */
+#ifndef FLAC__NO_ASM
+	if(!info->use_asm)
+		return;
+#ifdef FLAC__CPU_IA32
+	FLAC__ASSERT(info->type == FLAC__CPUINFO_TYPE_IA32);
+#ifdef FLAC__HAS_NASM
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(info->data.ia32.sse) {
+		dispatch->lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_4;
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_8;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_12;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+	}
+	else if(info->data.ia32._3dnow) {
+		dispatch->lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+		dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
+	}
+	else {
+		dispatch->lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_asm_ia32;
+	}
+	dispatch->lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
+	if(info->data.ia32.mmx)
+		dispatch->lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32_mmx;
+	else
+		dispatch->lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
+	if(info->data.ia32.mmx && info->data.ia32.cmov)
+		dispatch->fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_asm_ia32_mmx_cmov;
+#endif
+#if 1 /*@@@@@@ OPT: not clearly faster, needs more testing */
+	if(info->data.ia32.bswap)
+		dispatch->bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block_asm_ia32_bswap;
+#endif
+	dispatch->lpc_restore_signal = FLAC__lpc_restore_signal_asm_ia32;
+	if(info->data.ia32.mmx) {
+		dispatch->lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ia32_mmx;
+		dispatch->lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ia32_mmx;
+	}
+	else {
+		dispatch->lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ia32;
+		dispatch->lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ia32;
+	}
+#endif /* FLAC__HAS_NASM */
+#elif defined FLAC__CPU_PPC
+	FLAC__ASSERT(info->type == FLAC__CPUINFO_TYPE_PPC);
+	if(info->data.ppc.altivec) {
+		dispatch->lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ppc_altivec_16;
+		dispatch->lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ppc_altivec_16_order8;
+	}
+#elif defined FLAC__X86_64_INTRIN
+	FLAC__ASSERT(info->type == FLAC__CPUINFO_TYPE_X86_64);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(info->data.x86_64.sse2) {
+		dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation_intrin_sse2_lag_4;
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_intrin_sse2_lag_8;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_intrin_sse2_lag_12;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_intrin_sse2_lag_16;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_intrin_sse2_lag_32;
+		dispatch->lpc_compute_autocorrelation_windowed = FLAC__lpc_compute_autocorrelation_windowed_intrin_sse2;
+		dispatch->fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_intrin_sse2;
+		dispatch->fixed_compute_best_predictor_wide = FLAC__fixed_compute_best_predictor_wide_intrin_sse2;
+	}
+	if(info->data.x86_64.avx2) {
+		/* for lag <= 4 the 8-wide version is no faster, both are limited by the latency of the adds */
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_8;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_32;
+		dispatch->lpc_compute_autocorrelation_windowed = FLAC__lpc_compute_autocorrelation_windowed_intrin_avx2;
+		dispatch->lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2;
+		dispatch->lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2;
+		dispatch->lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2;
+		dispatch->fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_intrin_avx2;
+		dispatch->fixed_compute_best_predictor_wide = FLAC__fixed_compute_best_predictor_wide_intrin_avx2;
+	}
+	else if(info->data.x86_64.sse41) {
+		dispatch->lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41;
+		dispatch->lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41;
+		dispatch->lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41;
+	}
+#endif
+	if(info->data.x86_64.avx2) {
+		dispatch->fixed_compute_total_errors = FLAC__fixed_compute_total_errors_intrin_avx2;
+		dispatch->fixed_compute_residual = FLAC__fixed_compute_residual_intrin_avx2;
+	}
+	else if(info->data.x86_64.sse2) {
+		dispatch->fixed_compute_total_errors = FLAC__fixed_compute_total_errors_intrin_sse2;
+		dispatch->fixed_compute_residual = FLAC__fixed_compute_residual_intrin_sse2;
+	}
+	/* there is no AVX2 version; see fixed_intrin_avx2.c */
+	if(info->data.x86_64.sse2)
+		dispatch->fixed_restore_signal = FLAC__fixed_restore_signal_intrin_sse2;
+	if(info->data.x86_64.bmi2)
+		dispatch->bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block_bmi2;
+	if(info->data.x86_64.pclmul && info->data.x86_64.ssse3)
+		dispatch->crc16 = FLAC__crc16_intrin_pclmul;
+	if(info->data.x86_64.avx2) {
+		dispatch->precompute_partition_info_sums = FLAC__precompute_partition_info_sums_intrin_avx2;
+		dispatch->precompute_partition_info_escapes = FLAC__precompute_partition_info_escapes_intrin_avx2;
+		dispatch->count_rice_msbs = FLAC__count_rice_msbs_intrin_avx2;
+	}
+	else if(info->data.x86_64.sse41) {
+		dispatch->precompute_partition_info_sums = FLAC__precompute_partition_info_sums_intrin_sse41;
+		dispatch->precompute_partition_info_escapes = FLAC__precompute_partition_info_escapes_intrin_sse41;
+		dispatch->count_rice_msbs = FLAC__count_rice_msbs_intrin_sse41;
+	}
+	/* AVX2 has nothing to add here; the restore loops are limited by the sample-to-sample dependency */
+	if(info->data.x86_64.sse41) {
+		dispatch->lpc_restore_signal = FLAC__lpc_restore_signal_intrin_sse41;
+		dispatch->lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide_intrin_sse41;
+		dispatch->lpc_restore_signal_16bit = FLAC__lpc_restore_signal_intrin_sse41;
+		dispatch->lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_intrin_sse41;
+	}
+#elif defined FLAC__ARM64_NEON
+	FLAC__ASSERT(info->type == FLAC__CPUINFO_TYPE_ARM64);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(info->data.arm64.neon) {
+		dispatch->lpc_compute_autocorrelation_lag_4 = FLAC__lpc_compute_autocorrelation_intrin_neon_lag_4;
+		dispatch->lpc_compute_autocorrelation_lag_8 = FLAC__lpc_compute_autocorrelation_intrin_neon_lag_8;
+		dispatch->lpc_compute_autocorrelation_lag_12 = FLAC__lpc_compute_autocorrelation_intrin_neon_lag_12;
+		dispatch->lpc_compute_autocorrelation_lag_16 = FLAC__lpc_compute_autocorrelation_intrin_neon_lag_16;
+		dispatch->lpc_compute_autocorrelation_lag_32 = FLAC__lpc_compute_autocorrelation_intrin_neon_lag_32;
+		dispatch->lpc_compute_autocorrelation_windowed = FLAC__lpc_compute_autocorrelation_windowed_intrin_neon;
+		dispatch->fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_intrin_neon;
+		dispatch->fixed_compute_best_predictor_wide = FLAC__fixed_compute_best_predictor_wide_intrin_neon;
+	}
+#endif
+	if(info->data.arm64.neon) {
+		dispatch->fixed_compute_total_errors = FLAC__fixed_compute_total_errors_intrin_neon;
+		dispatch->fixed_compute_residual = FLAC__fixed_compute_residual_intrin_neon;
+		dispatch->fixed_restore_signal = FLAC__fixed_restore_signal_intrin_neon;
+		dispatch->precompute_partition_info_sums = FLAC__precompute_partition_info_sums_intrin_neon;
+		dispatch->precompute_partition_info_escapes = FLAC__precompute_partition_info_escapes_intrin_neon;
+		dispatch->count_rice_msbs = FLAC__count_rice_msbs_intrin_neon;
+	}
+#ifdef FLAC__ARM64_PMULL
+	if(info->data.arm64.pmull)
+		dispatch->crc16 = FLAC__crc16_intrin_neon_pmull;
+#endif
+#endif
+#else
+	(void)info;
+#endif /* !FLAC__NO_ASM */
+}
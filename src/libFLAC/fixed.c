@@ -349,6 +349,57 @@ unsigned FLAC__fixed_compute_best_predictor_wide(const FLAC__int32 data[], unsig
 	return order;
 }
 
+void FLAC__fixed_compute_total_errors(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1])
+{
+	FLAC__int32 last_error_0 = data[-1];
+	FLAC__int32 last_error_1 = data[-1] - data[-2];
+	FLAC__int32 last_error_2 = last_error_1 - (data[-2] - data[-3]);
+	FLAC__int32 last_error_3 = last_error_2 - (data[-2] - 2*data[-3] + data[-4]);
+	FLAC__int32 error, save;
+	FLAC__uint64 total_error_0 = 0, total_error_1 = 0, total_error_2 = 0, total_error_3 = 0, total_error_4 = 0;
+	unsigned i;
+
+	for(i = 0; i < data_len; i++) {
+		error  = data[i]     ; total_error_0 += local_abs(error);                      save = error;
+		error -= last_error_0; total_error_1 += local_abs(error); last_error_0 = save; save = error;
+		error -= last_error_1; total_error_2 += local_abs(error); last_error_1 = save; save = error;
+		error -= last_error_2; total_error_3 += local_abs(error); last_error_2 = save; save = error;
+		error -= last_error_3; total_error_4 += local_abs(error); last_error_3 = save;
+	}
+
+	total_error[0] = total_error_0;
+	total_error[1] = total_error_1;
+	total_error[2] = total_error_2;
+	total_error[3] = total_error_3;
+	total_error[4] = total_error_4;
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+unsigned FLAC__fixed_compute_best_predictor_from_total_errors(const FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+#else
+unsigned FLAC__fixed_compute_best_predictor_from_total_errors(const FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+#endif
+{
+	unsigned i, order = 0;
+
+	/* the same choice as FLAC__fixed_compute_best_predictor(): the highest order with the smallest error */
+	for(i = 1; i <= FLAC__MAX_FIXED_ORDER; i++) {
+		if(total_error[i] <= total_error[order])
+			order = i;
+	}
+
+	for(i = 0; i <= FLAC__MAX_FIXED_ORDER; i++) {
+		FLAC__ASSERT(data_len > 0 || total_error[i] == 0);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+		residual_bits_per_sample[i] = (FLAC__float)((total_error[i] > 0) ? log(M_LN2 * (FLAC__double)(FLAC__int64)total_error[i] / (FLAC__double)data_len) / M_LN2 : 0.0);
+#else
+		residual_bits_per_sample[i] = (total_error[i] > 0) ? local__compute_rbps_wide_integerized(total_error[i], data_len) : 0;
+#endif
+	}
+
+	return order;
+}
+
 void FLAC__fixed_compute_residual(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[])
 {
 	const int idata_len = (int)data_len;
@@ -0,0 +1,203 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+
+#include <immintrin.h>
+#include <string.h> /* for memcpy() */
+#include "FLAC/assert.h"
+#include "private/fixed.h"
+
+/*
+ * These are the AVX2 versions of the routines in fixed_intrin_sse2.c;
+ * see there for the details.  They handle 8 samples per iteration.
+ * There is no AVX2 version of FLAC__fixed_restore_signal() since the
+ * running sums would have to cross the two 128-bit halves of the
+ * vectors, which costs more than it saves.
+ */
+
+#define FIXED_ERRORS_(data, i) \
+	const __m256i d0 = _mm256_loadu_si256((const __m256i*)(data+i)); \
+	const __m256i d1 = _mm256_loadu_si256((const __m256i*)(data+i-1)); \
+	const __m256i d2 = _mm256_loadu_si256((const __m256i*)(data+i-2)); \
+	const __m256i d3 = _mm256_loadu_si256((const __m256i*)(data+i-3)); \
+	const __m256i d4 = _mm256_loadu_si256((const __m256i*)(data+i-4)); \
+	const __m256i e1 = _mm256_sub_epi32(d0, d1), f1 = _mm256_sub_epi32(d1, d2), g1 = _mm256_sub_epi32(d2, d3), h1 = _mm256_sub_epi32(d3, d4); \
+	const __m256i e2 = _mm256_sub_epi32(e1, f1), f2 = _mm256_sub_epi32(f1, g1), g2 = _mm256_sub_epi32(g1, h1); \
+	const __m256i e3 = _mm256_sub_epi32(e2, f2), f3 = _mm256_sub_epi32(f2, g2); \
+	const __m256i e4 = _mm256_sub_epi32(e3, f3);
+
+FLAC__INTRIN_TARGET("avx2")
+static __inline FLAC__uint32 hsum_epi32_(__m256i x)
+{
+	__m128i y = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+	y = _mm_add_epi32(y, _mm_shuffle_epi32(y, _MM_SHUFFLE(1,0,3,2)));
+	y = _mm_add_epi32(y, _mm_shuffle_epi32(y, _MM_SHUFFLE(2,3,0,1)));
+	return (FLAC__uint32)_mm_cvtsi128_si32(y);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+static __inline FLAC__uint64 hsum_epi64_(__m256i x)
+{
+	__m128i y = _mm_add_epi64(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+	y = _mm_add_epi64(y, _mm_unpackhi_epi64(y, y));
+	return (FLAC__uint64)_mm_cvtsi128_si64(y);
+}
+
+/* adds the 8 unsigned 32-bit lanes of x to the 4 64-bit lanes of acc */
+FLAC__INTRIN_TARGET("avx2")
+static __inline __m256i add_epu32_epi64_(__m256i acc, __m256i x)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	return _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_unpacklo_epi32(x, zero), _mm256_unpackhi_epi32(x, zero)));
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+FLAC__INTRIN_TARGET("avx2")
+unsigned FLAC__fixed_compute_best_predictor_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256(), acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256(), acc4 = _mm256_setzero_si256();
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+	unsigned i;
+
+	for(i = 0; i + 8 <= data_len; i += 8) {
+		FIXED_ERRORS_(data, i)
+		acc0 = _mm256_add_epi32(acc0, _mm256_abs_epi32(d0));
+		acc1 = _mm256_add_epi32(acc1, _mm256_abs_epi32(e1));
+		acc2 = _mm256_add_epi32(acc2, _mm256_abs_epi32(e2));
+		acc3 = _mm256_add_epi32(acc3, _mm256_abs_epi32(e3));
+		acc4 = _mm256_add_epi32(acc4, _mm256_abs_epi32(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	/* the sums wrap at 32 bits just like in FLAC__fixed_compute_best_predictor() */
+	total_error[0] = (FLAC__uint32)(hsum_epi32_(acc0) + (FLAC__uint32)total_error[0]);
+	total_error[1] = (FLAC__uint32)(hsum_epi32_(acc1) + (FLAC__uint32)total_error[1]);
+	total_error[2] = (FLAC__uint32)(hsum_epi32_(acc2) + (FLAC__uint32)total_error[2]);
+	total_error[3] = (FLAC__uint32)(hsum_epi32_(acc3) + (FLAC__uint32)total_error[3]);
+	total_error[4] = (FLAC__uint32)(hsum_epi32_(acc4) + (FLAC__uint32)total_error[4]);
+
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+
+	FLAC__fixed_compute_total_errors_intrin_avx2(data, data_len, total_error);
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+#endif
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__fixed_compute_total_errors_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1])
+{
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256(), acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256(), acc4 = _mm256_setzero_si256();
+	unsigned i;
+
+	for(i = 0; i + 8 <= data_len; i += 8) {
+		FIXED_ERRORS_(data, i)
+		acc0 = add_epu32_epi64_(acc0, _mm256_abs_epi32(d0));
+		acc1 = add_epu32_epi64_(acc1, _mm256_abs_epi32(e1));
+		acc2 = add_epu32_epi64_(acc2, _mm256_abs_epi32(e2));
+		acc3 = add_epu32_epi64_(acc3, _mm256_abs_epi32(e3));
+		acc4 = add_epu32_epi64_(acc4, _mm256_abs_epi32(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	total_error[0] += hsum_epi64_(acc0);
+	total_error[1] += hsum_epi64_(acc1);
+	total_error[2] += hsum_epi64_(acc2);
+	total_error[3] += hsum_epi64_(acc3);
+	total_error[4] += hsum_epi64_(acc4);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__fixed_compute_residual_intrin_avx2(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[])
+{
+	unsigned i = 0;
+
+	switch(order) {
+		case 0:
+			FLAC__ASSERT(sizeof(residual[0]) == sizeof(data[0]));
+			memcpy(residual, data, sizeof(residual[0])*data_len);
+			return;
+		case 1:
+			for( ; i + 8 <= data_len; i += 8) {
+				const __m256i d0 = _mm256_loadu_si256((const __m256i*)(data+i));
+				const __m256i d1 = _mm256_loadu_si256((const __m256i*)(data+i-1));
+				_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(d0, d1));
+			}
+			break;
+		case 2:
+			for( ; i + 8 <= data_len; i += 8) {
+				const __m256i d0 = _mm256_loadu_si256((const __m256i*)(data+i));
+				const __m256i d1 = _mm256_loadu_si256((const __m256i*)(data+i-1));
+				const __m256i d2 = _mm256_loadu_si256((const __m256i*)(data+i-2));
+				_mm256_storeu_si256((__m256i*)(residual+i), _mm256_add_epi32(_mm256_sub_epi32(d0, _mm256_slli_epi32(d1, 1)), d2));
+			}
+			break;
+		case 3:
+			for( ; i + 8 <= data_len; i += 8) {
+				const __m256i d0 = _mm256_loadu_si256((const __m256i*)(data+i));
+				const __m256i d1 = _mm256_loadu_si256((const __m256i*)(data+i-1));
+				const __m256i d2 = _mm256_loadu_si256((const __m256i*)(data+i-2));
+				const __m256i d3 = _mm256_loadu_si256((const __m256i*)(data+i-3));
+				const __m256i t = _mm256_sub_epi32(d1, d2);
+				_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_sub_epi32(d0, _mm256_add_epi32(_mm256_slli_epi32(t, 1), t)), d3));
+			}
+			break;
+		case 4:
+			for( ; i + 8 <= data_len; i += 8) {
+				const __m256i d0 = _mm256_loadu_si256((const __m256i*)(data+i));
+				const __m256i d1 = _mm256_loadu_si256((const __m256i*)(data+i-1));
+				const __m256i d2 = _mm256_loadu_si256((const __m256i*)(data+i-2));
+				const __m256i d3 = _mm256_loadu_si256((const __m256i*)(data+i-3));
+				const __m256i d4 = _mm256_loadu_si256((const __m256i*)(data+i-4));
+				const __m256i t = _mm256_add_epi32(_mm256_slli_epi32(d2, 2), _mm256_slli_epi32(d2, 1));
+				_mm256_storeu_si256((__m256i*)(residual+i), _mm256_add_epi32(_mm256_add_epi32(_mm256_sub_epi32(d0, _mm256_slli_epi32(_mm256_add_epi32(d1, d3), 2)), t), d4));
+			}
+			break;
+		default:
+			FLAC__ASSERT(0);
+			return;
+	}
+	FLAC__fixed_compute_residual(data+i, data_len-i, order, residual+i);
+}
+
+#endif
@@ -0,0 +1,221 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__ARM64_NEON
+
+#include <arm_neon.h>
+#include <string.h> /* for memcpy() */
+#include "FLAC/assert.h"
+#include "private/fixed.h"
+
+/*
+ * These are the NEON versions of the routines in fixed_intrin_sse2.c;
+ * see there for the details.  They handle 4 samples per iteration.
+ */
+
+#define FIXED_ERRORS_(data, i) \
+	const int32x4_t d0 = vld1q_s32(data+i); \
+	const int32x4_t d1 = vld1q_s32(data+i-1); \
+	const int32x4_t d2 = vld1q_s32(data+i-2); \
+	const int32x4_t d3 = vld1q_s32(data+i-3); \
+	const int32x4_t d4 = vld1q_s32(data+i-4); \
+	const int32x4_t e1 = vsubq_s32(d0, d1), f1 = vsubq_s32(d1, d2), g1 = vsubq_s32(d2, d3), h1 = vsubq_s32(d3, d4); \
+	const int32x4_t e2 = vsubq_s32(e1, f1), f2 = vsubq_s32(f1, g1), g2 = vsubq_s32(g1, h1); \
+	const int32x4_t e3 = vsubq_s32(e2, f2), f3 = vsubq_s32(f2, g2); \
+	const int32x4_t e4 = vsubq_s32(e3, f3);
+
+/* vabsq_s32() does not saturate, so the absolute value of INT32_MIN is 1<<31 as an unsigned, like local_abs() in fixed.c */
+#define ABS_(x) vreinterpretq_u32_s32(vabsq_s32(x))
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+unsigned FLAC__fixed_compute_best_predictor_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	uint32x4_t acc0 = vdupq_n_u32(0), acc1 = vdupq_n_u32(0), acc2 = vdupq_n_u32(0), acc3 = vdupq_n_u32(0), acc4 = vdupq_n_u32(0);
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+	unsigned i;
+
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		FIXED_ERRORS_(data, i)
+		acc0 = vaddq_u32(acc0, ABS_(d0));
+		acc1 = vaddq_u32(acc1, ABS_(e1));
+		acc2 = vaddq_u32(acc2, ABS_(e2));
+		acc3 = vaddq_u32(acc3, ABS_(e3));
+		acc4 = vaddq_u32(acc4, ABS_(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	/* the sums wrap at 32 bits just like in FLAC__fixed_compute_best_predictor() */
+	total_error[0] = (FLAC__uint32)(vaddvq_u32(acc0) + (FLAC__uint32)total_error[0]);
+	total_error[1] = (FLAC__uint32)(vaddvq_u32(acc1) + (FLAC__uint32)total_error[1]);
+	total_error[2] = (FLAC__uint32)(vaddvq_u32(acc2) + (FLAC__uint32)total_error[2]);
+	total_error[3] = (FLAC__uint32)(vaddvq_u32(acc3) + (FLAC__uint32)total_error[3]);
+	total_error[4] = (FLAC__uint32)(vaddvq_u32(acc4) + (FLAC__uint32)total_error[4]);
+
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+
+	FLAC__fixed_compute_total_errors_intrin_neon(data, data_len, total_error);
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+#endif
+
+void FLAC__fixed_compute_total_errors_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1])
+{
+	uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0), acc2 = vdupq_n_u64(0), acc3 = vdupq_n_u64(0), acc4 = vdupq_n_u64(0);
+	unsigned i;
+
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		FIXED_ERRORS_(data, i)
+		acc0 = vpadalq_u32(acc0, ABS_(d0));
+		acc1 = vpadalq_u32(acc1, ABS_(e1));
+		acc2 = vpadalq_u32(acc2, ABS_(e2));
+		acc3 = vpadalq_u32(acc3, ABS_(e3));
+		acc4 = vpadalq_u32(acc4, ABS_(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	total_error[0] += vaddvq_u64(acc0);
+	total_error[1] += vaddvq_u64(acc1);
+	total_error[2] += vaddvq_u64(acc2);
+	total_error[3] += vaddvq_u64(acc3);
+	total_error[4] += vaddvq_u64(acc4);
+}
+
+void FLAC__fixed_compute_residual_intrin_neon(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[])
+{
+	unsigned i = 0;
+
+	switch(order) {
+		case 0:
+			FLAC__ASSERT(sizeof(residual[0]) == sizeof(data[0]));
+			memcpy(residual, data, sizeof(residual[0])*data_len);
+			return;
+		case 1:
+			for( ; i + 4 <= data_len; i += 4)
+				vst1q_s32(residual+i, vsubq_s32(vld1q_s32(data+i), vld1q_s32(data+i-1)));
+			break;
+		case 2:
+			for( ; i + 4 <= data_len; i += 4) {
+				const int32x4_t d0 = vld1q_s32(data+i);
+				const int32x4_t d1 = vld1q_s32(data+i-1);
+				const int32x4_t d2 = vld1q_s32(data+i-2);
+				vst1q_s32(residual+i, vaddq_s32(vsubq_s32(d0, vshlq_n_s32(d1, 1)), d2));
+			}
+			break;
+		case 3:
+			for( ; i + 4 <= data_len; i += 4) {
+				const int32x4_t d0 = vld1q_s32(data+i);
+				const int32x4_t d1 = vld1q_s32(data+i-1);
+				const int32x4_t d2 = vld1q_s32(data+i-2);
+				const int32x4_t d3 = vld1q_s32(data+i-3);
+				vst1q_s32(residual+i, vsubq_s32(vmlsq_n_s32(d0, vsubq_s32(d1, d2), 3), d3));
+			}
+			break;
+		case 4:
+			for( ; i + 4 <= data_len; i += 4) {
+				const int32x4_t d0 = vld1q_s32(data+i);
+				const int32x4_t d1 = vld1q_s32(data+i-1);
+				const int32x4_t d2 = vld1q_s32(data+i-2);
+				const int32x4_t d3 = vld1q_s32(data+i-3);
+				const int32x4_t d4 = vld1q_s32(data+i-4);
+				vst1q_s32(residual+i, vaddq_s32(vmlaq_n_s32(vmlsq_n_s32(d0, vaddq_s32(d1, d3), 4), d2, 6), d4));
+			}
+			break;
+		default:
+			FLAC__ASSERT(0);
+			return;
+	}
+	FLAC__fixed_compute_residual(data+i, data_len-i, order, residual+i);
+}
+
+#define PREFIX_SUM_(x, carry) \
+	x = vaddq_s32(x, vextq_s32(zero, x, 3)); \
+	x = vaddq_s32(x, vextq_s32(zero, x, 2)); \
+	x = vaddq_s32(x, carry); \
+	carry = vdupq_laneq_s32(x, 3);
+#define RESTORE_LOOP_(sums) \
+	for( ; i + 4 <= data_len; i += 4) { \
+		int32x4_t x = vld1q_s32(residual+i); \
+		sums \
+		vst1q_s32(data+i, x); \
+	}
+
+void FLAC__fixed_restore_signal_intrin_neon(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[])
+{
+	const int32x4_t zero = vdupq_n_s32(0);
+	unsigned i = 0;
+	int32x4_t c0, c1, c2, c3;
+
+	switch(order) {
+		case 0:
+			FLAC__ASSERT(sizeof(residual[0]) == sizeof(data[0]));
+			memcpy(data, residual, sizeof(residual[0])*data_len);
+			return;
+		case 1:
+			c0 = vdupq_n_s32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c0))
+			break;
+		case 2:
+			c1 = vdupq_n_s32(data[-1] - data[-2]);
+			c0 = vdupq_n_s32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		case 3:
+			c2 = vdupq_n_s32(data[-1] - 2*data[-2] + data[-3]);
+			c1 = vdupq_n_s32(data[-1] - data[-2]);
+			c0 = vdupq_n_s32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c2) PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		case 4:
+			c3 = vdupq_n_s32(data[-1] - 3*data[-2] + 3*data[-3] - data[-4]);
+			c2 = vdupq_n_s32(data[-1] - 2*data[-2] + data[-3]);
+			c1 = vdupq_n_s32(data[-1] - data[-2]);
+			c0 = vdupq_n_s32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c3) PREFIX_SUM_(x, c2) PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		default:
+			FLAC__ASSERT(0);
+			return;
+	}
+	FLAC__fixed_restore_signal(residual+i, data_len-i, order, data+i);
+}
+
+#endif
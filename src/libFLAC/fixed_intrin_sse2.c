@@ -0,0 +1,265 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+
+#include <emmintrin.h>
+#include <string.h> /* for memcpy() */
+#include "FLAC/assert.h"
+#include "private/fixed.h"
+
+/*
+ * SSE2 is part of the x86_64 baseline, so unlike the other intrinsic
+ * routines these don't need a target attribute.
+ *
+ * The errors of the fixed predictors are the successive differences
+ * of the signal, so for 4 samples at a time they are computed from the
+ * signal at offsets 0..4 instead of being carried from one sample to
+ * the next as in the C version.  The arithmetic wraps the same way, so
+ * the sums come out exactly the same.  The samples left over at the
+ * end are handed to the C versions, which is why those take the
+ * signal history from data[-4,-1].
+ */
+
+/* the differences of order 0..4 at data[i..i+3] */
+#define FIXED_ERRORS_(data, i) \
+	const __m128i d0 = _mm_loadu_si128((const __m128i*)(data+i)); \
+	const __m128i d1 = _mm_loadu_si128((const __m128i*)(data+i-1)); \
+	const __m128i d2 = _mm_loadu_si128((const __m128i*)(data+i-2)); \
+	const __m128i d3 = _mm_loadu_si128((const __m128i*)(data+i-3)); \
+	const __m128i d4 = _mm_loadu_si128((const __m128i*)(data+i-4)); \
+	const __m128i e1 = _mm_sub_epi32(d0, d1), f1 = _mm_sub_epi32(d1, d2), g1 = _mm_sub_epi32(d2, d3), h1 = _mm_sub_epi32(d3, d4); \
+	const __m128i e2 = _mm_sub_epi32(e1, f1), f2 = _mm_sub_epi32(f1, g1), g2 = _mm_sub_epi32(g1, h1); \
+	const __m128i e3 = _mm_sub_epi32(e2, f2), f3 = _mm_sub_epi32(f2, g2); \
+	const __m128i e4 = _mm_sub_epi32(e3, f3);
+
+/* SSE2 has no _mm_abs_epi32(); the absolute value of INT32_MIN is 1<<31 as an unsigned, like local_abs() in fixed.c */
+static __inline __m128i abs_epi32_(__m128i x)
+{
+	const __m128i sign = _mm_srai_epi32(x, 31);
+	return _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+}
+
+static __inline FLAC__uint32 hsum_epi32_(__m128i x)
+{
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1,0,3,2)));
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2,3,0,1)));
+	return (FLAC__uint32)_mm_cvtsi128_si32(x);
+}
+
+static __inline FLAC__uint64 hsum_epi64_(__m128i x)
+{
+	x = _mm_add_epi64(x, _mm_unpackhi_epi64(x, x));
+	return (FLAC__uint64)_mm_cvtsi128_si64(x);
+}
+
+/* adds the 4 unsigned 32-bit lanes of x to the 2 64-bit lanes of acc */
+static __inline __m128i add_epu32_epi64_(__m128i acc, __m128i x)
+{
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_add_epi64(acc, _mm_add_epi64(_mm_unpacklo_epi32(x, zero), _mm_unpackhi_epi32(x, zero)));
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+unsigned FLAC__fixed_compute_best_predictor_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	__m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128(), acc2 = _mm_setzero_si128(), acc3 = _mm_setzero_si128(), acc4 = _mm_setzero_si128();
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+	unsigned i;
+
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		FIXED_ERRORS_(data, i)
+		acc0 = _mm_add_epi32(acc0, abs_epi32_(d0));
+		acc1 = _mm_add_epi32(acc1, abs_epi32_(e1));
+		acc2 = _mm_add_epi32(acc2, abs_epi32_(e2));
+		acc3 = _mm_add_epi32(acc3, abs_epi32_(e3));
+		acc4 = _mm_add_epi32(acc4, abs_epi32_(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	/* the sums wrap at 32 bits just like in FLAC__fixed_compute_best_predictor() */
+	total_error[0] = (FLAC__uint32)(hsum_epi32_(acc0) + (FLAC__uint32)total_error[0]);
+	total_error[1] = (FLAC__uint32)(hsum_epi32_(acc1) + (FLAC__uint32)total_error[1]);
+	total_error[2] = (FLAC__uint32)(hsum_epi32_(acc2) + (FLAC__uint32)total_error[2]);
+	total_error[3] = (FLAC__uint32)(hsum_epi32_(acc3) + (FLAC__uint32)total_error[3]);
+	total_error[4] = (FLAC__uint32)(hsum_epi32_(acc4) + (FLAC__uint32)total_error[4]);
+
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1])
+{
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+
+	FLAC__fixed_compute_total_errors_intrin_sse2(data, data_len, total_error);
+	return FLAC__fixed_compute_best_predictor_from_total_errors(total_error, data_len, residual_bits_per_sample);
+}
+#endif
+
+void FLAC__fixed_compute_total_errors_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1])
+{
+	__m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128(), acc2 = _mm_setzero_si128(), acc3 = _mm_setzero_si128(), acc4 = _mm_setzero_si128();
+	unsigned i;
+
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		FIXED_ERRORS_(data, i)
+		acc0 = add_epu32_epi64_(acc0, abs_epi32_(d0));
+		acc1 = add_epu32_epi64_(acc1, abs_epi32_(e1));
+		acc2 = add_epu32_epi64_(acc2, abs_epi32_(e2));
+		acc3 = add_epu32_epi64_(acc3, abs_epi32_(e3));
+		acc4 = add_epu32_epi64_(acc4, abs_epi32_(e4));
+	}
+	FLAC__fixed_compute_total_errors(data+i, data_len-i, total_error);
+
+	total_error[0] += hsum_epi64_(acc0);
+	total_error[1] += hsum_epi64_(acc1);
+	total_error[2] += hsum_epi64_(acc2);
+	total_error[3] += hsum_epi64_(acc3);
+	total_error[4] += hsum_epi64_(acc4);
+}
+
+void FLAC__fixed_compute_residual_intrin_sse2(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[])
+{
+	unsigned i = 0;
+
+	switch(order) {
+		case 0:
+			FLAC__ASSERT(sizeof(residual[0]) == sizeof(data[0]));
+			memcpy(residual, data, sizeof(residual[0])*data_len);
+			return;
+		case 1:
+			for( ; i + 4 <= data_len; i += 4) {
+				const __m128i d0 = _mm_loadu_si128((const __m128i*)(data+i));
+				const __m128i d1 = _mm_loadu_si128((const __m128i*)(data+i-1));
+				_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(d0, d1));
+			}
+			break;
+		case 2:
+			for( ; i + 4 <= data_len; i += 4) {
+				const __m128i d0 = _mm_loadu_si128((const __m128i*)(data+i));
+				const __m128i d1 = _mm_loadu_si128((const __m128i*)(data+i-1));
+				const __m128i d2 = _mm_loadu_si128((const __m128i*)(data+i-2));
+				_mm_storeu_si128((__m128i*)(residual+i), _mm_add_epi32(_mm_sub_epi32(d0, _mm_slli_epi32(d1, 1)), d2));
+			}
+			break;
+		case 3:
+			for( ; i + 4 <= data_len; i += 4) {
+				const __m128i d0 = _mm_loadu_si128((const __m128i*)(data+i));
+				const __m128i d1 = _mm_loadu_si128((const __m128i*)(data+i-1));
+				const __m128i d2 = _mm_loadu_si128((const __m128i*)(data+i-2));
+				const __m128i d3 = _mm_loadu_si128((const __m128i*)(data+i-3));
+				const __m128i t = _mm_sub_epi32(d1, d2);
+				_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_sub_epi32(d0, _mm_add_epi32(_mm_slli_epi32(t, 1), t)), d3));
+			}
+			break;
+		case 4:
+			for( ; i + 4 <= data_len; i += 4) {
+				const __m128i d0 = _mm_loadu_si128((const __m128i*)(data+i));
+				const __m128i d1 = _mm_loadu_si128((const __m128i*)(data+i-1));
+				const __m128i d2 = _mm_loadu_si128((const __m128i*)(data+i-2));
+				const __m128i d3 = _mm_loadu_si128((const __m128i*)(data+i-3));
+				const __m128i d4 = _mm_loadu_si128((const __m128i*)(data+i-4));
+				const __m128i t = _mm_add_epi32(_mm_slli_epi32(d2, 2), _mm_slli_epi32(d2, 1));
+				_mm_storeu_si128((__m128i*)(residual+i), _mm_add_epi32(_mm_add_epi32(_mm_sub_epi32(d0, _mm_slli_epi32(_mm_add_epi32(d1, d3), 2)), t), d4));
+			}
+			break;
+		default:
+			FLAC__ASSERT(0);
+			return;
+	}
+	FLAC__fixed_compute_residual(data+i, data_len-i, order, residual+i);
+}
+
+/*
+ * Restoring a signal of order n is summing up the residual n times
+ * over, each sum starting from the difference of the signal history
+ * of the matching order.  The sums are done 4 samples at a time, so
+ * the sample-to-sample dependency is only on the last lane of the
+ * previous 4.
+ */
+#define PREFIX_SUM_(x, carry) \
+	x = _mm_add_epi32(x, _mm_slli_si128(x, 4)); \
+	x = _mm_add_epi32(x, _mm_slli_si128(x, 8)); \
+	x = _mm_add_epi32(x, carry); \
+	carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3,3,3,3));
+#define RESTORE_LOOP_(sums) \
+	for( ; i + 4 <= data_len; i += 4) { \
+		__m128i x = _mm_loadu_si128((const __m128i*)(residual+i)); \
+		sums \
+		_mm_storeu_si128((__m128i*)(data+i), x); \
+	}
+
+void FLAC__fixed_restore_signal_intrin_sse2(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[])
+{
+	unsigned i = 0;
+	__m128i c0, c1, c2, c3;
+
+	switch(order) {
+		case 0:
+			FLAC__ASSERT(sizeof(residual[0]) == sizeof(data[0]));
+			memcpy(data, residual, sizeof(residual[0])*data_len);
+			return;
+		case 1:
+			c0 = _mm_set1_epi32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c0))
+			break;
+		case 2:
+			c1 = _mm_set1_epi32(data[-1] - data[-2]);
+			c0 = _mm_set1_epi32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		case 3:
+			c2 = _mm_set1_epi32(data[-1] - 2*data[-2] + data[-3]);
+			c1 = _mm_set1_epi32(data[-1] - data[-2]);
+			c0 = _mm_set1_epi32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c2) PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		case 4:
+			c3 = _mm_set1_epi32(data[-1] - 3*data[-2] + 3*data[-3] - data[-4]);
+			c2 = _mm_set1_epi32(data[-1] - 2*data[-2] + data[-3]);
+			c1 = _mm_set1_epi32(data[-1] - data[-2]);
+			c0 = _mm_set1_epi32(data[-1]);
+			RESTORE_LOOP_(PREFIX_SUM_(x, c3) PREFIX_SUM_(x, c2) PREFIX_SUM_(x, c1) PREFIX_SUM_(x, c0))
+			break;
+		default:
+			FLAC__ASSERT(0);
+			return;
+	}
+	FLAC__fixed_restore_signal(residual+i, data_len-i, order, data+i);
+}
+
+#endif
@@ -49,6 +49,7 @@ void FLAC__bitwriter_delete(FLAC__BitWriter *bw);
 FLAC__bool FLAC__bitwriter_init(FLAC__BitWriter *bw);
 void FLAC__bitwriter_free(FLAC__BitWriter *bw); /* does not 'free(buffer)' */
 void FLAC__bitwriter_clear(FLAC__BitWriter *bw);
+FLAC__bool FLAC__bitwriter_reserve(FLAC__BitWriter *bw, unsigned bits); /* makes room for 'bits' more bits so that writing them does not have to grow the buffer */
 void FLAC__bitwriter_dump(const FLAC__BitWriter *bw, FILE *out);
 
 /*
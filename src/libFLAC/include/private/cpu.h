@@ -41,6 +41,8 @@
 typedef enum {
 	FLAC__CPUINFO_TYPE_IA32,
 	FLAC__CPUINFO_TYPE_PPC,
+	FLAC__CPUINFO_TYPE_X86_64,
+	FLAC__CPUINFO_TYPE_ARM64,
 	FLAC__CPUINFO_TYPE_UNKNOWN
 } FLAC__CPUInfo_Type;
 
@@ -64,17 +66,72 @@ typedef struct {
 	FLAC__bool ppc64;
 } FLAC__CPUInfo_PPC;
 
+typedef struct {
+	FLAC__bool sse2;
+	FLAC__bool sse3;
+	FLAC__bool ssse3;
+	FLAC__bool sse41;
+	FLAC__bool avx;
+	FLAC__bool avx2;
+	FLAC__bool fma;
+	FLAC__bool bmi2;
+	FLAC__bool pclmul;
+} FLAC__CPUInfo_X86_64;
+
+typedef struct {
+	FLAC__bool neon;
+	FLAC__bool crc32;
+	FLAC__bool pmull;
+} FLAC__CPUInfo_ARM64;
+
 typedef struct {
 	FLAC__bool use_asm;
 	FLAC__CPUInfo_Type type;
 	union {
 		FLAC__CPUInfo_IA32 ia32;
 		FLAC__CPUInfo_PPC ppc;
+		FLAC__CPUInfo_X86_64 x86_64;
+		FLAC__CPUInfo_ARM64 arm64;
 	} data;
 } FLAC__CPUInfo;
 
+/*
+ * Fills in *info for the CPU we are running on.  Any feature named in
+ * the FLAC_CPU_DISABLE environment variable (a comma-separated list
+ * like "avx2,sse41"; "asm" turns off all of them) is reported as
+ * missing, which makes it easy to compare the different routines on
+ * the same machine.
+ */
 void FLAC__cpu_info(FLAC__CPUInfo *info);
 
+/*
+ * On x86_64 the SIMD routines are written with compiler intrinsics.
+ * Each one is compiled for its own instruction set with a function
+ * target attribute and is only called when FLAC__cpu_info() says the
+ * CPU (and OS) support it.
+ */
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_X86_64 && defined FLAC__HAS_X86INTRIN
+#define FLAC__X86_64_INTRIN
+#define FLAC__INTRIN_TARGET(x) __attribute__((__target__(x)))
+#endif
+
+/*
+ * NEON is part of the AArch64 baseline, so the NEON routines need no
+ * special compiler support beyond <arm_neon.h>.
+ */
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_ARM64 && defined __ARM_NEON
+#define FLAC__ARM64_NEON
+#endif
+
+/*
+ * The 64-bit polynomial multiply (PMULL) is an optional part of the
+ * crypto extension, so it is only compiled in when the compiler is
+ * targeting that extension; the CPU is still checked at runtime.
+ */
+#if defined FLAC__ARM64_NEON && (defined __ARM_FEATURE_CRYPTO || defined __ARM_FEATURE_AES)
+#define FLAC__ARM64_PMULL
+#endif
+
 #ifndef FLAC__NO_ASM
 #ifdef FLAC__CPU_IA32
 #ifdef FLAC__HAS_NASM
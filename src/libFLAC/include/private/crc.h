@@ -33,6 +33,7 @@
 #define FLAC__PRIVATE__CRC_H
 
 #include "FLAC/ordinals.h"
+#include "cpu.h"
 
 /* 8 bit CRC generator, MSB shifted first
 ** polynomial = x^8 + x^2 + x^1 + x^0
@@ -56,6 +57,19 @@ extern unsigned const FLAC__crc16_table[256];
 #define FLAC__CRC16_UPDATE(data, crc) ((((crc)<<8) ^ FLAC__crc16_table[((crc)>>8) ^ (data)]) & 0xffff)
 #endif
 
+/* tables for computing the CRC-16 several bytes at a time; entry [0] is
+** the same as FLAC__crc16_table[]
+*/
+extern FLAC__uint16 const FLAC__crc16_slice_table[8][256];
+
 unsigned FLAC__crc16(const FLAC__byte *data, unsigned len);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+unsigned FLAC__crc16_intrin_pclmul(const FLAC__byte *data, unsigned len);
+#  endif
+#  ifdef FLAC__ARM64_PMULL
+unsigned FLAC__crc16_intrin_neon_pmull(const FLAC__byte *data, unsigned len);
+#  endif
+#endif
 
 #endif
@@ -0,0 +1,95 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAC__PRIVATE__DISPATCH_H
+#define FLAC__PRIVATE__DISPATCH_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "private/bitreader.h"
+#include "private/cpu.h"
+#include "private/float.h"
+#include "FLAC/format.h"
+
+/*
+ * The DSP routines that have CPU-specific versions.  The encoder and
+ * decoder both get theirs from FLAC__cpu_dispatch() so the choice of
+ * routine for a given FLAC__CPUInfo is made in one place.
+ */
+typedef struct {
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	void (*lpc_compute_autocorrelation)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	/* these only have to work for lag <= 4, 8, 12, 16 and 32 respectively */
+	void (*lpc_compute_autocorrelation_lag_4)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*lpc_compute_autocorrelation_lag_8)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*lpc_compute_autocorrelation_lag_12)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*lpc_compute_autocorrelation_lag_16)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*lpc_compute_autocorrelation_lag_32)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	/* window + autocorrelation in one pass for lag <= 32; 0 if there is no such routine for this CPU */
+	void (*lpc_compute_autocorrelation_windowed)(const FLAC__int32 in[], const FLAC__real window[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	unsigned (*fixed_compute_best_predictor)(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+	unsigned (*fixed_compute_best_predictor_wide)(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+	void (*lpc_compute_residual_from_qlp_coefficients)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+	void (*lpc_compute_residual_from_qlp_coefficients_64bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+	void (*lpc_compute_residual_from_qlp_coefficients_16bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+#else
+	unsigned (*fixed_compute_best_predictor)(const FLAC__int32 data[], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+	unsigned (*fixed_compute_best_predictor_wide)(const FLAC__int32 data[], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#endif
+	void (*fixed_compute_total_errors)(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+	void (*fixed_compute_residual)(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+	void (*fixed_restore_signal)(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[]);
+	void (*lpc_restore_signal)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	void (*lpc_restore_signal_64bit)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	void (*lpc_restore_signal_16bit)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	void (*lpc_restore_signal_16bit_order8)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	FLAC__bool (*bitreader_read_rice_signed_block)(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter);
+	unsigned (*crc16)(const FLAC__byte *data, unsigned len);
+	void (*precompute_partition_info_sums)(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+	void (*precompute_partition_info_escapes)(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+	/* the CPU-specific versions of this one count in 32 bits; see FLAC__count_rice_msbs() */
+	void (*count_rice_msbs)(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]);
+} FLAC__CPUDispatch;
+
+/*
+ *	FLAC__cpu_dispatch()
+ *	--------------------------------------------------------------------
+ *	Fill in the dispatch table with the fastest routines the CPU
+ *	described by info can run, falling back to the plain C versions.
+ *
+ *	IN info            as returned by FLAC__cpu_info()
+ *	OUT dispatch
+ */
+void FLAC__cpu_dispatch(const FLAC__CPUInfo *info, FLAC__CPUDispatch *dispatch);
+
+#endif
@@ -36,6 +36,7 @@
 #include <config.h>
 #endif
 
+#include "private/cpu.h"
 #include "private/float.h"
 #include "FLAC/format.h"
 
@@ -59,13 +60,69 @@ unsigned FLAC__fixed_compute_best_predictor(const FLAC__int32 data[], unsigned d
 unsigned FLAC__fixed_compute_best_predictor_asm_ia32_mmx_cmov(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
 #   endif
 #  endif
+#  ifdef FLAC__X86_64_INTRIN
+unsigned FLAC__fixed_compute_best_predictor_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+unsigned FLAC__fixed_compute_best_predictor_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+unsigned FLAC__fixed_compute_best_predictor_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
 # endif
 unsigned FLAC__fixed_compute_best_predictor_wide(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+# ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+unsigned FLAC__fixed_compute_best_predictor_wide_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
+# endif
 #else
 unsigned FLAC__fixed_compute_best_predictor(const FLAC__int32 data[], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
 unsigned FLAC__fixed_compute_best_predictor_wide(const FLAC__int32 data[], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
 #endif
 
+/*
+ *	FLAC__fixed_compute_total_errors()
+ *	--------------------------------------------------------------------
+ *	Sum the absolute residual of each fixed predictor order.  The sums
+ *	of adjacent stretches of signal add up to the sums of the two
+ *	together, so they can be computed once over short stretches and
+ *	combined for longer ones.
+ *
+ *	IN data[-FLAC__MAX_FIXED_ORDER,data_len-1]  (NOTE THE INDICES!)
+ *	IN data_len
+ *	OUT total_error[0,FLAC__MAX_FIXED_ORDER]
+ */
+void FLAC__fixed_compute_total_errors(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__fixed_compute_total_errors_intrin_sse2(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+void FLAC__fixed_compute_total_errors_intrin_avx2(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__fixed_compute_total_errors_intrin_neon(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+#  endif
+#endif
+
+/*
+ *	FLAC__fixed_compute_best_predictor_from_total_errors()
+ *	--------------------------------------------------------------------
+ *	Like FLAC__fixed_compute_best_predictor(), but from the sums
+ *	computed by FLAC__fixed_compute_total_errors() over data_len
+ *	samples.
+ *
+ *	IN total_error[0,FLAC__MAX_FIXED_ORDER]
+ *	IN data_len
+ *	OUT residual_bits_per_sample[0,FLAC__MAX_FIXED_ORDER]
+ */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+unsigned FLAC__fixed_compute_best_predictor_from_total_errors(const FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#else
+unsigned FLAC__fixed_compute_best_predictor_from_total_errors(const FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
+#endif
+
 /*
  *	FLAC__fixed_compute_residual()
  *	--------------------------------------------------------------------
@@ -78,6 +135,15 @@ unsigned FLAC__fixed_compute_best_predictor_wide(const FLAC__int32 data[], unsig
  *	OUT residual[0,data_len-1]        residual signal
  */
 void FLAC__fixed_compute_residual(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__fixed_compute_residual_intrin_sse2(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+void FLAC__fixed_compute_residual_intrin_avx2(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__fixed_compute_residual_intrin_neon(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+#  endif
+#endif
 
 /*
  *	FLAC__fixed_restore_signal()
@@ -93,5 +159,13 @@ void FLAC__fixed_compute_residual(const FLAC__int32 data[], unsigned data_len, u
  *	OUT data[0,data_len-1]            original signal
  */
 void FLAC__fixed_restore_signal(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[]);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__fixed_restore_signal_intrin_sse2(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__fixed_restore_signal_intrin_neon(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[]);
+#  endif
+#endif
 
 #endif
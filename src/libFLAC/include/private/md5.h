@@ -39,6 +39,7 @@ typedef struct {
 void FLAC__MD5Init(FLAC__MD5Context *context);
 void FLAC__MD5Final(FLAC__byte digest[16], FLAC__MD5Context *context);
 
+FLAC__bool FLAC__MD5Reserve(FLAC__MD5Context *ctx, unsigned channels, unsigned samples, unsigned bytes_per_sample);
 FLAC__bool FLAC__MD5Accumulate(FLAC__MD5Context *ctx, const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bytes_per_sample);
 
 #endif
@@ -0,0 +1,130 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAC__PRIVATE__STREAM_ENCODER_H
+#define FLAC__PRIVATE__STREAM_ENCODER_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "private/cpu.h"
+#include "FLAC/ordinals.h"
+
+/*
+ * The per-sample parts of the encoder's residual coding search.  The
+ * merging of partitions for lower partition orders and the choice of
+ * parameters stay in stream_encoder.c; only the passes over the
+ * residual have CPU-specific versions.
+ */
+
+/*
+ *	FLAC__precompute_partition_info_sums()
+ *	--------------------------------------------------------------------
+ *	Sums the magnitudes of the residual in each partition for the given
+ *	partition order.  The first partition is predictor_order samples
+ *	short since the warmup samples have no residual.
+ *
+ *	IN residual[0,residual_samples-1]
+ *	OUT abs_residual_partition_sums[0,(1<<partition_order)-1]
+ *	IN residual_samples
+ *	IN predictor_order
+ *	IN partition_order
+ *	IN bps                      bits per sample of the signal the residual
+ *	                            came from; if a partition's sum is sure
+ *	                            to fit in 32 bits it is added up in 32 bits
+ */
+void FLAC__precompute_partition_info_sums(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__precompute_partition_info_sums_intrin_sse41(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+void FLAC__precompute_partition_info_sums_intrin_avx2(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__precompute_partition_info_sums_intrin_neon(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+#  endif
+#endif
+
+/*
+ *	FLAC__precompute_partition_info_escapes()
+ *	--------------------------------------------------------------------
+ *	Finds the number of bits each partition for the given partition
+ *	order would need if its residual were stored verbatim (escaped).
+ *
+ *	IN residual[0,residual_samples-1]
+ *	OUT raw_bits_per_partition[0,(1<<partition_order)-1]
+ *	IN residual_samples
+ *	IN predictor_order
+ *	IN partition_order
+ */
+void FLAC__precompute_partition_info_escapes(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__precompute_partition_info_escapes_intrin_sse41(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+void FLAC__precompute_partition_info_escapes_intrin_avx2(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__precompute_partition_info_escapes_intrin_neon(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+#  endif
+#endif
+
+/*
+ *	FLAC__count_rice_msbs()
+ *	--------------------------------------------------------------------
+ *	For each of the Rice parameters min_parameter through
+ *	min_parameter+parameters-1, adds up the parts of the Rice codewords
+ *	of residual[] that are coded in unary, i.e. each folded residual
+ *	value shifted right by the parameter.  The exact size of the coded
+ *	partition for a parameter is then just that count plus one stop
+ *	bit and parameter low bits per sample, so the whole neighbourhood
+ *	of a parameter can be priced in one pass over the residual.
+ *
+ *	The SIMD versions count in 32 bits and must only be used when the
+ *	sum of the magnitudes of residual[] is less than 1<<31.
+ *
+ *	IN residual[0,samples-1]
+ *	IN samples
+ *	IN min_parameter
+ *	IN parameters
+ *	OUT msbs[0,parameters-1]
+ */
+void FLAC__count_rice_msbs(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__X86_64_INTRIN
+void FLAC__count_rice_msbs_intrin_sse41(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]);
+void FLAC__count_rice_msbs_intrin_avx2(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]);
+#  endif
+#  ifdef FLAC__ARM64_NEON
+void FLAC__count_rice_msbs_intrin_neon(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]);
+#  endif
+#endif
+
+#endif
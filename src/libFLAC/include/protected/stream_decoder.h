@@ -45,6 +45,9 @@ typedef struct FLAC__StreamDecoderProtected {
 	unsigned sample_rate; /* in Hz */
 	unsigned blocksize; /* in samples (per channel) */
 	FLAC__bool md5_checking; /* if true, generate MD5 signature of decoded data and compare against signature in the STREAMINFO metadata block */
+	unsigned num_threads;
+	unsigned pipeline_depth;
+	FLAC__bool frame_indexing; /* if true, build a frame index while decoding */
 #if FLAC__HAS_OGG
 	FLAC__OggDecoderAspect ogg_decoder_aspect;
 #endif
@@ -55,4 +58,11 @@ typedef struct FLAC__StreamDecoderProtected {
  */
 unsigned FLAC__stream_decoder_get_input_bytes_unconsumed(const FLAC__StreamDecoder *decoder);
 
+/*
+ * size the decoding buffers for frames of up to 'blocksize' samples and
+ * 'channels' channels with residual partition orders up to
+ * 'max_partition_order', so that decoding such frames does not allocate
+ */
+FLAC__bool FLAC__stream_decoder_reserve(FLAC__StreamDecoder *decoder, unsigned blocksize, unsigned channels, unsigned max_partition_order);
+
 #endif
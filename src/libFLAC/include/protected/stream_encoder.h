@@ -82,10 +82,12 @@ typedef struct FLAC__StreamEncoderProtected {
 	FLAC__bool do_md5;
 	FLAC__bool do_mid_side_stereo;
 	FLAC__bool loose_mid_side_stereo;
+	FLAC__bool fast_mid_side_stereo;
 	unsigned channels;
 	unsigned bits_per_sample;
 	unsigned sample_rate;
 	unsigned blocksize;
+	FLAC__bool variable_blocksize;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	unsigned num_apodizations;
 	FLAC__ApodizationSpecification apodizations[FLAC__MAX_APODIZATION_FUNCTIONS];
@@ -99,6 +101,10 @@ typedef struct FLAC__StreamEncoderProtected {
 	unsigned max_residual_partition_order;
 	unsigned rice_parameter_search_dist;
 	FLAC__uint64 total_samples_estimate;
+	unsigned num_threads;
+	void *workspace;
+	size_t workspace_size;
+	FLAC__bool frame_indexing; /* if true, build a frame index while encoding */
 	FLAC__StreamMetadata **metadata;
 	unsigned num_metadata_blocks;
 	FLAC__uint64 streaminfo_offset, seektable_offset, audio_offset;
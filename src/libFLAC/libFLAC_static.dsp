@@ -258,6 +258,10 @@ SOURCE=.\crc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\dispatch.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\fixed.c
 # End Source File
 # Begin Source File
@@ -350,6 +354,10 @@ SOURCE=.\include\private\crc.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\private\dispatch.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\private\fixed.h
 # End Source File
 # Begin Source File
@@ -0,0 +1,321 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+#include <immintrin.h>
+#include <string.h> /* for memcpy() */
+#include "FLAC/assert.h"
+#include "private/lpc.h"
+
+/*
+ * These are the AVX2 versions of the residual routines in
+ * lpc_intrin_sse41.c; see there for the details.  They handle 8 (or 4,
+ * for the 64-bit version) samples per iteration.  There are no AVX2
+ * versions of the restore routines since those are limited by the
+ * sample-to-sample dependency and not by the width of the vectors.
+ */
+
+#define RESIDUAL32_TERM_(j) summ = _mm256_add_epi32(summ, _mm256_mullo_epi32(q##j, _mm256_loadu_si256((const __m256i*)(data+i-(j)-1))));
+#define RESIDUAL32_LOOP_(terms) \
+	for(i = 0; i < limit; i += 8) { \
+		summ = _mm256_setzero_si256(); \
+		terms \
+		_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(data+i)), _mm256_sra_epi32(summ, cnt))); \
+	}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 7;
+	const __m128i cnt = _mm_cvtsi32_si128(lp_quantization);
+	__m256i summ, q0, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11, qv[32];
+	FLAC__int32 sum;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order <= 12) {
+		q0 = q1 = q2 = q3 = q4 = q5 = q6 = q7 = q8 = q9 = q10 = q11 = _mm256_setzero_si256();
+		switch(order) { /* the cases fall through */
+			case 12: q11 = _mm256_set1_epi32(qlp_coeff[11]);
+			case 11: q10 = _mm256_set1_epi32(qlp_coeff[10]);
+			case 10: q9 = _mm256_set1_epi32(qlp_coeff[9]);
+			case 9: q8 = _mm256_set1_epi32(qlp_coeff[8]);
+			case 8: q7 = _mm256_set1_epi32(qlp_coeff[7]);
+			case 7: q6 = _mm256_set1_epi32(qlp_coeff[6]);
+			case 6: q5 = _mm256_set1_epi32(qlp_coeff[5]);
+			case 5: q4 = _mm256_set1_epi32(qlp_coeff[4]);
+			case 4: q3 = _mm256_set1_epi32(qlp_coeff[3]);
+			case 3: q2 = _mm256_set1_epi32(qlp_coeff[2]);
+			case 2: q1 = _mm256_set1_epi32(qlp_coeff[1]);
+			case 1: q0 = _mm256_set1_epi32(qlp_coeff[0]);
+		}
+		switch(order) {
+			case 12: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(11) RESIDUAL32_TERM_(10) RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 11: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(10) RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 10: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 9: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 8: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 7: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 6: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 5: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 4: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 3: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 2: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 1: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(0)) break;
+		}
+	}
+	else {
+		for(j = 0; j < (int)order; j++)
+			qv[j] = _mm256_set1_epi32(qlp_coeff[j]);
+		for(i = 0; i < limit; i += 8) {
+			summ = _mm256_setzero_si256();
+			for(j = 0; j < (int)order; j++)
+				summ = _mm256_add_epi32(summ, _mm256_mullo_epi32(qv[j], _mm256_loadu_si256((const __m256i*)(data+i-j-1))));
+			_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(data+i)), _mm256_sra_epi32(summ, cnt)));
+		}
+	}
+	_mm256_zeroupper();
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * data[i-j-1];
+		residual[i] = data[i] - (sum >> lp_quantization);
+	}
+}
+
+#define RESIDUAL64_TERM_(j) summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q##j, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(data+i-(j)-1)))));
+#define RESIDUAL64_LOOP_(terms) \
+	for(i = 0; i < limit; i += 4) { \
+		summ = _mm256_setzero_si256(); \
+		terms \
+		summ = _mm256_permutevar8x32_epi32(_mm256_srl_epi64(summ, cnt), pack); \
+		_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(data+i)), _mm256_castsi256_si128(summ))); \
+	}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 3;
+	const __m128i cnt = _mm_cvtsi32_si128(lp_quantization);
+	/* moves the low 32 bits of each 64-bit lane to the low 128 bits */
+	const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	__m256i summ, q0, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11, qv[32];
+	FLAC__int64 sum;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+	FLAC__ASSERT(lp_quantization <= 32);
+
+	if(order <= 12) {
+		q0 = q1 = q2 = q3 = q4 = q5 = q6 = q7 = q8 = q9 = q10 = q11 = _mm256_setzero_si256();
+		switch(order) { /* the cases fall through */
+			case 12: q11 = _mm256_set1_epi32(qlp_coeff[11]);
+			case 11: q10 = _mm256_set1_epi32(qlp_coeff[10]);
+			case 10: q9 = _mm256_set1_epi32(qlp_coeff[9]);
+			case 9: q8 = _mm256_set1_epi32(qlp_coeff[8]);
+			case 8: q7 = _mm256_set1_epi32(qlp_coeff[7]);
+			case 7: q6 = _mm256_set1_epi32(qlp_coeff[6]);
+			case 6: q5 = _mm256_set1_epi32(qlp_coeff[5]);
+			case 5: q4 = _mm256_set1_epi32(qlp_coeff[4]);
+			case 4: q3 = _mm256_set1_epi32(qlp_coeff[3]);
+			case 3: q2 = _mm256_set1_epi32(qlp_coeff[2]);
+			case 2: q1 = _mm256_set1_epi32(qlp_coeff[1]);
+			case 1: q0 = _mm256_set1_epi32(qlp_coeff[0]);
+		}
+		switch(order) {
+			case 12: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(11) RESIDUAL64_TERM_(10) RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 11: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(10) RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 10: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 9: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 8: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 7: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 6: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 5: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 4: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 3: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 2: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 1: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(0)) break;
+		}
+	}
+	else {
+		for(j = 0; j < (int)order; j++)
+			qv[j] = _mm256_set1_epi32(qlp_coeff[j]);
+		for(i = 0; i < limit; i += 4) {
+			summ = _mm256_setzero_si256();
+			for(j = 0; j < (int)order; j++)
+				summ = _mm256_add_epi64(summ, _mm256_mul_epi32(qv[j], _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(data+i-j-1)))));
+			summ = _mm256_permutevar8x32_epi32(_mm256_srl_epi64(summ, cnt), pack);
+			_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(data+i)), _mm256_castsi256_si128(summ)));
+		}
+	}
+	_mm256_zeroupper();
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * (FLAC__int64)data[i-j-1];
+		residual[i] = data[i] - (FLAC__int32)(sum >> lp_quantization);
+	}
+}
+
+/*
+ * These are the AVX2 versions of the autocorrelation routines in
+ * lpc_intrin_sse2.c; see there for the details.  They carry 8 lags per
+ * vector.  The multiply and add are kept separate (the "avx2" target
+ * does not include FMA, so the compiler will not fuse them either) to
+ * give the same results as the C version.
+ */
+
+#define AUTOC_TERM_(j) acc##j = _mm256_add_ps(acc##j, _mm256_mul_ps(d, _mm256_loadu_ps(data+i+8*(j))));
+#define AUTOC_LOOP_(terms) \
+	for(i = 0; i < n; i++) { \
+		const __m256 d = _mm256_broadcast_ss(data+i); \
+		terms \
+	}
+
+/*
+ * Adds data[i]*data[i+lag] to acc for i in [0,n) and lag in [0,8*nv).
+ * data[0,n+8*nv-2] must be readable.
+ */
+FLAC__INTRIN_TARGET("avx2")
+static void autoc_block_(const FLAC__real data[], unsigned n, unsigned nv, __m256 acc[4])
+{
+	unsigned i;
+	__m256 acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3];
+
+	switch(nv) {
+		case 4: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1) AUTOC_TERM_(2) AUTOC_TERM_(3)) break;
+		case 2: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1)) break;
+		case 1: AUTOC_LOOP_(AUTOC_TERM_(0)) break;
+		default: FLAC__ASSERT(0);
+	}
+
+	acc[0] = acc0; acc[1] = acc1; acc[2] = acc2; acc[3] = acc3;
+}
+
+FLAC__INTRIN_TARGET("avx2")
+static void store_autoc_(const __m256 acc[4], unsigned lag, FLAC__real autoc[])
+{
+	FLAC__real out[32];
+	unsigned j;
+	for(j = 0; j < 4; j++)
+		_mm256_storeu_ps(out+8*j, acc[j]);
+	memcpy(autoc, out, sizeof(FLAC__real) * lag);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+static void compute_autocorrelation_(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[], unsigned nv)
+{
+	FLAC__real tail[64];
+	__m256 acc[4];
+	const unsigned width = 8 * nv;
+	const unsigned m = data_len >= width? data_len - width + 1 : 0;
+	unsigned i;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= width);
+	FLAC__ASSERT(lag <= data_len);
+
+	for(i = 0; i < 4; i++)
+		acc[i] = _mm256_setzero_ps();
+	autoc_block_(data, m, nv, acc);
+	/* finish from a zero-padded copy so as not to read past the end of data[] */
+	for(i = 0; i < data_len - m; i++)
+		tail[i] = data[m+i];
+	for(; i < data_len - m + width - 1; i++)
+		tail[i] = 0.0;
+	autoc_block_(tail, data_len - m, nv, acc);
+	store_autoc_(acc, lag, autoc);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_8(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 1);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 2);
+}
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_32(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 4);
+}
+
+#define WINDOW_TILE_ 256
+
+FLAC__INTRIN_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_windowed_intrin_avx2(const FLAC__int32 in[], const FLAC__real window[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	FLAC__real buf[WINDOW_TILE_ + 32];
+	__m256 acc[4];
+	const unsigned nv = lag <= 16? (lag + 7) / 8 : 4;
+	const unsigned width = 8 * nv;
+	unsigned i, t;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= 32);
+	FLAC__ASSERT(lag <= data_len);
+
+	for(i = 0; i < 4; i++)
+		acc[i] = _mm256_setzero_ps();
+	for(t = 0; t < data_len; t += WINDOW_TILE_) {
+		const unsigned n = data_len - t < WINDOW_TILE_? data_len - t : WINDOW_TILE_;
+		const unsigned avail = data_len - t < n + width - 1? data_len - t : n + width - 1;
+		for(i = 0; i + 8 <= avail; i += 8)
+			_mm256_storeu_ps(buf+i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(in+t+i))), _mm256_loadu_ps(window+t+i)));
+		for(; i < avail; i++)
+			buf[i] = in[t+i] * window[t+i];
+		for(; i < n + width - 1; i++)
+			buf[i] = 0.0;
+		autoc_block_(buf, n, nv, acc);
+	}
+	store_autoc_(acc, lag, autoc);
+}
+
+#endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
+#endif /* FLAC__X86_64_INTRIN */
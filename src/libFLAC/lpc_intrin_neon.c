@@ -0,0 +1,170 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__ARM64_NEON
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+#include <arm_neon.h>
+#include <string.h> /* for memcpy() */
+#include "FLAC/assert.h"
+#include "private/lpc.h"
+
+/*
+ * These are the NEON versions of the autocorrelation routines in
+ * lpc_intrin_sse2.c; see there for the details.  They carry 4 lags per
+ * vector.  The multiply and add are kept separate, as in the C
+ * version, rather than using vfmaq_f32().
+ */
+
+#define AUTOC_TERM_(j) acc##j = vaddq_f32(acc##j, vmulq_f32(d, vld1q_f32(data+i+4*(j))));
+#define AUTOC_LOOP_(terms) \
+	for(i = 0; i < n; i++) { \
+		const float32x4_t d = vld1q_dup_f32(data+i); \
+		terms \
+	}
+
+/*
+ * Adds data[i]*data[i+lag] to acc for i in [0,n) and lag in [0,4*nv).
+ * data[0,n+4*nv-2] must be readable.
+ */
+static void autoc_block_(const FLAC__real data[], unsigned n, unsigned nv, float32x4_t acc[8])
+{
+	unsigned i;
+	float32x4_t acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3], acc4 = acc[4], acc5 = acc[5], acc6 = acc[6], acc7 = acc[7];
+
+	switch(nv) {
+		case 8: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1) AUTOC_TERM_(2) AUTOC_TERM_(3) AUTOC_TERM_(4) AUTOC_TERM_(5) AUTOC_TERM_(6) AUTOC_TERM_(7)) break;
+		case 4: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1) AUTOC_TERM_(2) AUTOC_TERM_(3)) break;
+		case 3: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1) AUTOC_TERM_(2)) break;
+		case 2: AUTOC_LOOP_(AUTOC_TERM_(0) AUTOC_TERM_(1)) break;
+		case 1: AUTOC_LOOP_(AUTOC_TERM_(0)) break;
+		default: FLAC__ASSERT(0);
+	}
+
+	acc[0] = acc0; acc[1] = acc1; acc[2] = acc2; acc[3] = acc3; acc[4] = acc4; acc[5] = acc5; acc[6] = acc6; acc[7] = acc7;
+}
+
+static void store_autoc_(const float32x4_t acc[8], unsigned lag, FLAC__real autoc[])
+{
+	FLAC__real out[32];
+	unsigned j;
+	for(j = 0; j < 8; j++)
+		vst1q_f32(out+4*j, acc[j]);
+	memcpy(autoc, out, sizeof(FLAC__real) * lag);
+}
+
+static void compute_autocorrelation_(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[], unsigned nv)
+{
+	FLAC__real tail[64];
+	float32x4_t acc[8];
+	const unsigned width = 4 * nv;
+	const unsigned m = data_len >= width? data_len - width + 1 : 0;
+	unsigned i;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= width);
+	FLAC__ASSERT(lag <= data_len);
+
+	for(i = 0; i < 8; i++)
+		acc[i] = vdupq_n_f32(0.0f);
+	autoc_block_(data, m, nv, acc);
+	/* finish from a zero-padded copy so as not to read past the end of data[] */
+	for(i = 0; i < data_len - m; i++)
+		tail[i] = data[m+i];
+	for(; i < data_len - m + width - 1; i++)
+		tail[i] = 0.0;
+	autoc_block_(tail, data_len - m, nv, acc);
+	store_autoc_(acc, lag, autoc);
+}
+
+void FLAC__lpc_compute_autocorrelation_intrin_neon_lag_4(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 1);
+}
+
+void FLAC__lpc_compute_autocorrelation_intrin_neon_lag_8(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 2);
+}
+
+void FLAC__lpc_compute_autocorrelation_intrin_neon_lag_12(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 3);
+}
+
+void FLAC__lpc_compute_autocorrelation_intrin_neon_lag_16(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 4);
+}
+
+void FLAC__lpc_compute_autocorrelation_intrin_neon_lag_32(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	compute_autocorrelation_(data, data_len, lag, autoc, 8);
+}
+
+#define WINDOW_TILE_ 256
+
+void FLAC__lpc_compute_autocorrelation_windowed_intrin_neon(const FLAC__int32 in[], const FLAC__real window[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	FLAC__real buf[WINDOW_TILE_ + 32];
+	float32x4_t acc[8];
+	const unsigned nv = lag <= 16? (lag + 3) / 4 : 8;
+	const unsigned width = 4 * nv;
+	unsigned i, t;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= 32);
+	FLAC__ASSERT(lag <= data_len);
+
+	for(i = 0; i < 8; i++)
+		acc[i] = vdupq_n_f32(0.0f);
+	for(t = 0; t < data_len; t += WINDOW_TILE_) {
+		const unsigned n = data_len - t < WINDOW_TILE_? data_len - t : WINDOW_TILE_;
+		const unsigned avail = data_len - t < n + width - 1? data_len - t : n + width - 1;
+		for(i = 0; i + 4 <= avail; i += 4)
+			vst1q_f32(buf+i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(in+t+i)), vld1q_f32(window+t+i)));
+		for(; i < avail; i++)
+			buf[i] = in[t+i] * window[t+i];
+		for(; i < n + width - 1; i++)
+			buf[i] = 0.0;
+		autoc_block_(buf, n, nv, acc);
+	}
+	store_autoc_(acc, lag, autoc);
+}
+
+#endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
+#endif /* FLAC__ARM64_NEON */
@@ -0,0 +1,366 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+
+#include <smmintrin.h>
+#include "FLAC/assert.h"
+#include "private/lpc.h"
+
+/*
+ * The vector loops below handle 4 (or 2, for the 64-bit versions)
+ * samples per iteration; whatever is left at the end of the block is
+ * done one sample at a time just like the plain C versions in lpc.c.
+ *
+ * As in lpc.c we do unique versions up to 12th order since that's the
+ * subset limit; higher orders go through a generic loop or the C
+ * version.
+ */
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+#define RESIDUAL32_TERM_(j) summ = _mm_add_epi32(summ, _mm_mullo_epi32(q##j, _mm_loadu_si128((const __m128i*)(data+i-(j)-1))));
+#define RESIDUAL32_LOOP_(terms) \
+	for(i = 0; i < limit; i += 4) { \
+		summ = _mm_setzero_si128(); \
+		terms \
+		_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(data+i)), _mm_sra_epi32(summ, cnt))); \
+	}
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 3;
+	const __m128i cnt = _mm_cvtsi32_si128(lp_quantization);
+	__m128i summ, q0, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11, qv[32];
+	FLAC__int32 sum;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order <= 12) {
+		q0 = q1 = q2 = q3 = q4 = q5 = q6 = q7 = q8 = q9 = q10 = q11 = _mm_setzero_si128();
+		switch(order) { /* the cases fall through */
+			case 12: q11 = _mm_set1_epi32(qlp_coeff[11]);
+			case 11: q10 = _mm_set1_epi32(qlp_coeff[10]);
+			case 10: q9 = _mm_set1_epi32(qlp_coeff[9]);
+			case 9: q8 = _mm_set1_epi32(qlp_coeff[8]);
+			case 8: q7 = _mm_set1_epi32(qlp_coeff[7]);
+			case 7: q6 = _mm_set1_epi32(qlp_coeff[6]);
+			case 6: q5 = _mm_set1_epi32(qlp_coeff[5]);
+			case 5: q4 = _mm_set1_epi32(qlp_coeff[4]);
+			case 4: q3 = _mm_set1_epi32(qlp_coeff[3]);
+			case 3: q2 = _mm_set1_epi32(qlp_coeff[2]);
+			case 2: q1 = _mm_set1_epi32(qlp_coeff[1]);
+			case 1: q0 = _mm_set1_epi32(qlp_coeff[0]);
+		}
+		switch(order) {
+			case 12: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(11) RESIDUAL32_TERM_(10) RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 11: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(10) RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 10: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(9) RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 9: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(8) RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 8: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(7) RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 7: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(6) RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 6: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(5) RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 5: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(4) RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 4: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(3) RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 3: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(2) RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 2: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(1) RESIDUAL32_TERM_(0)) break;
+			case 1: RESIDUAL32_LOOP_(RESIDUAL32_TERM_(0)) break;
+		}
+	}
+	else {
+		for(j = 0; j < (int)order; j++)
+			qv[j] = _mm_set1_epi32(qlp_coeff[j]);
+		for(i = 0; i < limit; i += 4) {
+			summ = _mm_setzero_si128();
+			for(j = 0; j < (int)order; j++)
+				summ = _mm_add_epi32(summ, _mm_mullo_epi32(qv[j], _mm_loadu_si128((const __m128i*)(data+i-j-1))));
+			_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(data+i)), _mm_sra_epi32(summ, cnt)));
+		}
+	}
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * data[i-j-1];
+		residual[i] = data[i] - (sum >> lp_quantization);
+	}
+}
+
+/*
+ * _mm_mul_epi32() multiplies the low signed 32 bits of each 64-bit lane,
+ * so two samples are sign-extended into the two lanes and the result is
+ * the full 64-bit product.  Only the low 32 bits of the shifted sum are
+ * kept, so a logical shift gives the same residual as the arithmetic
+ * shift in the C version.
+ */
+#define RESIDUAL64_TERM_(j) summ = _mm_add_epi64(summ, _mm_mul_epi32(q##j, _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(data+i-(j)-1)))));
+#define RESIDUAL64_LOOP_(terms) \
+	for(i = 0; i < limit; i += 2) { \
+		summ = _mm_setzero_si128(); \
+		terms \
+		summ = _mm_shuffle_epi32(_mm_srl_epi64(summ, cnt), _MM_SHUFFLE(2,0,2,0)); \
+		_mm_storel_epi64((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadl_epi64((const __m128i*)(data+i)), summ)); \
+	}
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 1;
+	const __m128i cnt = _mm_cvtsi32_si128(lp_quantization);
+	__m128i summ, q0, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11;
+	FLAC__int64 sum;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+	FLAC__ASSERT(lp_quantization <= 32);
+
+	if(order <= 12) {
+		q0 = q1 = q2 = q3 = q4 = q5 = q6 = q7 = q8 = q9 = q10 = q11 = _mm_setzero_si128();
+		switch(order) { /* the cases fall through */
+			case 12: q11 = _mm_set1_epi32(qlp_coeff[11]);
+			case 11: q10 = _mm_set1_epi32(qlp_coeff[10]);
+			case 10: q9 = _mm_set1_epi32(qlp_coeff[9]);
+			case 9: q8 = _mm_set1_epi32(qlp_coeff[8]);
+			case 8: q7 = _mm_set1_epi32(qlp_coeff[7]);
+			case 7: q6 = _mm_set1_epi32(qlp_coeff[6]);
+			case 6: q5 = _mm_set1_epi32(qlp_coeff[5]);
+			case 5: q4 = _mm_set1_epi32(qlp_coeff[4]);
+			case 4: q3 = _mm_set1_epi32(qlp_coeff[3]);
+			case 3: q2 = _mm_set1_epi32(qlp_coeff[2]);
+			case 2: q1 = _mm_set1_epi32(qlp_coeff[1]);
+			case 1: q0 = _mm_set1_epi32(qlp_coeff[0]);
+		}
+		switch(order) {
+			case 12: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(11) RESIDUAL64_TERM_(10) RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 11: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(10) RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 10: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(9) RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 9: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(8) RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 8: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(7) RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 7: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(6) RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 6: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(5) RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 5: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(4) RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 4: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(3) RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 3: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(2) RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 2: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(1) RESIDUAL64_TERM_(0)) break;
+			case 1: RESIDUAL64_LOOP_(RESIDUAL64_TERM_(0)) break;
+		}
+	}
+	else {
+		/* two samples at a time is not enough to beat the C version at these orders */
+		FLAC__lpc_compute_residual_from_qlp_coefficients_wide(data, data_len, qlp_coeff, order, lp_quantization, residual);
+		return;
+	}
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * (FLAC__int64)data[i-j-1];
+		residual[i] = data[i] - (FLAC__int32)(sum >> lp_quantization);
+	}
+}
+
+#endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
+
+/*
+ * Restoring the signal is recursive, so the samples cannot simply be
+ * computed side by side like the residual.  Instead the block is done
+ * in pairs of samples.  The part of the prediction that only uses
+ * data[i-3] and earlier for the pair starting at i is computed with
+ * vector multiplies; since it does not depend on the pair just
+ * finished it overlaps with the scalar chain instead of lengthening
+ * it.  Lags 1 and 2 (and 3 for the second sample) are added one sample
+ * at a time, with the term on the previous sample added last so that it
+ * is the only thing on the critical path.
+ *
+ * The older samples are kept sign-extended in 64-bit lanes, in
+ * registers, so that _mm_mul_epi32() can be used and so the vector part
+ * never reloads what was just stored.  For the 32-bit version only the
+ * low 32 bits of each lane are used, which gives the same wrap-around
+ * result as the C version.
+ *
+ * For the lower orders the C version is already limited by the
+ * sample-to-sample dependency, so we leave those to it.
+ */
+#define RESTORE_TERM_(j, v) summ = _mm_add_epi64(summ, _mm_mul_epi32(q##j, v));
+#define RESTORE_SHIFT_WINDOW_ \
+		a4 = a3; a3 = a2; a2 = a1; a1 = a0; \
+		a0 = _mm_insert_epi64(_mm_cvtsi64_si128(e0), e1, 1);
+#define RESTORE32_LOOP_(terms) \
+	for(i = 0; i < limit; i += 2) { \
+		summ = _mm_setzero_si128(); \
+		terms \
+		d0 = residual[i  ] + (((FLAC__int32)_mm_cvtsi128_si64(summ) + c1 * e0 + c0 * e1) >> lp_quantization); \
+		d1 = residual[i+1] + (((FLAC__int32)_mm_extract_epi64(summ, 1) + c2 * e0 + c1 * e1 + c0 * d0) >> lp_quantization); \
+		data[i] = d0; data[i+1] = d1; \
+		RESTORE_SHIFT_WINDOW_ \
+		e0 = d0; e1 = d1; \
+	}
+#define RESTORE64_LOOP_(terms) \
+	for(i = 0; i < limit; i += 2) { \
+		summ = _mm_setzero_si128(); \
+		terms \
+		d0 = residual[i  ] + (FLAC__int32)((_mm_cvtsi128_si64(summ) + c1 * (FLAC__int64)e0 + c0 * (FLAC__int64)e1) >> lp_quantization); \
+		d1 = residual[i+1] + (FLAC__int32)((_mm_extract_epi64(summ, 1) + c2 * (FLAC__int64)e0 + c1 * (FLAC__int64)e1 + c0 * (FLAC__int64)d0) >> lp_quantization); \
+		data[i] = d0; data[i+1] = d1; \
+		RESTORE_SHIFT_WINDOW_ \
+		e0 = d0; e1 = d1; \
+	}
+/*
+ * a0 holds data[i-4,i-3], a1 data[i-6,i-5] and so on; each of these
+ * is the pair data[i-lag,i-lag+1] except for lag 3, where the lane that
+ * would be data[i-2] is zero.
+ */
+#define LAG3_ _mm_srli_si128(a0, 8)
+#define LAG4_ a0
+#define LAG5_ _mm_alignr_epi8(a0, a1, 8)
+#define LAG6_ a1
+#define LAG7_ _mm_alignr_epi8(a1, a2, 8)
+#define LAG8_ a2
+#define LAG9_ _mm_alignr_epi8(a2, a3, 8)
+#define LAG10_ a3
+#define LAG11_ _mm_alignr_epi8(a3, a4, 8)
+#define LAG12_ a4
+/* lags 3 and up of the orders we handle */
+#define RESTORE_TERMS_12_ RESTORE_TERM_(11, LAG12_) RESTORE_TERMS_11_
+#define RESTORE_TERMS_11_ RESTORE_TERM_(10, LAG11_) RESTORE_TERMS_10_
+#define RESTORE_TERMS_10_ RESTORE_TERM_(9, LAG10_) RESTORE_TERMS_9_
+#define RESTORE_TERMS_9_ RESTORE_TERM_(8, LAG9_) RESTORE_TERMS_8_
+#define RESTORE_TERMS_8_ RESTORE_TERM_(7, LAG8_) RESTORE_TERMS_7_
+#define RESTORE_TERMS_7_ RESTORE_TERM_(6, LAG7_) RESTORE_TERMS_6_
+#define RESTORE_TERMS_6_ RESTORE_TERM_(5, LAG6_) RESTORE_TERMS_5_
+#define RESTORE_TERMS_5_ RESTORE_TERM_(4, LAG5_) RESTORE_TERMS_4_
+#define RESTORE_TERMS_4_ RESTORE_TERM_(3, LAG4_) RESTORE_TERM_(2, LAG3_)
+#define RESTORE_SETUP_ \
+	/* only data[-order,-1] is guaranteed to exist, so pad the rest of the window with zeroes */ \
+	for(j = 0; j < 14; j++) \
+		history[j] = j < 14 - (int)order? 0 : data[j-14]; \
+	a0 = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(history+10))); \
+	a1 = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(history+8))); \
+	a2 = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(history+6))); \
+	a3 = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(history+4))); \
+	a4 = _mm_cvtepi32_epi64(_mm_loadl_epi64((const __m128i*)(history+2))); \
+	e0 = history[12]; \
+	e1 = history[13]; \
+	c0 = qlp_coeff[0]; \
+	c1 = qlp_coeff[1]; \
+	c2 = qlp_coeff[2]; \
+	q2 = _mm_set1_epi32(qlp_coeff[2]); \
+	q3 = _mm_set1_epi32(qlp_coeff[3]); \
+	q4 = q5 = q6 = q7 = q8 = q9 = q10 = q11 = _mm_setzero_si128(); \
+	switch(order) { /* the cases fall through */ \
+		case 12: q11 = _mm_set1_epi32(qlp_coeff[11]); \
+		case 11: q10 = _mm_set1_epi32(qlp_coeff[10]); \
+		case 10: q9 = _mm_set1_epi32(qlp_coeff[9]); \
+		case 9: q8 = _mm_set1_epi32(qlp_coeff[8]); \
+		case 8: q7 = _mm_set1_epi32(qlp_coeff[7]); \
+		case 7: q6 = _mm_set1_epi32(qlp_coeff[6]); \
+		case 6: q5 = _mm_set1_epi32(qlp_coeff[5]); \
+		case 5: q4 = _mm_set1_epi32(qlp_coeff[4]); \
+	}
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__lpc_restore_signal_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 1;
+	__m128i summ, a0, a1, a2, a3, a4, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11;
+	FLAC__int32 history[14], sum, d0, d1, e0, e1, c0, c1, c2;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order < 8 || order > 12) {
+		FLAC__lpc_restore_signal(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	RESTORE_SETUP_
+	switch(order) {
+		case 12: RESTORE32_LOOP_(RESTORE_TERMS_12_) break;
+		case 11: RESTORE32_LOOP_(RESTORE_TERMS_11_) break;
+		case 10: RESTORE32_LOOP_(RESTORE_TERMS_10_) break;
+		case 9: RESTORE32_LOOP_(RESTORE_TERMS_9_) break;
+		case 8: RESTORE32_LOOP_(RESTORE_TERMS_8_) break;
+	}
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * data[i-j-1];
+		data[i] = residual[i] + (sum >> lp_quantization);
+	}
+}
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__lpc_restore_signal_wide_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	int i = 0, j;
+	const int limit = (int)data_len - 1;
+	__m128i summ, a0, a1, a2, a3, a4, q2, q3, q4, q5, q6, q7, q8, q9, q10, q11;
+	FLAC__int64 sum;
+	FLAC__int32 history[14], d0, d1, e0, e1, c0, c1, c2;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order < 8 || order > 12) {
+		FLAC__lpc_restore_signal_wide(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	RESTORE_SETUP_
+	switch(order) {
+		case 12: RESTORE64_LOOP_(RESTORE_TERMS_12_) break;
+		case 11: RESTORE64_LOOP_(RESTORE_TERMS_11_) break;
+		case 10: RESTORE64_LOOP_(RESTORE_TERMS_10_) break;
+		case 9: RESTORE64_LOOP_(RESTORE_TERMS_9_) break;
+		case 8: RESTORE64_LOOP_(RESTORE_TERMS_8_) break;
+	}
+
+	for(; i < (int)data_len; i++) {
+		sum = 0;
+		for(j = 0; j < (int)order; j++)
+			sum += qlp_coeff[j] * (FLAC__int64)data[i-j-1];
+		data[i] = residual[i] + (FLAC__int32)(sum >> lp_quantization);
+	}
+}
+
+#endif /* FLAC__X86_64_INTRIN */
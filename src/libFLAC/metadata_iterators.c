@@ -339,6 +339,109 @@ FLAC_API FLAC__bool FLAC__metadata_get_picture(const char *filename, FLAC__Strea
 	return (0 != *picture);
 }
 
+/* the signature at the start of a frame index file */
+static const FLAC__byte frame_index_signature_[4] = { 'f', 'L', 'a', 'I' };
+
+/* the most seek points that fit in one SEEKTABLE block */
+#define FRAME_INDEX_MAX_POINTS_PER_BLOCK (((1u << FLAC__STREAM_METADATA_LENGTH_LEN) - 1) / FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)
+
+FLAC_API FLAC__bool FLAC__metadata_read_frame_index(const char *filename, FLAC__StreamMetadata **frame_index)
+{
+	FILE *file;
+	FLAC__byte signature[sizeof(frame_index_signature_)];
+	FLAC__StreamMetadata *object;
+	FLAC__StreamMetadata_SeekTable block;
+	FLAC__bool is_last = false;
+	FLAC__MetadataType type;
+	unsigned length, num_points;
+
+	FLAC__ASSERT(0 != filename);
+	FLAC__ASSERT(0 != frame_index);
+
+	*frame_index = 0;
+
+	if(0 == (file = fopen(filename, "rb")))
+		return false;
+	if(fread(signature, 1, sizeof(signature), file) != sizeof(signature) || memcmp(signature, frame_index_signature_, sizeof(signature))) {
+		fclose(file);
+		return false;
+	}
+	if(0 == (object = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE))) {
+		fclose(file);
+		return false;
+	}
+
+	while(!is_last) {
+		if(!read_metadata_block_header_cb_((FLAC__IOHandle)file, (FLAC__IOCallback_Read)fread, &is_last, &type, &length) || type != FLAC__METADATA_TYPE_SEEKTABLE || length % FLAC__STREAM_METADATA_SEEKPOINT_LENGTH != 0) {
+			FLAC__metadata_object_delete(object);
+			fclose(file);
+			return false;
+		}
+		block.points = 0;
+		num_points = object->data.seek_table.num_points;
+		if(
+			read_metadata_block_data_seektable_cb_((FLAC__IOHandle)file, (FLAC__IOCallback_Read)fread, &block, length) != FLAC__METADATA_SIMPLE_ITERATOR_STATUS_OK ||
+			!FLAC__metadata_object_seektable_resize_points(object, num_points + block.num_points)
+		) {
+			if(0 != block.points)
+				free(block.points);
+			FLAC__metadata_object_delete(object);
+			fclose(file);
+			return false;
+		}
+		/* append the block's points */
+		if(0 != block.points) {
+			memcpy(object->data.seek_table.points + num_points, block.points, block.num_points * sizeof(FLAC__StreamMetadata_SeekPoint));
+			free(block.points);
+		}
+	}
+	fclose(file);
+
+	if(!FLAC__format_seektable_is_legal(&object->data.seek_table)) {
+		FLAC__metadata_object_delete(object);
+		return false;
+	}
+
+	*frame_index = object;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__metadata_write_frame_index(const char *filename, const FLAC__StreamMetadata *frame_index)
+{
+	FILE *file;
+	FLAC__StreamMetadata block;
+	unsigned i = 0;
+	FLAC__bool ok;
+
+	FLAC__ASSERT(0 != filename);
+	FLAC__ASSERT(0 != frame_index);
+	FLAC__ASSERT(frame_index->type == FLAC__METADATA_TYPE_SEEKTABLE);
+
+	if(0 == (file = fopen(filename, "wb")))
+		return false;
+
+	ok = local__fwrite(frame_index_signature_, 1, sizeof(frame_index_signature_), file) == sizeof(frame_index_signature_);
+
+	/* one SEEKTABLE block for every FRAME_INDEX_MAX_POINTS_PER_BLOCK points, and at least one */
+	block.type = FLAC__METADATA_TYPE_SEEKTABLE;
+	do {
+		block.data.seek_table.points = frame_index->data.seek_table.points + i;
+		block.data.seek_table.num_points = min(frame_index->data.seek_table.num_points - i, FRAME_INDEX_MAX_POINTS_PER_BLOCK);
+		block.length = block.data.seek_table.num_points * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH;
+		i += block.data.seek_table.num_points;
+		block.is_last = (i == frame_index->data.seek_table.num_points);
+		ok = ok &&
+			write_metadata_block_header_cb_((FLAC__IOHandle)file, (FLAC__IOCallback_Write)fwrite, &block) &&
+			write_metadata_block_data_seektable_cb_((FLAC__IOHandle)file, (FLAC__IOCallback_Write)fwrite, &block.data.seek_table);
+	} while(ok && !block.is_last);
+
+	if(fclose(file) != 0)
+		ok = false;
+	if(!ok)
+		(void)unlink(filename);
+	return ok;
+}
+
 
 /****************************************************************************
  *
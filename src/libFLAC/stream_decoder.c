@@ -46,6 +46,15 @@
 #include <string.h> /* for memset/memcpy() */
 #include <sys/stat.h> /* for stat() */
 #include <sys/types.h> /* for off_t */
+#ifdef FLAC__HAS_PTHREAD
+#include <pthread.h>
+#endif
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+#include <fcntl.h> /* for open() */
+#include <sys/mman.h> /* for mmap() */
+#include <unistd.h> /* for close() */
+#define FLAC__STREAM_DECODER_HAS_MMAP
+#endif
 #if defined _MSC_VER || defined __BORLANDC__ || defined __MINGW32__
 #if _MSC_VER < 1400 || defined __BORLANDC__ /* @@@ [2G limit] */
 #define fseeko fseek
@@ -60,12 +69,15 @@
 #endif
 #endif
 #include "FLAC/assert.h"
+#include "FLAC/metadata.h"
 #include "share/alloc.h"
+#include "share/pcm.h"
 #include "protected/stream_decoder.h"
 #include "private/bitreader.h"
 #include "private/bitmath.h"
 #include "private/cpu.h"
 #include "private/crc.h"
+#include "private/dispatch.h"
 #include "private/fixed.h"
 #include "private/format.h"
 #include "private/lpc.h"
@@ -76,6 +88,10 @@
 #undef max
 #endif
 #define max(a,b) ((a)>(b)?(a):(b))
+#ifdef min
+#undef min
+#endif
+#define min(a,b) ((a)<(b)?(a):(b))
 
 /* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
 #ifdef _MSC_VER
@@ -103,6 +119,77 @@ FLAC_API int FLAC_API_SUPPORTS_OGG_FLAC =
 
 static FLAC__byte ID3V2_TAG_[3] = { 'I', 'D', '3' };
 
+/* Upper limit for FLAC__stream_decoder_set_num_threads(). */
+#define FLAC__STREAM_DECODER_MAX_THREADS 64
+
+/* Bytes the frame scanner keeps room for, and the least it reads from the input at a time. */
+#define FLAC__STREAM_DECODER_SCAN_CHUNK 65536
+#define FLAC__STREAM_DECODER_SCAN_MIN_READ 4096
+
+/* The longest possible frame header, including the CRC-8. */
+#define FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN 16
+
+/* Upper limit for FLAC__stream_decoder_set_pipeline_depth(). */
+#define FLAC__STREAM_DECODER_MAX_PIPELINE_DEPTH 16
+
+/* Samples per channel that pack_samples_() decorrelates at a time. */
+#define FLAC__STREAM_DECODER_PACK_CHUNK 256
+
+/* For packing samples into the client's buffers in native byte order. */
+#if WORDS_BIGENDIAN
+#define FLAC__STREAM_DECODER_IS_BIG_ENDIAN true
+#else
+#define FLAC__STREAM_DECODER_IS_BIG_ENDIAN false
+#endif
+
+/*
+ * Everything needed to decode one frame.  When decoding single-threaded
+ * there is exactly one of these and its input is the decoder's own
+ * bitreader; with worker threads each pending frame gets its own copy of
+ * the frame's bytes, found ahead of time by the frame scanner, and reads
+ * them through frame_input.
+ */
+typedef struct {
+	FLAC__BitReader *input;                           /* where the frame is read from */
+	FLAC__Frame frame;
+	FLAC__int32 *output[FLAC__MAX_CHANNELS];
+	FLAC__int32 *residual[FLAC__MAX_CHANNELS]; /* WATCHOUT: these are the aligned pointers; the real pointers that should be free()'d are residual_unaligned[] below */
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents[FLAC__MAX_CHANNELS];
+	unsigned output_capacity, output_channels;
+	unsigned restore_samples;                         /* how many samples from the start of the block are restored into output[]; normally the blocksize */
+	FLAC__bool decorrelate;                           /* false to leave the channel decorrelation to pack_samples_() */
+	FLAC__bool lost_sync;                             /* true if the frame turned out to be bad; error_status says why */
+	FLAC__StreamDecoderErrorStatus error_status;
+	FLAC__bool crc_ok;                                /* false if the frame CRC did not match; the output is zeroed */
+	FLAC__bool memory_error;                          /* true if decoding failed for lack of memory */
+#ifdef FLAC__HAS_PTHREAD
+	FLAC__BitReader *frame_input;                     /* reads from data[] */
+	FLAC__byte *data;                                 /* any bytes the scanner skipped to find the frame, then the bytes of the frame */
+	size_t data_length, data_capacity, data_consumed;
+	size_t junk_length;                               /* bytes at the start of data[] that belong to no frame; all of data[] if there is no frame */
+	unsigned header_length;                           /* bytes of data[] taken by the frame header, already parsed into frame.header */
+	FLAC__uint64 end_position;                        /* stream offset just past data[], if known */
+	FLAC__bool has_trailing_bytes;                    /* the frame ended before the end of data[] */
+	FLAC__bool ok;                                    /* false if decoding ran out of data[] or memory */
+	FLAC__bool done;                                  /* set by the worker thread once the frame is decoded */
+#endif
+	/* unaligned (original) pointers to allocated data */
+	FLAC__int32 *residual_unaligned[FLAC__MAX_CHANNELS];
+} FLAC__StreamDecoderThreadTask;
+
+#ifdef FLAC__HAS_PTHREAD
+/*
+ * A decoded frame waiting in the pipeline for the consumer thread, which
+ * does the MD5 checking and calls the write callback.
+ */
+typedef struct {
+	FLAC__Frame frame;
+	FLAC__int32 *output[FLAC__MAX_CHANNELS];          /* a copy of the decoded signal */
+	unsigned output_capacity;                         /* allocated size (in samples) of each output[] */
+	FLAC__bool do_md5_checking;
+} FLAC__StreamDecoderPipelineFrame;
+#endif
+
 /***********************************************************************
  *
  * Private class method prototypes
@@ -111,7 +198,11 @@ static FLAC__byte ID3V2_TAG_[3] = { 'I', 'D', '3' };
 
 static void set_defaults_(FLAC__StreamDecoder *decoder);
 static FILE *get_binary_stdin_(void);
-static FLAC__bool allocate_output_(FLAC__StreamDecoder *decoder, unsigned size, unsigned channels);
+static FLAC__StreamDecoderThreadTask *threadtask_new_(void);
+static void threadtask_delete_(FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool allocate_output_(FLAC__StreamDecoderThreadTask *threadtask, unsigned size, unsigned channels);
+static void free_output_(FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool finish_internal_(FLAC__StreamDecoder *decoder, FLAC__bool keep_buffers);
 static FLAC__bool has_id_filtered_(FLAC__StreamDecoder *decoder, FLAC__byte *id);
 static FLAC__bool find_metadata_(FLAC__StreamDecoder *decoder);
 static FLAC__bool read_metadata_(FLAC__StreamDecoder *decoder);
@@ -124,21 +215,52 @@ static FLAC__bool skip_id3v2_tag_(FLAC__StreamDecoder *decoder);
 static FLAC__bool frame_sync_(FLAC__StreamDecoder *decoder);
 static FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FLAC__bool do_full_decode);
 static FLAC__bool read_frame_header_(FLAC__StreamDecoder *decoder);
-static FLAC__bool read_subframe_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
-static FLAC__bool read_subframe_constant_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
-static FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode);
-static FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode);
-static FLAC__bool read_subframe_verbatim_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
-static FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, unsigned predictor_order, unsigned partition_order, FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents, FLAC__int32 *residual, FLAC__bool is_extended);
-static FLAC__bool read_zero_padding_(FLAC__StreamDecoder *decoder);
+static FLAC__bool read_frame_body_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, FLAC__bool do_full_decode);
+static FLAC__bool write_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, FLAC__bool do_full_decode);
+static FLAC__bool index_frame_(FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header);
+static void frame_lost_sync_(FLAC__StreamDecoderThreadTask *threadtask, FLAC__StreamDecoderErrorStatus status);
+static FLAC__bool read_subframe_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
+static FLAC__bool read_subframe_constant_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
+static FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode);
+static FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode);
+static FLAC__bool read_subframe_verbatim_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
+static FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned predictor_order, unsigned partition_order, FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents, FLAC__int32 *residual, FLAC__bool is_extended);
+static FLAC__bool read_zero_padding_(FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool begin_scan_(FLAC__StreamDecoder *decoder);
+static FLAC__bool scan_fill_(FLAC__StreamDecoder *decoder, size_t bytes);
+static FLAC__bool scan_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte *buffer, size_t bytes, FLAC__FrameHeader *header, unsigned *header_length);
+static FLAC__bool scan_next_frame_(FLAC__StreamDecoder *decoder, FLAC__FrameHeader *header, unsigned *header_length, size_t *frame_length, size_t *junk_length, FLAC__bool *runs_to_end_of_input);
+#ifdef FLAC__HAS_PTHREAD
+static FLAC__bool process_frames_threaded_(FLAC__StreamDecoder *decoder);
+static FLAC__bool scan_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool decode_threaded_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool write_threaded_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask);
+static FLAC__bool flush_threadtasks_(FLAC__StreamDecoder *decoder, unsigned keep, FLAC__bool *needs_replay);
+static void discard_threadtasks_(FLAC__StreamDecoder *decoder);
+static FLAC__bool replay_threadtasks_(FLAC__StreamDecoder *decoder);
+static FLAC__bool threadtask_read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data);
+static FLAC__bool start_threads_(FLAC__StreamDecoder *decoder);
+static void stop_threads_(FLAC__StreamDecoder *decoder);
+static void *decoder_thread_(void *arg);
+static FLAC__bool start_pipeline_(FLAC__StreamDecoder *decoder);
+static void stop_pipeline_(FLAC__StreamDecoder *decoder);
+static FLAC__StreamDecoderWriteStatus queue_pipeline_frame_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
+static FLAC__bool drain_pipeline_(FLAC__StreamDecoder *decoder);
+static void *pipeline_thread_(void *arg);
+#endif
+static FLAC__bool process_until_end_of_stream_(FLAC__StreamDecoder *decoder);
 static FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data);
 #if FLAC__HAS_OGG
 static FLAC__StreamDecoderReadStatus read_callback_ogg_aspect_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes);
 static FLAC__OggDecoderAspectReadStatus read_callback_proxy_(const void *void_decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 #endif
 static FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
+static FLAC__StreamDecoderWriteStatus write_range_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
+static FLAC__bool read_samples_interleaved_(FLAC__StreamDecoder *decoder, FLAC__byte *buffer, unsigned bytes_per_sample, unsigned samples, unsigned *samples_read);
+static void pack_samples_(FLAC__byte *out, const FLAC__int32 * const in[], FLAC__ChannelAssignment channel_assignment, unsigned channels, unsigned bps, unsigned offset, unsigned count, unsigned bytes_per_sample);
 static void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status);
 static FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample);
+static FLAC__bool seek_frame_(FLAC__StreamDecoder *decoder, FLAC__uint64 *frame_end);
 #if FLAC__HAS_OGG
 static FLAC__bool seek_to_absolute_sample_ogg_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample);
 #endif
@@ -147,6 +269,13 @@ static FLAC__StreamDecoderSeekStatus file_seek_callback_(const FLAC__StreamDecod
 static FLAC__StreamDecoderTellStatus file_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data);
 static FLAC__StreamDecoderLengthStatus file_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data);
 static FLAC__bool file_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data);
+#ifdef FLAC__STREAM_DECODER_HAS_MMAP
+static FLAC__StreamDecoderReadStatus mmap_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+static FLAC__StreamDecoderSeekStatus mmap_seek_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data);
+static FLAC__StreamDecoderTellStatus mmap_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data);
+static FLAC__StreamDecoderLengthStatus mmap_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data);
+static FLAC__bool mmap_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data);
+#endif
 
 /***********************************************************************
  *
@@ -174,14 +303,56 @@ typedef struct FLAC__StreamDecoderPrivate {
 	void (*local_lpc_restore_signal_16bit)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
 	/* for use when the signal is <= 16 bits-per-sample, or <= 15 bits-per-sample on a side channel (which requires 1 extra bit), AND order <= 8: */
 	void (*local_lpc_restore_signal_16bit_order8)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	void (*local_fixed_restore_signal)(const FLAC__int32 residual[], unsigned data_len, unsigned order, FLAC__int32 data[]);
+	unsigned (*local_crc16)(const FLAC__byte *data, unsigned len);
 	FLAC__bool (*local_bitreader_read_rice_signed_block)(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter);
 	void *client_data;
 	FILE *file; /* only used if FLAC__stream_decoder_init_file()/FLAC__stream_decoder_init_file() called, else NULL */
+	const FLAC__byte *mmap_data; /* only used if FLAC__stream_decoder_init_mmap()/FLAC__stream_decoder_init_ogg_mmap() mapped the file, else NULL */
+	size_t mmap_length;
+	size_t mmap_position; /* the read position in mmap_data; for native FLAC the bitreader advances it directly */
 	FLAC__BitReader *input;
-	FLAC__int32 *output[FLAC__MAX_CHANNELS];
-	FLAC__int32 *residual[FLAC__MAX_CHANNELS]; /* WATCHOUT: these are the aligned pointers; the real pointers that should be free()'d are residual_unaligned[] below */
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents[FLAC__MAX_CHANNELS];
-	unsigned output_capacity, output_channels;
+	FLAC__StreamDecoderThreadTask *threadtask[2*FLAC__STREAM_DECODER_MAX_THREADS]; /* per-frame workspaces; only [0] is used when single-threaded */
+	unsigned num_threadtasks; /* number of allocated threadtask[] */
+#ifdef FLAC__HAS_PTHREAD
+	unsigned next_threadtask; /* index of the threadtask[] the next scanned frame will go into */
+	unsigned num_pending_threadtasks; /* number of frames handed to worker threads and not yet written */
+	pthread_t thread[FLAC__STREAM_DECODER_MAX_THREADS];
+	unsigned num_running_threads;
+	unsigned next_queued_threadtask; /* index of the threadtask[] the next idle worker will pick up */
+	unsigned num_queued_threadtasks; /* number of frames waiting for a worker */
+	FLAC__bool threads_should_exit;
+	pthread_mutex_t mutex; /* protects the queue and the threadtask[]->done flags */
+	pthread_cond_t cond_queued; /* signalled when a frame is queued or the workers should exit */
+	pthread_cond_t cond_done; /* signalled when a worker has finished a frame */
+	const FLAC__StreamDecoderThreadTask *writing_threadtask; /* the frame being written, for FLAC__stream_decoder_get_decode_position() */
+	FLAC__byte *replay; /* input handed back by replay_threadtasks_(); read_callback_() returns replay[replay_start..replay_length-1] before reading on */
+	size_t replay_start, replay_length;
+	FLAC__bool resyncing; /* decoding single-threaded after a damaged frame, until a frame decodes cleanly again */
+	FLAC__StreamDecoderPipelineFrame pipeline[FLAC__STREAM_DECODER_MAX_PIPELINE_DEPTH]; /* decoded frames handed to the consumer thread; a ring of protected_->pipeline_depth */
+	unsigned pipeline_head; /* index of the oldest frame in the pipeline */
+	unsigned pipeline_count; /* number of frames in the pipeline, including the one being delivered */
+	FLAC__StreamDecoderWriteStatus pipeline_status; /* FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE until delivering a frame fails */
+	FLAC__bool pipeline_running; /* the consumer thread has been started */
+	FLAC__bool pipeline_active; /* frames currently go through the pipeline; only inside FLAC__stream_decoder_process_until_end_of_stream() */
+	FLAC__bool pipeline_should_exit;
+	FLAC__bool pipeline_wait_next; /* the next frame is delivered before decoding goes on; set after an error */
+	pthread_t pipeline_thread;
+	pthread_mutex_t pipeline_mutex; /* protects pipeline_head, pipeline_count, pipeline_status and pipeline_should_exit */
+	pthread_cond_t pipeline_cond; /* signalled when a frame is queued or delivered, or the consumer should exit */
+#endif
+	FLAC__byte *scan_buffer; /* input read ahead by the frame scanner; the unscanned part is scan_buffer[scan_start..scan_length-1] */
+	size_t scan_start, scan_length, scan_capacity;
+	FLAC__bool scan_eof; /* the frame scanner has hit the end of the input */
+	FLAC__uint64 scan_position; /* stream offset of scan_buffer[0] */
+	FLAC__bool has_scan_position;
+	FLAC__uint64 scan_samples; /* sample number following the last frame scanned */
+	FLAC__StreamMetadata *seek_index; /* frame index given by FLAC__stream_decoder_set_frame_index(), or NULL */
+	FLAC__StreamMetadata_SeekPoint *frame_index; /* frame index built while decoding when protected_->frame_indexing is set */
+	unsigned frame_index_length, frame_index_capacity;
+	FLAC__uint64 frame_index_samples; /* sample number following the last frame indexed */
+	FLAC__bool has_frame_end; /* frame_end_position is where the next frame starts if its sample number is frame_end_sample */
+	FLAC__uint64 frame_end_position, frame_end_sample;
 	FLAC__uint32 fixed_block_size, next_fixed_block_size;
 	FLAC__uint64 samples_decoded;
 	FLAC__bool has_stream_info, has_seek_table;
@@ -195,8 +366,6 @@ typedef struct FLAC__StreamDecoderPrivate {
 	FLAC__CPUInfo cpuinfo;
 	FLAC__byte header_warmup[2]; /* contains the sync code and reserved bits */
 	FLAC__byte lookahead; /* temp storage when we need to look ahead one byte in the stream */
-	/* unaligned (original) pointers to allocated data */
-	FLAC__int32 *residual_unaligned[FLAC__MAX_CHANNELS];
 	FLAC__bool do_md5_checking; /* initially gets protected_->md5_checking but is turned off after a seek or if the metadata has a zero MD5 */
 	FLAC__bool internal_reset_hack; /* used only during init() so we can call reset to set up the decoder without rewinding the input */
 	FLAC__bool is_seeking;
@@ -210,6 +379,18 @@ typedef struct FLAC__StreamDecoderPrivate {
 #if FLAC__HAS_OGG
 	FLAC__bool got_a_frame; /* hack needed in Ogg FLAC seek routine to check when process_single() actually writes a frame */
 #endif
+	/* (these are only used by FLAC__stream_decoder_process_range()) */
+	FLAC__bool range_active; /* frames go to write_range_() instead of the write callback */
+	FLAC__uint64 range_first, range_next, range_end; /* the first sample of the range, the next one to be written and the one just past the range */
+	FLAC__int32 *range_buffer; /* the client's interleaved buffer for the range, or NULL to use the write callback */
+	unsigned range_channels; /* channels in range_buffer, taken from the first frame written to it */
+	/* (these are only used by FLAC__stream_decoder_read_samples_interleaved*()) */
+	FLAC__bool pull_active; /* frames are kept for the client to read instead of going to the write callback */
+	FLAC__bool has_pulled_frame; /* pulled_header and pulled_output[] describe a frame the client has not read all of */
+	FLAC__FrameHeader pulled_header;
+	const FLAC__int32 *pulled_output[FLAC__MAX_CHANNELS]; /* the frame's signal, in threadtask[0]->output[] */
+	FLAC__ChannelAssignment pulled_channel_assignment; /* how the signal is still coded; FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT if it is decorrelated */
+	unsigned pulled_samples; /* how many samples of the frame the client has read */
 } FLAC__StreamDecoderPrivate;
 
 /***********************************************************************
@@ -284,7 +465,7 @@ FLAC_API const char * const FLAC__StreamDecoderErrorStatusString[] = {
 FLAC_API FLAC__StreamDecoder *FLAC__stream_decoder_new(void)
 {
 	FLAC__StreamDecoder *decoder;
-	unsigned i;
+	FLAC__CPUDispatch dispatch;
 
 	FLAC__ASSERT(sizeof(int) >= 4); /* we want to die right away if this is not true */
 
@@ -323,19 +504,34 @@ FLAC_API FLAC__StreamDecoder *FLAC__stream_decoder_new(void)
 		return 0;
 	}
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		decoder->private_->output[i] = 0;
-		decoder->private_->residual_unaligned[i] = decoder->private_->residual[i] = 0;
+	if(0 == (decoder->private_->threadtask[0] = threadtask_new_())) {
+		free(decoder->private_->metadata_filter_ids);
+		FLAC__bitreader_delete(decoder->private_->input);
+		free(decoder->private_);
+		free(decoder->protected_);
+		free(decoder);
+		return 0;
 	}
+	decoder->private_->num_threadtasks = 1;
 
-	decoder->private_->output_capacity = 0;
-	decoder->private_->output_channels = 0;
-	decoder->private_->has_seek_table = false;
+	/*
+	 * get the CPU info and set the function pointers; these do not change
+	 * for the lifetime of the instance so they are not redone at init time
+	 */
+	FLAC__cpu_info(&decoder->private_->cpuinfo);
+	FLAC__cpu_dispatch(&decoder->private_->cpuinfo, &dispatch);
+	decoder->private_->local_lpc_restore_signal = dispatch.lpc_restore_signal;
+	decoder->private_->local_lpc_restore_signal_64bit = dispatch.lpc_restore_signal_64bit;
+	decoder->private_->local_lpc_restore_signal_16bit = dispatch.lpc_restore_signal_16bit;
+	decoder->private_->local_lpc_restore_signal_16bit_order8 = dispatch.lpc_restore_signal_16bit_order8;
+	decoder->private_->local_fixed_restore_signal = dispatch.fixed_restore_signal;
+	decoder->private_->local_crc16 = dispatch.crc16;
+	decoder->private_->local_bitreader_read_rice_signed_block = dispatch.bitreader_read_rice_signed_block;
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&decoder->private_->partitioned_rice_contents[i]);
+	decoder->private_->has_seek_table = false;
 
 	decoder->private_->file = 0;
+	decoder->private_->mmap_data = 0;
 
 	set_defaults_(decoder);
 
@@ -346,8 +542,6 @@ FLAC_API FLAC__StreamDecoder *FLAC__stream_decoder_new(void)
 
 FLAC_API void FLAC__stream_decoder_delete(FLAC__StreamDecoder *decoder)
 {
-	unsigned i;
-
 	FLAC__ASSERT(0 != decoder);
 	FLAC__ASSERT(0 != decoder->protected_);
 	FLAC__ASSERT(0 != decoder->private_);
@@ -358,10 +552,15 @@ FLAC_API void FLAC__stream_decoder_delete(FLAC__StreamDecoder *decoder)
 	if(0 != decoder->private_->metadata_filter_ids)
 		free(decoder->private_->metadata_filter_ids);
 
+	if(0 != decoder->private_->seek_index)
+		FLAC__metadata_object_delete(decoder->private_->seek_index);
+	if(0 != decoder->private_->frame_index)
+		free(decoder->private_->frame_index);
+
 	FLAC__bitreader_delete(decoder->private_->input);
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&decoder->private_->partitioned_rice_contents[i]);
+	FLAC__ASSERT(decoder->private_->num_threadtasks == 1);
+	threadtask_delete_(decoder->private_->threadtask[0]);
 
 	free(decoder->private_);
 	free(decoder->protected_);
@@ -412,47 +611,6 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 		return decoder->protected_->state = FLAC__STREAM_DECODER_OGG_ERROR;
 #endif
 
-	/*
-	 * get the CPU info and set the function pointers
-	 */
-	FLAC__cpu_info(&decoder->private_->cpuinfo);
-	/* first default to the non-asm routines */
-	decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal;
-	decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide;
-	decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal;
-	decoder->private_->local_lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal;
-	decoder->private_->local_bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block;
-	/* now override with asm where appropriate */
-#ifndef FLAC__NO_ASM
-	if(decoder->private_->cpuinfo.use_asm) {
-#ifdef FLAC__CPU_IA32
-		FLAC__ASSERT(decoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_IA32);
-#ifdef FLAC__HAS_NASM
-#if 1 /*@@@@@@ OPT: not clearly faster, needs more testing */
-		if(decoder->private_->cpuinfo.data.ia32.bswap)
-			decoder->private_->local_bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block_asm_ia32_bswap;
-#endif
-		if(decoder->private_->cpuinfo.data.ia32.mmx) {
-			decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal_asm_ia32;
-			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ia32_mmx;
-			decoder->private_->local_lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ia32_mmx;
-		}
-		else {
-			decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal_asm_ia32;
-			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ia32;
-			decoder->private_->local_lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ia32;
-		}
-#endif
-#elif defined FLAC__CPU_PPC
-		FLAC__ASSERT(decoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_PPC);
-		if(decoder->private_->cpuinfo.data.ppc.altivec) {
-			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ppc_altivec_16;
-			decoder->private_->local_lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ppc_altivec_16_order8;
-		}
-#endif
-	}
-#endif
-
 	/* from here on, errors are fatal */
 
 	if(!FLAC__bitreader_init(decoder->private_->input, decoder->private_->cpuinfo, read_callback_, decoder)) {
@@ -476,6 +634,51 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 
 	decoder->private_->do_md5_checking = decoder->protected_->md5_checking;
 	decoder->private_->is_seeking = false;
+	decoder->private_->range_active = false;
+	decoder->private_->pull_active = false;
+	decoder->private_->has_pulled_frame = false;
+
+	decoder->private_->threadtask[0]->input = decoder->private_->input;
+#ifdef FLAC__HAS_PTHREAD
+	/*
+	 * set up the per-frame workspaces and start the worker threads;
+	 * Ogg FLAC is always decoded on the calling thread
+	 */
+	if(decoder->protected_->num_threads > 1 && !is_ogg) {
+		unsigned i;
+		for(i = 1; i < 2 * decoder->protected_->num_threads; i++) {
+			if(0 == (decoder->private_->threadtask[i] = threadtask_new_())) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
+			}
+			decoder->private_->num_threadtasks = i + 1;
+		}
+		for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+			FLAC__StreamDecoderThreadTask *threadtask = decoder->private_->threadtask[i];
+			if(0 == (threadtask->frame_input = FLAC__bitreader_new()) || !FLAC__bitreader_init(threadtask->frame_input, decoder->private_->cpuinfo, threadtask_read_callback_, threadtask)) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
+			}
+		}
+		decoder->private_->next_threadtask = 0;
+		decoder->private_->num_pending_threadtasks = 0;
+		decoder->private_->writing_threadtask = 0;
+		if(!start_threads_(decoder)) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
+		}
+	}
+	decoder->private_->pipeline_running = false;
+	decoder->private_->pipeline_active = false;
+	if(decoder->protected_->pipeline_depth > 1 && !start_pipeline_(decoder)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
+	}
+#endif
+
+	/* the frame index built for the previous stream is kept until now */
+	decoder->private_->frame_index_length = 0;
+	decoder->private_->frame_index_samples = 0;
 
 	decoder->private_->internal_reset_hack = true; /* so the following reset does not try to rewind the input */
 	if(!FLAC__stream_decoder_reset(decoder)) {
@@ -556,10 +759,10 @@ static FLAC__StreamDecoderInitStatus init_FILE_internal_(
 	FLAC__ASSERT(0 != file);
 
 	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
-		return decoder->protected_->state = FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+		return FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
 
 	if(0 == write_callback || 0 == error_callback)
-		return decoder->protected_->state = FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
+		return FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
 
 	/*
 	 * To make sure that our file does not go unclosed after an error, we
@@ -630,10 +833,10 @@ static FLAC__StreamDecoderInitStatus init_file_internal_(
 	 * in FLAC__stream_decoder_init_FILE() before the FILE* is assigned.
 	 */
 	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
-		return decoder->protected_->state = FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+		return FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
 
 	if(0 == write_callback || 0 == error_callback)
-		return decoder->protected_->state = FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
+		return FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
 
 	file = filename? fopen(filename, "rb") : stdin;
 
@@ -667,7 +870,113 @@ FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_file(
 	return init_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/true);
 }
 
+static FLAC__StreamDecoderInitStatus init_mmap_internal_(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data,
+	FLAC__bool is_ogg
+)
+{
+#ifdef FLAC__STREAM_DECODER_HAS_MMAP
+	struct stat filestats;
+	void *data = MAP_FAILED;
+	int fd;
+	FLAC__StreamDecoderInitStatus init_status;
+#endif
+
+	FLAC__ASSERT(0 != decoder);
+
+	/*
+	 * As in init_file_internal_(), do the entrance checks before we map
+	 * anything so nothing is left mapped after an error.
+	 */
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+
+	if(0 == write_callback || 0 == error_callback)
+		return FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
+
+#ifdef FLAC__STREAM_DECODER_HAS_MMAP
+	if(0 != filename) {
+		if((fd = open(filename, O_RDONLY)) < 0)
+			return FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE;
+		/* only regular, non-empty files that fit in the address space can be mapped */
+		if(fstat(fd, &filestats) == 0 && S_ISREG(filestats.st_mode) && filestats.st_size > 0 && (FLAC__uint64)filestats.st_size <= (FLAC__uint64)((size_t)(-1)))
+			data = mmap(0, (size_t)filestats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd); /* the mapping keeps its own reference to the file */
+
+		if(data != MAP_FAILED) {
+			decoder->private_->mmap_data = (const FLAC__byte*)data;
+			decoder->private_->mmap_length = (size_t)filestats.st_size;
+			decoder->private_->mmap_position = 0;
+
+			init_status = init_stream_internal_(
+				decoder,
+				mmap_read_callback_,
+				mmap_seek_callback_,
+				mmap_tell_callback_,
+				mmap_length_callback_,
+				mmap_eof_callback_,
+				write_callback,
+				metadata_callback,
+				error_callback,
+				client_data,
+				is_ogg
+			);
+			if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+				munmap(data, decoder->private_->mmap_length);
+				decoder->private_->mmap_data = 0;
+			}
+			/* Ogg FLAC has to be unpacked page by page, but native FLAC can go straight into the bitreader */
+			else if(!is_ogg)
+				FLAC__bitreader_set_source(decoder->private_->input, decoder->private_->mmap_data, decoder->private_->mmap_length, &decoder->private_->mmap_position);
+			return init_status;
+		}
+	}
+#endif
+
+	/* stdin, and anything that cannot be mapped, is read with stdio */
+	return init_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, is_ogg);
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_mmap(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_mmap_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/false);
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_mmap(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_mmap_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/true);
+}
+
 FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
+{
+	return finish_internal_(decoder, /*keep_buffers=*/false);
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_recycle(FLAC__StreamDecoder *decoder)
+{
+	return finish_internal_(decoder, /*keep_buffers=*/true);
+}
+
+FLAC__bool finish_internal_(FLAC__StreamDecoder *decoder, FLAC__bool keep_buffers)
 {
 	FLAC__bool md5_failed = false;
 	unsigned i;
@@ -689,25 +998,41 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 		decoder->private_->seek_table.data.seek_table.points = 0;
 		decoder->private_->has_seek_table = false;
 	}
-	FLAC__bitreader_free(decoder->private_->input);
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		/* WATCHOUT:
-		 * FLAC__lpc_restore_signal_asm_ia32_mmx() requires that the
-		 * output arrays have a buffer of up to 3 zeroes in front
-		 * (at negative indices) for alignment purposes; we use 4
-		 * to keep the data well-aligned.
-		 */
-		if(0 != decoder->private_->output[i]) {
-			free(decoder->private_->output[i]-4);
-			decoder->private_->output[i] = 0;
-		}
-		if(0 != decoder->private_->residual_unaligned[i]) {
-			free(decoder->private_->residual_unaligned[i]);
-			decoder->private_->residual_unaligned[i] = decoder->private_->residual[i] = 0;
-		}
+	/* the input buffer is picked up again by FLAC__bitreader_init() */
+	if(!keep_buffers)
+		FLAC__bitreader_free(decoder->private_->input);
+	if(0 != decoder->private_->scan_buffer) {
+		free(decoder->private_->scan_buffer);
+		decoder->private_->scan_buffer = 0;
+	}
+	decoder->private_->scan_start = decoder->private_->scan_length = decoder->private_->scan_capacity = 0;
+#ifdef FLAC__HAS_PTHREAD
+	if(0 != decoder->private_->replay) {
+		free(decoder->private_->replay);
+		decoder->private_->replay = 0;
+	}
+	decoder->private_->replay_start = decoder->private_->replay_length = 0;
+	decoder->private_->resyncing = false;
+	stop_threads_(decoder);
+	stop_pipeline_(decoder);
+	/* the first workspace stays around for single-threaded decoding */
+	if(0 != decoder->private_->threadtask[0]->frame_input) {
+		FLAC__bitreader_delete(decoder->private_->threadtask[0]->frame_input);
+		decoder->private_->threadtask[0]->frame_input = 0;
+	}
+	if(0 != decoder->private_->threadtask[0]->data) {
+		free(decoder->private_->threadtask[0]->data);
+		decoder->private_->threadtask[0]->data = 0;
 	}
-	decoder->private_->output_capacity = 0;
-	decoder->private_->output_channels = 0;
+	decoder->private_->threadtask[0]->data_capacity = 0;
+#endif
+	if(!keep_buffers)
+		free_output_(decoder->private_->threadtask[0]);
+	for(i = 1; i < decoder->private_->num_threadtasks; i++) {
+		threadtask_delete_(decoder->private_->threadtask[i]);
+		decoder->private_->threadtask[i] = 0;
+	}
+	decoder->private_->num_threadtasks = 1;
 
 #if FLAC__HAS_OGG
 	if(decoder->private_->is_ogg)
@@ -720,11 +1045,21 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 		decoder->private_->file = 0;
 	}
 
+#ifdef FLAC__STREAM_DECODER_HAS_MMAP
+	if(0 != decoder->private_->mmap_data) {
+		munmap((void*)decoder->private_->mmap_data, decoder->private_->mmap_length);
+		decoder->private_->mmap_data = 0;
+	}
+#endif
+
 	if(decoder->private_->do_md5_checking) {
 		if(memcmp(decoder->private_->stream_info.data.stream_info.md5sum, decoder->private_->computed_md5sum, 16))
 			md5_failed = true;
 	}
 	decoder->private_->is_seeking = false;
+	decoder->private_->range_active = false;
+	decoder->private_->pull_active = false;
+	decoder->private_->has_pulled_frame = false;
 
 	set_defaults_(decoder);
 
@@ -760,6 +1095,71 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_md5_checking(FLAC__StreamDecoder *d
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__HAS_PTHREAD
+	if(value == 0 || value > FLAC__STREAM_DECODER_MAX_THREADS)
+		return false;
+#else
+	if(value != 1)
+		return false;
+#endif
+	decoder->protected_->num_threads = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_pipeline_depth(FLAC__StreamDecoder *decoder, unsigned value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__HAS_PTHREAD
+	if(value == 0 || value > FLAC__STREAM_DECODER_MAX_PIPELINE_DEPTH)
+		return false;
+#else
+	if(value != 1)
+		return false;
+#endif
+	decoder->protected_->pipeline_depth = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_indexing(FLAC__StreamDecoder *decoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+	decoder->protected_->frame_indexing = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_index(FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *frame_index)
+{
+	FLAC__StreamMetadata *copy = 0;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->private_);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+	if(0 != frame_index) {
+		if(frame_index->type != FLAC__METADATA_TYPE_SEEKTABLE || !FLAC__format_seektable_is_legal(&frame_index->data.seek_table))
+			return false;
+		if(0 == (copy = FLAC__metadata_object_clone(frame_index)))
+			return false;
+	}
+	if(0 != decoder->private_->seek_index)
+		FLAC__metadata_object_delete(decoder->private_->seek_index);
+	decoder->private_->seek_index = copy;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_decoder_set_metadata_respond(FLAC__StreamDecoder *decoder, FLAC__MetadataType type)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -895,6 +1295,27 @@ FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDeco
 	return decoder->protected_->md5_checking;
 }
 
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->num_threads;
+}
+
+FLAC_API unsigned FLAC__stream_decoder_get_pipeline_depth(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->pipeline_depth;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_indexing(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->frame_indexing;
+}
+
 FLAC_API FLAC__uint64 FLAC__stream_decoder_get_total_samples(const FLAC__StreamDecoder *decoder)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -949,6 +1370,15 @@ FLAC_API FLAC__bool FLAC__stream_decoder_get_decode_position(const FLAC__StreamD
 #endif
 	if(0 == decoder->private_->tell_callback)
 		return false;
+#ifdef FLAC__HAS_PTHREAD
+	/* the input has been read ahead by the frame scanner; report the end of the frame being written */
+	if(0 != decoder->private_->writing_threadtask) {
+		if(!decoder->private_->has_scan_position)
+			return false;
+		*position = decoder->private_->writing_threadtask->end_position;
+		return true;
+	}
+#endif
 	if(decoder->private_->tell_callback(decoder, position, decoder->private_->client_data) != FLAC__STREAM_DECODER_TELL_STATUS_OK)
 		return false;
 	/* should never happen since all FLAC frames and metadata blocks are byte aligned, but check just in case */
@@ -967,6 +1397,7 @@ FLAC_API FLAC__bool FLAC__stream_decoder_flush(FLAC__StreamDecoder *decoder)
 
 	decoder->private_->samples_decoded = 0;
 	decoder->private_->do_md5_checking = false;
+	decoder->private_->has_pulled_frame = false;
 
 #if FLAC__HAS_OGG
 	if(decoder->private_->is_ogg)
@@ -977,6 +1408,12 @@ FLAC_API FLAC__bool FLAC__stream_decoder_flush(FLAC__StreamDecoder *decoder)
 		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
 		return false;
 	}
+	decoder->private_->scan_start = decoder->private_->scan_length = 0;
+	decoder->private_->scan_eof = false;
+#ifdef FLAC__HAS_PTHREAD
+	decoder->private_->replay_start = decoder->private_->replay_length = 0;
+	decoder->private_->resyncing = false;
+#endif
 	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
 
 	return true;
@@ -1038,6 +1475,7 @@ FLAC_API FLAC__bool FLAC__stream_decoder_reset(FLAC__StreamDecoder *decoder)
 
 	decoder->private_->first_frame_offset = 0;
 	decoder->private_->unparseable_frame_count = 0;
+	decoder->private_->has_frame_end = false;
 
 	return true;
 }
@@ -1108,11 +1546,47 @@ FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_metadata(FLAC__Str
 
 FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_stream(FLAC__StreamDecoder *decoder)
 {
-	FLAC__bool dummy;
 	FLAC__ASSERT(0 != decoder);
 	FLAC__ASSERT(0 != decoder->protected_);
 
+#ifdef FLAC__HAS_PTHREAD
+	if(decoder->private_->pipeline_running) {
+		FLAC__bool ok;
+
+		/* every frame is handed to the client before we return */
+		decoder->private_->pipeline_status = FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		decoder->private_->pipeline_wait_next = false;
+		decoder->private_->pipeline_active = true;
+		ok = process_until_end_of_stream_(decoder);
+		if(!drain_pipeline_(decoder)) {
+			/* same state as when read_frame_() stops on a failed write without the pipeline */
+			decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+			ok = false;
+		}
+		decoder->private_->pipeline_active = false;
+		return ok;
+	}
+#endif
+	return process_until_end_of_stream_(decoder);
+}
+
+FLAC__bool process_until_end_of_stream_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__bool dummy;
+
 	while(1) {
+#ifdef FLAC__HAS_PTHREAD
+		/* the frame scanner needs the STREAMINFO to number the frames */
+		if(
+			decoder->private_->num_threadtasks > 1 && decoder->private_->has_stream_info && !decoder->private_->resyncing &&
+			FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input) &&
+			(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC || decoder->protected_->state == FLAC__STREAM_DECODER_READ_FRAME)
+		) {
+			if(!process_frames_threaded_(decoder))
+				return false; /* above function sets the status for us */
+			continue;
+		}
+#endif
 		switch(decoder->protected_->state) {
 			case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
 				if(!find_metadata_(decoder))
@@ -1238,28 +1712,258 @@ FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *deco
 	}
 }
 
-/***********************************************************************
- *
- * Protected class methods
- *
- ***********************************************************************/
-
-unsigned FLAC__stream_decoder_get_input_bytes_unconsumed(const FLAC__StreamDecoder *decoder)
+FLAC_API FLAC__bool FLAC__stream_decoder_process_range(FLAC__StreamDecoder *decoder, FLAC__uint64 first_sample, FLAC__uint64 last_sample, FLAC__int32 buffer[], FLAC__bool *md5_checked)
 {
+	FLAC__uint64 total_samples;
+	FLAC__bool ok = true;
+
 	FLAC__ASSERT(0 != decoder);
-	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input));
-	FLAC__ASSERT(!(FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) & 7));
-	return FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) / 8;
-}
+	FLAC__ASSERT(0 != decoder->protected_);
 
-/***********************************************************************
- *
- * Private class methods
- *
- ***********************************************************************/
+	if(0 != md5_checked)
+		*md5_checked = false;
 
-void set_defaults_(FLAC__StreamDecoder *decoder)
-{
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
+	)
+		return false;
+
+	if(first_sample > last_sample)
+		return false;
+
+	/* we need the STREAMINFO to know where the stream ends and whether the range can be MD5-checked */
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above call sets the state for us */
+	}
+
+	total_samples = FLAC__stream_decoder_get_total_samples(decoder);
+	if(total_samples > 0 && last_sample >= total_samples)
+		return false;
+
+	/* the MD5 signature covers the whole stream, so only a range of all of it can be checked */
+	if(first_sample != 0 || last_sample + 1 != total_samples)
+		decoder->private_->do_md5_checking = false;
+
+	decoder->private_->range_active = true;
+	decoder->private_->range_first = decoder->private_->range_next = first_sample;
+	decoder->private_->range_end = last_sample + 1;
+	decoder->private_->range_buffer = buffer;
+	decoder->private_->range_channels = 0;
+
+	/* unless the range starts with the next frame, go to the frame holding its first sample */
+	if(decoder->private_->samples_decoded != first_sample)
+		ok = FLAC__stream_decoder_seek_absolute(decoder, first_sample);
+
+	while(ok && decoder->private_->range_next < decoder->private_->range_end) {
+		if(!FLAC__stream_decoder_process_single(decoder))
+			ok = false; /* above call sets the state for us */
+		else if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM || decoder->protected_->state == FLAC__STREAM_DECODER_ABORTED)
+			ok = false;
+	}
+
+	if(ok && 0 != md5_checked)
+		*md5_checked = decoder->private_->do_md5_checking;
+
+	decoder->private_->range_active = false;
+	decoder->private_->range_buffer = 0;
+	return ok;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_read_samples_interleaved(FLAC__StreamDecoder *decoder, FLAC__int32 buffer[], unsigned samples, unsigned *samples_read)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != buffer);
+	FLAC__ASSERT(0 != samples_read);
+	return read_samples_interleaved_(decoder, (FLAC__byte*)buffer, sizeof(FLAC__int32), samples, samples_read);
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_read_samples_interleaved_int16(FLAC__StreamDecoder *decoder, FLAC__int16 buffer[], unsigned samples, unsigned *samples_read)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != buffer);
+	FLAC__ASSERT(0 != samples_read);
+	return read_samples_interleaved_(decoder, (FLAC__byte*)buffer, sizeof(FLAC__int16), samples, samples_read);
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_scan_frames(FLAC__StreamDecoder *decoder, FLAC__StreamMetadata **frame_index)
+{
+	FLAC__StreamMetadata *index;
+	FLAC__FrameHeader header;
+	unsigned header_length, num_frames = 0;
+	size_t frame_length, junk_length;
+	FLAC__bool runs_to_end_of_input;
+	FLAC__uint64 position;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != frame_index);
+
+	*frame_index = 0;
+
+#if FLAC__HAS_OGG
+	if(decoder->private_->is_ogg)
+		return false;
+#endif
+
+	/* if we haven't finished processing the metadata yet, do that so we have the STREAMINFO and first_frame_offset */
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above function sets the status for us */
+	}
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME
+	)
+		return false;
+
+	/* frame numbers can only be turned into sample numbers and offsets with the STREAMINFO and a known position */
+	if(!decoder->private_->has_stream_info || !FLAC__stream_decoder_get_decode_position(decoder, &position))
+		return false;
+
+	if(0 == (index = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE))) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	if(!begin_scan_(decoder)) {
+		FLAC__metadata_object_delete(index);
+		return false;
+	}
+	FLAC__ASSERT(decoder->private_->has_scan_position);
+
+	/* the audio is never decoded so there is nothing to check the MD5 against */
+	decoder->private_->do_md5_checking = false;
+	decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+
+	while(1) {
+		const FLAC__byte *frame;
+		FLAC__StreamMetadata_SeekPoint *point;
+
+		if(!scan_next_frame_(decoder, &header, &header_length, &frame_length, &junk_length, &runs_to_end_of_input)) {
+			/* the above function sets the state for us */
+			FLAC__metadata_object_delete(index);
+			return false;
+		}
+		if(junk_length > 0)
+			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+		decoder->private_->scan_start += junk_length;
+		if(frame_length == 0) /* no more frames */
+			break;
+
+		/* the frame footer covers everything, so a good CRC-16 means the frame really ends here */
+		frame = decoder->private_->scan_buffer + decoder->private_->scan_start;
+		if(frame_length < header_length + 2 || decoder->private_->local_crc16(frame, (unsigned)frame_length - 2) != ((unsigned)frame[frame_length-2] << 8 | frame[frame_length-1])) {
+			/* like read_frame_(), fail on a last frame cut short by the end of the input */
+			if(runs_to_end_of_input) {
+				FLAC__metadata_object_delete(index);
+				decoder->private_->scan_start += frame_length;
+				decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+				return false;
+			}
+			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+		}
+
+		if(num_frames == index->data.seek_table.num_points && !FLAC__metadata_object_seektable_resize_points(index, num_frames? 2 * num_frames : 1024)) {
+			FLAC__metadata_object_delete(index);
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		point = &index->data.seek_table.points[num_frames++];
+		point->sample_number = header.number.sample_number;
+		point->stream_offset = decoder->private_->scan_position + decoder->private_->scan_start - decoder->private_->first_frame_offset;
+		point->frame_samples = header.blocksize;
+
+		decoder->private_->scan_start += frame_length;
+	}
+
+	if(!FLAC__metadata_object_seektable_resize_points(index, num_frames)) {
+		FLAC__metadata_object_delete(index);
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	decoder->private_->samples_decoded = decoder->private_->scan_samples;
+	decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+	*frame_index = index;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_index(const FLAC__StreamDecoder *decoder, FLAC__StreamMetadata **frame_index)
+{
+	FLAC__StreamMetadata *index;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->private_);
+	FLAC__ASSERT(0 != frame_index);
+
+	*frame_index = 0;
+
+	if(0 == (index = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE)))
+		return false;
+	if(!FLAC__metadata_object_seektable_resize_points(index, decoder->private_->frame_index_length)) {
+		FLAC__metadata_object_delete(index);
+		return false;
+	}
+	if(decoder->private_->frame_index_length > 0)
+		memcpy(index->data.seek_table.points, decoder->private_->frame_index, decoder->private_->frame_index_length * sizeof(FLAC__StreamMetadata_SeekPoint));
+	*frame_index = index;
+	return true;
+}
+
+/***********************************************************************
+ *
+ * Protected class methods
+ *
+ ***********************************************************************/
+
+unsigned FLAC__stream_decoder_get_input_bytes_unconsumed(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input));
+	FLAC__ASSERT(!(FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) & 7));
+#ifdef FLAC__HAS_PTHREAD
+	/* the input handed back by replay_threadtasks_() has been read from the client too */
+	return FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) / 8 + (unsigned)(decoder->private_->replay_length - decoder->private_->replay_start);
+#else
+	return FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) / 8;
+#endif
+}
+
+FLAC__bool FLAC__stream_decoder_reserve(FLAC__StreamDecoder *decoder, unsigned blocksize, unsigned channels, unsigned max_partition_order)
+{
+	unsigned i, channel;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(channels <= FLAC__MAX_CHANNELS);
+
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		FLAC__StreamDecoderThreadTask *threadtask = decoder->private_->threadtask[i];
+		if(!allocate_output_(threadtask, blocksize, channels))
+			return false;
+		for(channel = 0; channel < channels; channel++) {
+			if(!FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(&threadtask->partitioned_rice_contents[channel], max(6, max_partition_order)))
+				return false;
+		}
+	}
+	return true;
+}
+
+/***********************************************************************
+ *
+ * Private class methods
+ *
+ ***********************************************************************/
+
+void set_defaults_(FLAC__StreamDecoder *decoder)
+{
 #if FLAC__HAS_OGG
 	decoder->private_->is_ogg = false;
 #endif
@@ -1278,6 +1982,14 @@ void set_defaults_(FLAC__StreamDecoder *decoder)
 	decoder->private_->metadata_filter_ids_count = 0;
 
 	decoder->protected_->md5_checking = false;
+	decoder->protected_->num_threads = 1;
+	decoder->protected_->pipeline_depth = 1;
+	decoder->protected_->frame_indexing = false;
+
+	if(0 != decoder->private_->seek_index) {
+		FLAC__metadata_object_delete(decoder->private_->seek_index);
+		decoder->private_->seek_index = 0;
+	}
 
 #if FLAC__HAS_OGG
 	FLAC__ogg_decoder_aspect_set_defaults(&decoder->protected_->ogg_decoder_aspect);
@@ -1305,26 +2017,57 @@ FILE *get_binary_stdin_(void)
 	return stdin;
 }
 
-FLAC__bool allocate_output_(FLAC__StreamDecoder *decoder, unsigned size, unsigned channels)
+FLAC__StreamDecoderThreadTask *threadtask_new_(void)
+{
+	FLAC__StreamDecoderThreadTask *threadtask;
+	unsigned i;
+
+	threadtask = (FLAC__StreamDecoderThreadTask*)calloc(1, sizeof(FLAC__StreamDecoderThreadTask));
+	if(threadtask == 0)
+		return 0;
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents[i]);
+
+#ifdef FLAC__HAS_PTHREAD
+	threadtask->done = true;
+#endif
+
+	return threadtask;
+}
+
+void threadtask_delete_(FLAC__StreamDecoderThreadTask *threadtask)
+{
+	unsigned i;
+
+	FLAC__ASSERT(0 != threadtask);
+
+	free_output_(threadtask);
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents[i]);
+
+#ifdef FLAC__HAS_PTHREAD
+	if(0 != threadtask->frame_input)
+		FLAC__bitreader_delete(threadtask->frame_input);
+	if(0 != threadtask->data)
+		free(threadtask->data);
+#endif
+
+	free(threadtask);
+}
+
+FLAC__bool allocate_output_(FLAC__StreamDecoderThreadTask *threadtask, unsigned size, unsigned channels)
 {
 	unsigned i;
 	FLAC__int32 *tmp;
 
-	if(size <= decoder->private_->output_capacity && channels <= decoder->private_->output_channels)
+	if(size <= threadtask->output_capacity && channels <= threadtask->output_channels)
 		return true;
 
 	/* simply using realloc() is not practical because the number of channels may change mid-stream */
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		if(0 != decoder->private_->output[i]) {
-			free(decoder->private_->output[i]-4);
-			decoder->private_->output[i] = 0;
-		}
-		if(0 != decoder->private_->residual_unaligned[i]) {
-			free(decoder->private_->residual_unaligned[i]);
-			decoder->private_->residual_unaligned[i] = decoder->private_->residual[i] = 0;
-		}
-	}
+	free_output_(threadtask);
 
 	for(i = 0; i < channels; i++) {
 		/* WATCHOUT:
@@ -1334,28 +2077,43 @@ FLAC__bool allocate_output_(FLAC__StreamDecoder *decoder, unsigned size, unsigne
 		 * to keep the data well-aligned.
 		 */
 		tmp = (FLAC__int32*)safe_malloc_muladd2_(sizeof(FLAC__int32), /*times (*/size, /*+*/4/*)*/);
-		if(tmp == 0) {
-			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		if(tmp == 0)
 			return false;
-		}
 		memset(tmp, 0, sizeof(FLAC__int32)*4);
-		decoder->private_->output[i] = tmp + 4;
+		threadtask->output[i] = tmp + 4;
 
 		/* WATCHOUT:
 		 * minimum of quadword alignment for PPC vector optimizations is REQUIRED:
 		 */
-		if(!FLAC__memory_alloc_aligned_int32_array(size, &decoder->private_->residual_unaligned[i], &decoder->private_->residual[i])) {
-			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		if(!FLAC__memory_alloc_aligned_int32_array(size, &threadtask->residual_unaligned[i], &threadtask->residual[i]))
 			return false;
-		}
 	}
 
-	decoder->private_->output_capacity = size;
-	decoder->private_->output_channels = channels;
+	threadtask->output_capacity = size;
+	threadtask->output_channels = channels;
 
 	return true;
 }
 
+void free_output_(FLAC__StreamDecoderThreadTask *threadtask)
+{
+	unsigned i;
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		if(0 != threadtask->output[i]) {
+			free(threadtask->output[i]-4);
+			threadtask->output[i] = 0;
+		}
+		if(0 != threadtask->residual_unaligned[i]) {
+			free(threadtask->residual_unaligned[i]);
+			threadtask->residual_unaligned[i] = threadtask->residual[i] = 0;
+		}
+	}
+
+	threadtask->output_capacity = 0;
+	threadtask->output_channels = 0;
+}
+
 FLAC__bool has_id_filtered_(FLAC__StreamDecoder *decoder, FLAC__byte *id)
 {
 	size_t i;
@@ -1595,6 +2353,11 @@ FLAC__bool read_metadata_(FLAC__StreamDecoder *decoder)
 		/* if this fails, it's OK, it's just a hint for the seek routine */
 		if(!FLAC__stream_decoder_get_decode_position(decoder, &decoder->private_->first_frame_offset))
 			decoder->private_->first_frame_offset = 0;
+		else {
+			decoder->private_->has_frame_end = true;
+			decoder->private_->frame_end_position = decoder->private_->first_frame_offset;
+			decoder->private_->frame_end_sample = 0;
+		}
 		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
 	}
 
@@ -2001,14 +2764,14 @@ FLAC__bool frame_sync_(FLAC__StreamDecoder *decoder)
 
 FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FLAC__bool do_full_decode)
 {
-	unsigned channel;
-	unsigned i;
-	FLAC__int32 mid, side;
+	FLAC__StreamDecoderThreadTask *threadtask = decoder->private_->threadtask[0];
 	unsigned frame_crc; /* the one we calculate from the input stream */
-	FLAC__uint32 x;
 
 	*got_a_frame = false;
 
+	/* any frame the client was reading is about to be overwritten */
+	decoder->private_->has_pulled_frame = false;
+
 	/* init the CRC */
 	frame_crc = 0;
 	frame_crc = FLAC__CRC16_UPDATE(decoder->private_->header_warmup[0], frame_crc);
@@ -2019,29 +2782,115 @@ FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FL
 		return false;
 	if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) /* means we didn't sync on a valid header */
 		return true;
-	if(!allocate_output_(decoder, decoder->private_->frame.header.blocksize, decoder->private_->frame.header.channels))
+
+	/*
+	 * While seeking, a frame that can't hold the target only has to be
+	 * checked and located, so we skip restoring its samples.
+	 */
+	if(decoder->private_->is_seeking && do_full_decode) {
+		const FLAC__uint64 this_frame_sample = decoder->private_->frame.header.number.sample_number;
+		const FLAC__uint64 target_sample = decoder->private_->target_sample;
+		FLAC__ASSERT(decoder->private_->frame.header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+		if(target_sample < this_frame_sample || target_sample >= this_frame_sample + decoder->private_->frame.header.blocksize)
+			do_full_decode = false;
+	}
+
+	threadtask->input = decoder->private_->input;
+	threadtask->frame.header = decoder->private_->frame.header;
+	threadtask->restore_samples = threadtask->frame.header.blocksize;
+	/* a frame read by the client is decorrelated as it is packed, unless the MD5 sum needs it first */
+	threadtask->decorrelate = !decoder->private_->pull_active || decoder->private_->do_md5_checking;
+
+	/*
+	 * The samples of a frame past the end of a range being decoded by
+	 * FLAC__stream_decoder_process_range() are never delivered, so unless
+	 * they are needed for the MD5 signature we only read their residual.
+	 */
+	if(decoder->private_->range_active && !decoder->private_->do_md5_checking) {
+		const FLAC__uint64 this_frame_sample = threadtask->frame.header.number.sample_number;
+		if(this_frame_sample < decoder->private_->range_end && decoder->private_->range_end - this_frame_sample < threadtask->restore_samples)
+			threadtask->restore_samples = (unsigned)(decoder->private_->range_end - this_frame_sample);
+	}
+
+	if(!read_frame_body_(decoder, threadtask, do_full_decode)) {
+		if(threadtask->memory_error)
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		/* else read_callback_ sets the state for us */
+		return false;
+	}
+	if(threadtask->lost_sync) { /* means bad sync or got corruption */
+		send_error_to_client_(decoder, threadtask->error_status);
+		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+		return true;
+	}
+	if(!threadtask->crc_ok)
+		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+
+	*got_a_frame = true;
+
+	/* we wait to update fixed_block_size until here, when we're sure we've got a proper frame and hence a correct blocksize */
+	if(decoder->private_->next_fixed_block_size)
+		decoder->private_->fixed_block_size = decoder->private_->next_fixed_block_size;
+
+	if(!write_frame_(decoder, threadtask, do_full_decode))
+		return false;
+
+#ifdef FLAC__HAS_PTHREAD
+	/* back in step after a damaged frame; the worker threads can take over again */
+	if(threadtask->crc_ok)
+		decoder->private_->resyncing = false;
+#endif
+
+	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+	return true;
+}
+
+/*
+ * Reads the subframes and footer of the frame whose header is already in
+ * threadtask->frame.header, from threadtask->input.  This touches nothing
+ * in the decoder but the read-only function pointers so that worker
+ * threads can run it; problems are reported through the threadtask:
+ * returns false if the input ran out (or memory_error is set), otherwise
+ * lost_sync says whether the frame was corrupt and crc_ok whether the
+ * footer CRC matched.
+ */
+FLAC__bool read_frame_body_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, FLAC__bool do_full_decode)
+{
+	unsigned channel;
+	unsigned i;
+	FLAC__int32 mid, side;
+	unsigned frame_crc; /* the one we calculate from the input stream */
+	FLAC__uint32 x;
+
+	threadtask->lost_sync = false;
+	threadtask->crc_ok = false;
+	threadtask->memory_error = false;
+
+	if(!allocate_output_(threadtask, threadtask->frame.header.blocksize, threadtask->frame.header.channels)) {
+		threadtask->memory_error = true;
 		return false;
-	for(channel = 0; channel < decoder->private_->frame.header.channels; channel++) {
+	}
+	for(channel = 0; channel < threadtask->frame.header.channels; channel++) {
 		/*
 		 * first figure the correct bits-per-sample of the subframe
 		 */
-		unsigned bps = decoder->private_->frame.header.bits_per_sample;
-		switch(decoder->private_->frame.header.channel_assignment) {
+		unsigned bps = threadtask->frame.header.bits_per_sample;
+		switch(threadtask->frame.header.channel_assignment) {
 			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
 				/* no adjustment needed */
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-				FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
+				FLAC__ASSERT(threadtask->frame.header.channels == 2);
 				if(channel == 1)
 					bps++;
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-				FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
+				FLAC__ASSERT(threadtask->frame.header.channels == 2);
 				if(channel == 0)
 					bps++;
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-				FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
+				FLAC__ASSERT(threadtask->frame.header.channels == 2);
 				if(channel == 1)
 					bps++;
 				break;
@@ -2051,54 +2900,55 @@ FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FL
 		/*
 		 * now read it
 		 */
-		if(!read_subframe_(decoder, channel, bps, do_full_decode))
+		if(!read_subframe_(decoder, threadtask, channel, bps, do_full_decode))
 			return false;
-		if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) /* means bad sync or got corruption */
+		if(threadtask->lost_sync) /* means bad sync or got corruption */
 			return true;
 	}
-	if(!read_zero_padding_(decoder))
+	if(!read_zero_padding_(threadtask))
 		return false;
-	if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) /* means bad sync or got corruption (i.e. "zero bits" were not all zeroes) */
+	if(threadtask->lost_sync) /* means bad sync or got corruption (i.e. "zero bits" were not all zeroes) */
 		return true;
 
 	/*
 	 * Read the frame CRC-16 from the footer and check
 	 */
-	frame_crc = FLAC__bitreader_get_read_crc16(decoder->private_->input);
-	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &x, FLAC__FRAME_FOOTER_CRC_LEN))
+	frame_crc = FLAC__bitreader_get_read_crc16(threadtask->input);
+	if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &x, FLAC__FRAME_FOOTER_CRC_LEN))
 		return false; /* read_callback_ sets the state for us */
-	if(frame_crc == x) {
-		if(do_full_decode) {
+	threadtask->crc_ok = (frame_crc == x);
+	if(threadtask->crc_ok) {
+		if(do_full_decode && threadtask->decorrelate) {
 			/* Undo any special channel coding */
-			switch(decoder->private_->frame.header.channel_assignment) {
+			switch(threadtask->frame.header.channel_assignment) {
 				case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
 					/* do nothing */
 					break;
 				case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-					FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
-					for(i = 0; i < decoder->private_->frame.header.blocksize; i++)
-						decoder->private_->output[1][i] = decoder->private_->output[0][i] - decoder->private_->output[1][i];
+					FLAC__ASSERT(threadtask->frame.header.channels == 2);
+					for(i = 0; i < threadtask->restore_samples; i++)
+						threadtask->output[1][i] = threadtask->output[0][i] - threadtask->output[1][i];
 					break;
 				case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-					FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
-					for(i = 0; i < decoder->private_->frame.header.blocksize; i++)
-						decoder->private_->output[0][i] += decoder->private_->output[1][i];
+					FLAC__ASSERT(threadtask->frame.header.channels == 2);
+					for(i = 0; i < threadtask->restore_samples; i++)
+						threadtask->output[0][i] += threadtask->output[1][i];
 					break;
 				case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-					FLAC__ASSERT(decoder->private_->frame.header.channels == 2);
-					for(i = 0; i < decoder->private_->frame.header.blocksize; i++) {
+					FLAC__ASSERT(threadtask->frame.header.channels == 2);
+					for(i = 0; i < threadtask->restore_samples; i++) {
 #if 1
-						mid = decoder->private_->output[0][i];
-						side = decoder->private_->output[1][i];
+						mid = threadtask->output[0][i];
+						side = threadtask->output[1][i];
 						mid <<= 1;
 						mid |= (side & 1); /* i.e. if 'side' is odd... */
-						decoder->private_->output[0][i] = (mid + side) >> 1;
-						decoder->private_->output[1][i] = (mid - side) >> 1;
+						threadtask->output[0][i] = (mid + side) >> 1;
+						threadtask->output[1][i] = (mid - side) >> 1;
 #else
 						/* OPT: without 'side' temp variable */
-						mid = (decoder->private_->output[0][i] << 1) | (decoder->private_->output[1][i] & 1); /* i.e. if 'side' is odd... */
-						decoder->private_->output[0][i] = (mid + decoder->private_->output[1][i]) >> 1;
-						decoder->private_->output[1][i] = (mid - decoder->private_->output[1][i]) >> 1;
+						mid = (threadtask->output[0][i] << 1) | (threadtask->output[1][i] & 1); /* i.e. if 'side' is odd... */
+						threadtask->output[0][i] = (mid + threadtask->output[1][i]) >> 1;
+						threadtask->output[1][i] = (mid - threadtask->output[1][i]) >> 1;
 #endif
 					}
 					break;
@@ -2109,53 +2959,116 @@ FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FL
 		}
 	}
 	else {
-		/* Bad frame, emit error and zero the output signal */
-		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+		/* Bad frame, zero the output signal; the caller emits the error */
 		if(do_full_decode) {
-			for(channel = 0; channel < decoder->private_->frame.header.channels; channel++) {
-				memset(decoder->private_->output[channel], 0, sizeof(FLAC__int32) * decoder->private_->frame.header.blocksize);
+			for(channel = 0; channel < threadtask->frame.header.channels; channel++) {
+				memset(threadtask->output[channel], 0, sizeof(FLAC__int32) * threadtask->restore_samples);
 			}
 		}
 	}
 
-	*got_a_frame = true;
-
-	/* we wait to update fixed_block_size until here, when we're sure we've got a proper frame and hence a correct blocksize */
-	if(decoder->private_->next_fixed_block_size)
-		decoder->private_->fixed_block_size = decoder->private_->next_fixed_block_size;
+	return true;
+}
 
+/* Makes the frame decoded into threadtask the current one and hands it to the client. */
+FLAC__bool write_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, FLAC__bool do_full_decode)
+{
 	/* put the latest values into the public section of the decoder instance */
-	decoder->protected_->channels = decoder->private_->frame.header.channels;
-	decoder->protected_->channel_assignment = decoder->private_->frame.header.channel_assignment;
-	decoder->protected_->bits_per_sample = decoder->private_->frame.header.bits_per_sample;
-	decoder->protected_->sample_rate = decoder->private_->frame.header.sample_rate;
-	decoder->protected_->blocksize = decoder->private_->frame.header.blocksize;
+	decoder->protected_->channels = threadtask->frame.header.channels;
+	decoder->protected_->channel_assignment = threadtask->frame.header.channel_assignment;
+	decoder->protected_->bits_per_sample = threadtask->frame.header.bits_per_sample;
+	decoder->protected_->sample_rate = threadtask->frame.header.sample_rate;
+	decoder->protected_->blocksize = threadtask->frame.header.blocksize;
 
-	FLAC__ASSERT(decoder->private_->frame.header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
-	decoder->private_->samples_decoded = decoder->private_->frame.header.number.sample_number + decoder->private_->frame.header.blocksize;
+	FLAC__ASSERT(threadtask->frame.header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+	decoder->private_->samples_decoded = threadtask->frame.header.number.sample_number + threadtask->frame.header.blocksize;
+
+	if(decoder->protected_->frame_indexing && !index_frame_(decoder, &threadtask->frame.header)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
 
 	/* write it */
 	if(do_full_decode) {
-		if(write_audio_frame_to_client_(decoder, &decoder->private_->frame, (const FLAC__int32 * const *)decoder->private_->output) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE)
+		if(write_audio_frame_to_client_(decoder, &threadtask->frame, (const FLAC__int32 * const *)threadtask->output) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE)
 			return false;
 	}
+	else if(decoder->private_->is_seeking) {
+		/* the seek routines still need to know which frame we skipped */
+#if FLAC__HAS_OGG
+		decoder->private_->got_a_frame = true;
+#endif
+		decoder->private_->last_frame = threadtask->frame;
+	}
 
-	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
 	return true;
 }
 
-FLAC__bool read_frame_header_(FLAC__StreamDecoder *decoder)
+/*
+ * Adds the frame about to be written to the frame index if it directly
+ * follows the previous one, so that we know where it starts.  Frames are
+ * normally appended; after a seek they may fill a gap in the index, or
+ * already be in it.
+ */
+FLAC__bool index_frame_(FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header)
 {
-	FLAC__uint32 x;
-	FLAC__uint64 xx;
-	unsigned i, blocksize_hint = 0, sample_rate_hint = 0;
-	FLAC__byte crc8, raw_header[16]; /* MAGIC NUMBER based on the maximum frame header size, including CRC */
-	unsigned raw_header_len;
-	FLAC__bool is_unparseable = false;
-
-	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input));
-
-	/* init the raw header with the saved bits from synchronization */
+	const FLAC__uint64 sample = header->number.sample_number;
+
+	if(decoder->private_->has_frame_end && sample == decoder->private_->frame_end_sample) {
+		FLAC__StreamMetadata_SeekPoint *index = decoder->private_->frame_index;
+		unsigned i = decoder->private_->frame_index_length;
+		if(sample < decoder->private_->frame_index_samples) {
+			unsigned lo = 0, hi = i;
+			while(lo < hi) {
+				const unsigned mid = lo + (hi - lo) / 2;
+				if(index[mid].sample_number < sample)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			i = lo;
+		}
+		if(i == decoder->private_->frame_index_length || index[i].sample_number != sample) {
+			if(decoder->private_->frame_index_length == decoder->private_->frame_index_capacity) {
+				const unsigned new_capacity = decoder->private_->frame_index_capacity? 2 * decoder->private_->frame_index_capacity : 1024;
+				if(0 == (index = (FLAC__StreamMetadata_SeekPoint*)safe_realloc_mul_2op_(index, new_capacity, /*times*/sizeof(FLAC__StreamMetadata_SeekPoint))))
+					return false;
+				decoder->private_->frame_index = index;
+				decoder->private_->frame_index_capacity = new_capacity;
+			}
+			memmove(&index[i+1], &index[i], (decoder->private_->frame_index_length - i) * sizeof(FLAC__StreamMetadata_SeekPoint));
+			decoder->private_->frame_index_length++;
+			index[i].sample_number = sample;
+			index[i].stream_offset = decoder->private_->frame_end_position - decoder->private_->first_frame_offset;
+			index[i].frame_samples = header->blocksize;
+			if(i + 1 == decoder->private_->frame_index_length)
+				decoder->private_->frame_index_samples = sample + header->blocksize;
+		}
+	}
+
+	decoder->private_->has_frame_end = FLAC__stream_decoder_get_decode_position(decoder, &decoder->private_->frame_end_position);
+	decoder->private_->frame_end_sample = sample + header->blocksize;
+	return true;
+}
+
+void frame_lost_sync_(FLAC__StreamDecoderThreadTask *threadtask, FLAC__StreamDecoderErrorStatus status)
+{
+	threadtask->lost_sync = true;
+	threadtask->error_status = status;
+}
+
+FLAC__bool read_frame_header_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__uint32 x;
+	FLAC__uint64 xx;
+	unsigned i, blocksize_hint = 0, sample_rate_hint = 0;
+	FLAC__byte crc8, raw_header[16]; /* MAGIC NUMBER based on the maximum frame header size, including CRC */
+	unsigned raw_header_len;
+	FLAC__bool is_unparseable = false;
+
+	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input));
+
+	/* init the raw header with the saved bits from synchronization */
 	raw_header[0] = decoder->private_->header_warmup[0];
 	raw_header[1] = decoder->private_->header_warmup[1];
 	raw_header_len = 2;
@@ -2453,13 +3366,13 @@ FLAC__bool read_frame_header_(FLAC__StreamDecoder *decoder)
 	return true;
 }
 
-FLAC__bool read_subframe_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
+FLAC__bool read_subframe_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
 {
 	FLAC__uint32 x;
 	FLAC__bool wasted_bits;
 	unsigned i;
 
-	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &x, 8)) /* MAGIC NUMBER */
+	if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &x, 8)) /* MAGIC NUMBER */
 		return false; /* read_callback_ sets the state for us */
 
 	wasted_bits = (x & 1);
@@ -2467,119 +3380,117 @@ FLAC__bool read_subframe_(FLAC__StreamDecoder *decoder, unsigned channel, unsign
 
 	if(wasted_bits) {
 		unsigned u;
-		if(!FLAC__bitreader_read_unary_unsigned(decoder->private_->input, &u))
+		if(!FLAC__bitreader_read_unary_unsigned(threadtask->input, &u))
 			return false; /* read_callback_ sets the state for us */
-		decoder->private_->frame.subframes[channel].wasted_bits = u+1;
-		bps -= decoder->private_->frame.subframes[channel].wasted_bits;
+		threadtask->frame.subframes[channel].wasted_bits = u+1;
+		bps -= threadtask->frame.subframes[channel].wasted_bits;
 	}
 	else
-		decoder->private_->frame.subframes[channel].wasted_bits = 0;
+		threadtask->frame.subframes[channel].wasted_bits = 0;
 
 	/*
 	 * Lots of magic numbers here
 	 */
 	if(x & 0x80) {
-		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
-		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+		frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
 		return true;
 	}
 	else if(x == 0) {
-		if(!read_subframe_constant_(decoder, channel, bps, do_full_decode))
+		if(!read_subframe_constant_(decoder, threadtask, channel, bps, do_full_decode))
 			return false;
 	}
 	else if(x == 2) {
-		if(!read_subframe_verbatim_(decoder, channel, bps, do_full_decode))
+		if(!read_subframe_verbatim_(decoder, threadtask, channel, bps, do_full_decode))
 			return false;
 	}
 	else if(x < 16) {
-		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
-		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+		frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
 		return true;
 	}
 	else if(x <= 24) {
-		if(!read_subframe_fixed_(decoder, channel, bps, (x>>1)&7, do_full_decode))
+		if(!read_subframe_fixed_(decoder, threadtask, channel, bps, (x>>1)&7, do_full_decode))
 			return false;
-		if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) /* means bad sync or got corruption */
+		if(threadtask->lost_sync) /* means bad sync or got corruption */
 			return true;
 	}
 	else if(x < 64) {
-		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
-		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+		frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
 		return true;
 	}
 	else {
-		if(!read_subframe_lpc_(decoder, channel, bps, ((x>>1)&31)+1, do_full_decode))
+		if(!read_subframe_lpc_(decoder, threadtask, channel, bps, ((x>>1)&31)+1, do_full_decode))
 			return false;
-		if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) /* means bad sync or got corruption */
+		if(threadtask->lost_sync) /* means bad sync or got corruption */
 			return true;
 	}
 
 	if(wasted_bits && do_full_decode) {
-		x = decoder->private_->frame.subframes[channel].wasted_bits;
-		for(i = 0; i < decoder->private_->frame.header.blocksize; i++)
-			decoder->private_->output[channel][i] <<= x;
+		x = threadtask->frame.subframes[channel].wasted_bits;
+		for(i = 0; i < threadtask->restore_samples; i++)
+			threadtask->output[channel][i] <<= x;
 	}
 
 	return true;
 }
 
-FLAC__bool read_subframe_constant_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
+FLAC__bool read_subframe_constant_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
 {
-	FLAC__Subframe_Constant *subframe = &decoder->private_->frame.subframes[channel].data.constant;
+	FLAC__Subframe_Constant *subframe = &threadtask->frame.subframes[channel].data.constant;
 	FLAC__int32 x;
 	unsigned i;
-	FLAC__int32 *output = decoder->private_->output[channel];
+	FLAC__int32 *output = threadtask->output[channel];
 
-	decoder->private_->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_CONSTANT;
+	(void)decoder;
 
-	if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &x, bps))
+	threadtask->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_CONSTANT;
+
+	if(!FLAC__bitreader_read_raw_int32(threadtask->input, &x, bps))
 		return false; /* read_callback_ sets the state for us */
 
 	subframe->value = x;
 
 	/* decode the subframe */
 	if(do_full_decode) {
-		for(i = 0; i < decoder->private_->frame.header.blocksize; i++)
+		for(i = 0; i < threadtask->restore_samples; i++)
 			output[i] = x;
 	}
 
 	return true;
 }
 
-FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode)
+FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode)
 {
-	FLAC__Subframe_Fixed *subframe = &decoder->private_->frame.subframes[channel].data.fixed;
+	FLAC__Subframe_Fixed *subframe = &threadtask->frame.subframes[channel].data.fixed;
 	FLAC__int32 i32;
 	FLAC__uint32 u32;
 	unsigned u;
 
-	decoder->private_->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_FIXED;
+	threadtask->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_FIXED;
 
-	subframe->residual = decoder->private_->residual[channel];
+	subframe->residual = threadtask->residual[channel];
 	subframe->order = order;
 
 	/* read warm-up samples */
 	for(u = 0; u < order; u++) {
-		if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &i32, bps))
+		if(!FLAC__bitreader_read_raw_int32(threadtask->input, &i32, bps))
 			return false; /* read_callback_ sets the state for us */
 		subframe->warmup[u] = i32;
 	}
 
 	/* read entropy coding method info */
-	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &u32, FLAC__ENTROPY_CODING_METHOD_TYPE_LEN))
+	if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &u32, FLAC__ENTROPY_CODING_METHOD_TYPE_LEN))
 		return false; /* read_callback_ sets the state for us */
 	subframe->entropy_coding_method.type = (FLAC__EntropyCodingMethodType)u32;
 	switch(subframe->entropy_coding_method.type) {
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE:
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2:
-			if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &u32, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN))
+			if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &u32, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN))
 				return false; /* read_callback_ sets the state for us */
 			subframe->entropy_coding_method.data.partitioned_rice.order = u32;
-			subframe->entropy_coding_method.data.partitioned_rice.contents = &decoder->private_->partitioned_rice_contents[channel];
+			subframe->entropy_coding_method.data.partitioned_rice.contents = &threadtask->partitioned_rice_contents[channel];
 			break;
 		default:
-			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
-			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+			frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
 			return true;
 	}
 
@@ -2587,7 +3498,7 @@ FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, unsigned channel,
 	switch(subframe->entropy_coding_method.type) {
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE:
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2:
-			if(!read_residual_partitioned_rice_(decoder, order, subframe->entropy_coding_method.data.partitioned_rice.order, &decoder->private_->partitioned_rice_contents[channel], decoder->private_->residual[channel], /*is_extended=*/subframe->entropy_coding_method.type == FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2))
+			if(!read_residual_partitioned_rice_(decoder, threadtask, order, subframe->entropy_coding_method.data.partitioned_rice.order, &threadtask->partitioned_rice_contents[channel], threadtask->residual[channel], /*is_extended=*/subframe->entropy_coding_method.type == FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2))
 				return false;
 			break;
 		default:
@@ -2596,69 +3507,68 @@ FLAC__bool read_subframe_fixed_(FLAC__StreamDecoder *decoder, unsigned channel,
 
 	/* decode the subframe */
 	if(do_full_decode) {
-		memcpy(decoder->private_->output[channel], subframe->warmup, sizeof(FLAC__int32) * order);
-		FLAC__fixed_restore_signal(decoder->private_->residual[channel], decoder->private_->frame.header.blocksize-order, order, decoder->private_->output[channel]+order);
+		memcpy(threadtask->output[channel], subframe->warmup, sizeof(FLAC__int32) * order);
+		if(threadtask->restore_samples > order)
+			decoder->private_->local_fixed_restore_signal(threadtask->residual[channel], threadtask->restore_samples-order, order, threadtask->output[channel]+order);
 	}
 
 	return true;
 }
 
-FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode)
+FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, const unsigned order, FLAC__bool do_full_decode)
 {
-	FLAC__Subframe_LPC *subframe = &decoder->private_->frame.subframes[channel].data.lpc;
+	FLAC__Subframe_LPC *subframe = &threadtask->frame.subframes[channel].data.lpc;
 	FLAC__int32 i32;
 	FLAC__uint32 u32;
 	unsigned u;
 
-	decoder->private_->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_LPC;
+	threadtask->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_LPC;
 
-	subframe->residual = decoder->private_->residual[channel];
+	subframe->residual = threadtask->residual[channel];
 	subframe->order = order;
 
 	/* read warm-up samples */
 	for(u = 0; u < order; u++) {
-		if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &i32, bps))
+		if(!FLAC__bitreader_read_raw_int32(threadtask->input, &i32, bps))
 			return false; /* read_callback_ sets the state for us */
 		subframe->warmup[u] = i32;
 	}
 
 	/* read qlp coeff precision */
-	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &u32, FLAC__SUBFRAME_LPC_QLP_COEFF_PRECISION_LEN))
+	if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &u32, FLAC__SUBFRAME_LPC_QLP_COEFF_PRECISION_LEN))
 		return false; /* read_callback_ sets the state for us */
 	if(u32 == (1u << FLAC__SUBFRAME_LPC_QLP_COEFF_PRECISION_LEN) - 1) {
-		send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
-		decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+		frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
 		return true;
 	}
 	subframe->qlp_coeff_precision = u32+1;
 
 	/* read qlp shift */
-	if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &i32, FLAC__SUBFRAME_LPC_QLP_SHIFT_LEN))
+	if(!FLAC__bitreader_read_raw_int32(threadtask->input, &i32, FLAC__SUBFRAME_LPC_QLP_SHIFT_LEN))
 		return false; /* read_callback_ sets the state for us */
 	subframe->quantization_level = i32;
 
 	/* read quantized lp coefficiencts */
 	for(u = 0; u < order; u++) {
-		if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &i32, subframe->qlp_coeff_precision))
+		if(!FLAC__bitreader_read_raw_int32(threadtask->input, &i32, subframe->qlp_coeff_precision))
 			return false; /* read_callback_ sets the state for us */
 		subframe->qlp_coeff[u] = i32;
 	}
 
 	/* read entropy coding method info */
-	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &u32, FLAC__ENTROPY_CODING_METHOD_TYPE_LEN))
+	if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &u32, FLAC__ENTROPY_CODING_METHOD_TYPE_LEN))
 		return false; /* read_callback_ sets the state for us */
 	subframe->entropy_coding_method.type = (FLAC__EntropyCodingMethodType)u32;
 	switch(subframe->entropy_coding_method.type) {
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE:
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2:
-			if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &u32, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN))
+			if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &u32, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN))
 				return false; /* read_callback_ sets the state for us */
 			subframe->entropy_coding_method.data.partitioned_rice.order = u32;
-			subframe->entropy_coding_method.data.partitioned_rice.contents = &decoder->private_->partitioned_rice_contents[channel];
+			subframe->entropy_coding_method.data.partitioned_rice.contents = &threadtask->partitioned_rice_contents[channel];
 			break;
 		default:
-			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
-			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+			frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM);
 			return true;
 	}
 
@@ -2666,7 +3576,7 @@ FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, unsigned channel, un
 	switch(subframe->entropy_coding_method.type) {
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE:
 		case FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2:
-			if(!read_residual_partitioned_rice_(decoder, order, subframe->entropy_coding_method.data.partitioned_rice.order, &decoder->private_->partitioned_rice_contents[channel], decoder->private_->residual[channel], /*is_extended=*/subframe->entropy_coding_method.type == FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2))
+			if(!read_residual_partitioned_rice_(decoder, threadtask, order, subframe->entropy_coding_method.data.partitioned_rice.order, &threadtask->partitioned_rice_contents[channel], threadtask->residual[channel], /*is_extended=*/subframe->entropy_coding_method.type == FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2))
 				return false;
 			break;
 		default:
@@ -2675,125 +3585,1077 @@ FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, unsigned channel, un
 
 	/* decode the subframe */
 	if(do_full_decode) {
-		memcpy(decoder->private_->output[channel], subframe->warmup, sizeof(FLAC__int32) * order);
+		memcpy(threadtask->output[channel], subframe->warmup, sizeof(FLAC__int32) * order);
 		/*@@@@@@ technically not pessimistic enough, should be more like
 		if( (FLAC__uint64)order * ((((FLAC__uint64)1)<<bps)-1) * ((1<<subframe->qlp_coeff_precision)-1) < (((FLAC__uint64)-1) << 32) )
 		*/
+		if(threadtask->restore_samples <= order)
+			return true; /* nothing past the warm-up samples is wanted */
 		if(bps + subframe->qlp_coeff_precision + FLAC__bitmath_ilog2(order) <= 32)
 			if(bps <= 16 && subframe->qlp_coeff_precision <= 16) {
 				if(order <= 8)
-					decoder->private_->local_lpc_restore_signal_16bit_order8(decoder->private_->residual[channel], decoder->private_->frame.header.blocksize-order, subframe->qlp_coeff, order, subframe->quantization_level, decoder->private_->output[channel]+order);
+					decoder->private_->local_lpc_restore_signal_16bit_order8(threadtask->residual[channel], threadtask->restore_samples-order, subframe->qlp_coeff, order, subframe->quantization_level, threadtask->output[channel]+order);
 				else
-					decoder->private_->local_lpc_restore_signal_16bit(decoder->private_->residual[channel], decoder->private_->frame.header.blocksize-order, subframe->qlp_coeff, order, subframe->quantization_level, decoder->private_->output[channel]+order);
+					decoder->private_->local_lpc_restore_signal_16bit(threadtask->residual[channel], threadtask->restore_samples-order, subframe->qlp_coeff, order, subframe->quantization_level, threadtask->output[channel]+order);
 			}
 			else
-				decoder->private_->local_lpc_restore_signal(decoder->private_->residual[channel], decoder->private_->frame.header.blocksize-order, subframe->qlp_coeff, order, subframe->quantization_level, decoder->private_->output[channel]+order);
+				decoder->private_->local_lpc_restore_signal(threadtask->residual[channel], threadtask->restore_samples-order, subframe->qlp_coeff, order, subframe->quantization_level, threadtask->output[channel]+order);
 		else
-			decoder->private_->local_lpc_restore_signal_64bit(decoder->private_->residual[channel], decoder->private_->frame.header.blocksize-order, subframe->qlp_coeff, order, subframe->quantization_level, decoder->private_->output[channel]+order);
+			decoder->private_->local_lpc_restore_signal_64bit(threadtask->residual[channel], threadtask->restore_samples-order, subframe->qlp_coeff, order, subframe->quantization_level, threadtask->output[channel]+order);
+	}
+
+	return true;
+}
+
+FLAC__bool read_subframe_verbatim_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
+{
+	FLAC__Subframe_Verbatim *subframe = &threadtask->frame.subframes[channel].data.verbatim;
+	FLAC__int32 x, *residual = threadtask->residual[channel];
+	unsigned i;
+
+	(void)decoder;
+
+	threadtask->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_VERBATIM;
+
+	subframe->data = residual;
+
+	for(i = 0; i < threadtask->frame.header.blocksize; i++) {
+		if(!FLAC__bitreader_read_raw_int32(threadtask->input, &x, bps))
+			return false; /* read_callback_ sets the state for us */
+		residual[i] = x;
+	}
+
+	/* decode the subframe */
+	if(do_full_decode)
+		memcpy(threadtask->output[channel], subframe->data, sizeof(FLAC__int32) * threadtask->restore_samples);
+
+	return true;
+}
+
+FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask, unsigned predictor_order, unsigned partition_order, FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents, FLAC__int32 *residual, FLAC__bool is_extended)
+{
+	FLAC__uint32 rice_parameter;
+	int i;
+	unsigned partition, sample, u;
+	const unsigned partitions = 1u << partition_order;
+	const unsigned partition_samples = partition_order > 0? threadtask->frame.header.blocksize >> partition_order : threadtask->frame.header.blocksize - predictor_order;
+	const unsigned plen = is_extended? FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_PARAMETER_LEN : FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_PARAMETER_LEN;
+	const unsigned pesc = is_extended? FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_ESCAPE_PARAMETER : FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ESCAPE_PARAMETER;
+
+	/* sanity checks */
+	if(partition_order == 0) {
+		if(threadtask->frame.header.blocksize < predictor_order) {
+			frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+			return true;
+		}
+	}
+	else {
+		if(partition_samples < predictor_order) {
+			frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+			return true;
+		}
+	}
+
+	if(!FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(partitioned_rice_contents, max(6, partition_order))) {
+		threadtask->memory_error = true;
+		return false;
+	}
+
+	sample = 0;
+	for(partition = 0; partition < partitions; partition++) {
+		if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &rice_parameter, plen))
+			return false; /* read_callback_ sets the state for us */
+		partitioned_rice_contents->parameters[partition] = rice_parameter;
+		if(rice_parameter < pesc) {
+			partitioned_rice_contents->raw_bits[partition] = 0;
+			u = (partition_order == 0 || partition > 0)? partition_samples : partition_samples - predictor_order;
+			if(!decoder->private_->local_bitreader_read_rice_signed_block(threadtask->input, residual + sample, u, rice_parameter))
+				return false; /* read_callback_ sets the state for us */
+			sample += u;
+		}
+		else {
+			if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &rice_parameter, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_RAW_LEN))
+				return false; /* read_callback_ sets the state for us */
+			partitioned_rice_contents->raw_bits[partition] = rice_parameter;
+			for(u = (partition_order == 0 || partition > 0)? 0 : predictor_order; u < partition_samples; u++, sample++) {
+				if(!FLAC__bitreader_read_raw_int32(threadtask->input, &i, rice_parameter))
+					return false; /* read_callback_ sets the state for us */
+				residual[sample] = i;
+			}
+		}
+	}
+
+	return true;
+}
+
+FLAC__bool read_zero_padding_(FLAC__StreamDecoderThreadTask *threadtask)
+{
+	if(!FLAC__bitreader_is_consumed_byte_aligned(threadtask->input)) {
+		FLAC__uint32 zero = 0;
+		if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &zero, FLAC__bitreader_bits_left_for_byte_alignment(threadtask->input)))
+			return false; /* read_callback_ sets the state for us */
+		if(zero != 0) {
+			frame_lost_sync_(threadtask, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+		}
+	}
+	return true;
+}
+
+/*
+ * Sets up the frame scanner to read the input from where frame_sync_()
+ * has got to, taking back whatever it has already consumed.
+ */
+FLAC__bool begin_scan_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__byte prefix[2];
+	unsigned prefix_length = 0;
+	FLAC__uint64 position;
+
+	FLAC__ASSERT(FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input));
+
+	/* give back what frame_sync_() has already taken from the input */
+	if(decoder->protected_->state == FLAC__STREAM_DECODER_READ_FRAME) {
+		prefix[0] = decoder->private_->header_warmup[0];
+		prefix[1] = decoder->private_->header_warmup[1];
+		prefix_length = 2;
+	}
+	else if(decoder->private_->cached) {
+		prefix[0] = decoder->private_->lookahead;
+		prefix_length = 1;
+		decoder->private_->cached = false;
+	}
+
+	decoder->private_->has_scan_position = FLAC__stream_decoder_get_decode_position(decoder, &position);
+	decoder->private_->scan_position = decoder->private_->has_scan_position? position - prefix_length : 0;
+	decoder->private_->scan_start = decoder->private_->scan_length = 0;
+	decoder->private_->scan_eof = false;
+	decoder->private_->scan_samples = decoder->private_->samples_decoded;
+	if(decoder->private_->scan_capacity < FLAC__STREAM_DECODER_SCAN_CHUNK) {
+		FLAC__byte *tmp = (FLAC__byte*)realloc(decoder->private_->scan_buffer, FLAC__STREAM_DECODER_SCAN_CHUNK);
+		if(0 == tmp) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		decoder->private_->scan_buffer = tmp;
+		decoder->private_->scan_capacity = FLAC__STREAM_DECODER_SCAN_CHUNK;
+	}
+	memcpy(decoder->private_->scan_buffer, prefix, prefix_length);
+	decoder->private_->scan_length = prefix_length;
+
+	return true;
+}
+
+/* Reads ahead until at least 'bytes' unscanned bytes are buffered or the input ends. */
+FLAC__bool scan_fill_(FLAC__StreamDecoder *decoder, size_t bytes)
+{
+	while(!decoder->private_->scan_eof && decoder->private_->scan_length - decoder->private_->scan_start < bytes) {
+		size_t want = bytes - (decoder->private_->scan_length - decoder->private_->scan_start);
+		unsigned nread;
+
+		/* move the unscanned bytes to the front of the buffer */
+		if(decoder->private_->scan_start > 0) {
+			memmove(decoder->private_->scan_buffer, decoder->private_->scan_buffer + decoder->private_->scan_start, decoder->private_->scan_length - decoder->private_->scan_start);
+			decoder->private_->scan_position += decoder->private_->scan_start;
+			decoder->private_->scan_length -= decoder->private_->scan_start;
+			decoder->private_->scan_start = 0;
+		}
+		if(decoder->private_->scan_capacity < bytes + FLAC__STREAM_DECODER_SCAN_CHUNK) {
+			FLAC__byte *tmp = (FLAC__byte*)safe_realloc_add_2op_(decoder->private_->scan_buffer, bytes, FLAC__STREAM_DECODER_SCAN_CHUNK);
+			if(0 == tmp) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return false;
+			}
+			decoder->private_->scan_buffer = tmp;
+			decoder->private_->scan_capacity = bytes + FLAC__STREAM_DECODER_SCAN_CHUNK;
+		}
+
+		/* don't read much further than asked, a seek may only want one frame */
+		if(want < FLAC__STREAM_DECODER_SCAN_MIN_READ)
+			want = FLAC__STREAM_DECODER_SCAN_MIN_READ;
+		if(want > decoder->private_->scan_capacity - decoder->private_->scan_length)
+			want = decoder->private_->scan_capacity - decoder->private_->scan_length;
+		if(!FLAC__bitreader_read_byte_block_aligned_no_crc_upto(decoder->private_->input, decoder->private_->scan_buffer + decoder->private_->scan_length, (unsigned)want, &nread)) {
+			if(decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM)
+				return false; /* read_callback_ sets the state for us */
+			decoder->private_->scan_eof = true;
+			decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+		}
+		decoder->private_->scan_length += nread;
+	}
+	return true;
+}
+
+/*
+ * Parses the frame header at the start of buffer[] like
+ * read_frame_header_(), but quietly: returns false unless it is a
+ * complete, parseable header with a good CRC-8 that fits the STREAMINFO.
+ * The frame number, if any, is converted to a sample number.
+ */
+FLAC__bool scan_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte *buffer, size_t bytes, FLAC__FrameHeader *header, unsigned *header_length)
+{
+	const FLAC__StreamMetadata_StreamInfo *stream_info = &decoder->private_->stream_info.data.stream_info;
+	FLAC__uint32 x;
+	FLAC__uint64 xx;
+	unsigned i, len, blocksize_hint = 0, sample_rate_hint = 0;
+	FLAC__bool is_variable_blocksize;
+
+	FLAC__ASSERT(decoder->private_->has_stream_info);
+
+	if(bytes > FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN)
+		bytes = FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN;
+	if(bytes < 6) /* MAGIC NUMBER for the shortest possible header */
+		return false;
+	/* the sync code and reserved bit; the sync code cannot appear inside the header */
+	if(buffer[0] != 0xff || buffer[1] >> 1 != 0x7c || buffer[2] == 0xff || buffer[3] == 0xff) /* MAGIC NUMBERs */
+		return false;
+
+	switch(x = buffer[2] >> 4) {
+		case 0:
+			return false;
+		case 1:
+			header->blocksize = 192;
+			break;
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			header->blocksize = 576 << (x-2);
+			break;
+		case 6:
+		case 7:
+			blocksize_hint = x;
+			break;
+		default:
+			header->blocksize = 256 << (x-8);
+			break;
+	}
+
+	switch(x = buffer[2] & 0x0f) {
+		case 0:
+			header->sample_rate = stream_info->sample_rate;
+			break;
+		case 1:
+			header->sample_rate = 88200;
+			break;
+		case 2:
+			header->sample_rate = 176400;
+			break;
+		case 3:
+			header->sample_rate = 192000;
+			break;
+		case 4:
+			header->sample_rate = 8000;
+			break;
+		case 5:
+			header->sample_rate = 16000;
+			break;
+		case 6:
+			header->sample_rate = 22050;
+			break;
+		case 7:
+			header->sample_rate = 24000;
+			break;
+		case 8:
+			header->sample_rate = 32000;
+			break;
+		case 9:
+			header->sample_rate = 44100;
+			break;
+		case 10:
+			header->sample_rate = 48000;
+			break;
+		case 11:
+			header->sample_rate = 96000;
+			break;
+		case 12:
+		case 13:
+		case 14:
+			sample_rate_hint = x;
+			break;
+		default:
+			return false;
+	}
+
+	x = (unsigned)(buffer[3] >> 4);
+	if(x & 8) {
+		header->channels = 2;
+		switch(x & 7) {
+			case 0:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE;
+				break;
+			case 1:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE;
+				break;
+			case 2:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_MID_SIDE;
+				break;
+			default:
+				return false;
+		}
+	}
+	else {
+		header->channels = (unsigned)x + 1;
+		header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
+	}
+
+	switch(x = (unsigned)(buffer[3] & 0x0e) >> 1) {
+		case 0:
+			header->bits_per_sample = stream_info->bits_per_sample;
+			break;
+		case 1:
+			header->bits_per_sample = 8;
+			break;
+		case 2:
+			header->bits_per_sample = 12;
+			break;
+		case 4:
+			header->bits_per_sample = 16;
+			break;
+		case 5:
+			header->bits_per_sample = 20;
+			break;
+		case 6:
+			header->bits_per_sample = 24;
+			break;
+		default:
+			return false;
+	}
+
+	/* check to make sure that reserved bit is 0 */
+	if(buffer[3] & 0x01) /* MAGIC NUMBER */
+		return false;
+
+	/* a frame that does not match the STREAMINFO is not one of ours */
+	if(header->channels != stream_info->channels || header->bits_per_sample != stream_info->bits_per_sample)
+		return false;
+
+	/* the frame's starting sample number (or frame number as the case may be), UTF-8 coded */
+	is_variable_blocksize = (buffer[1] & 0x01) || stream_info->min_blocksize != stream_info->max_blocksize;
+	len = 4;
+	x = buffer[len++];
+	if(!(x & 0x80)) { /* 0xxxxxxx */
+		xx = x;
+		i = 0;
+	}
+	else if((x & 0xE0) == 0xC0) { /* 110xxxxx */
+		xx = x & 0x1F;
+		i = 1;
+	}
+	else if((x & 0xF0) == 0xE0) { /* 1110xxxx */
+		xx = x & 0x0F;
+		i = 2;
+	}
+	else if((x & 0xF8) == 0xF0) { /* 11110xxx */
+		xx = x & 0x07;
+		i = 3;
+	}
+	else if((x & 0xFC) == 0xF8) { /* 111110xx */
+		xx = x & 0x03;
+		i = 4;
+	}
+	else if((x & 0xFE) == 0xFC) { /* 1111110x */
+		xx = x & 0x01;
+		i = 5;
+	}
+	else if(x == 0xFE && is_variable_blocksize) { /* 11111110 */
+		xx = 0;
+		i = 6;
+	}
+	else
+		return false;
+	for( ; i; i--) {
+		if(len >= bytes)
+			return false;
+		x = buffer[len++];
+		if((x & 0xC0) != 0x80) /* 10xxxxxx */
+			return false;
+		xx <<= 6;
+		xx |= (x & 0x3F);
+	}
+
+	if(blocksize_hint) {
+		if(len + (blocksize_hint == 7? 2 : 1) > bytes)
+			return false;
+		x = buffer[len++];
+		if(blocksize_hint == 7)
+			x = (x << 8) | buffer[len++];
+		header->blocksize = x+1;
+	}
+
+	if(sample_rate_hint) {
+		if(len + (sample_rate_hint == 12? 1 : 2) > bytes)
+			return false;
+		x = buffer[len++];
+		if(sample_rate_hint != 12)
+			x = (x << 8) | buffer[len++];
+		if(sample_rate_hint == 12)
+			header->sample_rate = x*1000;
+		else if(sample_rate_hint == 13)
+			header->sample_rate = x;
+		else
+			header->sample_rate = x*10;
+	}
+
+	/* the CRC-8 byte */
+	if(len >= bytes || FLAC__crc8(buffer, len) != buffer[len])
+		return false;
+	*header_length = len + 1;
+
+	header->number_type = FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER;
+	if(is_variable_blocksize)
+		header->number.sample_number = xx;
+	else
+		header->number.sample_number = (decoder->private_->fixed_block_size? decoder->private_->fixed_block_size : stream_info->min_blocksize) * xx;
+	header->crc = buffer[len];
+
+	return true;
+}
+
+/*
+ * Finds the next frame in the input and parses its header; the frame is
+ * left at scan_buffer[scan_start+*junk_length..scan_start+*junk_length+*frame_length-1]
+ * behind the *junk_length bytes before it that belong to no frame.
+ * A frame ends where a header with the very next sample number starts;
+ * failing that, it is cut at the first later header that could be a
+ * frame, or at the size no valid frame can exceed.  *frame_length is 0
+ * if there are no more frames.  The caller moves scan_start past the
+ * junk and the frame.
+ */
+FLAC__bool scan_next_frame_(FLAC__StreamDecoder *decoder, FLAC__FrameHeader *header, unsigned *header_length, size_t *frame_length, size_t *junk_length, FLAC__bool *runs_to_end_of_input)
+{
+	const FLAC__StreamMetadata_StreamInfo *stream_info = &decoder->private_->stream_info.data.stream_info;
+	const FLAC__byte *buffer;
+	FLAC__FrameHeader next_header;
+	unsigned next_header_length;
+	size_t avail, pos, end, fallback = 0, limit;
+	FLAC__uint64 next_sample;
+
+	*frame_length = 0;
+	*junk_length = 0;
+	*runs_to_end_of_input = false;
+
+	/* like frame_sync_(), stop once all the samples are in */
+	if(stream_info->total_samples && decoder->private_->scan_samples >= stream_info->total_samples)
+		return true;
+
+	/* find the frame header */
+	pos = 0;
+	while(1) {
+		if(!scan_fill_(decoder, pos + FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN))
+			return false;
+		buffer = decoder->private_->scan_buffer + decoder->private_->scan_start;
+		avail = decoder->private_->scan_length - decoder->private_->scan_start;
+		if(pos + 2 > avail) { /* end of input */
+			*junk_length = avail;
+			return true;
+		}
+		if(0 == (buffer = (const FLAC__byte*)memchr(buffer + pos, 0xff, avail - 1 - pos))) {
+			pos = avail - 1;
+			continue;
+		}
+		pos = buffer - (decoder->private_->scan_buffer + decoder->private_->scan_start);
+		if(avail - pos < FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN && !decoder->private_->scan_eof)
+			continue;
+		if(scan_frame_header_(decoder, buffer, avail - pos, header, header_length))
+			break;
+		pos++;
+	}
+	*junk_length = pos;
+	next_sample = header->number.sample_number + header->blocksize;
+
+	/* no frame can be longer than its samples coded verbatim plus the headers and footer */
+	limit = (size_t)header->blocksize * header->channels * 4 + FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN + header->channels * 6 + 2; /* MAGIC NUMBERs */
+	if(stream_info->max_framesize > limit)
+		limit = stream_info->max_framesize;
+
+	/* find where it ends; positions from here on are relative to the frame */
+	end = *header_length;
+	while(1) {
+		size_t search_end;
+		if(!scan_fill_(decoder, pos + end + FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN))
+			return false;
+		buffer = decoder->private_->scan_buffer + decoder->private_->scan_start + pos;
+		avail = decoder->private_->scan_length - decoder->private_->scan_start - pos;
+		if(end >= limit) {
+			end = fallback? fallback : limit;
+			break;
+		}
+		if(end + 2 > avail) { /* the frame runs to the end of the input */
+			end = avail;
+			*runs_to_end_of_input = true;
+			break;
+		}
+		search_end = avail - 1 < limit? avail - 1 : limit;
+		if(0 == (buffer = (const FLAC__byte*)memchr(buffer + end, 0xff, search_end - end))) {
+			end = search_end;
+			continue;
+		}
+		end = buffer - (decoder->private_->scan_buffer + decoder->private_->scan_start + pos);
+		if(avail - end < FLAC__STREAM_DECODER_MAX_FRAME_HEADER_LEN && !decoder->private_->scan_eof)
+			continue;
+		if(scan_frame_header_(decoder, buffer, avail - end, &next_header, &next_header_length)) {
+			if(next_header.number.sample_number == next_sample)
+				break;
+			if(!fallback && next_header.number.sample_number > header->number.sample_number)
+				fallback = end;
+		}
+		end++;
+	}
+
+	*frame_length = end;
+	decoder->private_->scan_samples = next_sample;
+
+	return true;
+}
+
+#ifdef FLAC__HAS_PTHREAD
+/*
+ * Decodes the rest of the stream with the worker threads: the calling
+ * thread splits the input into frames with scan_frame_(), the workers
+ * decode them, and flush_threadtasks_() hands them to the client in
+ * stream order.  The first frame that does not decode cleanly, and
+ * everything after it, goes back to the single-threaded decoder through
+ * replay_threadtasks_(), so damaged input is reported and recovered
+ * from exactly as without threads.
+ */
+FLAC__bool process_frames_threaded_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__StreamDecoderThreadTask *threadtask;
+	FLAC__bool needs_replay = false;
+
+	FLAC__ASSERT(decoder->private_->num_pending_threadtasks == 0);
+
+	/* the frames may land in threadtask[0] too */
+	decoder->private_->has_pulled_frame = false;
+
+	if(!begin_scan_(decoder))
+		return false;
+
+	decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+
+	while(1) {
+		threadtask = decoder->private_->threadtask[decoder->private_->next_threadtask];
+
+		/* if every workspace is busy, write out the oldest frame to free one up */
+		if(decoder->private_->num_pending_threadtasks == decoder->private_->num_threadtasks) {
+			if(!flush_threadtasks_(decoder, decoder->private_->num_threadtasks - 1, &needs_replay)) {
+				/* the above function sets the state for us in case of an error */
+				discard_threadtasks_(decoder);
+				return false;
+			}
+			if(needs_replay)
+				break;
+		}
+
+		if(!scan_frame_(decoder, threadtask)) {
+			/* the above function sets the state for us */
+			discard_threadtasks_(decoder);
+			return false;
+		}
+		if(threadtask->data_length == 0) /* no more input */
+			break;
+
+		pthread_mutex_lock(&decoder->private_->mutex);
+		if(threadtask->junk_length == threadtask->data_length) {
+			/* the input ends in bytes that belong to no frame; leave them to the single-threaded decoder */
+			threadtask->ok = false;
+			threadtask->memory_error = false;
+		}
+		else {
+			threadtask->done = false;
+			decoder->private_->num_queued_threadtasks++;
+			pthread_cond_signal(&decoder->private_->cond_queued);
+		}
+		pthread_mutex_unlock(&decoder->private_->mutex);
+
+		decoder->private_->next_threadtask = (decoder->private_->next_threadtask + 1) % decoder->private_->num_threadtasks;
+		decoder->private_->num_pending_threadtasks++;
+	}
+
+	if(!needs_replay && !flush_threadtasks_(decoder, 0, &needs_replay)) {
+		discard_threadtasks_(decoder);
+		return false;
+	}
+	if(needs_replay)
+		return replay_threadtasks_(decoder);
+
+	decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+	return true;
+}
+
+/*
+ * Finds the next frame in the input and copies it, along with any junk
+ * before it, into threadtask->data; threadtask->data_length is 0 if
+ * there is no more input.  The worker thread reports any trouble when
+ * it decodes it.
+ */
+FLAC__bool scan_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask)
+{
+	size_t end, junk;
+	FLAC__bool runs_to_end_of_input;
+
+	threadtask->data_length = 0;
+	threadtask->junk_length = 0;
+	if(!scan_next_frame_(decoder, &threadtask->frame.header, &threadtask->header_length, &end, &junk, &runs_to_end_of_input))
+		return false;
+	end += junk;
+	if(end == 0)
+		return true;
+
+	/* hand the frame over */
+	if(threadtask->data_capacity < end) {
+		FLAC__byte *tmp = (FLAC__byte*)realloc(threadtask->data, end);
+		if(0 == tmp) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		threadtask->data = tmp;
+		threadtask->data_capacity = end;
+	}
+	memcpy(threadtask->data, decoder->private_->scan_buffer + decoder->private_->scan_start, end);
+	threadtask->data_length = end;
+	threadtask->junk_length = junk;
+	decoder->private_->scan_start += end;
+	threadtask->end_position = decoder->private_->scan_position + decoder->private_->scan_start;
+
+	return true;
+}
+
+/* Decodes the frame in threadtask->data; runs on a worker thread. */
+FLAC__bool decode_threaded_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask)
+{
+	FLAC__uint32 x;
+	unsigned i;
+
+	threadtask->lost_sync = false;
+	threadtask->memory_error = false;
+	threadtask->has_trailing_bytes = false;
+	threadtask->input = threadtask->frame_input;
+	threadtask->data_consumed = threadtask->junk_length;
+	if(!FLAC__bitreader_clear(threadtask->input))
+		return false;
+	FLAC__bitreader_reset_read_crc16(threadtask->input, 0);
+	threadtask->restore_samples = threadtask->frame.header.blocksize;
+	threadtask->decorrelate = true;
+
+	/* the scanner has already parsed the header; just run it through the CRC-16 */
+	for(i = 0; i < threadtask->header_length; i++) {
+		if(!FLAC__bitreader_read_raw_uint32(threadtask->input, &x, 8))
+			return false;
+	}
+
+	if(!read_frame_body_(decoder, threadtask, /*do_full_decode=*/true))
+		return false;
+
+	threadtask->has_trailing_bytes = threadtask->data_consumed < threadtask->data_length || FLAC__bitreader_get_input_bits_unconsumed(threadtask->input) > 0;
+	return true;
+}
+
+/* Writes out a frame decoded cleanly by a worker thread. */
+FLAC__bool write_threaded_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *threadtask)
+{
+	FLAC__bool ok;
+
+	decoder->private_->writing_threadtask = threadtask;
+	ok = write_frame_(decoder, threadtask, /*do_full_decode=*/true);
+	decoder->private_->writing_threadtask = 0;
+	return ok;
+}
+
+/*
+ * Writes frames from the worker threads, in order, until at most 'keep'
+ * are still pending.  Stops with *needs_replay set at the first frame
+ * that read_frame_() might have handled differently: one with junk
+ * before or after it, a bad CRC or any other damage.
+ */
+FLAC__bool flush_threadtasks_(FLAC__StreamDecoder *decoder, unsigned keep, FLAC__bool *needs_replay)
+{
+	*needs_replay = false;
+	while(decoder->private_->num_pending_threadtasks > keep) {
+		FLAC__StreamDecoderThreadTask *threadtask = decoder->private_->threadtask[(decoder->private_->next_threadtask + decoder->private_->num_threadtasks - decoder->private_->num_pending_threadtasks) % decoder->private_->num_threadtasks];
+
+		pthread_mutex_lock(&decoder->private_->mutex);
+		while(!threadtask->done)
+			pthread_cond_wait(&decoder->private_->cond_done, &decoder->private_->mutex);
+		pthread_mutex_unlock(&decoder->private_->mutex);
+
+		if(threadtask->memory_error) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!threadtask->ok || threadtask->junk_length > 0 || threadtask->lost_sync || !threadtask->crc_ok || threadtask->has_trailing_bytes) {
+			*needs_replay = true;
+			return true;
+		}
+
+		decoder->private_->num_pending_threadtasks--;
+		if(!write_threaded_frame_(decoder, threadtask))
+			return false;
+	}
+	return true;
+}
+
+/* Waits for the worker threads to finish the pending frames and throws them away. */
+void discard_threadtasks_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&decoder->private_->mutex);
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		while(!decoder->private_->threadtask[i]->done)
+			pthread_cond_wait(&decoder->private_->cond_done, &decoder->private_->mutex);
+	}
+	pthread_mutex_unlock(&decoder->private_->mutex);
+
+	decoder->private_->num_pending_threadtasks = 0;
+}
+
+/*
+ * Gives the pending frames, from the oldest one on, and everything the
+ * scanner has read ahead back to the input, and leaves the decoder
+ * searching for a frame sync at the start of them.  read_frame_() picks
+ * up from there and the worker threads take over again once it has
+ * decoded a frame cleanly.
+ */
+FLAC__bool replay_threadtasks_(FLAC__StreamDecoder *decoder)
+{
+	const unsigned first = (decoder->private_->next_threadtask + decoder->private_->num_threadtasks - decoder->private_->num_pending_threadtasks) % decoder->private_->num_threadtasks;
+	const unsigned count = decoder->private_->num_pending_threadtasks;
+	const unsigned buffered = FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) / 8;
+	const size_t replay_left = decoder->private_->replay_length - decoder->private_->replay_start;
+	size_t length, pos;
+	FLAC__byte *replay;
+	unsigned i;
+
+	discard_threadtasks_(decoder);
+
+	length = (decoder->private_->scan_length - decoder->private_->scan_start) + buffered + replay_left;
+	for(i = 0; i < count; i++)
+		length += decoder->private_->threadtask[(first + i) % decoder->private_->num_threadtasks]->data_length;
+
+	if(0 == (replay = (FLAC__byte*)malloc(length > 0? length : 1))) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	pos = 0;
+	for(i = 0; i < count; i++) {
+		const FLAC__StreamDecoderThreadTask *threadtask = decoder->private_->threadtask[(first + i) % decoder->private_->num_threadtasks];
+		memcpy(replay + pos, threadtask->data, threadtask->data_length);
+		pos += threadtask->data_length;
+	}
+	memcpy(replay + pos, decoder->private_->scan_buffer + decoder->private_->scan_start, decoder->private_->scan_length - decoder->private_->scan_start);
+	pos += decoder->private_->scan_length - decoder->private_->scan_start;
+	/* what the bitreader has buffered but not yet handed to the scanner */
+	if(buffered > 0 && !FLAC__bitreader_read_byte_block_aligned_no_crc(decoder->private_->input, replay + pos, buffered)) {
+		free(replay);
+		return false; /* read_callback_ sets the state for us */
+	}
+	pos += buffered;
+	if(replay_left > 0)
+		memcpy(replay + pos, decoder->private_->replay + decoder->private_->replay_start, replay_left);
+	FLAC__ASSERT(pos + replay_left == length);
+
+	if(0 != decoder->private_->replay)
+		free(decoder->private_->replay);
+	decoder->private_->replay = replay;
+	decoder->private_->replay_start = 0;
+	decoder->private_->replay_length = length;
+	decoder->private_->scan_start = decoder->private_->scan_length = 0;
+	decoder->private_->scan_eof = false;
+
+	decoder->private_->resyncing = true;
+	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+	return true;
+}
+
+FLAC__bool threadtask_read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	FLAC__StreamDecoderThreadTask *threadtask = (FLAC__StreamDecoderThreadTask *)client_data;
+	const size_t left = threadtask->data_length - threadtask->data_consumed;
+
+	if(left == 0) {
+		*bytes = 0;
+		return false;
+	}
+	if(*bytes > left)
+		*bytes = left;
+	memcpy(buffer, threadtask->data + threadtask->data_consumed, *bytes);
+	threadtask->data_consumed += *bytes;
+	return true;
+}
+
+FLAC__bool start_threads_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	FLAC__ASSERT(decoder->private_->num_running_threads == 0);
+
+	if(0 != pthread_mutex_init(&decoder->private_->mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&decoder->private_->cond_queued, 0)) {
+		pthread_mutex_destroy(&decoder->private_->mutex);
+		return false;
+	}
+	if(0 != pthread_cond_init(&decoder->private_->cond_done, 0)) {
+		pthread_cond_destroy(&decoder->private_->cond_queued);
+		pthread_mutex_destroy(&decoder->private_->mutex);
+		return false;
+	}
+	decoder->private_->next_queued_threadtask = 0;
+	decoder->private_->num_queued_threadtasks = 0;
+	decoder->private_->threads_should_exit = false;
+
+	for(i = 0; i < decoder->protected_->num_threads; i++) {
+		if(0 != pthread_create(&decoder->private_->thread[i], 0, decoder_thread_, decoder))
+			break;
+	}
+	decoder->private_->num_running_threads = i;
+
+	if(i < decoder->protected_->num_threads) {
+		if(i > 0) {
+			stop_threads_(decoder);
+		}
+		else {
+			pthread_cond_destroy(&decoder->private_->cond_done);
+			pthread_cond_destroy(&decoder->private_->cond_queued);
+			pthread_mutex_destroy(&decoder->private_->mutex);
+		}
+		return false;
 	}
 
 	return true;
 }
 
-FLAC__bool read_subframe_verbatim_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode)
+void stop_threads_(FLAC__StreamDecoder *decoder)
 {
-	FLAC__Subframe_Verbatim *subframe = &decoder->private_->frame.subframes[channel].data.verbatim;
-	FLAC__int32 x, *residual = decoder->private_->residual[channel];
 	unsigned i;
 
-	decoder->private_->frame.subframes[channel].type = FLAC__SUBFRAME_TYPE_VERBATIM;
-
-	subframe->data = residual;
+	if(decoder->private_->num_running_threads == 0)
+		return;
 
-	for(i = 0; i < decoder->private_->frame.header.blocksize; i++) {
-		if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &x, bps))
-			return false; /* read_callback_ sets the state for us */
-		residual[i] = x;
-	}
+	pthread_mutex_lock(&decoder->private_->mutex);
+	decoder->private_->threads_should_exit = true;
+	pthread_cond_broadcast(&decoder->private_->cond_queued);
+	pthread_mutex_unlock(&decoder->private_->mutex);
 
-	/* decode the subframe */
-	if(do_full_decode)
-		memcpy(decoder->private_->output[channel], subframe->data, sizeof(FLAC__int32) * decoder->private_->frame.header.blocksize);
+	for(i = 0; i < decoder->private_->num_running_threads; i++)
+		pthread_join(decoder->private_->thread[i], 0);
+	decoder->private_->num_running_threads = 0;
+	decoder->private_->num_pending_threadtasks = 0;
 
-	return true;
+	pthread_cond_destroy(&decoder->private_->cond_done);
+	pthread_cond_destroy(&decoder->private_->cond_queued);
+	pthread_mutex_destroy(&decoder->private_->mutex);
 }
 
-FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, unsigned predictor_order, unsigned partition_order, FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents, FLAC__int32 *residual, FLAC__bool is_extended)
+void *decoder_thread_(void *arg)
 {
-	FLAC__uint32 rice_parameter;
-	int i;
-	unsigned partition, sample, u;
-	const unsigned partitions = 1u << partition_order;
-	const unsigned partition_samples = partition_order > 0? decoder->private_->frame.header.blocksize >> partition_order : decoder->private_->frame.header.blocksize - predictor_order;
-	const unsigned plen = is_extended? FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_PARAMETER_LEN : FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_PARAMETER_LEN;
-	const unsigned pesc = is_extended? FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_ESCAPE_PARAMETER : FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ESCAPE_PARAMETER;
+	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder*)arg;
+	FLAC__StreamDecoderThreadTask *threadtask;
+	FLAC__bool ok;
 
-	/* sanity checks */
-	if(partition_order == 0) {
-		if(decoder->private_->frame.header.blocksize < predictor_order) {
-			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
-			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
-			return true;
-		}
-	}
-	else {
-		if(partition_samples < predictor_order) {
-			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
-			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
-			return true;
-		}
+	pthread_mutex_lock(&decoder->private_->mutex);
+	while(1) {
+		while(!decoder->private_->threads_should_exit && decoder->private_->num_queued_threadtasks == 0)
+			pthread_cond_wait(&decoder->private_->cond_queued, &decoder->private_->mutex);
+		if(decoder->private_->threads_should_exit)
+			break;
+
+		threadtask = decoder->private_->threadtask[decoder->private_->next_queued_threadtask];
+		decoder->private_->next_queued_threadtask = (decoder->private_->next_queued_threadtask + 1) % decoder->private_->num_threadtasks;
+		decoder->private_->num_queued_threadtasks--;
+		pthread_mutex_unlock(&decoder->private_->mutex);
+
+		ok = decode_threaded_frame_(decoder, threadtask);
+
+		pthread_mutex_lock(&decoder->private_->mutex);
+		threadtask->ok = ok;
+		threadtask->done = true;
+		pthread_cond_broadcast(&decoder->private_->cond_done);
 	}
+	pthread_mutex_unlock(&decoder->private_->mutex);
 
-	if(!FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(partitioned_rice_contents, max(6, partition_order))) {
-		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+	return 0;
+}
+
+FLAC__bool start_pipeline_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(!decoder->private_->pipeline_running);
+
+	memset(decoder->private_->pipeline, 0, sizeof(decoder->private_->pipeline));
+	decoder->private_->pipeline_head = 0;
+	decoder->private_->pipeline_count = 0;
+	decoder->private_->pipeline_status = FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	decoder->private_->pipeline_should_exit = false;
+	decoder->private_->pipeline_wait_next = false;
+
+	if(0 != pthread_mutex_init(&decoder->private_->pipeline_mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&decoder->private_->pipeline_cond, 0)) {
+		pthread_mutex_destroy(&decoder->private_->pipeline_mutex);
+		return false;
+	}
+	if(0 != pthread_create(&decoder->private_->pipeline_thread, 0, pipeline_thread_, decoder)) {
+		pthread_cond_destroy(&decoder->private_->pipeline_cond);
+		pthread_mutex_destroy(&decoder->private_->pipeline_mutex);
 		return false;
 	}
 
-	sample = 0;
-	for(partition = 0; partition < partitions; partition++) {
-		if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &rice_parameter, plen))
-			return false; /* read_callback_ sets the state for us */
-		partitioned_rice_contents->parameters[partition] = rice_parameter;
-		if(rice_parameter < pesc) {
-			partitioned_rice_contents->raw_bits[partition] = 0;
-			u = (partition_order == 0 || partition > 0)? partition_samples : partition_samples - predictor_order;
-			if(!decoder->private_->local_bitreader_read_rice_signed_block(decoder->private_->input, residual + sample, u, rice_parameter))
-				return false; /* read_callback_ sets the state for us */
-			sample += u;
+	decoder->private_->pipeline_running = true;
+	return true;
+}
+
+void stop_pipeline_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i, channel;
+
+	if(!decoder->private_->pipeline_running)
+		return;
+
+	pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+	decoder->private_->pipeline_should_exit = true;
+	pthread_cond_broadcast(&decoder->private_->pipeline_cond);
+	pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+	pthread_join(decoder->private_->pipeline_thread, 0);
+	pthread_cond_destroy(&decoder->private_->pipeline_cond);
+	pthread_mutex_destroy(&decoder->private_->pipeline_mutex);
+	decoder->private_->pipeline_running = false;
+
+	for(i = 0; i < FLAC__STREAM_DECODER_MAX_PIPELINE_DEPTH; i++) {
+		for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+			if(0 != decoder->private_->pipeline[i].output[channel]) {
+				free(decoder->private_->pipeline[i].output[channel]);
+				decoder->private_->pipeline[i].output[channel] = 0;
+			}
 		}
-		else {
-			if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &rice_parameter, FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_RAW_LEN))
-				return false; /* read_callback_ sets the state for us */
-			partitioned_rice_contents->raw_bits[partition] = rice_parameter;
-			for(u = (partition_order == 0 || partition > 0)? 0 : predictor_order; u < partition_samples; u++, sample++) {
-				if(!FLAC__bitreader_read_raw_int32(decoder->private_->input, &i, rice_parameter))
-					return false; /* read_callback_ sets the state for us */
-				residual[sample] = i;
+		decoder->private_->pipeline[i].output_capacity = 0;
+	}
+}
+
+/*
+ * Copies a decoded frame into the next free slot of the pipeline and
+ * hands it to the consumer thread, waiting for a slot if the pipeline
+ * is full.  Returns the status of the last frame the consumer failed to
+ * deliver, if any, so that the caller stops decoding.
+ */
+FLAC__StreamDecoderWriteStatus queue_pipeline_frame_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
+{
+	FLAC__StreamDecoderPipelineFrame *slot;
+	FLAC__StreamDecoderWriteStatus status;
+	const unsigned depth = decoder->protected_->pipeline_depth;
+	unsigned channel;
+
+	pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+	while(decoder->private_->pipeline_status == FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE && decoder->private_->pipeline_count == depth)
+		pthread_cond_wait(&decoder->private_->pipeline_cond, &decoder->private_->pipeline_mutex);
+	status = decoder->private_->pipeline_status;
+	slot = &decoder->private_->pipeline[(decoder->private_->pipeline_head + decoder->private_->pipeline_count) % depth];
+	pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+	if(status != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE)
+		return status;
+
+	if(slot->output_capacity < frame->header.blocksize) {
+		for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+			if(0 != slot->output[channel]) {
+				free(slot->output[channel]);
+				slot->output[channel] = 0;
 			}
 		}
+		slot->output_capacity = 0;
+		for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+			if(0 == (slot->output[channel] = (FLAC__int32*)safe_malloc_mul_2op_(sizeof(FLAC__int32), /*times*/frame->header.blocksize)))
+				return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		slot->output_capacity = frame->header.blocksize;
+	}
+	for(channel = 0; channel < frame->header.channels; channel++)
+		memcpy(slot->output[channel], buffer[channel], sizeof(FLAC__int32) * frame->header.blocksize);
+	slot->frame = *frame;
+	slot->do_md5_checking = decoder->private_->do_md5_checking;
+
+	pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+	decoder->private_->pipeline_count++;
+	pthread_cond_broadcast(&decoder->private_->pipeline_cond);
+	pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+	/* clients usually act on an error in the next write callback, so after
+	 * an error that frame is delivered before decoding goes on, as it would
+	 * be without the pipeline */
+	if(decoder->private_->pipeline_wait_next) {
+		decoder->private_->pipeline_wait_next = false;
+		if(!drain_pipeline_(decoder))
+			return decoder->private_->pipeline_status;
 	}
 
-	return true;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
-FLAC__bool read_zero_padding_(FLAC__StreamDecoder *decoder)
+/* Waits until every frame in the pipeline is delivered; returns false if the consumer failed to deliver one. */
+FLAC__bool drain_pipeline_(FLAC__StreamDecoder *decoder)
 {
-	if(!FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input)) {
-		FLAC__uint32 zero = 0;
-		if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &zero, FLAC__bitreader_bits_left_for_byte_alignment(decoder->private_->input)))
-			return false; /* read_callback_ sets the state for us */
-		if(zero != 0) {
-			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
-			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+	FLAC__bool ok;
+
+	pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+	while(decoder->private_->pipeline_count > 0)
+		pthread_cond_wait(&decoder->private_->pipeline_cond, &decoder->private_->pipeline_mutex);
+	ok = (decoder->private_->pipeline_status == FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE);
+	pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+	return ok;
+}
+
+void *pipeline_thread_(void *arg)
+{
+	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder*)arg;
+	FLAC__StreamDecoderPipelineFrame *slot;
+	FLAC__StreamDecoderWriteStatus status;
+
+	pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+	while(1) {
+		while(!decoder->private_->pipeline_should_exit && decoder->private_->pipeline_count == 0)
+			pthread_cond_wait(&decoder->private_->pipeline_cond, &decoder->private_->pipeline_mutex);
+		if(decoder->private_->pipeline_should_exit)
+			break;
+		slot = &decoder->private_->pipeline[decoder->private_->pipeline_head];
+		status = decoder->private_->pipeline_status;
+		pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+		/* once the client has aborted, the remaining frames are just dropped */
+		if(status == FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+			if(slot->do_md5_checking && !FLAC__MD5Accumulate(&decoder->private_->md5context, (const FLAC__int32 * const *)slot->output, slot->frame.header.channels, slot->frame.header.blocksize, (slot->frame.header.bits_per_sample+7) / 8))
+				status = FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+			else
+				status = decoder->private_->write_callback(decoder, &slot->frame, (const FLAC__int32 * const *)slot->output, decoder->private_->client_data);
 		}
+
+		pthread_mutex_lock(&decoder->private_->pipeline_mutex);
+		decoder->private_->pipeline_status = status;
+		decoder->private_->pipeline_head = (decoder->private_->pipeline_head + 1) % decoder->protected_->pipeline_depth;
+		decoder->private_->pipeline_count--;
+		pthread_cond_broadcast(&decoder->private_->pipeline_cond);
 	}
-	return true;
+	pthread_mutex_unlock(&decoder->private_->pipeline_mutex);
+
+	return 0;
 }
+#endif
 
 FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data)
 {
 	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder *)client_data;
 
+#ifdef FLAC__HAS_PTHREAD
+	/* input handed back by replay_threadtasks_() comes first */
+	if(decoder->private_->replay_start < decoder->private_->replay_length) {
+		if(*bytes > decoder->private_->replay_length - decoder->private_->replay_start)
+			*bytes = decoder->private_->replay_length - decoder->private_->replay_start;
+		memcpy(buffer, decoder->private_->replay + decoder->private_->replay_start, *bytes);
+		decoder->private_->replay_start += *bytes;
+		return true;
+	}
+#endif
 	if(
 #if FLAC__HAS_OGG
 		/* see [1] HACK NOTE below for why we don't call the eof_callback when decoding Ogg FLAC */
@@ -2933,6 +4795,9 @@ FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder
 			unsigned delta = (unsigned)(target_sample - this_frame_sample);
 			/* kick out of seek mode */
 			decoder->private_->is_seeking = false;
+			/* a range being decoded knows where it starts by itself */
+			if(decoder->private_->range_active)
+				return write_range_(decoder, frame, buffer);
 			/* shift out the samples before target_sample */
 			if(delta > 0) {
 				unsigned channel;
@@ -2960,25 +4825,298 @@ FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder
 		 */
 		if(!decoder->private_->has_stream_info)
 			decoder->private_->do_md5_checking = false;
+#ifdef FLAC__HAS_PTHREAD
+		if(decoder->private_->pipeline_active)
+			return queue_pipeline_frame_(decoder, frame, buffer);
+#endif
 		if(decoder->private_->do_md5_checking) {
 			if(!FLAC__MD5Accumulate(&decoder->private_->md5context, buffer, frame->header.channels, frame->header.blocksize, (frame->header.bits_per_sample+7) / 8))
 				return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
+		if(decoder->private_->range_active)
+			return write_range_(decoder, frame, buffer);
+		if(decoder->private_->pull_active) {
+			/* keep the frame for read_samples_interleaved_() */
+			unsigned channel;
+			FLAC__ASSERT(buffer == (const FLAC__int32 * const *)decoder->private_->threadtask[0]->output);
+			decoder->private_->pulled_header = frame->header;
+			for(channel = 0; channel < frame->header.channels; channel++)
+				decoder->private_->pulled_output[channel] = buffer[channel];
+			decoder->private_->pulled_channel_assignment = decoder->private_->threadtask[0]->decorrelate? FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT : frame->header.channel_assignment;
+			decoder->private_->pulled_samples = 0;
+			decoder->private_->has_pulled_frame = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		}
 		return decoder->private_->write_callback(decoder, frame, buffer, decoder->private_->client_data);
 	}
 }
 
+/*
+ * Delivers the part of a frame that falls inside the range being decoded
+ * by FLAC__stream_decoder_process_range(), either straight into the
+ * client's buffer or through the write callback as a shortened frame.
+ * Samples past the end of the range may not have been restored (see
+ * read_frame_()) and are never looked at.
+ */
+FLAC__StreamDecoderWriteStatus write_range_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
+{
+	const FLAC__uint64 this_frame_sample = frame->header.number.sample_number;
+	const FLAC__uint64 next_frame_sample = this_frame_sample + (FLAC__uint64)frame->header.blocksize;
+	const unsigned channels = frame->header.channels;
+	const FLAC__int32 *newbuffer[FLAC__MAX_CHANNELS];
+	unsigned channel, from, to;
+
+	FLAC__ASSERT(frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+
+	if(next_frame_sample <= decoder->private_->range_next || this_frame_sample >= decoder->private_->range_end)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+
+	from = this_frame_sample < decoder->private_->range_next? (unsigned)(decoder->private_->range_next - this_frame_sample) : 0;
+	to = next_frame_sample > decoder->private_->range_end? (unsigned)(decoder->private_->range_end - this_frame_sample) : frame->header.blocksize;
+	for(channel = 0; channel < channels; channel++)
+		newbuffer[channel] = buffer[channel] + from;
+
+	if(0 != decoder->private_->range_buffer) {
+		FLAC__int32 *out;
+		if(0 == decoder->private_->range_channels)
+			decoder->private_->range_channels = channels;
+		else if(channels != decoder->private_->range_channels)
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		out = decoder->private_->range_buffer + (size_t)(decoder->private_->range_next - decoder->private_->range_first) * channels;
+		/* frames lost to a bad sync leave a gap, which is filled with silence */
+		if(this_frame_sample > decoder->private_->range_next) {
+			const size_t gap = (size_t)(this_frame_sample - decoder->private_->range_next) * channels;
+			memset(out, 0, sizeof(FLAC__int32) * gap);
+			out += gap;
+		}
+		(void)pcm__pack_interleaved((FLAC__byte*)out, newbuffer, channels, to - from, sizeof(FLAC__int32), /*shift=*/0, FLAC__STREAM_DECODER_IS_BIG_ENDIAN, /*is_unsigned=*/false);
+	}
+	else {
+		FLAC__StreamDecoderWriteStatus status;
+		decoder->private_->last_frame = *frame;
+		decoder->private_->last_frame.header.blocksize = to - from;
+		decoder->private_->last_frame.header.number.sample_number += (FLAC__uint64)from;
+		if((status = decoder->private_->write_callback(decoder, &decoder->private_->last_frame, newbuffer, decoder->private_->client_data)) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE)
+			return status;
+	}
+
+	decoder->private_->range_next = this_frame_sample + to;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+/*
+ * Reads up to 'samples' samples per channel into the client's buffer as
+ * interleaved words of 'bytes_per_sample' bytes, decoding frames as
+ * needed.  A frame is decoded into threadtask[0] and left there, and
+ * the part of it that does not fit is read by the next call.  Stops
+ * early at the end of the stream or before a frame whose channels or
+ * bits-per-sample differ from the samples already read.
+ */
+FLAC__bool read_samples_interleaved_(FLAC__StreamDecoder *decoder, FLAC__byte *buffer, unsigned bytes_per_sample, unsigned samples, unsigned *samples_read)
+{
+	unsigned done = 0, channels = 0, bps = 0, n;
+	FLAC__bool ok = true;
+
+	FLAC__ASSERT(0 != decoder->protected_);
+
+	*samples_read = 0;
+
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
+	)
+		return false;
+
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above call sets the state for us */
+	}
+
+	decoder->private_->pull_active = true;
+
+	while(done < samples) {
+		const FLAC__FrameHeader *header = &decoder->private_->pulled_header;
+		if(!decoder->private_->has_pulled_frame) {
+			if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM)
+				break;
+			if(decoder->protected_->state == FLAC__STREAM_DECODER_ABORTED || !FLAC__stream_decoder_process_single(decoder)) {
+				ok = false; /* above call sets the state for us */
+				break;
+			}
+			continue;
+		}
+		/* the caller has to know what it got, so a change of format waits for the next call */
+		if(done == 0) {
+			channels = header->channels;
+			bps = header->bits_per_sample;
+		}
+		else if(header->channels != channels || header->bits_per_sample != bps)
+			break;
+		n = min(header->blocksize - decoder->private_->pulled_samples, samples - done);
+		pack_samples_(buffer + (size_t)done * channels * bytes_per_sample, decoder->private_->pulled_output, decoder->private_->pulled_channel_assignment, channels, bps, decoder->private_->pulled_samples, n, bytes_per_sample);
+		done += n;
+		decoder->private_->pulled_samples += n;
+		if(decoder->private_->pulled_samples == header->blocksize)
+			decoder->private_->has_pulled_frame = false;
+	}
+
+	decoder->private_->pull_active = false;
+	*samples_read = done;
+	return ok;
+}
+
+/*
+ * Packs samples offset..offset+count-1 of a frame into 'out' as
+ * interleaved native-endian words of 'bytes_per_sample' bytes, undoing
+ * the stereo decorrelation on the way if channel_assignment says it
+ * has not been done yet.  The samples are decorrelated a chunk at a
+ * time into a small buffer that stays in cache, so the frame's signal
+ * is only read once and never written back.  16-bit words get the
+ * samples scaled to 16 bits; 32-bit words get them as they are.
+ */
+void pack_samples_(FLAC__byte *out, const FLAC__int32 * const in[], FLAC__ChannelAssignment channel_assignment, unsigned channels, unsigned bps, unsigned offset, unsigned count, unsigned bytes_per_sample)
+{
+	const unsigned left_shift = (bytes_per_sample == 2 && bps < 16)? 16 - bps : 0;
+	const unsigned right_shift = (bytes_per_sample == 2 && bps > 16)? bps - 16 : 0;
+	FLAC__int32 chunk[FLAC__MAX_CHANNELS][FLAC__STREAM_DECODER_PACK_CHUNK];
+	const FLAC__int32 *signal[FLAC__MAX_CHANNELS];
+	unsigned channel, i, n;
+
+	if(channel_assignment == FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT && right_shift == 0) {
+		for(channel = 0; channel < channels; channel++)
+			signal[channel] = in[channel] + offset;
+		(void)pcm__pack_interleaved(out, signal, channels, count, bytes_per_sample, left_shift, FLAC__STREAM_DECODER_IS_BIG_ENDIAN, /*is_unsigned=*/false);
+		return;
+	}
+
+	for(channel = 0; channel < channels; channel++)
+		signal[channel] = chunk[channel];
+	for( ; count > 0; count -= n, offset += n, out += n * channels * bytes_per_sample) {
+		FLAC__int32 *left = chunk[0], *right = chunk[1];
+		n = min(count, FLAC__STREAM_DECODER_PACK_CHUNK);
+		switch(channel_assignment) {
+			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
+				for(channel = 0; channel < channels; channel++) {
+					const FLAC__int32 *x = in[channel] + offset;
+					for(i = 0; i < n; i++)
+						chunk[channel][i] = x[i] >> right_shift;
+				}
+				break;
+			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
+				FLAC__ASSERT(channels == 2);
+				for(i = 0; i < n; i++) {
+					const FLAC__int32 l = in[0][offset+i];
+					left[i] = l >> right_shift;
+					right[i] = (l - in[1][offset+i]) >> right_shift;
+				}
+				break;
+			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
+				FLAC__ASSERT(channels == 2);
+				for(i = 0; i < n; i++) {
+					const FLAC__int32 r = in[1][offset+i];
+					left[i] = (in[0][offset+i] + r) >> right_shift;
+					right[i] = r >> right_shift;
+				}
+				break;
+			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
+				FLAC__ASSERT(channels == 2);
+				for(i = 0; i < n; i++) {
+					const FLAC__int32 side = in[1][offset+i];
+					const FLAC__int32 mid = (in[0][offset+i] << 1) | (side & 1); /* i.e. if 'side' is odd... */
+					left[i] = ((mid + side) >> 1) >> right_shift;
+					right[i] = ((mid - side) >> 1) >> right_shift;
+				}
+				break;
+			default:
+				FLAC__ASSERT(0);
+				break;
+		}
+		(void)pcm__pack_interleaved(out, signal, channels, n, bytes_per_sample, left_shift, FLAC__STREAM_DECODER_IS_BIG_ENDIAN, /*is_unsigned=*/false);
+	}
+}
+
 void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status)
 {
+	/* except for a bad CRC, the next frame may not start where the last one ended */
+	if(status != FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH)
+		decoder->private_->has_frame_end = false;
+#ifdef FLAC__HAS_PTHREAD
+	/* the client gets the error after the frames before it, from this thread */
+	if(decoder->private_->pipeline_active) {
+		(void)drain_pipeline_((FLAC__StreamDecoder*)decoder);
+		decoder->private_->pipeline_wait_next = true;
+	}
+#endif
 	if(!decoder->private_->is_seeking)
 		decoder->private_->error_callback(decoder, status, decoder->private_->client_data);
 	else if(status == FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM)
 		decoder->private_->unparseable_frame_count++;
 }
 
+/*
+ * Gets the first frame from the input position for the seek routine.
+ * A frame that can't hold the target is only located with the frame
+ * scanner and checked by its CRC-16, never decoded.  Any other frame is
+ * read again from its start and processed as usual, which ends the seek
+ * if it is the target frame.  Either way last_frame.header and
+ * samples_decoded describe the frame and *frame_end is where it ends.
+ */
+FLAC__bool seek_frame_(FLAC__StreamDecoder *decoder, FLAC__uint64 *frame_end)
+{
+	FLAC__FrameHeader header;
+	unsigned header_length;
+	size_t frame_length, junk_length;
+	FLAC__bool runs_to_end_of_input;
+
+	if(decoder->private_->has_stream_info) {
+		const FLAC__uint64 target_sample = decoder->private_->target_sample;
+		const FLAC__byte *frame;
+
+		if(!begin_scan_(decoder))
+			return false;
+		if(decoder->private_->has_scan_position) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+			if(!scan_next_frame_(decoder, &header, &header_length, &frame_length, &junk_length, &runs_to_end_of_input))
+				return false; /* the above function sets the state for us */
+			decoder->private_->scan_start += junk_length;
+			frame = decoder->private_->scan_buffer + decoder->private_->scan_start;
+			if(
+				frame_length >= header_length + 2 && !runs_to_end_of_input &&
+				(target_sample < header.number.sample_number || target_sample >= header.number.sample_number + header.blocksize) &&
+				decoder->private_->local_crc16(frame, (unsigned)frame_length - 2) == ((unsigned)frame[frame_length-2] << 8 | frame[frame_length-1])
+			) {
+				decoder->private_->last_frame.header = header;
+				decoder->private_->samples_decoded = header.number.sample_number + header.blocksize;
+				*frame_end = decoder->private_->scan_position + decoder->private_->scan_start + frame_length;
+				decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+				return true;
+			}
+			/* go back to where the frame (or the end of the input) is and read it properly */
+			if(decoder->private_->seek_callback(decoder, decoder->private_->scan_position + decoder->private_->scan_start, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+				return false;
+			}
+			if(!FLAC__stream_decoder_flush(decoder)) {
+				/* above call sets the state for us */
+				return false;
+			}
+		}
+	}
+
+	if(!FLAC__stream_decoder_process_single(decoder))
+		return false;
+	return !decoder->private_->is_seeking || FLAC__stream_decoder_get_decode_position(decoder, frame_end);
+}
+
 FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample)
 {
-	FLAC__uint64 first_frame_offset = decoder->private_->first_frame_offset, lower_bound, upper_bound, lower_bound_sample, upper_bound_sample, this_frame_sample;
+	FLAC__uint64 first_frame_offset = decoder->private_->first_frame_offset, lower_bound, upper_bound, lower_bound_sample, upper_bound_sample, this_frame_sample, frame_end = 0;
 	FLAC__int64 pos = -1;
 	int i;
 	unsigned approx_bytes_per_frame;
@@ -3092,6 +5230,39 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 		upper_bound_sample++;
 
 	decoder->private_->target_sample = target_sample;
+
+	/* with a frame index we can go straight to the target frame */
+	if(0 != decoder->private_->seek_index) {
+		const FLAC__StreamMetadata_SeekTable *index = &decoder->private_->seek_index->data.seek_table;
+		unsigned lo = 0, hi = index->num_points;
+		/* find the last point at or before the target; the index is sorted and placeholders come last */
+		while(lo < hi) {
+			const unsigned mid = lo + (hi - lo) / 2;
+			if(index->points[mid].sample_number <= target_sample)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if(lo > 0 && target_sample - index->points[lo-1].sample_number < index->points[lo-1].frame_samples) {
+			if(decoder->private_->seek_callback(decoder, first_frame_offset + index->points[lo-1].stream_offset, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+				return false;
+			}
+			if(!FLAC__stream_decoder_flush(decoder)) {
+				/* above call sets the state for us */
+				return false;
+			}
+			decoder->private_->unparseable_frame_count = 0;
+			if(!FLAC__stream_decoder_process_single(decoder)) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+				return false;
+			}
+			if(!decoder->private_->is_seeking)
+				return true;
+			/* the index does not match the stream; fall back to searching */
+		}
+	}
+
 	while(1) {
 		/* check if the bounds are still ok */
 		if (lower_bound_sample >= upper_bound_sample || lower_bound > upper_bound) {
@@ -3131,7 +5302,7 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 		 * FLAC__stream_decoder_process_single() to return false.
 		 */
 		decoder->private_->unparseable_frame_count = 0;
-		if(!FLAC__stream_decoder_process_single(decoder)) {
+		if(!seek_frame_(decoder, &frame_end)) {
 			decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
 			return false;
 		}
@@ -3171,18 +5342,12 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 		if(target_sample < this_frame_sample) {
 			upper_bound_sample = this_frame_sample + decoder->private_->last_frame.header.blocksize;
 /*@@@@@@ what will decode position be if at end of stream? */
-			if(!FLAC__stream_decoder_get_decode_position(decoder, &upper_bound)) {
-				decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
-				return false;
-			}
+			upper_bound = frame_end;
 			approx_bytes_per_frame = (unsigned)(2 * (upper_bound - pos) / 3 + 16);
 		}
 		else { /* target_sample >= this_frame_sample + this frame's blocksize */
 			lower_bound_sample = this_frame_sample + decoder->private_->last_frame.header.blocksize;
-			if(!FLAC__stream_decoder_get_decode_position(decoder, &lower_bound)) {
-				decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
-				return false;
-			}
+			lower_bound = frame_end;
 			approx_bytes_per_frame = (unsigned)(2 * (lower_bound - pos) / 3 + 16);
 		}
 	}
@@ -3392,3 +5557,57 @@ FLAC__bool file_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_d
 
 	return feof(decoder->private_->file)? true : false;
 }
+
+#ifdef FLAC__STREAM_DECODER_HAS_MMAP
+/* only called for Ogg FLAC, and for native FLAC once the bitreader has used up the mapping */
+FLAC__StreamDecoderReadStatus mmap_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	const size_t remaining = decoder->private_->mmap_length - decoder->private_->mmap_position;
+	(void)client_data;
+
+	if(*bytes > 0) {
+		if(*bytes > remaining)
+			*bytes = remaining;
+		if(*bytes == 0)
+			return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+		memcpy(buffer, decoder->private_->mmap_data + decoder->private_->mmap_position, *bytes);
+		decoder->private_->mmap_position += *bytes;
+		return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+	}
+	else
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT; /* abort to avoid a deadlock */
+}
+
+FLAC__StreamDecoderSeekStatus mmap_seek_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	(void)client_data;
+
+	if(absolute_byte_offset > decoder->private_->mmap_length)
+		return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+	decoder->private_->mmap_position = (size_t)absolute_byte_offset;
+	return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+FLAC__StreamDecoderTellStatus mmap_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	(void)client_data;
+
+	*absolute_byte_offset = decoder->private_->mmap_position;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+FLAC__StreamDecoderLengthStatus mmap_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+{
+	(void)client_data;
+
+	*stream_length = decoder->private_->mmap_length;
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+FLAC__bool mmap_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	(void)client_data;
+
+	return decoder->private_->mmap_position >= decoder->private_->mmap_length;
+}
+#endif
@@ -46,6 +46,9 @@
 #include <stdlib.h> /* for malloc() */
 #include <string.h> /* for memcpy() */
 #include <sys/types.h> /* for off_t */
+#ifdef FLAC__HAS_PTHREAD
+#include <pthread.h>
+#endif
 #if defined _MSC_VER || defined __BORLANDC__ || defined __MINGW32__
 #if _MSC_VER < 1400 || defined __BORLANDC__ /* @@@ [2G limit] */
 #define fseeko fseek
@@ -60,18 +63,22 @@
 #endif
 #endif
 #include "FLAC/assert.h"
+#include "FLAC/metadata.h"
 #include "FLAC/stream_decoder.h"
 #include "share/alloc.h"
+#include "protected/stream_decoder.h" /* for FLAC__stream_decoder_reserve() */
 #include "protected/stream_encoder.h"
 #include "private/bitwriter.h"
 #include "private/bitmath.h"
 #include "private/crc.h"
 #include "private/cpu.h"
+#include "private/dispatch.h"
 #include "private/fixed.h"
 #include "private/format.h"
 #include "private/lpc.h"
 #include "private/md5.h"
 #include "private/memory.h"
+#include "private/stream_encoder.h"
 #if FLAC__HAS_OGG
 #include "private/ogg_helper.h"
 #include "private/ogg_mapping.h"
@@ -99,11 +106,13 @@
  * compression within 0.1% of exact calculation.
  */
 #undef EXACT_RICE_BITS_CALCULATION
-/* Rice parameter searching is off by default.  The simple (and fast)
- * parameter estimation in this encoder is very good, almost always
- * yielding compression within 0.1% of the optimal parameters.
+/* The Rice parameter of each partition is estimated from the mean
+ * magnitude of its residual.  With a rice_parameter_search_dist, the
+ * parameters that close to the estimate are also tried, with their
+ * sizes counted exactly; FLAC__count_rice_msbs() counts them all in one
+ * pass.  RICE2 partitions have at most this many parameters to try.
  */
-#undef ENABLE_RICE_PARAMETER_SEARCH 
+#define FLAC__STREAM_ENCODER_MAX_RICE_PARAMETERS 32
 
 
 typedef struct {
@@ -124,6 +133,174 @@ typedef enum {
 	ENCODER_IN_AUDIO = 2
 } EncoderStateHint;
 
+/* Upper limit for FLAC__stream_encoder_set_num_threads(). */
+#define FLAC__STREAM_ENCODER_MAX_THREADS 64
+
+/* Alignment of the buffers taken from a workspace set with FLAC__stream_encoder_set_workspace(); the same as FLAC__memory_alloc_aligned() uses. */
+#define FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT 32
+
+/* Number of candidate blocksizes with FLAC__stream_encoder_set_variable_blocksize(): the blocksize and up to three halvings of it... */
+#define FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS 4
+
+/* ...but never into frames smaller than this. */
+#define FLAC__STREAM_ENCODER_MIN_VARIABLE_BLOCKSIZE 256
+
+/* Rough size of a frame header and footer, charged for each frame when deciding whether to split a block. */
+#define FLAC__STREAM_ENCODER_FRAME_OVERHEAD_BITS 96
+
+/*
+ * With fast mid/side stereo, the channel assignments whose estimated
+ * size is within 1/(1<<this) of the best estimate are all encoded;
+ * when only one is that close, just its two subframes are.
+ */
+#define FLAC__STREAM_ENCODER_FAST_MID_SIDE_MARGIN_SHIFT 8
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+/*
+ * An LPC predictor evaluate_lpc_subframe_() already tried on the
+ * current subframe.  Different windows often quantize to the same
+ * predictor, and trying it again would give the same residual and a
+ * subframe no smaller than before, which can never replace the best
+ * one (only a smaller one does), so it is skipped.
+ */
+typedef struct {
+	unsigned subframe_number;                         /* matches FLAC__StreamEncoderThreadTask.lpc_subframe_number while valid */
+	int quantization;
+	unsigned rice_parameter;
+	FLAC__int32 qlp_coeff[FLAC__MAX_LPC_ORDER];
+} FLAC__StreamEncoderLPCCandidate;
+#endif
+
+/*
+ * Everything needed to turn one block of input into one frame.  When
+ * encoding single-threaded there is exactly one of these and its
+ * integer_signal[] simply points at the encoder's input buffers; with
+ * worker threads each pending frame gets its own copy of the block so
+ * the caller can keep filling the input buffers.
+ */
+typedef struct {
+	FLAC__int32 *integer_signal[FLAC__MAX_CHANNELS];  /* the integer version of the input signal */
+	FLAC__int32 *integer_signal_mid_side[2];          /* the integer version of the mid-side input signal (stereo only) */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real *windowed_signal;                      /* the integer_signal[] * current window[] */
+#endif
+	unsigned subframe_bps[FLAC__MAX_CHANNELS];        /* the effective bits per sample of the input signal (stream bps - wasted bits) */
+	unsigned subframe_bps_mid_side[2];                /* the effective bits per sample of the mid-side input signal (stream bps - wasted bits + 0/1) */
+	FLAC__int32 *residual_workspace[FLAC__MAX_CHANNELS][2]; /* each channel has a candidate and best workspace where the subframe residual signals will be stored */
+	FLAC__int32 *residual_workspace_mid_side[2][2];
+	FLAC__Subframe subframe_workspace[FLAC__MAX_CHANNELS][2];
+	FLAC__Subframe subframe_workspace_mid_side[2][2];
+	FLAC__Subframe *subframe_workspace_ptr[FLAC__MAX_CHANNELS][2];
+	FLAC__Subframe *subframe_workspace_ptr_mid_side[2][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace_mid_side[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr_mid_side[FLAC__MAX_CHANNELS][2];
+	unsigned best_subframe[FLAC__MAX_CHANNELS];       /* index (0 or 1) into 2nd dimension of the above workspaces */
+	unsigned best_subframe_mid_side[2];
+	unsigned best_subframe_bits[FLAC__MAX_CHANNELS];  /* size in bits of the best subframe for each channel */
+	unsigned best_subframe_bits_mid_side[2];
+	FLAC__uint64 *abs_residual_partition_sums;        /* workspace where the sum of abs(candidate residual) for each partition is stored */
+	unsigned *raw_bits_per_partition;                 /* workspace where the sum of silog2(candidate residual) for each partition is stored */
+	FLAC__BitWriter *frame;                           /* the frame being worked on */
+	unsigned frame_number;
+	FLAC__uint64 sample_number;                       /* number of the first sample in the frame; only used for variable blocksize streams */
+	unsigned blocksize;                               /* number of samples in the frame */
+	FLAC__bool is_fractional_block;
+	FLAC__bool is_last_block;
+	FLAC__bool do_independent;                        /* which channel assignments to try; decided by process_frame_() */
+	FLAC__bool do_mid_side;
+	FLAC__ChannelAssignment channel_assignment;       /* the channel assignment process_subframes_() picked */
+	FLAC__bool channel_assignment_estimated;          /* with fast mid/side stereo: whether process_subframes_() estimated the channel assignments... */
+	FLAC__ChannelAssignment estimated_channel_assignment; /* ...which one looked best... */
+	unsigned num_channel_assignments_tried;           /* ...and how many it then encoded */
+	FLAC__bool ok;                                    /* false if encoding the frame failed; the encoder state says why */
+#ifdef FLAC__HAS_PTHREAD
+	FLAC__bool done;                                  /* set by the worker thread once the frame is ready to write */
+#endif
+	FLAC__bool rice_contents_in_workspace;            /* the Rice parameter arrays were taken from the client's workspace and must not be freed */
+	/* unaligned (original) pointers to allocated data */
+	FLAC__int32 *integer_signal_unaligned[FLAC__MAX_CHANNELS];
+	FLAC__int32 *integer_signal_mid_side_unaligned[2];
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real *windowed_signal_unaligned;
+#endif
+	FLAC__int32 *residual_workspace_unaligned[FLAC__MAX_CHANNELS][2];
+	FLAC__int32 *residual_workspace_mid_side_unaligned[2][2];
+	FLAC__uint64 *abs_residual_partition_sums_unaligned;
+	unsigned *raw_bits_per_partition_unaligned;
+	/*
+	 * These fields have been moved here from private function local
+	 * declarations merely to save stack space during encoding.
+	 */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real lp_coeff[FLAC__MAX_LPC_ORDER][FLAC__MAX_LPC_ORDER]; /* from process_subframe_() */
+	FLAC__StreamEncoderLPCCandidate lpc_candidate[FLAC__MAX_LPC_ORDER][FLAC__MAX_QLP_COEFF_PRECISION-FLAC__MIN_QLP_COEFF_PRECISION+1]; /* from evaluate_lpc_subframe_(); the last predictor tried for each order and precision */
+	unsigned lpc_subframe_number;                     /* counts the subframes process_subframe_() searched LPC predictors for */
+#endif
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_extra[2]; /* from find_best_partition_order_() */
+} FLAC__StreamEncoderThreadTask;
+
+/*
+ * The settings that decide which buffers init allocates and how big
+ * they are.  FLAC__stream_encoder_recycle() keeps the buffers around and
+ * the next init uses them again if this comes out the same.
+ */
+typedef struct {
+	unsigned channels;
+	unsigned bits_per_sample;
+	unsigned blocksize;
+	FLAC__bool variable_blocksize;
+	unsigned max_partition_order;
+	FLAC__bool do_lpc;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned num_apodizations;
+	FLAC__ApodizationSpecification apodizations[FLAC__MAX_APODIZATION_FUNCTIONS];
+#endif
+	unsigned num_threadtasks;
+	FLAC__bool do_mid_side_stereo;
+	FLAC__bool do_escape_coding;
+	FLAC__bool verify;
+	void *workspace;
+	size_t workspace_size;
+} FLAC__StreamEncoderBufferLayout;
+
+#ifdef FLAC__HAS_PTHREAD
+/* Number of blocks that can be queued for a helper stage before the encoder has to wait for it. */
+#define FLAC__STREAM_ENCODER_STAGE_DEPTH 8
+
+/* One block of work for a helper stage. */
+typedef struct {
+	FLAC__int32 *signal[FLAC__MAX_CHANNELS];          /* a copy of the original (unencoded) block */
+	unsigned samples;
+	FLAC__byte *bytes;                                /* the encoded frame; only used by the verify stage */
+	size_t num_bytes;
+	size_t capacity;                                  /* allocated size of bytes[] */
+} FLAC__StreamEncoderStageBlock;
+
+/*
+ * A helper thread that takes work that only depends on the order of the
+ * blocks (MD5 accumulation, verification) off the encoding thread.  The
+ * encoder fills the next free block in the ring and queues it; the
+ * helper processes the blocks in order.  The first error is kept and
+ * handed to the encoder the next time it queues a block or drains the
+ * stage.
+ */
+typedef struct {
+	FLAC__StreamEncoderState (*process)(FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderStageBlock *block);
+	FLAC__StreamEncoder *encoder;
+	FLAC__StreamEncoderStageBlock block[FLAC__STREAM_ENCODER_STAGE_DEPTH];
+	unsigned head;                                    /* index of the oldest queued block */
+	unsigned count;                                   /* number of queued blocks, including the one being processed */
+	FLAC__StreamEncoderState error;                   /* FLAC__STREAM_ENCODER_OK until processing a block fails */
+	FLAC__bool running;
+	FLAC__bool should_exit;
+	pthread_t thread;
+	pthread_mutex_t mutex;                            /* protects head, count, error and should_exit */
+	pthread_cond_t cond;                              /* signalled when a block is queued or finished, or the thread should exit */
+} FLAC__StreamEncoderStage;
+#endif
+
 static struct CompressionLevels {
 	FLAC__bool do_mid_side_stereo;
 	FLAC__bool loose_mid_side_stereo;
@@ -156,18 +333,58 @@ static struct CompressionLevels {
 
 static void set_defaults_(FLAC__StreamEncoder *encoder);
 static void free_(FLAC__StreamEncoder *encoder);
+static void release_buffers_(FLAC__StreamEncoder *encoder);
+static void get_buffer_layout_(const FLAC__StreamEncoder *encoder, FLAC__StreamEncoderBufferLayout *layout);
+static FLAC__bool buffer_layouts_equal_(const FLAC__StreamEncoderBufferLayout *a, const FLAC__StreamEncoderBufferLayout *b);
+static FLAC__bool finish_internal_(FLAC__StreamEncoder *encoder, FLAC__bool keep_buffers);
 static FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize);
-static FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, unsigned samples, FLAC__bool is_last_block);
+static size_t workspace_size_(const FLAC__StreamEncoder *encoder, unsigned blocksize, unsigned num_threadtasks);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+static unsigned window_capacity_(const FLAC__StreamEncoder *encoder, unsigned blocksize);
+static unsigned window_offset_(unsigned max_blocksize, unsigned blocksize);
+static void compute_window_(const FLAC__ApodizationSpecification *apodization, FLAC__real *window, unsigned n);
+#endif
+static size_t frame_bytes_bound_(const FLAC__StreamEncoder *encoder);
+static unsigned max_reserved_partition_order_(const FLAC__StreamEncoder *encoder, unsigned blocksize);
+static FLAC__StreamEncoderThreadTask *threadtask_new_(void);
+static FLAC__bool threadtask_reserve_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask, unsigned max_partition_order);
+static void threadtask_delete_(FLAC__StreamEncoderThreadTask *threadtask);
+#ifdef FLAC__HAS_PTHREAD
+static FLAC__bool start_threads_(FLAC__StreamEncoder *encoder);
+static void stop_threads_(FLAC__StreamEncoder *encoder);
+static void *encoder_thread_(void *arg);
+static FLAC__bool start_stage_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage, FLAC__StreamEncoderState (*process)(FLAC__StreamEncoder *, const FLAC__StreamEncoderStageBlock *), FLAC__bool with_bytes);
+static void stop_stage_(FLAC__StreamEncoderStage *stage);
+static FLAC__StreamEncoderStageBlock *stage_get_block_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage);
+static void stage_queue_block_(FLAC__StreamEncoderStage *stage);
+static FLAC__bool stage_drain_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage);
+static void *stage_thread_(void *arg);
+static FLAC__StreamEncoderState md5_block_(FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderStageBlock *block);
+static FLAC__StreamEncoderState verify_block_(FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderStageBlock *block);
+static FLAC__bool queue_md5_block_(FLAC__StreamEncoder *encoder, unsigned blocksize);
+static FLAC__bool queue_verify_block_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples);
+#endif
+static FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, FLAC__BitWriter *frame, unsigned samples, FLAC__bool is_last_block);
 static FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, FLAC__bool is_last_block);
+static FLAC__bool index_frame_(FLAC__StreamEncoder *encoder, size_t bytes, unsigned samples);
 static void update_metadata_(const FLAC__StreamEncoder *encoder);
 #if FLAC__HAS_OGG
 static void update_ogg_metadata_(FLAC__StreamEncoder *encoder);
 #endif
-static FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block);
-static FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block);
+static FLAC__bool process_block_(FLAC__StreamEncoder *encoder);
+static unsigned select_blocksizes_(FLAC__StreamEncoder *encoder, unsigned blocksizes[]);
+static unsigned collect_blocksizes_(const FLAC__StreamEncoder *encoder, FLAC__bool split[][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)], unsigned level, unsigned index, unsigned blocksizes[], unsigned num_blocksizes);
+static void estimate_signal_bits_(const FLAC__StreamEncoder *encoder, const FLAC__int32 signal[], unsigned bits_per_sample, FLAC__uint64 bits[][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)]);
+static FLAC__uint64 estimate_subframe_bits_(const FLAC__StreamEncoder *encoder, const FLAC__int32 signal[], unsigned blocksize);
+static FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, unsigned blocksize, FLAC__bool is_fractional_block, FLAC__bool is_last_block);
+static FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask);
+static FLAC__bool write_encoded_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask);
+static FLAC__bool flush_threadtasks_(FLAC__StreamEncoder *encoder, unsigned keep);
+static FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask);
 
 static FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	unsigned min_partition_order,
 	unsigned max_partition_order,
 	const FLAC__FrameHeader *frame_header,
@@ -198,6 +415,7 @@ static unsigned evaluate_constant_subframe_(
 
 static unsigned evaluate_fixed_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -218,6 +436,7 @@ static unsigned evaluate_fixed_subframe_(
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 static unsigned evaluate_lpc_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -247,7 +466,8 @@ static unsigned evaluate_verbatim_subframe_(
 );
 
 static unsigned find_best_partition_order_(
-	struct FLAC__StreamEncoderPrivate *private_,
+	const FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned raw_bits_per_partition[],
@@ -264,6 +484,7 @@ static unsigned find_best_partition_order_(
 );
 
 static void precompute_partition_info_sums_(
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned residual_samples,
@@ -274,6 +495,7 @@ static void precompute_partition_info_sums_(
 );
 
 static void precompute_partition_info_escapes_(
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
 	unsigned raw_bits_per_partition[],
 	unsigned residual_samples,
@@ -282,10 +504,20 @@ static void precompute_partition_info_escapes_(
 	unsigned max_partition_order
 );
 
+static unsigned search_rice_parameter_(
+	const FLAC__StreamEncoder *encoder,
+	const FLAC__int32 residual[],
+	const unsigned partition_samples,
+	const FLAC__uint64 abs_residual_partition_sum,
+	const unsigned suggested_rice_parameter,
+	const unsigned rice_parameter_limit,
+	const unsigned rice_parameter_search_dist,
+	unsigned *best_partition_bits
+);
+
 static FLAC__bool set_partitioned_rice_(
-#ifdef EXACT_RICE_BITS_CALCULATION
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
-#endif
 	const FLAC__uint64 abs_residual_partition_sums[],
 	const unsigned raw_bits_per_partition[],
 	const unsigned residual_samples,
@@ -322,6 +554,7 @@ static FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDec
 static FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void verify_metadata_callback_(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__StreamEncoderState *verify_state_(FLAC__StreamEncoder *encoder);
 
 static FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 static FLAC__StreamEncoderSeekStatus file_seek_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -344,43 +577,53 @@ typedef struct FLAC__StreamEncoderPrivate {
 	FLAC__real *real_signal[FLAC__MAX_CHANNELS];      /* (@@@ currently unused) the floating-point version of the input signal */
 	FLAC__real *real_signal_mid_side[2];              /* (@@@ currently unused) the floating-point version of the mid-side input signal (stereo only) */
 	FLAC__real *window[FLAC__MAX_APODIZATION_FUNCTIONS]; /* the pre-computed floating-point window for each apodization function */
-	FLAC__real *windowed_signal;                      /* the integer_signal[] * current window[] */
 #endif
-	unsigned subframe_bps[FLAC__MAX_CHANNELS];        /* the effective bits per sample of the input signal (stream bps - wasted bits) */
-	unsigned subframe_bps_mid_side[2];                /* the effective bits per sample of the mid-side input signal (stream bps - wasted bits + 0/1) */
-	FLAC__int32 *residual_workspace[FLAC__MAX_CHANNELS][2]; /* each channel has a candidate and best workspace where the subframe residual signals will be stored */
-	FLAC__int32 *residual_workspace_mid_side[2][2];
-	FLAC__Subframe subframe_workspace[FLAC__MAX_CHANNELS][2];
-	FLAC__Subframe subframe_workspace_mid_side[2][2];
-	FLAC__Subframe *subframe_workspace_ptr[FLAC__MAX_CHANNELS][2];
-	FLAC__Subframe *subframe_workspace_ptr_mid_side[2][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace_mid_side[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr_mid_side[FLAC__MAX_CHANNELS][2];
-	unsigned best_subframe[FLAC__MAX_CHANNELS];       /* index (0 or 1) into 2nd dimension of the above workspaces */
-	unsigned best_subframe_mid_side[2];
-	unsigned best_subframe_bits[FLAC__MAX_CHANNELS];  /* size in bits of the best subframe for each channel */
-	unsigned best_subframe_bits_mid_side[2];
-	FLAC__uint64 *abs_residual_partition_sums;        /* workspace where the sum of abs(candidate residual) for each partition is stored */
-	unsigned *raw_bits_per_partition;                 /* workspace where the sum of silog2(candidate residual) for each partition is stored */
-	FLAC__BitWriter *frame;                           /* the current frame being worked on */
+	FLAC__StreamEncoderThreadTask *threadtask[2*FLAC__STREAM_ENCODER_MAX_THREADS]; /* per-frame workspaces; only [0] is used when single-threaded */
+	unsigned num_threadtasks;                         /* number of allocated threadtask[] */
+	unsigned next_threadtask;                         /* index of the threadtask[] the next frame will be encoded into */
+	unsigned num_pending_threadtasks;                 /* number of frames handed to worker threads and not yet written */
+#ifdef FLAC__HAS_PTHREAD
+	pthread_t thread[FLAC__STREAM_ENCODER_MAX_THREADS];
+	unsigned num_running_threads;
+	unsigned next_queued_threadtask;                  /* index of the threadtask[] the next idle worker will pick up */
+	unsigned num_queued_threadtasks;                  /* number of frames waiting for a worker */
+	FLAC__bool threads_should_exit;
+	pthread_mutex_t mutex;                            /* protects the queue and the threadtask[]->done flags */
+	pthread_cond_t cond_queued;                       /* signalled when a frame is queued or the workers should exit */
+	pthread_cond_t cond_done;                         /* signalled when a worker has finished a frame */
+	FLAC__StreamEncoderStage md5_stage;               /* MD5 accumulation, when running on its own thread */
+	FLAC__StreamEncoderStage verify_stage;            /* verify decoding, when running on its own thread */
+#endif
+	FLAC__BitWriter *frame;                           /* used for writing metadata blocks */
 	unsigned loose_mid_side_stereo_frames;            /* rounded number of frames the encoder will use before trying both independent and mid/side frames again */
 	unsigned loose_mid_side_stereo_frame_count;       /* number of frames using the current channel assignment */
+	FLAC__uint64 fast_mid_side_frames;                /* number of frames whose channel assignment was estimated... */
+	FLAC__uint64 fast_mid_side_searched_frames;       /* ...of those, how many had more than one assignment encoded... */
+	FLAC__uint64 fast_mid_side_missed_frames;         /* ...and of those, how many ended up with another than the estimated one */
 	FLAC__ChannelAssignment last_channel_assignment;
 	FLAC__StreamMetadata streaminfo;                  /* scratchpad for STREAMINFO as it is built */
 	FLAC__StreamMetadata_SeekTable *seek_table;       /* pointer into encoder->protected_->metadata_ where the seek table is */
 	unsigned current_sample_number;
 	unsigned current_frame_number;
+	FLAC__uint64 next_frame_sample_number;            /* number of the first sample in the next frame handed to process_frame_() */
+	unsigned num_blocksize_levels;                    /* number of candidate blocksizes, halving from protected_->blocksize; 1 unless encoding with variable blocksize */
 	FLAC__MD5Context md5context;
 	FLAC__CPUInfo cpuinfo;
+	FLAC__CPUDispatch dispatch;                       /* what FLAC__cpu_dispatch() picked for cpuinfo; both are set once in FLAC__stream_encoder_new() */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	unsigned (*local_fixed_compute_best_predictor)(const FLAC__int32 data[], unsigned data_len, FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
 #else
 	unsigned (*local_fixed_compute_best_predictor)(const FLAC__int32 data[], unsigned data_len, FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1]);
 #endif
+	void (*local_fixed_compute_total_errors)(const FLAC__int32 data[], unsigned data_len, FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1]);
+	void (*local_fixed_compute_residual)(const FLAC__int32 data[], unsigned data_len, unsigned order, FLAC__int32 residual[]);
+	unsigned (*local_crc16)(const FLAC__byte *data, unsigned len);
+	void (*local_precompute_partition_info_sums)(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps);
+	void (*local_precompute_partition_info_escapes)(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order);
+	void (*local_count_rice_msbs)(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[]); /* only for partitions whose magnitudes add up to less than 1<<31 */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	void (*local_lpc_compute_autocorrelation)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*local_lpc_compute_autocorrelation_windowed)(const FLAC__int32 in[], const FLAC__real window[], unsigned data_len, unsigned lag, FLAC__real autoc[]); /* 0 if not available */
 	void (*local_lpc_compute_residual_from_qlp_coefficients)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 	void (*local_lpc_compute_residual_from_qlp_coefficients_64bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 	void (*local_lpc_compute_residual_from_qlp_coefficients_16bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
@@ -407,27 +650,20 @@ typedef struct FLAC__StreamEncoderPrivate {
 	FLAC__uint64 samples_written;
 	unsigned frames_written;
 	unsigned total_frames_estimate;
-	/* unaligned (original) pointers to allocated data */
+	FLAC__StreamMetadata_SeekPoint *frame_index; /* frame index built while encoding when protected_->frame_indexing is set */
+	unsigned frame_index_length, frame_index_capacity;
+	FLAC__uint64 frame_index_base; /* bytes_written when the first frame was written */
+	size_t workspace_used;                 /* bytes of encoder->protected_->workspace handed out so far */
+	FLAC__StreamEncoderBufferLayout buffer_layout; /* the settings the buffers below were allocated for */
+	FLAC__bool buffers_valid;              /* the buffers below are all set up for buffer_layout */
+	/* unaligned (original) pointers to allocated data; these stay 0 for buffers taken from encoder->protected_->workspace */
 	FLAC__int32 *integer_signal_unaligned[FLAC__MAX_CHANNELS];
 	FLAC__int32 *integer_signal_mid_side_unaligned[2];
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	FLAC__real *real_signal_unaligned[FLAC__MAX_CHANNELS]; /* (@@@ currently unused) */
 	FLAC__real *real_signal_mid_side_unaligned[2]; /* (@@@ currently unused) */
 	FLAC__real *window_unaligned[FLAC__MAX_APODIZATION_FUNCTIONS];
-	FLAC__real *windowed_signal_unaligned;
-#endif
-	FLAC__int32 *residual_workspace_unaligned[FLAC__MAX_CHANNELS][2];
-	FLAC__int32 *residual_workspace_mid_side_unaligned[2][2];
-	FLAC__uint64 *abs_residual_partition_sums_unaligned;
-	unsigned *raw_bits_per_partition_unaligned;
-	/*
-	 * These fields have been moved here from private function local
-	 * declarations merely to save stack space during encoding.
-	 */
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-	FLAC__real lp_coeff[FLAC__MAX_LPC_ORDER][FLAC__MAX_LPC_ORDER]; /* from process_subframe_() */
 #endif
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_extra[2]; /* from find_best_partition_order_() */
 	/*
 	 * The data for the verify section
 	 */
@@ -437,6 +673,8 @@ typedef struct FLAC__StreamEncoderPrivate {
 		FLAC__bool needs_magic_hack;
 		verify_input_fifo input_fifo;
 		verify_output output;
+		FLAC__int32 * const *expected;               /* the original signal the next decoded frame is compared against */
+		FLAC__StreamEncoderState stage_state;         /* where the callbacks report errors while the verify stage is running */
 		struct {
 			FLAC__uint64 absolute_sample;
 			unsigned frame_number;
@@ -529,7 +767,6 @@ static const unsigned OVERREAD_ = 1;
 FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 {
 	FLAC__StreamEncoder *encoder;
-	unsigned i;
 
 	FLAC__ASSERT(sizeof(int) >= 4); /* we want to die right away if this is not true */
 
@@ -561,38 +798,17 @@ FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 
 	encoder->private_->file = 0;
 
+	/*
+	 * get the CPU info once; init only picks the function pointers
+	 * that fit the settings
+	 */
+	FLAC__cpu_info(&encoder->private_->cpuinfo);
+	FLAC__cpu_dispatch(&encoder->private_->cpuinfo, &encoder->private_->dispatch);
+
 	set_defaults_(encoder);
 
 	encoder->private_->is_being_deleted = false;
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		encoder->private_->subframe_workspace_ptr[i][0] = &encoder->private_->subframe_workspace[i][0];
-		encoder->private_->subframe_workspace_ptr[i][1] = &encoder->private_->subframe_workspace[i][1];
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->subframe_workspace_ptr_mid_side[i][0] = &encoder->private_->subframe_workspace_mid_side[i][0];
-		encoder->private_->subframe_workspace_ptr_mid_side[i][1] = &encoder->private_->subframe_workspace_mid_side[i][1];
-	}
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		encoder->private_->partitioned_rice_contents_workspace_ptr[i][0] = &encoder->private_->partitioned_rice_contents_workspace[i][0];
-		encoder->private_->partitioned_rice_contents_workspace_ptr[i][1] = &encoder->private_->partitioned_rice_contents_workspace[i][1];
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[i][0] = &encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0];
-		encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[i][1] = &encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1];
-	}
-
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace[i][1]);
-	}
-	for(i = 0; i < 2; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1]);
-	}
-	for(i = 0; i < 2; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_extra[i]);
-
 	encoder->protected_->state = FLAC__STREAM_ENCODER_UNINITIALIZED;
 
 	return encoder;
@@ -600,8 +816,6 @@ FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 
 FLAC_API void FLAC__stream_encoder_delete(FLAC__StreamEncoder *encoder)
 {
-	unsigned i;
-
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->protected_);
 	FLAC__ASSERT(0 != encoder->private_);
@@ -610,21 +824,15 @@ FLAC_API void FLAC__stream_encoder_delete(FLAC__StreamEncoder *encoder)
 	encoder->private_->is_being_deleted = true;
 
 	(void)FLAC__stream_encoder_finish(encoder);
+	/* in case FLAC__stream_encoder_recycle() left any behind */
+	release_buffers_(encoder);
+
+	if(0 != encoder->private_->frame_index)
+		free(encoder->private_->frame_index);
 
 	if(0 != encoder->private_->verify.decoder)
 		FLAC__stream_decoder_delete(encoder->private_->verify.decoder);
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace[i][1]);
-	}
-	for(i = 0; i < 2; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1]);
-	}
-	for(i = 0; i < 2; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_extra[i]);
-
 	FLAC__bitwriter_delete(encoder->private_->frame);
 	free(encoder->private_);
 	free(encoder->protected_);
@@ -648,8 +856,11 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	FLAC__bool is_ogg
 )
 {
-	unsigned i;
+	unsigned i, max_partition_order;
 	FLAC__bool metadata_has_seektable, metadata_has_vorbis_comment, metadata_picture_has_type1, metadata_picture_has_type2;
+	FLAC__StreamEncoderBufferLayout buffer_layout;
+	FLAC__bool reuse_buffers;
+	FLAC__CPUDispatch dispatch;
 
 	FLAC__ASSERT(0 != encoder);
 
@@ -670,9 +881,12 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	if(encoder->protected_->channels != 2) {
 		encoder->protected_->do_mid_side_stereo = false;
 		encoder->protected_->loose_mid_side_stereo = false;
+		encoder->protected_->fast_mid_side_stereo = false;
 	}
-	else if(!encoder->protected_->do_mid_side_stereo)
+	else if(!encoder->protected_->do_mid_side_stereo) {
 		encoder->protected_->loose_mid_side_stereo = false;
+		encoder->protected_->fast_mid_side_stereo = false;
+	}
 
 	if(encoder->protected_->bits_per_sample >= 32)
 		encoder->protected_->do_mid_side_stereo = false; /* since we currenty do 32-bit math, the side channel would have 33 bps and overflow */
@@ -844,36 +1058,41 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		}
 	}
 
-	encoder->private_->input_capacity = 0;
-	for(i = 0; i < encoder->protected_->channels; i++) {
-		encoder->private_->integer_signal_unaligned[i] = encoder->private_->integer_signal[i] = 0;
+	/*
+	 * Buffers kept by FLAC__stream_encoder_recycle() are used as they are
+	 * if they were set up for the same layout; otherwise they go.
+	 */
+	get_buffer_layout_(encoder, &buffer_layout);
+	reuse_buffers = encoder->private_->buffers_valid && buffer_layouts_equal_(&buffer_layout, &encoder->private_->buffer_layout);
+	if(!reuse_buffers) {
+		release_buffers_(encoder);
+		for(i = 0; i < encoder->protected_->channels; i++) {
+			encoder->private_->integer_signal_unaligned[i] = encoder->private_->integer_signal[i] = 0;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
-		encoder->private_->real_signal_unaligned[i] = encoder->private_->real_signal[i] = 0;
+			encoder->private_->real_signal_unaligned[i] = encoder->private_->real_signal[i] = 0;
 #endif
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->integer_signal_mid_side_unaligned[i] = encoder->private_->integer_signal_mid_side[i] = 0;
+		}
+		for(i = 0; i < 2; i++) {
+			encoder->private_->integer_signal_mid_side_unaligned[i] = encoder->private_->integer_signal_mid_side[i] = 0;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
-		encoder->private_->real_signal_mid_side_unaligned[i] = encoder->private_->real_signal_mid_side[i] = 0;
+			encoder->private_->real_signal_mid_side_unaligned[i] = encoder->private_->real_signal_mid_side[i] = 0;
 #endif
-	}
+		}
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
-	for(i = 0; i < encoder->protected_->num_apodizations; i++)
-		encoder->private_->window_unaligned[i] = encoder->private_->window[i] = 0;
-	encoder->private_->windowed_signal_unaligned = encoder->private_->windowed_signal = 0;
+		for(i = 0; i < encoder->protected_->num_apodizations; i++)
+			encoder->private_->window_unaligned[i] = encoder->private_->window[i] = 0;
 #endif
-	for(i = 0; i < encoder->protected_->channels; i++) {
-		encoder->private_->residual_workspace_unaligned[i][0] = encoder->private_->residual_workspace[i][0] = 0;
-		encoder->private_->residual_workspace_unaligned[i][1] = encoder->private_->residual_workspace[i][1] = 0;
-		encoder->private_->best_subframe[i] = 0;
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->residual_workspace_mid_side_unaligned[i][0] = encoder->private_->residual_workspace_mid_side[i][0] = 0;
-		encoder->private_->residual_workspace_mid_side_unaligned[i][1] = encoder->private_->residual_workspace_mid_side[i][1] = 0;
-		encoder->private_->best_subframe_mid_side[i] = 0;
+		for(i = 0; i < 2*FLAC__STREAM_ENCODER_MAX_THREADS; i++)
+			encoder->private_->threadtask[i] = 0;
 	}
-	encoder->private_->abs_residual_partition_sums_unaligned = encoder->private_->abs_residual_partition_sums = 0;
-	encoder->private_->raw_bits_per_partition_unaligned = encoder->private_->raw_bits_per_partition = 0;
+	encoder->private_->buffers_valid = false;
+	encoder->private_->next_threadtask = 0;
+	encoder->private_->num_pending_threadtasks = 0;
+#ifdef FLAC__HAS_PTHREAD
+	encoder->private_->num_running_threads = 0;
+	encoder->private_->md5_stage.running = false;
+	encoder->private_->verify_stage.running = false;
+#endif
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	encoder->private_->loose_mid_side_stereo_frames = (unsigned)((FLAC__double)encoder->protected_->sample_rate * 0.4 / (FLAC__double)encoder->protected_->blocksize + 0.5);
 #else
@@ -888,66 +1107,61 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	if(encoder->private_->loose_mid_side_stereo_frames == 0)
 		encoder->private_->loose_mid_side_stereo_frames = 1;
 	encoder->private_->loose_mid_side_stereo_frame_count = 0;
+	encoder->private_->fast_mid_side_frames = 0;
+	encoder->private_->fast_mid_side_searched_frames = 0;
+	encoder->private_->fast_mid_side_missed_frames = 0;
 	encoder->private_->current_sample_number = 0;
 	encoder->private_->current_frame_number = 0;
+	encoder->private_->next_frame_sample_number = 0;
+
+	encoder->private_->num_blocksize_levels = 1;
+	if(encoder->protected_->variable_blocksize) {
+		unsigned blocksize = encoder->protected_->blocksize;
+		while(encoder->private_->num_blocksize_levels < FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS && blocksize % 2 == 0 && blocksize / 2 >= FLAC__STREAM_ENCODER_MIN_VARIABLE_BLOCKSIZE) {
+			blocksize /= 2;
+			encoder->private_->num_blocksize_levels++;
+		}
+	}
 
 	encoder->private_->use_wide_by_block = (encoder->protected_->bits_per_sample + FLAC__bitmath_ilog2(encoder->protected_->blocksize)+1 > 30);
 	encoder->private_->use_wide_by_order = (encoder->protected_->bits_per_sample + FLAC__bitmath_ilog2(max(encoder->protected_->max_lpc_order, FLAC__MAX_FIXED_ORDER))+1 > 30); /*@@@ need to use this? */
 	encoder->private_->use_wide_by_partition = (false); /*@@@ need to set this */
 
 	/*
-	 * get the CPU info and set the function pointers
+	 * set the function pointers
 	 */
-	FLAC__cpu_info(&encoder->private_->cpuinfo);
-	/* first default to the non-asm routines */
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-	encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation;
-#endif
-	encoder->private_->local_fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor;
+	dispatch = encoder->private_->dispatch;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
-	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients;
-	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide;
-	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients;
+	if(encoder->protected_->max_lpc_order < 4)
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation_lag_4;
+	else if(encoder->protected_->max_lpc_order < 8)
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation_lag_8;
+	else if(encoder->protected_->max_lpc_order < 12)
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation_lag_12;
+	else if(encoder->protected_->max_lpc_order < 16)
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation_lag_16;
+	else if(encoder->protected_->max_lpc_order < 32)
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation_lag_32;
+	else
+		encoder->private_->local_lpc_compute_autocorrelation = dispatch.lpc_compute_autocorrelation;
+	if(encoder->protected_->max_lpc_order < 32)
+		encoder->private_->local_lpc_compute_autocorrelation_windowed = dispatch.lpc_compute_autocorrelation_windowed;
+	else
+		encoder->private_->local_lpc_compute_autocorrelation_windowed = 0;
+	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = dispatch.lpc_compute_residual_from_qlp_coefficients;
+	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = dispatch.lpc_compute_residual_from_qlp_coefficients_64bit;
+	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = dispatch.lpc_compute_residual_from_qlp_coefficients_16bit;
 #endif
-	/* now override with asm where appropriate */
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-# ifndef FLAC__NO_ASM
-	if(encoder->private_->cpuinfo.use_asm) {
-#  ifdef FLAC__CPU_IA32
-		FLAC__ASSERT(encoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_IA32);
-#   ifdef FLAC__HAS_NASM
-		if(encoder->private_->cpuinfo.data.ia32.sse) {
-			if(encoder->protected_->max_lpc_order < 4)
-				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_4;
-			else if(encoder->protected_->max_lpc_order < 8)
-				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_8;
-			else if(encoder->protected_->max_lpc_order < 12)
-				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_sse_lag_12;
-			else
-				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32;
-		}
-		else if(encoder->private_->cpuinfo.data.ia32._3dnow)
-			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
-		else
-			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32;
-		if(encoder->private_->cpuinfo.data.ia32.mmx) {
-			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
-			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32_mmx;
-		}
-		else {
-			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
-			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
-		}
-		if(encoder->private_->cpuinfo.data.ia32.mmx && encoder->private_->cpuinfo.data.ia32.cmov)
-			encoder->private_->local_fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_asm_ia32_mmx_cmov;
-#   endif /* FLAC__HAS_NASM */
-#  endif /* FLAC__CPU_IA32 */
-	}
-# endif /* !FLAC__NO_ASM */
-#endif /* !FLAC__INTEGER_ONLY_LIBRARY */
+	encoder->private_->local_crc16 = dispatch.crc16;
+	encoder->private_->local_precompute_partition_info_sums = dispatch.precompute_partition_info_sums;
+	encoder->private_->local_precompute_partition_info_escapes = dispatch.precompute_partition_info_escapes;
+	encoder->private_->local_count_rice_msbs = dispatch.count_rice_msbs;
+	encoder->private_->local_fixed_compute_best_predictor = dispatch.fixed_compute_best_predictor;
+	encoder->private_->local_fixed_compute_total_errors = dispatch.fixed_compute_total_errors;
+	encoder->private_->local_fixed_compute_residual = dispatch.fixed_compute_residual;
 	/* finally override based on wide-ness if necessary */
 	if(encoder->private_->use_wide_by_block) {
-		encoder->private_->local_fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_wide;
+		encoder->private_->local_fixed_compute_best_predictor = dispatch.fixed_compute_best_predictor_wide;
 	}
 
 	/* set state to OK; from here on, errors are fatal and we'll override the state then */
@@ -968,9 +1182,48 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->metadata_callback = metadata_callback;
 	encoder->private_->client_data = client_data;
 
-	if(!resize_buffers_(encoder, encoder->protected_->blocksize)) {
-		/* the above function sets the state for us in case of an error */
-		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+	/*
+	 * Set up the per-frame workspaces; with worker threads we keep up
+	 * to two frames per thread in flight so that the workers are not
+	 * starved while the client fills the next block.
+	 */
+	max_partition_order = buffer_layout.max_partition_order;
+	if(reuse_buffers) {
+		FLAC__ASSERT(encoder->private_->num_threadtasks == buffer_layout.num_threadtasks);
+		for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+			FLAC__StreamEncoderThreadTask *threadtask = encoder->private_->threadtask[i];
+			FLAC__bitwriter_clear(threadtask->frame);
+			threadtask->ok = true;
+#ifdef FLAC__HAS_PTHREAD
+			threadtask->done = true;
+#endif
+		}
+	}
+	else {
+		encoder->private_->num_threadtasks = buffer_layout.num_threadtasks;
+		for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+			if(0 == (encoder->private_->threadtask[i] = threadtask_new_())) {
+				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+			}
+		}
+
+		if(!resize_buffers_(encoder, encoder->protected_->blocksize)) {
+			/* the above function sets the state for us in case of an error */
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
+
+		/*
+		 * Whatever else grows with the frames (the Rice parameter arrays and
+		 * the frame bitwriters) is sized for the worst case here, so that
+		 * encoding itself does not allocate.
+		 */
+		for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+			if(!threadtask_reserve_(encoder, encoder->private_->threadtask[i], max_partition_order)) {
+				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+			}
+		}
 	}
 
 	if(!FLAC__bitwriter_init(encoder->private_->frame)) {
@@ -978,6 +1231,13 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
 
+#ifdef FLAC__HAS_PTHREAD
+	if(encoder->protected_->num_threads > 1 && !start_threads_(encoder)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+	}
+#endif
+
 	/*
 	 * Set up the verify stuff if necessary
 	 */
@@ -986,19 +1246,27 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		 * First, set up the fifo which will hold the
 		 * original signal to compare against
 		 */
-		encoder->private_->verify.input_fifo.size = encoder->protected_->blocksize+OVERREAD_;
-		for(i = 0; i < encoder->protected_->channels; i++) {
-			if(0 == (encoder->private_->verify.input_fifo.data[i] = (FLAC__int32*)safe_malloc_mul_2op_(sizeof(FLAC__int32), /*times*/encoder->private_->verify.input_fifo.size))) {
-				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		if(!reuse_buffers) {
+			encoder->private_->verify.input_fifo.size = encoder->protected_->blocksize+OVERREAD_;
+			/* with worker threads, every frame still in flight is also still in the fifo */
+			if(encoder->private_->num_threadtasks > 1)
+				encoder->private_->verify.input_fifo.size += encoder->protected_->blocksize * encoder->private_->num_threadtasks;
+			for(i = 0; i < encoder->protected_->channels; i++) {
+				if(0 == (encoder->private_->verify.input_fifo.data[i] = (FLAC__int32*)safe_malloc_mul_2op_(sizeof(FLAC__int32), /*times*/encoder->private_->verify.input_fifo.size))) {
+					encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+					return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+				}
 			}
 		}
 		encoder->private_->verify.input_fifo.tail = 0;
+		encoder->private_->verify.expected = encoder->private_->verify.input_fifo.data;
 
 		/*
-		 * Now set up a stream decoder for verification
+		 * Now set up a stream decoder for verification; one left over
+		 * from an earlier stream is finished and can be used again
 		 */
-		encoder->private_->verify.decoder = FLAC__stream_decoder_new();
+		if(0 == encoder->private_->verify.decoder)
+			encoder->private_->verify.decoder = FLAC__stream_decoder_new();
 		if(0 == encoder->private_->verify.decoder) {
 			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
@@ -1008,7 +1276,15 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
+
+		if(!FLAC__stream_decoder_reserve(encoder->private_->verify.decoder, encoder->protected_->blocksize, encoder->protected_->channels, max_partition_order)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
 	}
+	encoder->private_->buffer_layout = buffer_layout;
+	encoder->private_->buffers_valid = true;
+
 	encoder->private_->verify.error_stats.absolute_sample = 0;
 	encoder->private_->verify.error_stats.frame_number = 0;
 	encoder->private_->verify.error_stats.channel = 0;
@@ -1022,6 +1298,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	 */
 	encoder->private_->first_seekpoint_to_check = 0;
 	encoder->private_->samples_written = 0;
+	encoder->private_->frame_index_length = 0;
 	encoder->protected_->streaminfo_offset = 0;
 	encoder->protected_->seektable_offset = 0;
 	encoder->protected_->audio_offset = 0;
@@ -1035,7 +1312,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
-	if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+	if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 		/* the above function sets the state for us in case of an error */
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
@@ -1048,7 +1325,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.type = FLAC__METADATA_TYPE_STREAMINFO;
 	encoder->private_->streaminfo.is_last = false; /* we will have at a minimum a VORBIS_COMMENT afterwards */
 	encoder->private_->streaminfo.length = FLAC__STREAM_METADATA_STREAMINFO_LENGTH;
-	encoder->private_->streaminfo.data.stream_info.min_blocksize = encoder->protected_->blocksize; /* this encoder uses the same blocksize for the whole stream */
+	encoder->private_->streaminfo.data.stream_info.min_blocksize = encoder->protected_->blocksize >> (encoder->private_->num_blocksize_levels - 1); /* the same as max_blocksize unless the blocksize is variable */
 	encoder->private_->streaminfo.data.stream_info.max_blocksize = encoder->protected_->blocksize;
 	encoder->private_->streaminfo.data.stream_info.min_framesize = 0; /* we don't know this yet; have to fill it in later */
 	encoder->private_->streaminfo.data.stream_info.max_framesize = 0; /* we don't know this yet; have to fill it in later */
@@ -1057,13 +1334,18 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.data.stream_info.bits_per_sample = encoder->protected_->bits_per_sample;
 	encoder->private_->streaminfo.data.stream_info.total_samples = encoder->protected_->total_samples_estimate; /* we will replace this later with the real total */
 	memset(encoder->private_->streaminfo.data.stream_info.md5sum, 0, 16); /* we don't know this yet; have to fill it in later */
-	if(encoder->protected_->do_md5)
+	if(encoder->protected_->do_md5) {
 		FLAC__MD5Init(&encoder->private_->md5context);
+		if(!FLAC__MD5Reserve(&encoder->private_->md5context, encoder->protected_->channels, encoder->protected_->blocksize, (encoder->protected_->bits_per_sample+7) / 8)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
+	}
 	if(!FLAC__add_metadata_block(&encoder->private_->streaminfo, encoder->private_->frame)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
-	if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+	if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 		/* the above function sets the state for us in case of an error */
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
@@ -1099,7 +1381,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
-		if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+		if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 			/* the above function sets the state for us in case of an error */
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
@@ -1114,7 +1396,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
-		if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+		if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 			/* the above function sets the state for us in case of an error */
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
@@ -1129,6 +1411,20 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	if(encoder->protected_->verify)
 		encoder->private_->verify.state_hint = ENCODER_IN_AUDIO;
 
+#ifdef FLAC__HAS_PTHREAD
+	/*
+	 * With worker threads, also move MD5 accumulation and verification
+	 * of the audio frames off the calling thread.  If a stage cannot be
+	 * started, that work is simply done inline as usual.
+	 */
+	if(encoder->private_->num_running_threads > 0) {
+		if(encoder->protected_->do_md5)
+			(void)start_stage_(encoder, &encoder->private_->md5_stage, md5_block_, /*with_bytes=*/false);
+		if(encoder->protected_->verify)
+			(void)start_stage_(encoder, &encoder->private_->verify_stage, verify_block_, /*with_bytes=*/true);
+	}
+#endif
+
 	return FLAC__STREAM_ENCODER_INIT_STATUS_OK;
 }
 
@@ -1308,6 +1604,16 @@ FLAC_API FLAC__StreamEncoderInitStatus FLAC__stream_encoder_init_ogg_file(
 }
 
 FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
+{
+	return finish_internal_(encoder, /*keep_buffers=*/false);
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_recycle(FLAC__StreamEncoder *encoder)
+{
+	return finish_internal_(encoder, /*keep_buffers=*/true);
+}
+
+FLAC__bool finish_internal_(FLAC__StreamEncoder *encoder, FLAC__bool keep_buffers)
 {
 	FLAC__bool error = false;
 
@@ -1319,14 +1625,28 @@ FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
 		return true;
 
 	if(encoder->protected_->state == FLAC__STREAM_ENCODER_OK && !encoder->private_->is_being_deleted) {
-		if(encoder->private_->current_sample_number != 0) {
+		/* write out everything still in the hands of the worker threads before the last frame */
+		if(!flush_threadtasks_(encoder, 0))
+			error = true;
+		else if(encoder->private_->current_sample_number != 0) {
 			const FLAC__bool is_fractional_block = encoder->protected_->blocksize != encoder->private_->current_sample_number;
-			encoder->protected_->blocksize = encoder->private_->current_sample_number;
-			if(!process_frame_(encoder, is_fractional_block, /*is_last_block=*/true))
+			if(!process_frame_(encoder, encoder->private_->current_sample_number, is_fractional_block, /*is_last_block=*/true))
 				error = true;
 		}
+#ifdef FLAC__HAS_PTHREAD
+		if(!error && encoder->private_->md5_stage.running && !stage_drain_(encoder, &encoder->private_->md5_stage))
+			error = true;
+		if(!error && encoder->private_->verify_stage.running && !stage_drain_(encoder, &encoder->private_->verify_stage))
+			error = true;
+#endif
 	}
 
+#ifdef FLAC__HAS_PTHREAD
+	/* the helper stages must be idle before the MD5 context and the verify decoder are finished */
+	stop_stage_(&encoder->private_->md5_stage);
+	stop_stage_(&encoder->private_->verify_stage);
+#endif
+
 	if(encoder->protected_->do_md5)
 		FLAC__MD5Final(encoder->private_->streaminfo.data.stream_info.md5sum, &encoder->private_->md5context);
 
@@ -1348,7 +1668,7 @@ FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
 				encoder->private_->metadata_callback(encoder, &encoder->private_->streaminfo, encoder->private_->client_data);
 		}
 
-		if(encoder->protected_->verify && 0 != encoder->private_->verify.decoder && !FLAC__stream_decoder_finish(encoder->private_->verify.decoder)) {
+		if(encoder->protected_->verify && 0 != encoder->private_->verify.decoder && !(keep_buffers? FLAC__stream_decoder_recycle(encoder->private_->verify.decoder) : FLAC__stream_decoder_finish(encoder->private_->verify.decoder))) {
 			if(!error)
 				encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA;
 			error = true;
@@ -1367,6 +1687,8 @@ FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
 #endif
 
 	free_(encoder);
+	if(!keep_buffers)
+		release_buffers_(encoder);
 	set_defaults_(encoder);
 
 	if(!error)
@@ -1505,6 +1827,17 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_blocksize(FLAC__StreamEncoder *enco
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_encoder_set_variable_blocksize(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->variable_blocksize = value;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_set_do_mid_side_stereo(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -1527,16 +1860,27 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_loose_mid_side_stereo(FLAC__StreamE
 	return true;
 }
 
-/*@@@@add to tests*/
-FLAC_API FLAC__bool FLAC__stream_encoder_set_apodization(FLAC__StreamEncoder *encoder, const char *specification)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_fast_mid_side_stereo(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
-	FLAC__ASSERT(0 != specification);
 	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
 		return false;
-#ifdef FLAC__INTEGER_ONLY_LIBRARY
+	encoder->protected_->fast_mid_side_stereo = value;
+	return true;
+}
+
+/*@@@@add to tests*/
+FLAC_API FLAC__bool FLAC__stream_encoder_set_apodization(FLAC__StreamEncoder *encoder, const char *specification)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	FLAC__ASSERT(0 != specification);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__INTEGER_ONLY_LIBRARY
 	(void)specification; /* silently ignore since we haven't integerized; will always use a rectangular window */
 #else
 	encoder->protected_->num_apodizations = 0;
@@ -1688,12 +2032,7 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_rice_parameter_search_dist(FLAC__St
 	FLAC__ASSERT(0 != encoder->protected_);
 	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
 		return false;
-#if 0
-	/*@@@ deprecated: */
 	encoder->protected_->rice_parameter_search_dist = value;
-#else
-	(void)value;
-#endif
 	return true;
 }
 
@@ -1708,6 +2047,47 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_total_samples_estimate(FLAC__Stream
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__HAS_PTHREAD
+	if(value == 0 || value > FLAC__STREAM_ENCODER_MAX_THREADS)
+		return false;
+#else
+	if(value != 1)
+		return false;
+#endif
+	encoder->protected_->num_threads = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_set_workspace(FLAC__StreamEncoder *encoder, void *workspace, size_t size)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->workspace = workspace;
+	encoder->protected_->workspace_size = workspace? size : 0;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_set_frame_indexing(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->frame_indexing = value;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_set_metadata(FLAC__StreamEncoder *encoder, FLAC__StreamMetadata **metadata, unsigned num_blocks)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -1882,6 +2262,14 @@ FLAC_API unsigned FLAC__stream_encoder_get_blocksize(const FLAC__StreamEncoder *
 	return encoder->protected_->blocksize;
 }
 
+FLAC_API FLAC__bool FLAC__stream_encoder_get_variable_blocksize(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->variable_blocksize;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_get_do_mid_side_stereo(const FLAC__StreamEncoder *encoder)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -1898,6 +2286,27 @@ FLAC_API FLAC__bool FLAC__stream_encoder_get_loose_mid_side_stereo(const FLAC__S
 	return encoder->protected_->loose_mid_side_stereo;
 }
 
+FLAC_API FLAC__bool FLAC__stream_encoder_get_fast_mid_side_stereo(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->fast_mid_side_stereo;
+}
+
+FLAC_API void FLAC__stream_encoder_get_fast_mid_side_stats(const FLAC__StreamEncoder *encoder, FLAC__uint64 *frames, FLAC__uint64 *searched_frames, FLAC__uint64 *missed_frames)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(0 != frames)
+		*frames = encoder->private_->fast_mid_side_frames;
+	if(0 != searched_frames)
+		*searched_frames = encoder->private_->fast_mid_side_searched_frames;
+	if(0 != missed_frames)
+		*missed_frames = encoder->private_->fast_mid_side_missed_frames;
+}
+
 FLAC_API unsigned FLAC__stream_encoder_get_max_lpc_order(const FLAC__StreamEncoder *encoder)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -1970,6 +2379,60 @@ FLAC_API FLAC__uint64 FLAC__stream_encoder_get_total_samples_estimate(const FLAC
 	return encoder->protected_->total_samples_estimate;
 }
 
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->num_threads;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_frame_indexing(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->frame_indexing;
+}
+
+FLAC_API size_t FLAC__stream_encoder_get_workspace_size(const FLAC__StreamEncoder *encoder)
+{
+	unsigned blocksize;
+
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+
+	/* resolve the default blocksize the same way init_stream_internal_() does */
+	blocksize = encoder->protected_->blocksize;
+	if(blocksize == 0)
+		blocksize = encoder->protected_->max_lpc_order == 0? 1152 : 4096;
+
+	return workspace_size_(encoder, blocksize, encoder->protected_->num_threads > 1? 2 * encoder->protected_->num_threads : 1);
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_frame_index(const FLAC__StreamEncoder *encoder, FLAC__StreamMetadata **frame_index)
+{
+	FLAC__StreamMetadata *index;
+
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != frame_index);
+
+	*frame_index = 0;
+
+	if(0 == (index = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE)))
+		return false;
+	if(!FLAC__metadata_object_seektable_resize_points(index, encoder->private_->frame_index_length)) {
+		FLAC__metadata_object_delete(index);
+		return false;
+	}
+	if(encoder->private_->frame_index_length > 0)
+		memcpy(index->data.seek_table.points, encoder->private_->frame_index, encoder->private_->frame_index_length * sizeof(FLAC__StreamMetadata_SeekPoint));
+	*frame_index = index;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_process(FLAC__StreamEncoder *encoder, const FLAC__int32 * const buffer[], unsigned samples)
 {
 	unsigned i, j = 0, channel;
@@ -2005,17 +2468,8 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process(FLAC__StreamEncoder *encoder, c
 		/* we only process if we have a full block + 1 extra sample; final block is always handled by FLAC__stream_encoder_finish() */
 		if(encoder->private_->current_sample_number > blocksize) {
 			FLAC__ASSERT(encoder->private_->current_sample_number == blocksize+OVERREAD_);
-			FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
-			if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
+			if(!process_block_(encoder))
 				return false;
-			/* move unprocessed overread samples to beginnings of arrays */
-			for(channel = 0; channel < channels; channel++)
-				encoder->private_->integer_signal[channel][0] = encoder->private_->integer_signal[channel][blocksize];
-			if(encoder->protected_->do_mid_side_stereo) {
-				encoder->private_->integer_signal_mid_side[0][0] = encoder->private_->integer_signal_mid_side[0][blocksize];
-				encoder->private_->integer_signal_mid_side[1][0] = encoder->private_->integer_signal_mid_side[1][blocksize];
-			}
-			encoder->private_->current_sample_number = 1;
 		}
 	} while(j < samples);
 
@@ -2060,16 +2514,9 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process_interleaved(FLAC__StreamEncoder
 			encoder->private_->current_sample_number = i;
 			/* we only process if we have a full block + 1 extra sample; final block is always handled by FLAC__stream_encoder_finish() */
 			if(i > blocksize) {
-				if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
-					return false;
-				/* move unprocessed overread samples to beginnings of arrays */
 				FLAC__ASSERT(i == blocksize+OVERREAD_);
-				FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
-				encoder->private_->integer_signal[0][0] = encoder->private_->integer_signal[0][blocksize];
-				encoder->private_->integer_signal[1][0] = encoder->private_->integer_signal[1][blocksize];
-				encoder->private_->integer_signal_mid_side[0][0] = encoder->private_->integer_signal_mid_side[0][blocksize];
-				encoder->private_->integer_signal_mid_side[1][0] = encoder->private_->integer_signal_mid_side[1][blocksize];
-				encoder->private_->current_sample_number = 1;
+				if(!process_block_(encoder))
+					return false;
 			}
 		} while(j < samples);
 	}
@@ -2089,14 +2536,9 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process_interleaved(FLAC__StreamEncoder
 			encoder->private_->current_sample_number = i;
 			/* we only process if we have a full block + 1 extra sample; final block is always handled by FLAC__stream_encoder_finish() */
 			if(i > blocksize) {
-				if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
-					return false;
-				/* move unprocessed overread samples to beginnings of arrays */
 				FLAC__ASSERT(i == blocksize+OVERREAD_);
-				FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
-				for(channel = 0; channel < channels; channel++)
-					encoder->private_->integer_signal[channel][0] = encoder->private_->integer_signal[channel][blocksize];
-				encoder->private_->current_sample_number = 1;
+				if(!process_block_(encoder))
+					return false;
 			}
 		} while(j < samples);
 	}
@@ -2123,10 +2565,12 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 	encoder->protected_->do_md5 = true;
 	encoder->protected_->do_mid_side_stereo = false;
 	encoder->protected_->loose_mid_side_stereo = false;
+	encoder->protected_->fast_mid_side_stereo = false;
 	encoder->protected_->channels = 2;
 	encoder->protected_->bits_per_sample = 16;
 	encoder->protected_->sample_rate = 44100;
 	encoder->protected_->blocksize = 0;
+	encoder->protected_->variable_blocksize = false;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	encoder->protected_->num_apodizations = 1;
 	encoder->protected_->apodizations[0].type = FLAC__APODIZATION_TUKEY;
@@ -2141,6 +2585,10 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 	encoder->protected_->max_residual_partition_order = 0;
 	encoder->protected_->rice_parameter_search_dist = 0;
 	encoder->protected_->total_samples_estimate = 0;
+	encoder->protected_->num_threads = 1;
+	encoder->protected_->workspace = 0;
+	encoder->protected_->workspace_size = 0;
+	encoder->protected_->frame_indexing = false;
 	encoder->protected_->metadata = 0;
 	encoder->protected_->num_metadata_blocks = 0;
 
@@ -2168,15 +2616,32 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 
 void free_(FLAC__StreamEncoder *encoder)
 {
-	unsigned i, channel;
-
 	FLAC__ASSERT(0 != encoder);
+#ifdef FLAC__HAS_PTHREAD
+	/* the workers may still be busy with frames that will never be written */
+	stop_threads_(encoder);
+	stop_stage_(&encoder->private_->md5_stage);
+	stop_stage_(&encoder->private_->verify_stage);
+#endif
 	if(encoder->protected_->metadata) {
 		free(encoder->protected_->metadata);
 		encoder->protected_->metadata = 0;
 		encoder->protected_->num_metadata_blocks = 0;
 	}
-	for(i = 0; i < encoder->protected_->channels; i++) {
+}
+
+/*
+ * Frees everything init allocated for encoding.  This goes by the
+ * array sizes, not the current settings, because buffers kept by
+ * FLAC__stream_encoder_recycle() may be let go after the settings
+ * have changed.
+ */
+void release_buffers_(FLAC__StreamEncoder *encoder)
+{
+	unsigned i;
+
+	FLAC__ASSERT(0 != encoder);
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
 		if(0 != encoder->private_->integer_signal_unaligned[i]) {
 			free(encoder->private_->integer_signal_unaligned[i]);
 			encoder->private_->integer_signal_unaligned[i] = 0;
@@ -2201,56 +2666,154 @@ void free_(FLAC__StreamEncoder *encoder)
 #endif
 	}
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
-	for(i = 0; i < encoder->protected_->num_apodizations; i++) {
+	for(i = 0; i < FLAC__MAX_APODIZATION_FUNCTIONS; i++) {
 		if(0 != encoder->private_->window_unaligned[i]) {
 			free(encoder->private_->window_unaligned[i]);
 			encoder->private_->window_unaligned[i] = 0;
 		}
 	}
-	if(0 != encoder->private_->windowed_signal_unaligned) {
-		free(encoder->private_->windowed_signal_unaligned);
-		encoder->private_->windowed_signal_unaligned = 0;
-	}
 #endif
-	for(channel = 0; channel < encoder->protected_->channels; channel++) {
-		for(i = 0; i < 2; i++) {
-			if(0 != encoder->private_->residual_workspace_unaligned[channel][i]) {
-				free(encoder->private_->residual_workspace_unaligned[channel][i]);
-				encoder->private_->residual_workspace_unaligned[channel][i] = 0;
-			}
+	for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+		if(0 != encoder->private_->threadtask[i]) {
+			threadtask_delete_(encoder->private_->threadtask[i]);
+			encoder->private_->threadtask[i] = 0;
 		}
 	}
-	for(channel = 0; channel < 2; channel++) {
-		for(i = 0; i < 2; i++) {
-			if(0 != encoder->private_->residual_workspace_mid_side_unaligned[channel][i]) {
-				free(encoder->private_->residual_workspace_mid_side_unaligned[channel][i]);
-				encoder->private_->residual_workspace_mid_side_unaligned[channel][i] = 0;
-			}
+	encoder->private_->num_threadtasks = 0;
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		if(0 != encoder->private_->verify.input_fifo.data[i]) {
+			free(encoder->private_->verify.input_fifo.data[i]);
+			encoder->private_->verify.input_fifo.data[i] = 0;
 		}
 	}
-	if(0 != encoder->private_->abs_residual_partition_sums_unaligned) {
-		free(encoder->private_->abs_residual_partition_sums_unaligned);
-		encoder->private_->abs_residual_partition_sums_unaligned = 0;
-	}
-	if(0 != encoder->private_->raw_bits_per_partition_unaligned) {
-		free(encoder->private_->raw_bits_per_partition_unaligned);
-		encoder->private_->raw_bits_per_partition_unaligned = 0;
+	FLAC__bitwriter_free(encoder->private_->frame);
+	encoder->private_->input_capacity = 0;
+	encoder->private_->workspace_used = 0;
+	encoder->private_->buffers_valid = false;
+}
+
+void get_buffer_layout_(const FLAC__StreamEncoder *encoder, FLAC__StreamEncoderBufferLayout *layout)
+{
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned i;
+#endif
+
+	memset(layout, 0, sizeof(*layout));
+	layout->channels = encoder->protected_->channels;
+	layout->bits_per_sample = encoder->protected_->bits_per_sample;
+	layout->blocksize = encoder->protected_->blocksize;
+	layout->variable_blocksize = encoder->protected_->variable_blocksize;
+	layout->max_partition_order = max_reserved_partition_order_(encoder, encoder->protected_->blocksize);
+	layout->do_lpc = encoder->protected_->max_lpc_order > 0;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(layout->do_lpc) {
+		layout->num_apodizations = encoder->protected_->num_apodizations;
+		for(i = 0; i < layout->num_apodizations; i++)
+			layout->apodizations[i] = encoder->protected_->apodizations[i];
 	}
-	if(encoder->protected_->verify) {
-		for(i = 0; i < encoder->protected_->channels; i++) {
-			if(0 != encoder->private_->verify.input_fifo.data[i]) {
-				free(encoder->private_->verify.input_fifo.data[i]);
-				encoder->private_->verify.input_fifo.data[i] = 0;
-			}
-		}
+#endif
+	layout->num_threadtasks = encoder->protected_->num_threads > 1? 2 * encoder->protected_->num_threads : 1;
+	layout->do_mid_side_stereo = encoder->protected_->do_mid_side_stereo;
+	layout->do_escape_coding = encoder->protected_->do_escape_coding;
+	layout->verify = encoder->protected_->verify;
+	layout->workspace = encoder->protected_->workspace;
+	layout->workspace_size = encoder->protected_->workspace_size;
+}
+
+FLAC__bool buffer_layouts_equal_(const FLAC__StreamEncoderBufferLayout *a, const FLAC__StreamEncoderBufferLayout *b)
+{
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned i;
+
+	if(a->num_apodizations != b->num_apodizations)
+		return false;
+	for(i = 0; i < a->num_apodizations; i++) {
+		if(a->apodizations[i].type != b->apodizations[i].type)
+			return false;
+		if(a->apodizations[i].type == FLAC__APODIZATION_GAUSS && a->apodizations[i].parameters.gauss.stddev != b->apodizations[i].parameters.gauss.stddev)
+			return false;
+		if(a->apodizations[i].type == FLAC__APODIZATION_TUKEY && a->apodizations[i].parameters.tukey.p != b->apodizations[i].parameters.tukey.p)
+			return false;
 	}
-	FLAC__bitwriter_free(encoder->private_->frame);
+#endif
+	return
+		a->channels == b->channels &&
+		a->bits_per_sample == b->bits_per_sample &&
+		a->blocksize == b->blocksize &&
+		a->variable_blocksize == b->variable_blocksize &&
+		a->max_partition_order == b->max_partition_order &&
+		a->do_lpc == b->do_lpc &&
+		a->num_threadtasks == b->num_threadtasks &&
+		a->do_mid_side_stereo == b->do_mid_side_stereo &&
+		a->do_escape_coding == b->do_escape_coding &&
+		a->verify == b->verify &&
+		a->workspace == b->workspace &&
+		a->workspace_size == b->workspace_size;
+}
+
+/*
+ * Takes the next 'bytes' from the workspace the client set with
+ * FLAC__stream_encoder_set_workspace(), or returns 0 if it is too small.
+ * Every buffer is rounded up to the alignment, so all of them stay
+ * aligned if the first one is.
+ */
+static void *workspace_take_(FLAC__StreamEncoder *encoder, size_t bytes)
+{
+	FLAC__byte *workspace = (FLAC__byte*)encoder->protected_->workspace;
+	size_t offset = encoder->private_->workspace_used;
+
+	if(offset == 0)
+		offset = (FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT - ((size_t)workspace & (FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT-1))) & (FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT-1);
+	bytes = (bytes + FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT-1) & ~(size_t)(FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT-1);
+	if(offset > encoder->protected_->workspace_size || bytes > encoder->protected_->workspace_size - offset)
+		return 0;
+	encoder->private_->workspace_used = offset + bytes;
+	return workspace + offset;
+}
+
+/*
+ * These allocate like their FLAC__memory_alloc_aligned_*_array()
+ * counterparts unless the client set a workspace, in which case the
+ * buffer is taken from there and *unaligned_pointer is left alone.
+ */
+static FLAC__bool alloc_int32_array_(FLAC__StreamEncoder *encoder, unsigned elements, FLAC__int32 **unaligned_pointer, FLAC__int32 **aligned_pointer)
+{
+	if(0 == encoder->protected_->workspace)
+		return FLAC__memory_alloc_aligned_int32_array(elements, unaligned_pointer, aligned_pointer);
+	*aligned_pointer = (FLAC__int32*)workspace_take_(encoder, sizeof(FLAC__int32) * (size_t)elements);
+	return 0 != *aligned_pointer;
+}
+
+static FLAC__bool alloc_uint64_array_(FLAC__StreamEncoder *encoder, unsigned elements, FLAC__uint64 **unaligned_pointer, FLAC__uint64 **aligned_pointer)
+{
+	if(0 == encoder->protected_->workspace)
+		return FLAC__memory_alloc_aligned_uint64_array(elements, unaligned_pointer, aligned_pointer);
+	*aligned_pointer = (FLAC__uint64*)workspace_take_(encoder, sizeof(FLAC__uint64) * (size_t)elements);
+	return 0 != *aligned_pointer;
+}
+
+static FLAC__bool alloc_unsigned_array_(FLAC__StreamEncoder *encoder, unsigned elements, unsigned **unaligned_pointer, unsigned **aligned_pointer)
+{
+	if(0 == encoder->protected_->workspace)
+		return FLAC__memory_alloc_aligned_unsigned_array(elements, unaligned_pointer, aligned_pointer);
+	*aligned_pointer = (unsigned*)workspace_take_(encoder, sizeof(unsigned) * (size_t)elements);
+	return 0 != *aligned_pointer;
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+static FLAC__bool alloc_real_array_(FLAC__StreamEncoder *encoder, unsigned elements, FLAC__real **unaligned_pointer, FLAC__real **aligned_pointer)
+{
+	if(0 == encoder->protected_->workspace)
+		return FLAC__memory_alloc_aligned_real_array(elements, unaligned_pointer, aligned_pointer);
+	*aligned_pointer = (FLAC__real*)workspace_take_(encoder, sizeof(FLAC__real) * (size_t)elements);
+	return 0 != *aligned_pointer;
 }
+#endif
 
 FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 {
 	FLAC__bool ok;
-	unsigned i, channel;
+	unsigned i, t, channel;
 
 	FLAC__ASSERT(new_blocksize > 0);
 	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
@@ -2268,10 +2831,14 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 	 * alignment purposes; we use 4 in front to keep the data well-aligned.
 	 */
 
+	/* WATCHOUT: workspace_size_() must be kept in sync with what is allocated here */
+
 	for(i = 0; ok && i < encoder->protected_->channels; i++) {
-		ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_unaligned[i], &encoder->private_->integer_signal[i]);
-		memset(encoder->private_->integer_signal[i], 0, sizeof(FLAC__int32)*4);
-		encoder->private_->integer_signal[i] += 4;
+		ok = ok && alloc_int32_array_(encoder, new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_unaligned[i], &encoder->private_->integer_signal[i]);
+		if(ok) {
+			memset(encoder->private_->integer_signal[i], 0, sizeof(FLAC__int32)*4);
+			encoder->private_->integer_signal[i] += 4;
+		}
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 #if 0 /* @@@ currently unused */
 		if(encoder->protected_->max_lpc_order > 0)
@@ -2280,9 +2847,11 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 #endif
 	}
 	for(i = 0; ok && i < 2; i++) {
-		ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_mid_side_unaligned[i], &encoder->private_->integer_signal_mid_side[i]);
-		memset(encoder->private_->integer_signal_mid_side[i], 0, sizeof(FLAC__int32)*4);
-		encoder->private_->integer_signal_mid_side[i] += 4;
+		ok = ok && alloc_int32_array_(encoder, new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_mid_side_unaligned[i], &encoder->private_->integer_signal_mid_side[i]);
+		if(ok) {
+			memset(encoder->private_->integer_signal_mid_side[i], 0, sizeof(FLAC__int32)*4);
+			encoder->private_->integer_signal_mid_side[i] += 4;
+		}
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 #if 0 /* @@@ currently unused */
 		if(encoder->protected_->max_lpc_order > 0)
@@ -2293,82 +2862,64 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	if(ok && encoder->protected_->max_lpc_order > 0) {
 		for(i = 0; ok && i < encoder->protected_->num_apodizations; i++)
-			ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize, &encoder->private_->window_unaligned[i], &encoder->private_->window[i]);
-		ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize, &encoder->private_->windowed_signal_unaligned, &encoder->private_->windowed_signal);
+			ok = ok && alloc_real_array_(encoder, window_capacity_(encoder, new_blocksize), &encoder->private_->window_unaligned[i], &encoder->private_->window[i]);
 	}
 #endif
-	for(channel = 0; ok && channel < encoder->protected_->channels; channel++) {
-		for(i = 0; ok && i < 2; i++) {
-			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &encoder->private_->residual_workspace_unaligned[channel][i], &encoder->private_->residual_workspace[channel][i]);
+	for(t = 0; ok && t < encoder->private_->num_threadtasks; t++) {
+		FLAC__StreamEncoderThreadTask *threadtask = encoder->private_->threadtask[t];
+		if(encoder->private_->num_threadtasks > 1) {
+			/* each frame in flight needs its own copy of the input; see process_frame_() */
+			for(i = 0; ok && i < encoder->protected_->channels; i++) {
+				ok = ok && alloc_int32_array_(encoder, new_blocksize+4, &threadtask->integer_signal_unaligned[i], &threadtask->integer_signal[i]);
+				if(ok) {
+					memset(threadtask->integer_signal[i], 0, sizeof(FLAC__int32)*4);
+					threadtask->integer_signal[i] += 4;
+				}
+			}
+			for(i = 0; ok && encoder->protected_->do_mid_side_stereo && i < 2; i++) {
+				ok = ok && alloc_int32_array_(encoder, new_blocksize+4, &threadtask->integer_signal_mid_side_unaligned[i], &threadtask->integer_signal_mid_side[i]);
+				if(ok) {
+					memset(threadtask->integer_signal_mid_side[i], 0, sizeof(FLAC__int32)*4);
+					threadtask->integer_signal_mid_side[i] += 4;
+				}
+			}
 		}
-	}
-	for(channel = 0; ok && channel < 2; channel++) {
-		for(i = 0; ok && i < 2; i++) {
-			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &encoder->private_->residual_workspace_mid_side_unaligned[channel][i], &encoder->private_->residual_workspace_mid_side[channel][i]);
+		else {
+			/* single-threaded: encode straight from the input buffers */
+			for(i = 0; i < encoder->protected_->channels; i++)
+				threadtask->integer_signal[i] = encoder->private_->integer_signal[i];
+			for(i = 0; i < 2; i++)
+				threadtask->integer_signal_mid_side[i] = encoder->private_->integer_signal_mid_side[i];
+		}
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+		if(ok && encoder->protected_->max_lpc_order > 0)
+			ok = ok && alloc_real_array_(encoder, new_blocksize, &threadtask->windowed_signal_unaligned, &threadtask->windowed_signal);
+#endif
+		for(channel = 0; ok && channel < encoder->protected_->channels; channel++) {
+			for(i = 0; ok && i < 2; i++) {
+				ok = ok && alloc_int32_array_(encoder, new_blocksize, &threadtask->residual_workspace_unaligned[channel][i], &threadtask->residual_workspace[channel][i]);
+			}
+		}
+		for(channel = 0; ok && channel < 2; channel++) {
+			for(i = 0; ok && i < 2; i++) {
+				ok = ok && alloc_int32_array_(encoder, new_blocksize, &threadtask->residual_workspace_mid_side_unaligned[channel][i], &threadtask->residual_workspace_mid_side[channel][i]);
+			}
 		}
+		/* the *2 is an approximation to the series 1 + 1/2 + 1/4 + ... that sums tree occupies in a flat array */
+		/*@@@ new_blocksize*2 is too pessimistic, but to fix, we need smarter logic because a smaller new_blocksize can actually increase the # of partitions; would require moving this out into a separate function, then checking its capacity against the need of the current blocksize&min/max_partition_order (and maybe predictor order) */
+		ok = ok && alloc_uint64_array_(encoder, new_blocksize * 2, &threadtask->abs_residual_partition_sums_unaligned, &threadtask->abs_residual_partition_sums);
+		if(encoder->protected_->do_escape_coding)
+			ok = ok && alloc_unsigned_array_(encoder, new_blocksize * 2, &threadtask->raw_bits_per_partition_unaligned, &threadtask->raw_bits_per_partition);
 	}
-	/* the *2 is an approximation to the series 1 + 1/2 + 1/4 + ... that sums tree occupies in a flat array */
-	/*@@@ new_blocksize*2 is too pessimistic, but to fix, we need smarter logic because a smaller new_blocksize can actually increase the # of partitions; would require moving this out into a separate function, then checking its capacity against the need of the current blocksize&min/max_partition_order (and maybe predictor order) */
-	ok = ok && FLAC__memory_alloc_aligned_uint64_array(new_blocksize * 2, &encoder->private_->abs_residual_partition_sums_unaligned, &encoder->private_->abs_residual_partition_sums);
-	if(encoder->protected_->do_escape_coding)
-		ok = ok && FLAC__memory_alloc_aligned_unsigned_array(new_blocksize * 2, &encoder->private_->raw_bits_per_partition_unaligned, &encoder->private_->raw_bits_per_partition);
 
 	/* now adjust the windows if the blocksize has changed */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	if(ok && new_blocksize != encoder->private_->input_capacity && encoder->protected_->max_lpc_order > 0) {
+		/* with a variable blocksize each shorter candidate gets its own window, packed after the full-size one */
+		unsigned level;
 		for(i = 0; ok && i < encoder->protected_->num_apodizations; i++) {
-			switch(encoder->protected_->apodizations[i].type) {
-				case FLAC__APODIZATION_BARTLETT:
-					FLAC__window_bartlett(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BARTLETT_HANN:
-					FLAC__window_bartlett_hann(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BLACKMAN:
-					FLAC__window_blackman(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BLACKMAN_HARRIS_4TERM_92DB_SIDELOBE:
-					FLAC__window_blackman_harris_4term_92db_sidelobe(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_CONNES:
-					FLAC__window_connes(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_FLATTOP:
-					FLAC__window_flattop(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_GAUSS:
-					FLAC__window_gauss(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.gauss.stddev);
-					break;
-				case FLAC__APODIZATION_HAMMING:
-					FLAC__window_hamming(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_HANN:
-					FLAC__window_hann(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_KAISER_BESSEL:
-					FLAC__window_kaiser_bessel(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_NUTTALL:
-					FLAC__window_nuttall(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_RECTANGLE:
-					FLAC__window_rectangle(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_TRIANGLE:
-					FLAC__window_triangle(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_TUKEY:
-					FLAC__window_tukey(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.tukey.p);
-					break;
-				case FLAC__APODIZATION_WELCH:
-					FLAC__window_welch(encoder->private_->window[i], new_blocksize);
-					break;
-				default:
-					FLAC__ASSERT(0);
-					/* double protection */
-					FLAC__window_hann(encoder->private_->window[i], new_blocksize);
-					break;
-			}
+			for(level = 0; level < encoder->private_->num_blocksize_levels; level++)
+				compute_window_(&encoder->protected_->apodizations[i], encoder->private_->window[i] + window_offset_(new_blocksize, new_blocksize >> level), new_blocksize >> level);
 		}
 	}
 #endif
@@ -2381,53 +2932,227 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 	return ok;
 }
 
-FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, unsigned samples, FLAC__bool is_last_block)
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+/*
+ * The number of samples each window[] needs: one window for the
+ * blocksize, plus one for each shorter candidate blocksize when the
+ * blocksize is variable.  These halve, so they fit in twice the space.
+ */
+unsigned window_capacity_(const FLAC__StreamEncoder *encoder, unsigned blocksize)
 {
-	const FLAC__byte *buffer;
-	size_t bytes;
+	return encoder->protected_->variable_blocksize? 2 * blocksize : blocksize;
+}
 
-	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(encoder->private_->frame));
+/* Where the window for a frame of 'blocksize' samples starts; the sum of the longer ones before it. */
+unsigned window_offset_(unsigned max_blocksize, unsigned blocksize)
+{
+	return 2 * (max_blocksize - blocksize);
+}
 
-	if(!FLAC__bitwriter_get_buffer(encoder->private_->frame, &buffer, &bytes)) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-		return false;
+void compute_window_(const FLAC__ApodizationSpecification *apodization, FLAC__real *window, unsigned n)
+{
+	switch(apodization->type) {
+		case FLAC__APODIZATION_BARTLETT:
+			FLAC__window_bartlett(window, n);
+			break;
+		case FLAC__APODIZATION_BARTLETT_HANN:
+			FLAC__window_bartlett_hann(window, n);
+			break;
+		case FLAC__APODIZATION_BLACKMAN:
+			FLAC__window_blackman(window, n);
+			break;
+		case FLAC__APODIZATION_BLACKMAN_HARRIS_4TERM_92DB_SIDELOBE:
+			FLAC__window_blackman_harris_4term_92db_sidelobe(window, n);
+			break;
+		case FLAC__APODIZATION_CONNES:
+			FLAC__window_connes(window, n);
+			break;
+		case FLAC__APODIZATION_FLATTOP:
+			FLAC__window_flattop(window, n);
+			break;
+		case FLAC__APODIZATION_GAUSS:
+			FLAC__window_gauss(window, n, apodization->parameters.gauss.stddev);
+			break;
+		case FLAC__APODIZATION_HAMMING:
+			FLAC__window_hamming(window, n);
+			break;
+		case FLAC__APODIZATION_HANN:
+			FLAC__window_hann(window, n);
+			break;
+		case FLAC__APODIZATION_KAISER_BESSEL:
+			FLAC__window_kaiser_bessel(window, n);
+			break;
+		case FLAC__APODIZATION_NUTTALL:
+			FLAC__window_nuttall(window, n);
+			break;
+		case FLAC__APODIZATION_RECTANGLE:
+			FLAC__window_rectangle(window, n);
+			break;
+		case FLAC__APODIZATION_TRIANGLE:
+			FLAC__window_triangle(window, n);
+			break;
+		case FLAC__APODIZATION_TUKEY:
+			FLAC__window_tukey(window, n, apodization->parameters.tukey.p);
+			break;
+		case FLAC__APODIZATION_WELCH:
+			FLAC__window_welch(window, n);
+			break;
+		default:
+			FLAC__ASSERT(0);
+			/* double protection */
+			FLAC__window_hann(window, n);
+			break;
 	}
+}
+#endif
 
-	if(encoder->protected_->verify) {
-		encoder->private_->verify.output.data = buffer;
-		encoder->private_->verify.output.bytes = bytes;
-		if(encoder->private_->verify.state_hint == ENCODER_IN_MAGIC) {
-			encoder->private_->verify.needs_magic_hack = true;
-		}
-		else {
-			if(!FLAC__stream_decoder_process_single(encoder->private_->verify.decoder)) {
-				FLAC__bitwriter_release_buffer(encoder->private_->frame);
-				FLAC__bitwriter_clear(encoder->private_->frame);
-				if(encoder->protected_->state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA)
-					encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
-				return false;
-			}
-		}
-	}
+/*
+ * The size of the workspace resize_buffers_() needs for the given
+ * blocksize and number of threadtasks, including the slack for aligning
+ * the first buffer.
+ */
+size_t workspace_size_(const FLAC__StreamEncoder *encoder, unsigned blocksize, unsigned num_threadtasks)
+{
+	const size_t a = FLAC__STREAM_ENCODER_WORKSPACE_ALIGNMENT;
+	const size_t input_bytes = (sizeof(FLAC__int32) * (blocksize+4+OVERREAD_) + a-1) & ~(a-1);
+	const size_t signal_bytes = (sizeof(FLAC__int32) * (blocksize+4) + a-1) & ~(a-1);
+	const size_t residual_bytes = (sizeof(FLAC__int32) * blocksize + a-1) & ~(a-1);
+	size_t bytes = a-1, threadtask_bytes = 0;
+
+	bytes += (encoder->protected_->channels + 2) * input_bytes;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(encoder->protected_->max_lpc_order > 0)
+		bytes += encoder->protected_->num_apodizations * ((sizeof(FLAC__real) * window_capacity_(encoder, blocksize) + a-1) & ~(a-1));
+#endif
+
+	if(num_threadtasks > 1)
+		threadtask_bytes += (encoder->protected_->channels + (encoder->protected_->do_mid_side_stereo? 2 : 0)) * signal_bytes;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(encoder->protected_->max_lpc_order > 0)
+		threadtask_bytes += (sizeof(FLAC__real) * blocksize + a-1) & ~(a-1);
+#endif
+	threadtask_bytes += (encoder->protected_->channels + 2) * 2 * residual_bytes;
+	threadtask_bytes += (sizeof(FLAC__uint64) * blocksize * 2 + a-1) & ~(a-1);
+	if(encoder->protected_->do_escape_coding)
+		threadtask_bytes += (sizeof(unsigned) * blocksize * 2 + a-1) & ~(a-1);
+	/* the parameters[] and raw_bits[] of the Rice contents; see threadtask_reserve_() */
+	threadtask_bytes += (encoder->protected_->channels * 2 + 2 * 2 + 2) * 2 * (((sizeof(unsigned) << max_reserved_partition_order_(encoder, blocksize)) + a-1) & ~(a-1));
+
+	return bytes + num_threadtasks * threadtask_bytes;
+}
+
+/*
+ * An upper bound on the size of an encoded frame: the largest possible
+ * frame header and footer around a verbatim subframe for every channel,
+ * each one bit wider than the input to allow for a side channel.  Since
+ * the encoder falls back to verbatim subframes, no frame is larger.
+ */
+size_t frame_bytes_bound_(const FLAC__StreamEncoder *encoder)
+{
+	const size_t subframe_bits = 8 + (encoder->protected_->bits_per_sample+1) + (size_t)encoder->protected_->blocksize * (encoder->protected_->bits_per_sample+1);
+	return 16 + (encoder->protected_->channels * subframe_bits + 7) / 8 + 2;
+}
+
+/* The largest partition order the Rice parameter arrays are sized for. */
+unsigned max_reserved_partition_order_(const FLAC__StreamEncoder *encoder, unsigned blocksize)
+{
+	const unsigned max_partition_order = min(encoder->protected_->max_residual_partition_order, FLAC__format_get_max_rice_partition_order_from_blocksize(blocksize));
+	/* the encoder never asks for less than order 6; see set_partitioned_rice_() */
+	return max(6, max_partition_order);
+}
+
+FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, FLAC__BitWriter *frame, unsigned samples, FLAC__bool is_last_block)
+{
+	const FLAC__byte *buffer;
+	size_t bytes;
+
+	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(frame));
+
+	if(!FLAC__bitwriter_get_buffer(frame, &buffer, &bytes)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+
+	if(encoder->protected_->verify) {
+#ifdef FLAC__HAS_PTHREAD
+		/* the verify stage thread owns verify.output while it is running */
+		if(encoder->private_->verify_stage.running) {
+			if(!queue_verify_block_(encoder, buffer, bytes, samples)) {
+				/* the above function sets the state for us in case of an error */
+				FLAC__bitwriter_release_buffer(frame);
+				FLAC__bitwriter_clear(frame);
+				return false;
+			}
+		}
+		else
+#endif
+		{
+			encoder->private_->verify.output.data = buffer;
+			encoder->private_->verify.output.bytes = bytes;
+			if(encoder->private_->verify.state_hint == ENCODER_IN_MAGIC) {
+				encoder->private_->verify.needs_magic_hack = true;
+			}
+			else if(!FLAC__stream_decoder_process_single(encoder->private_->verify.decoder)) {
+				FLAC__bitwriter_release_buffer(frame);
+				FLAC__bitwriter_clear(frame);
+				if(encoder->protected_->state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA)
+					encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+				return false;
+			}
+		}
+	}
 
 	if(write_frame_(encoder, buffer, bytes, samples, is_last_block) != FLAC__STREAM_ENCODER_WRITE_STATUS_OK) {
-		FLAC__bitwriter_release_buffer(encoder->private_->frame);
-		FLAC__bitwriter_clear(encoder->private_->frame);
+		FLAC__bitwriter_release_buffer(frame);
+		FLAC__bitwriter_clear(frame);
 		encoder->protected_->state = FLAC__STREAM_ENCODER_CLIENT_ERROR;
 		return false;
 	}
 
-	FLAC__bitwriter_release_buffer(encoder->private_->frame);
-	FLAC__bitwriter_clear(encoder->private_->frame);
+	FLAC__bitwriter_release_buffer(frame);
+	FLAC__bitwriter_clear(frame);
 
 	if(samples > 0) {
 		encoder->private_->streaminfo.data.stream_info.min_framesize = min(bytes, encoder->private_->streaminfo.data.stream_info.min_framesize);
 		encoder->private_->streaminfo.data.stream_info.max_framesize = max(bytes, encoder->private_->streaminfo.data.stream_info.max_framesize);
+		if(encoder->protected_->frame_indexing && !index_frame_(encoder, bytes, samples)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
 	}
 
 	return true;
 }
 
+/* Adds the frame just written to the frame index. */
+FLAC__bool index_frame_(FLAC__StreamEncoder *encoder, size_t bytes, unsigned samples)
+{
+	const FLAC__uint64 sample = encoder->private_->samples_written - samples;
+	const FLAC__uint64 position = encoder->private_->bytes_written - bytes;
+	FLAC__StreamMetadata_SeekPoint *point;
+
+#if FLAC__HAS_OGG
+	/* the frames are scattered over Ogg pages */
+	if(encoder->private_->is_ogg)
+		return true;
+#endif
+	if(sample == 0)
+		encoder->private_->frame_index_base = position;
+	if(encoder->private_->frame_index_length == encoder->private_->frame_index_capacity) {
+		const unsigned new_capacity = encoder->private_->frame_index_capacity? 2 * encoder->private_->frame_index_capacity : 1024;
+		FLAC__StreamMetadata_SeekPoint *new_index = (FLAC__StreamMetadata_SeekPoint*)safe_realloc_mul_2op_(encoder->private_->frame_index, new_capacity, /*times*/sizeof(FLAC__StreamMetadata_SeekPoint));
+		if(0 == new_index)
+			return false;
+		encoder->private_->frame_index = new_index;
+		encoder->private_->frame_index_capacity = new_capacity;
+	}
+	point = &encoder->private_->frame_index[encoder->private_->frame_index_length++];
+	point->sample_number = sample;
+	point->stream_offset = position - encoder->private_->frame_index_base;
+	point->frame_samples = samples;
+	return true;
+}
+
 FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, FLAC__bool is_last_block)
 {
 	FLAC__StreamEncoderWriteStatus status;
@@ -2456,9 +3181,8 @@ FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const
 	 * frame yet)
 	 */
 	if(0 != encoder->private_->seek_table && encoder->protected_->audio_offset > 0 && encoder->private_->seek_table->num_points > 0) {
-		const unsigned blocksize = FLAC__stream_encoder_get_blocksize(encoder);
 		const FLAC__uint64 frame_first_sample = encoder->private_->samples_written;
-		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)blocksize - 1;
+		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)samples - 1;
 		FLAC__uint64 test_sample;
 		unsigned i;
 		for(i = encoder->private_->first_seekpoint_to_check; i < encoder->private_->seek_table->num_points; i++) {
@@ -2469,7 +3193,7 @@ FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const
 			else if(test_sample >= frame_first_sample) {
 				encoder->private_->seek_table->points[i].sample_number = frame_first_sample;
 				encoder->private_->seek_table->points[i].stream_offset = output_position - encoder->protected_->audio_offset;
-				encoder->private_->seek_table->points[i].frame_samples = blocksize;
+				encoder->private_->seek_table->points[i].frame_samples = samples;
 				encoder->private_->first_seekpoint_to_check++;
 				/* DO NOT: "break;" and here's why:
 				 * The seektable template may contain more than one target
@@ -2854,88 +3578,927 @@ void update_ogg_metadata_(FLAC__StreamEncoder *encoder)
 			memcpy(p, b, 18);
 		}
 
-		if(!simple_ogg_page__set_at(encoder, encoder->protected_->seektable_offset, &page, encoder->private_->seek_callback, encoder->private_->write_callback, encoder->private_->client_data)) {
-			simple_ogg_page__clear(&page);
-			return; /* state already set */
+		if(!simple_ogg_page__set_at(encoder, encoder->protected_->seektable_offset, &page, encoder->private_->seek_callback, encoder->private_->write_callback, encoder->private_->client_data)) {
+			simple_ogg_page__clear(&page);
+			return; /* state already set */
+		}
+		simple_ogg_page__clear(&page);
+	}
+}
+#endif
+
+/*
+ * Encodes the full block of input (plus the overread sample) that is
+ * waiting in the signal arrays, either as one frame or, with a variable
+ * blocksize, as the frames select_blocksizes_() splits it into, and
+ * moves what is left over to the beginnings of the arrays.
+ */
+FLAC__bool process_block_(FLAC__StreamEncoder *encoder)
+{
+	unsigned blocksizes[1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)];
+	unsigned num_blocksizes, i, channel, samples = encoder->private_->current_sample_number;
+
+	FLAC__ASSERT(samples == encoder->protected_->blocksize+OVERREAD_);
+
+	if(encoder->private_->num_blocksize_levels > 1)
+		num_blocksizes = select_blocksizes_(encoder, blocksizes);
+	else {
+		blocksizes[0] = encoder->protected_->blocksize;
+		num_blocksizes = 1;
+	}
+
+	for(i = 0; i < num_blocksizes; i++) {
+		if(!process_frame_(encoder, blocksizes[i], /*is_fractional_block=*/false, /*is_last_block=*/false))
+			return false;
+		/* move unprocessed samples, including the overread ones, to beginnings of arrays */
+		samples -= blocksizes[i];
+		for(channel = 0; channel < encoder->protected_->channels; channel++)
+			memmove(&encoder->private_->integer_signal[channel][0], &encoder->private_->integer_signal[channel][blocksizes[i]], sizeof(FLAC__int32) * samples);
+		if(encoder->protected_->do_mid_side_stereo) {
+			memmove(&encoder->private_->integer_signal_mid_side[0][0], &encoder->private_->integer_signal_mid_side[0][blocksizes[i]], sizeof(FLAC__int32) * samples);
+			memmove(&encoder->private_->integer_signal_mid_side[1][0], &encoder->private_->integer_signal_mid_side[1][blocksizes[i]], sizeof(FLAC__int32) * samples);
+		}
+	}
+
+	FLAC__ASSERT(samples == OVERREAD_);
+	encoder->private_->current_sample_number = samples;
+
+	return true;
+}
+
+/*
+ * Splits the waiting block into frames, by comparing the estimated size
+ * of each candidate frame with that of the best split of its two
+ * halves, from the smallest candidate blocksize up.  The estimates come
+ * from the residual of the best fixed predictor, which is far cheaper
+ * than trial encodes and good enough to find where the signal changes
+ * character.  Returns the number of frames; their blocksizes are stored
+ * in blocksizes[].
+ */
+unsigned select_blocksizes_(FLAC__StreamEncoder *encoder, unsigned blocksizes[])
+{
+	FLAC__uint64 signal_bits[FLAC__MAX_CHANNELS][FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)];
+	FLAC__uint64 best_bits[1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)];
+	FLAC__bool split[FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)];
+	const unsigned levels = encoder->private_->num_blocksize_levels;
+	const unsigned bits_per_sample = encoder->protected_->bits_per_sample;
+	unsigned level, i, channel;
+
+	FLAC__ASSERT(levels > 1 && levels <= FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS);
+
+	for(channel = 0; channel < encoder->protected_->channels; channel++)
+		estimate_signal_bits_(encoder, encoder->private_->integer_signal[channel], bits_per_sample, signal_bits[channel]);
+	if(encoder->protected_->do_mid_side_stereo) {
+		FLAC__ASSERT(encoder->protected_->channels == 2);
+		estimate_signal_bits_(encoder, encoder->private_->integer_signal_mid_side[0], bits_per_sample, signal_bits[2]);
+		estimate_signal_bits_(encoder, encoder->private_->integer_signal_mid_side[1], bits_per_sample + 1, signal_bits[3]);
+	}
+
+	for(level = levels; level-- > 0; ) {
+		for(i = 0; i < (1u << level); i++) {
+			FLAC__uint64 bits = 0;
+			if(encoder->protected_->do_mid_side_stereo) {
+				/* the same choice of channel assignment process_subframes_() makes, only on estimates */
+				const FLAC__uint64 left = signal_bits[0][level][i], right = signal_bits[1][level][i], mid = signal_bits[2][level][i], side = signal_bits[3][level][i];
+				bits = min(min(left + right, left + side), min(right + side, mid + side));
+			}
+			else {
+				for(channel = 0; channel < encoder->protected_->channels; channel++)
+					bits += signal_bits[channel][level][i];
+			}
+			bits += FLAC__STREAM_ENCODER_FRAME_OVERHEAD_BITS;
+			/* best_bits[2*i] and best_bits[2*i+1] still hold the best splits of the two halves from the level below */
+			if(level == levels - 1 || bits <= best_bits[2*i] + best_bits[2*i+1]) {
+				split[level][i] = false;
+				best_bits[i] = bits;
+			}
+			else {
+				split[level][i] = true;
+				best_bits[i] = best_bits[2*i] + best_bits[2*i+1];
+			}
+		}
+	}
+
+	return collect_blocksizes_(encoder, split, 0, 0, blocksizes, 0);
+}
+
+unsigned collect_blocksizes_(const FLAC__StreamEncoder *encoder, FLAC__bool split[][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)], unsigned level, unsigned index, unsigned blocksizes[], unsigned num_blocksizes)
+{
+	if(!split[level][index]) {
+		blocksizes[num_blocksizes++] = encoder->protected_->blocksize >> level;
+		return num_blocksizes;
+	}
+	num_blocksizes = collect_blocksizes_(encoder, split, level+1, 2*index, blocksizes, num_blocksizes);
+	return collect_blocksizes_(encoder, split, level+1, 2*index+1, blocksizes, num_blocksizes);
+}
+
+/*
+ * Estimates the size in bits of the subframe for each candidate frame
+ * of one signal.  The residual sums are computed once over the
+ * smallest candidates and added up for the larger ones; the first
+ * FLAC__MAX_FIXED_ORDER samples of a frame are warmup, so those of
+ * each smallest candidate are kept apart and only counted when it is
+ * not the first in a frame.
+ */
+void estimate_signal_bits_(const FLAC__StreamEncoder *encoder, const FLAC__int32 signal[], unsigned bits_per_sample, FLAC__uint64 bits[][1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)])
+{
+	FLAC__uint64 warmup_error[1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)][FLAC__MAX_FIXED_ORDER+1];
+	FLAC__uint64 error[1u << (FLAC__STREAM_ENCODER_MAX_BLOCKSIZE_LEVELS-1)][FLAC__MAX_FIXED_ORDER+1];
+	FLAC__uint64 total_error[FLAC__MAX_FIXED_ORDER+1];
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1];
+#else
+	FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1];
+#endif
+	const unsigned levels = encoder->private_->num_blocksize_levels;
+	const unsigned smallest_blocksize = encoder->protected_->blocksize >> (levels - 1);
+	unsigned level, i, j, order;
+
+	FLAC__ASSERT(smallest_blocksize > FLAC__MAX_FIXED_ORDER);
+
+	for(i = 0; i < (1u << (levels - 1)); i++) {
+		const FLAC__int32 *data = signal + i * smallest_blocksize;
+		if(i > 0)
+			encoder->private_->local_fixed_compute_total_errors(data, FLAC__MAX_FIXED_ORDER, warmup_error[i]);
+		encoder->private_->local_fixed_compute_total_errors(data+FLAC__MAX_FIXED_ORDER, smallest_blocksize-FLAC__MAX_FIXED_ORDER, error[i]);
+	}
+
+	for(level = 0; level < levels; level++) {
+		const unsigned blocksize = encoder->protected_->blocksize >> level;
+		const unsigned span = 1u << (levels - 1 - level); /* number of smallest candidates in each frame */
+		for(i = 0; i < (1u << level); i++) {
+			for(order = 0; order <= FLAC__MAX_FIXED_ORDER; order++) {
+				total_error[order] = error[i*span][order];
+				for(j = i*span + 1; j < (i+1)*span; j++)
+					total_error[order] += warmup_error[j][order] + error[j][order];
+			}
+			order = FLAC__fixed_compute_best_predictor_from_total_errors(total_error, blocksize-FLAC__MAX_FIXED_ORDER, residual_bits_per_sample);
+			/* the estimate is about the Rice parameter, which cannot go below zero for residuals that are mostly zero; the stop bit of each residual sample is added below */
+			if(residual_bits_per_sample[order] < 0)
+				residual_bits_per_sample[order] = 0;
+			/*
+			 * subframe header, warmup samples, residual coding method
+			 * and one Rice parameter, then the residual itself; an LPC
+			 * subframe also carries its coefficients, and since those
+			 * are what make short frames costly, its warmup and
+			 * coefficients are charged at the maximum order
+			 */
+			bits[level][i] =
+				FLAC__SUBFRAME_ZERO_PAD_LEN + FLAC__SUBFRAME_TYPE_LEN + FLAC__SUBFRAME_WASTED_BITS_FLAG_LEN +
+				(encoder->protected_->max_lpc_order > 0?
+					encoder->protected_->max_lpc_order * (bits_per_sample + encoder->protected_->qlp_coeff_precision) + FLAC__SUBFRAME_LPC_QLP_COEFF_PRECISION_LEN + FLAC__SUBFRAME_LPC_QLP_SHIFT_LEN :
+					order * bits_per_sample
+				) +
+				FLAC__ENTROPY_CODING_METHOD_TYPE_LEN + FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN + FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_PARAMETER_LEN +
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+				(FLAC__uint64)((residual_bits_per_sample[order] + 1.0f) * (FLAC__float)(blocksize-order) + 0.5f)
+#else
+				(((FLAC__uint64)(residual_bits_per_sample[order] + FLAC__FP_ONE) * (blocksize-order)) >> 16)
+#endif
+			;
+		}
+	}
+}
+
+/*
+ * A rough size for a subframe of the signal, from the residual of the
+ * best fixed predictor; good enough to tell which channel assignment
+ * will be the cheapest.
+ */
+FLAC__uint64 estimate_subframe_bits_(const FLAC__StreamEncoder *encoder, const FLAC__int32 signal[], unsigned blocksize)
+{
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__float residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1];
+#else
+	FLAC__fixedpoint residual_bits_per_sample[FLAC__MAX_FIXED_ORDER+1];
+#endif
+	const unsigned order = encoder->private_->local_fixed_compute_best_predictor(signal+FLAC__MAX_FIXED_ORDER, blocksize-FLAC__MAX_FIXED_ORDER, residual_bits_per_sample);
+
+	/* as in estimate_signal_bits_(), count the stop bit of each residual sample on top of the Rice parameter */
+	if(residual_bits_per_sample[order] < 0)
+		residual_bits_per_sample[order] = 0;
+	return
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+		(FLAC__uint64)((residual_bits_per_sample[order] + 1.0f) * (FLAC__float)(blocksize-order) + 0.5f)
+#else
+		(((FLAC__uint64)(residual_bits_per_sample[order] + FLAC__FP_ONE) * (blocksize-order)) >> 16)
+#endif
+	;
+}
+
+FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, unsigned blocksize, FLAC__bool is_fractional_block, FLAC__bool is_last_block)
+{
+	FLAC__StreamEncoderThreadTask *threadtask;
+	FLAC__bool do_independent, do_mid_side;
+	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
+
+	/*
+	 * Accumulate raw signal to the MD5 signature
+	 */
+#ifdef FLAC__HAS_PTHREAD
+	if(encoder->private_->md5_stage.running) {
+		if(!queue_md5_block_(encoder, blocksize)) {
+			/* the above function sets the state for us in case of an error */
+			return false;
+		}
+	}
+	else
+#endif
+	if(encoder->protected_->do_md5 && !FLAC__MD5Accumulate(&encoder->private_->md5context, (const FLAC__int32 * const *)encoder->private_->integer_signal, encoder->protected_->channels, blocksize, (encoder->protected_->bits_per_sample+7) / 8)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+
+	/*
+	 * Figure out what channel assignments to try
+	 */
+	if(encoder->protected_->do_mid_side_stereo) {
+		if(encoder->protected_->loose_mid_side_stereo) {
+			if(encoder->private_->loose_mid_side_stereo_frame_count == 0) {
+				do_independent = true;
+				do_mid_side = true;
+			}
+			else {
+				if(encoder->private_->loose_mid_side_stereo_frame_count == 1) {
+					/* the previous frame tried both and decided for the next few frames */
+					threadtask = encoder->private_->threadtask[(encoder->private_->next_threadtask + encoder->private_->num_threadtasks - 1) % encoder->private_->num_threadtasks];
+#ifdef FLAC__HAS_PTHREAD
+					if(encoder->private_->num_threadtasks > 1) {
+						pthread_mutex_lock(&encoder->private_->mutex);
+						while(!threadtask->done)
+							pthread_cond_wait(&encoder->private_->cond_done, &encoder->private_->mutex);
+						pthread_mutex_unlock(&encoder->private_->mutex);
+						if(!threadtask->ok)
+							return false; /* encode_frame_() set the state for us */
+					}
+#endif
+					encoder->private_->last_channel_assignment = threadtask->channel_assignment;
+				}
+				do_independent = (encoder->private_->last_channel_assignment == FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT);
+				do_mid_side = !do_independent;
+			}
+			encoder->private_->loose_mid_side_stereo_frame_count++;
+			if(encoder->private_->loose_mid_side_stereo_frame_count >= encoder->private_->loose_mid_side_stereo_frames)
+				encoder->private_->loose_mid_side_stereo_frame_count = 0;
+		}
+		else {
+			do_independent = true;
+			do_mid_side = true;
+		}
+	}
+	else {
+		do_independent = true;
+		do_mid_side = false;
+	}
+
+	/*
+	 * Make sure the workspace we are about to use is not still holding
+	 * a frame that has not been written yet
+	 */
+	if(!flush_threadtasks_(encoder, encoder->private_->num_threadtasks - 1))
+		return false;
+
+	threadtask = encoder->private_->threadtask[encoder->private_->next_threadtask];
+	threadtask->frame_number = encoder->private_->current_frame_number + encoder->private_->num_pending_threadtasks;
+	threadtask->sample_number = encoder->private_->next_frame_sample_number;
+	threadtask->blocksize = blocksize;
+	threadtask->is_fractional_block = is_fractional_block;
+	threadtask->is_last_block = is_last_block;
+	threadtask->do_independent = do_independent;
+	threadtask->do_mid_side = do_mid_side;
+
+	if(encoder->private_->num_threadtasks == 1) {
+		/*
+		 * Encode and write the frame right here
+		 */
+		threadtask->ok = encode_frame_(encoder, threadtask);
+		if(!write_encoded_frame_(encoder, threadtask)) {
+			/* the above function sets the state for us in case of an error */
+			return false;
+		}
+	}
+#ifdef FLAC__HAS_PTHREAD
+	else {
+		unsigned channel;
+
+		/*
+		 * Hand a copy of the block to the worker threads; the frame gets
+		 * written by flush_threadtasks_() once it and all frames before
+		 * it are done
+		 */
+		if(do_independent) {
+			for(channel = 0; channel < encoder->protected_->channels; channel++)
+				memcpy(threadtask->integer_signal[channel], encoder->private_->integer_signal[channel], sizeof(FLAC__int32) * blocksize);
+		}
+		if(do_mid_side) {
+			for(channel = 0; channel < 2; channel++)
+				memcpy(threadtask->integer_signal_mid_side[channel], encoder->private_->integer_signal_mid_side[channel], sizeof(FLAC__int32) * blocksize);
+		}
+
+		pthread_mutex_lock(&encoder->private_->mutex);
+		threadtask->done = false;
+		encoder->private_->num_queued_threadtasks++;
+		pthread_cond_signal(&encoder->private_->cond_queued);
+		pthread_mutex_unlock(&encoder->private_->mutex);
+
+		encoder->private_->next_threadtask = (encoder->private_->next_threadtask + 1) % encoder->private_->num_threadtasks;
+		encoder->private_->num_pending_threadtasks++;
+
+		if(is_last_block && !flush_threadtasks_(encoder, 0))
+			return false;
+	}
+#endif
+
+	/*
+	 * Get ready for the next frame
+	 */
+	encoder->private_->current_sample_number = 0;
+	encoder->private_->next_frame_sample_number += blocksize;
+
+	return true;
+}
+
+FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask)
+{
+	const FLAC__byte *buffer;
+	size_t bytes;
+	FLAC__uint16 crc;
+
+	/*
+	 * Process the frame header and subframes into the frame bitbuffer
+	 */
+	if(!process_subframes_(encoder, threadtask)) {
+		/* the above function sets the state for us in case of an error */
+		return false;
+	}
+
+	/*
+	 * Zero-pad the frame to a byte_boundary
+	 */
+	if(!FLAC__bitwriter_zero_pad_to_byte_boundary(threadtask->frame)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+
+	/*
+	 * CRC-16 the whole thing
+	 */
+	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(threadtask->frame));
+	if(!FLAC__bitwriter_get_buffer(threadtask->frame, &buffer, &bytes)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	crc = (FLAC__uint16)encoder->private_->local_crc16(buffer, (unsigned)bytes);
+	FLAC__bitwriter_release_buffer(threadtask->frame);
+	if(!FLAC__bitwriter_write_raw_uint32(threadtask->frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+
+	return true;
+}
+
+FLAC__bool write_encoded_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask)
+{
+	FLAC__ASSERT(threadtask->frame_number == encoder->private_->current_frame_number);
+
+	if(!threadtask->ok) {
+		/* encode_frame_() set the state for us */
+		FLAC__bitwriter_clear(threadtask->frame);
+		return false;
+	}
+
+	/*
+	 * Write it
+	 */
+	if(!write_bitbuffer_(encoder, threadtask->frame, threadtask->blocksize, threadtask->is_last_block)) {
+		/* the above function sets the state for us in case of an error */
+		return false;
+	}
+
+	if(threadtask->channel_assignment_estimated) {
+		encoder->private_->fast_mid_side_frames++;
+		if(threadtask->num_channel_assignments_tried > 1) {
+			encoder->private_->fast_mid_side_searched_frames++;
+			if(threadtask->channel_assignment != threadtask->estimated_channel_assignment)
+				encoder->private_->fast_mid_side_missed_frames++;
+		}
+	}
+
+	encoder->private_->current_frame_number++;
+	encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)threadtask->blocksize;
+
+	return true;
+}
+
+/* Writes frames from the worker threads, in order, until at most 'keep' are still pending. */
+FLAC__bool flush_threadtasks_(FLAC__StreamEncoder *encoder, unsigned keep)
+{
+#ifdef FLAC__HAS_PTHREAD
+	while(encoder->private_->num_pending_threadtasks > keep) {
+		FLAC__StreamEncoderThreadTask *threadtask = encoder->private_->threadtask[(encoder->private_->next_threadtask + encoder->private_->num_threadtasks - encoder->private_->num_pending_threadtasks) % encoder->private_->num_threadtasks];
+
+		pthread_mutex_lock(&encoder->private_->mutex);
+		while(!threadtask->done)
+			pthread_cond_wait(&encoder->private_->cond_done, &encoder->private_->mutex);
+		pthread_mutex_unlock(&encoder->private_->mutex);
+
+		encoder->private_->num_pending_threadtasks--;
+		if(!write_encoded_frame_(encoder, threadtask))
+			return false;
+	}
+#else
+	(void)encoder, (void)keep;
+	FLAC__ASSERT(encoder->private_->num_pending_threadtasks == 0);
+#endif
+	return true;
+}
+
+FLAC__StreamEncoderThreadTask *threadtask_new_(void)
+{
+	FLAC__StreamEncoderThreadTask *threadtask;
+	unsigned i;
+
+	threadtask = (FLAC__StreamEncoderThreadTask*)calloc(1, sizeof(FLAC__StreamEncoderThreadTask));
+	if(threadtask == 0)
+		return 0;
+
+	threadtask->frame = FLAC__bitwriter_new();
+	if(threadtask->frame == 0 || !FLAC__bitwriter_init(threadtask->frame)) {
+		if(threadtask->frame != 0)
+			FLAC__bitwriter_delete(threadtask->frame);
+		free(threadtask);
+		return 0;
+	}
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		threadtask->subframe_workspace_ptr[i][0] = &threadtask->subframe_workspace[i][0];
+		threadtask->subframe_workspace_ptr[i][1] = &threadtask->subframe_workspace[i][1];
+	}
+	for(i = 0; i < 2; i++) {
+		threadtask->subframe_workspace_ptr_mid_side[i][0] = &threadtask->subframe_workspace_mid_side[i][0];
+		threadtask->subframe_workspace_ptr_mid_side[i][1] = &threadtask->subframe_workspace_mid_side[i][1];
+	}
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		threadtask->partitioned_rice_contents_workspace_ptr[i][0] = &threadtask->partitioned_rice_contents_workspace[i][0];
+		threadtask->partitioned_rice_contents_workspace_ptr[i][1] = &threadtask->partitioned_rice_contents_workspace[i][1];
+	}
+	for(i = 0; i < 2; i++) {
+		threadtask->partitioned_rice_contents_workspace_ptr_mid_side[i][0] = &threadtask->partitioned_rice_contents_workspace_mid_side[i][0];
+		threadtask->partitioned_rice_contents_workspace_ptr_mid_side[i][1] = &threadtask->partitioned_rice_contents_workspace_mid_side[i][1];
+	}
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents_workspace[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents_workspace[i][1]);
+	}
+	for(i = 0; i < 2; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents_workspace_mid_side[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents_workspace_mid_side[i][1]);
+	}
+	for(i = 0; i < 2; i++)
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&threadtask->partitioned_rice_contents_extra[i]);
+
+	threadtask->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
+	threadtask->ok = true;
+#ifdef FLAC__HAS_PTHREAD
+	threadtask->done = true;
+#endif
+
+	return threadtask;
+}
+
+/*
+ * Sizes one set of Rice parameter arrays for partition orders up to
+ * max_partition_order, taking them from the client's workspace if
+ * there is one.
+ */
+static FLAC__bool reserve_partitioned_rice_contents_(FLAC__StreamEncoder *encoder, FLAC__EntropyCodingMethod_PartitionedRiceContents *contents, unsigned max_partition_order)
+{
+	if(0 == encoder->protected_->workspace)
+		return FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(contents, max_partition_order);
+
+	FLAC__ASSERT(0 == contents->parameters && 0 == contents->raw_bits);
+	if(0 == (contents->parameters = (unsigned*)workspace_take_(encoder, sizeof(unsigned) << max_partition_order)))
+		return false;
+	if(0 == (contents->raw_bits = (unsigned*)workspace_take_(encoder, sizeof(unsigned) << max_partition_order)))
+		return false;
+	memset(contents->raw_bits, 0, sizeof(unsigned) << max_partition_order);
+	contents->capacity_by_order = max_partition_order;
+	return true;
+}
+
+/*
+ * Sizes the Rice parameter arrays for partition orders up to
+ * max_partition_order and the frame bitwriter for the largest possible
+ * frame, so that encoding a frame does not have to grow them.
+ */
+FLAC__bool threadtask_reserve_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask, unsigned max_partition_order)
+{
+	FLAC__bool ok = true;
+	unsigned i;
+
+	threadtask->rice_contents_in_workspace = (0 != encoder->protected_->workspace);
+
+	for(i = 0; ok && i < encoder->protected_->channels; i++) {
+		ok = ok && reserve_partitioned_rice_contents_(encoder, &threadtask->partitioned_rice_contents_workspace[i][0], max_partition_order);
+		ok = ok && reserve_partitioned_rice_contents_(encoder, &threadtask->partitioned_rice_contents_workspace[i][1], max_partition_order);
+	}
+	for(i = 0; ok && i < 2; i++) {
+		ok = ok && reserve_partitioned_rice_contents_(encoder, &threadtask->partitioned_rice_contents_workspace_mid_side[i][0], max_partition_order);
+		ok = ok && reserve_partitioned_rice_contents_(encoder, &threadtask->partitioned_rice_contents_workspace_mid_side[i][1], max_partition_order);
+		ok = ok && reserve_partitioned_rice_contents_(encoder, &threadtask->partitioned_rice_contents_extra[i], max_partition_order);
+	}
+
+	return ok && FLAC__bitwriter_reserve(threadtask->frame, (unsigned)frame_bytes_bound_(encoder) * 8);
+}
+
+void threadtask_delete_(FLAC__StreamEncoderThreadTask *threadtask)
+{
+	unsigned i, channel;
+
+	FLAC__ASSERT(0 != threadtask);
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		if(0 != threadtask->integer_signal_unaligned[i])
+			free(threadtask->integer_signal_unaligned[i]);
+	}
+	for(i = 0; i < 2; i++) {
+		if(0 != threadtask->integer_signal_mid_side_unaligned[i])
+			free(threadtask->integer_signal_mid_side_unaligned[i]);
+	}
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	if(0 != threadtask->windowed_signal_unaligned)
+		free(threadtask->windowed_signal_unaligned);
+#endif
+	for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+		for(i = 0; i < 2; i++) {
+			if(0 != threadtask->residual_workspace_unaligned[channel][i])
+				free(threadtask->residual_workspace_unaligned[channel][i]);
+		}
+	}
+	for(channel = 0; channel < 2; channel++) {
+		for(i = 0; i < 2; i++) {
+			if(0 != threadtask->residual_workspace_mid_side_unaligned[channel][i])
+				free(threadtask->residual_workspace_mid_side_unaligned[channel][i]);
+		}
+	}
+	if(0 != threadtask->abs_residual_partition_sums_unaligned)
+		free(threadtask->abs_residual_partition_sums_unaligned);
+	if(0 != threadtask->raw_bits_per_partition_unaligned)
+		free(threadtask->raw_bits_per_partition_unaligned);
+
+	if(!threadtask->rice_contents_in_workspace) {
+		for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+			FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents_workspace[i][0]);
+			FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents_workspace[i][1]);
+		}
+		for(i = 0; i < 2; i++) {
+			FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents_workspace_mid_side[i][0]);
+			FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents_workspace_mid_side[i][1]);
+		}
+		for(i = 0; i < 2; i++)
+			FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&threadtask->partitioned_rice_contents_extra[i]);
+	}
+
+	FLAC__bitwriter_delete(threadtask->frame);
+	free(threadtask);
+}
+
+#ifdef FLAC__HAS_PTHREAD
+FLAC__bool start_threads_(FLAC__StreamEncoder *encoder)
+{
+	unsigned i;
+
+	FLAC__ASSERT(encoder->private_->num_running_threads == 0);
+
+	if(0 != pthread_mutex_init(&encoder->private_->mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&encoder->private_->cond_queued, 0)) {
+		pthread_mutex_destroy(&encoder->private_->mutex);
+		return false;
+	}
+	if(0 != pthread_cond_init(&encoder->private_->cond_done, 0)) {
+		pthread_cond_destroy(&encoder->private_->cond_queued);
+		pthread_mutex_destroy(&encoder->private_->mutex);
+		return false;
+	}
+	encoder->private_->next_queued_threadtask = 0;
+	encoder->private_->num_queued_threadtasks = 0;
+	encoder->private_->threads_should_exit = false;
+
+	for(i = 0; i < encoder->protected_->num_threads; i++) {
+		if(0 != pthread_create(&encoder->private_->thread[i], 0, encoder_thread_, encoder))
+			break;
+	}
+	encoder->private_->num_running_threads = i;
+
+	if(i < encoder->protected_->num_threads) {
+		if(i > 0) {
+			stop_threads_(encoder);
+		}
+		else {
+			pthread_cond_destroy(&encoder->private_->cond_done);
+			pthread_cond_destroy(&encoder->private_->cond_queued);
+			pthread_mutex_destroy(&encoder->private_->mutex);
+		}
+		return false;
+	}
+
+	return true;
+}
+
+void stop_threads_(FLAC__StreamEncoder *encoder)
+{
+	unsigned i;
+
+	if(encoder->private_->num_running_threads == 0)
+		return;
+
+	pthread_mutex_lock(&encoder->private_->mutex);
+	encoder->private_->threads_should_exit = true;
+	pthread_cond_broadcast(&encoder->private_->cond_queued);
+	pthread_mutex_unlock(&encoder->private_->mutex);
+
+	for(i = 0; i < encoder->private_->num_running_threads; i++)
+		pthread_join(encoder->private_->thread[i], 0);
+	encoder->private_->num_running_threads = 0;
+	encoder->private_->num_pending_threadtasks = 0;
+
+	pthread_cond_destroy(&encoder->private_->cond_done);
+	pthread_cond_destroy(&encoder->private_->cond_queued);
+	pthread_mutex_destroy(&encoder->private_->mutex);
+}
+
+void *encoder_thread_(void *arg)
+{
+	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)arg;
+	FLAC__StreamEncoderThreadTask *threadtask;
+	FLAC__bool ok;
+
+	pthread_mutex_lock(&encoder->private_->mutex);
+	while(1) {
+		while(!encoder->private_->threads_should_exit && encoder->private_->num_queued_threadtasks == 0)
+			pthread_cond_wait(&encoder->private_->cond_queued, &encoder->private_->mutex);
+		if(encoder->private_->threads_should_exit)
+			break;
+
+		threadtask = encoder->private_->threadtask[encoder->private_->next_queued_threadtask];
+		encoder->private_->next_queued_threadtask = (encoder->private_->next_queued_threadtask + 1) % encoder->private_->num_threadtasks;
+		encoder->private_->num_queued_threadtasks--;
+		pthread_mutex_unlock(&encoder->private_->mutex);
+
+		ok = encode_frame_(encoder, threadtask);
+
+		pthread_mutex_lock(&encoder->private_->mutex);
+		threadtask->ok = ok;
+		threadtask->done = true;
+		pthread_cond_broadcast(&encoder->private_->cond_done);
+	}
+	pthread_mutex_unlock(&encoder->private_->mutex);
+
+	return 0;
+}
+
+FLAC__bool start_stage_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage, FLAC__StreamEncoderState (*process)(FLAC__StreamEncoder *, const FLAC__StreamEncoderStageBlock *), FLAC__bool with_bytes)
+{
+	unsigned i, channel;
+
+	FLAC__ASSERT(!stage->running);
+
+	memset(stage, 0, sizeof(*stage));
+	stage->process = process;
+	stage->encoder = encoder;
+	stage->error = FLAC__STREAM_ENCODER_OK;
+
+	for(i = 0; i < FLAC__STREAM_ENCODER_STAGE_DEPTH; i++) {
+		for(channel = 0; channel < encoder->protected_->channels; channel++) {
+			if(0 == (stage->block[i].signal[channel] = (FLAC__int32*)safe_malloc_mul_2op_(sizeof(FLAC__int32), /*times*/encoder->protected_->blocksize)))
+				goto fail_;
+		}
+		if(with_bytes) {
+			/* big enough for any frame; queue_verify_block_() still grows it should one not fit */
+			stage->block[i].capacity = frame_bytes_bound_(encoder);
+			if(0 == (stage->block[i].bytes = (FLAC__byte*)malloc(stage->block[i].capacity)))
+				goto fail_;
+		}
+	}
+
+	if(0 != pthread_mutex_init(&stage->mutex, 0))
+		goto fail_;
+	if(0 != pthread_cond_init(&stage->cond, 0)) {
+		pthread_mutex_destroy(&stage->mutex);
+		goto fail_;
+	}
+	if(0 != pthread_create(&stage->thread, 0, stage_thread_, stage)) {
+		pthread_cond_destroy(&stage->cond);
+		pthread_mutex_destroy(&stage->mutex);
+		goto fail_;
+	}
+
+	stage->running = true;
+	return true;
+
+fail_:
+	for(i = 0; i < FLAC__STREAM_ENCODER_STAGE_DEPTH; i++) {
+		for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+			if(0 != stage->block[i].signal[channel])
+				free(stage->block[i].signal[channel]);
 		}
-		simple_ogg_page__clear(&page);
+		if(0 != stage->block[i].bytes)
+			free(stage->block[i].bytes);
 	}
+	memset(stage, 0, sizeof(*stage));
+	return false;
 }
-#endif
 
-FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block)
+void stop_stage_(FLAC__StreamEncoderStage *stage)
 {
-	FLAC__uint16 crc;
-	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
+	unsigned i, channel;
 
-	/*
-	 * Accumulate raw signal to the MD5 signature
-	 */
-	if(encoder->protected_->do_md5 && !FLAC__MD5Accumulate(&encoder->private_->md5context, (const FLAC__int32 * const *)encoder->private_->integer_signal, encoder->protected_->channels, encoder->protected_->blocksize, (encoder->protected_->bits_per_sample+7) / 8)) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-		return false;
-	}
+	if(!stage->running)
+		return;
 
-	/*
-	 * Process the frame header and subframes into the frame bitbuffer
-	 */
-	if(!process_subframes_(encoder, is_fractional_block)) {
-		/* the above function sets the state for us in case of an error */
-		return false;
+	pthread_mutex_lock(&stage->mutex);
+	stage->should_exit = true;
+	pthread_cond_broadcast(&stage->cond);
+	pthread_mutex_unlock(&stage->mutex);
+
+	pthread_join(stage->thread, 0);
+	pthread_cond_destroy(&stage->cond);
+	pthread_mutex_destroy(&stage->mutex);
+
+	for(i = 0; i < FLAC__STREAM_ENCODER_STAGE_DEPTH; i++) {
+		for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+			if(0 != stage->block[i].signal[channel])
+				free(stage->block[i].signal[channel]);
+		}
+		if(0 != stage->block[i].bytes)
+			free(stage->block[i].bytes);
 	}
+	memset(stage, 0, sizeof(*stage));
+}
 
-	/*
-	 * Zero-pad the frame to a byte_boundary
-	 */
-	if(!FLAC__bitwriter_zero_pad_to_byte_boundary(encoder->private_->frame)) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-		return false;
+/* Waits for a free block in the ring; returns 0 and sets the encoder state if the stage has failed. */
+FLAC__StreamEncoderStageBlock *stage_get_block_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage)
+{
+	FLAC__StreamEncoderStageBlock *block = 0;
+
+	pthread_mutex_lock(&stage->mutex);
+	while(stage->error == FLAC__STREAM_ENCODER_OK && stage->count == FLAC__STREAM_ENCODER_STAGE_DEPTH)
+		pthread_cond_wait(&stage->cond, &stage->mutex);
+	if(stage->error != FLAC__STREAM_ENCODER_OK)
+		encoder->protected_->state = stage->error;
+	else
+		block = &stage->block[(stage->head + stage->count) % FLAC__STREAM_ENCODER_STAGE_DEPTH];
+	pthread_mutex_unlock(&stage->mutex);
+
+	return block;
+}
+
+/* Hands the block last returned by stage_get_block_() to the stage. */
+void stage_queue_block_(FLAC__StreamEncoderStage *stage)
+{
+	pthread_mutex_lock(&stage->mutex);
+	FLAC__ASSERT(stage->count < FLAC__STREAM_ENCODER_STAGE_DEPTH);
+	stage->count++;
+	pthread_cond_broadcast(&stage->cond);
+	pthread_mutex_unlock(&stage->mutex);
+}
+
+/* Waits until every queued block is processed; returns false and sets the encoder state if any of them failed. */
+FLAC__bool stage_drain_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderStage *stage)
+{
+	FLAC__bool ok;
+
+	pthread_mutex_lock(&stage->mutex);
+	while(stage->error == FLAC__STREAM_ENCODER_OK && stage->count > 0)
+		pthread_cond_wait(&stage->cond, &stage->mutex);
+	ok = (stage->error == FLAC__STREAM_ENCODER_OK);
+	if(!ok)
+		encoder->protected_->state = stage->error;
+	pthread_mutex_unlock(&stage->mutex);
+
+	return ok;
+}
+
+void *stage_thread_(void *arg)
+{
+	FLAC__StreamEncoderStage *stage = (FLAC__StreamEncoderStage*)arg;
+	FLAC__StreamEncoderState state;
+
+	pthread_mutex_lock(&stage->mutex);
+	while(1) {
+		while(!stage->should_exit && stage->count == 0)
+			pthread_cond_wait(&stage->cond, &stage->mutex);
+		if(stage->should_exit)
+			break;
+		pthread_mutex_unlock(&stage->mutex);
+
+		/* once a block has failed the rest are just dropped */
+		state = stage->error == FLAC__STREAM_ENCODER_OK? stage->process(stage->encoder, &stage->block[stage->head]) : stage->error;
+
+		pthread_mutex_lock(&stage->mutex);
+		stage->error = state;
+		stage->head = (stage->head + 1) % FLAC__STREAM_ENCODER_STAGE_DEPTH;
+		stage->count--;
+		pthread_cond_broadcast(&stage->cond);
 	}
+	pthread_mutex_unlock(&stage->mutex);
 
-	/*
-	 * CRC-16 the whole thing
-	 */
-	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(encoder->private_->frame));
-	if(
-		!FLAC__bitwriter_get_write_crc16(encoder->private_->frame, &crc) ||
-		!FLAC__bitwriter_write_raw_uint32(encoder->private_->frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)
-	) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+	return 0;
+}
+
+FLAC__StreamEncoderState md5_block_(FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderStageBlock *block)
+{
+	if(!FLAC__MD5Accumulate(&encoder->private_->md5context, (const FLAC__int32 * const *)block->signal, encoder->protected_->channels, block->samples, (encoder->protected_->bits_per_sample+7) / 8))
+		return FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+	return FLAC__STREAM_ENCODER_OK;
+}
+
+FLAC__StreamEncoderState verify_block_(FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderStageBlock *block)
+{
+	encoder->private_->verify.output.data = block->bytes;
+	encoder->private_->verify.output.bytes = block->num_bytes;
+	encoder->private_->verify.expected = block->signal;
+	encoder->private_->verify.stage_state = FLAC__STREAM_ENCODER_OK;
+	if(!FLAC__stream_decoder_process_single(encoder->private_->verify.decoder) && encoder->private_->verify.stage_state == FLAC__STREAM_ENCODER_OK)
+		encoder->private_->verify.stage_state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+	return encoder->private_->verify.stage_state;
+}
+
+/* Queues a copy of the first 'blocksize' samples of the current block for the MD5 stage. */
+FLAC__bool queue_md5_block_(FLAC__StreamEncoder *encoder, unsigned blocksize)
+{
+	FLAC__StreamEncoderStageBlock *block;
+	unsigned channel;
+
+	if(0 == (block = stage_get_block_(encoder, &encoder->private_->md5_stage)))
 		return false;
-	}
 
-	/*
-	 * Write it
-	 */
-	if(!write_bitbuffer_(encoder, encoder->protected_->blocksize, is_last_block)) {
-		/* the above function sets the state for us in case of an error */
+	for(channel = 0; channel < encoder->protected_->channels; channel++)
+		memcpy(block->signal[channel], encoder->private_->integer_signal[channel], sizeof(FLAC__int32) * blocksize);
+	block->samples = blocksize;
+
+	stage_queue_block_(&encoder->private_->md5_stage);
+	return true;
+}
+
+/*
+ * Queues an encoded frame for the verify stage, together with its
+ * original signal, which is taken off the front of the verify fifo.
+ */
+FLAC__bool queue_verify_block_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples)
+{
+	FLAC__StreamEncoderStageBlock *block;
+	verify_input_fifo *fifo = &encoder->private_->verify.input_fifo;
+	unsigned channel;
+
+	FLAC__ASSERT(samples <= fifo->tail);
+
+	if(0 == (block = stage_get_block_(encoder, &encoder->private_->verify_stage)))
 		return false;
+
+	if(bytes > block->capacity) {
+		FLAC__byte *new_bytes = (FLAC__byte*)realloc(block->bytes, bytes);
+		if(0 == new_bytes) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		block->bytes = new_bytes;
+		block->capacity = bytes;
 	}
+	memcpy(block->bytes, buffer, bytes);
+	block->num_bytes = bytes;
 
-	/*
-	 * Get ready for the next frame
-	 */
-	encoder->private_->current_sample_number = 0;
-	encoder->private_->current_frame_number++;
-	encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)encoder->protected_->blocksize;
+	fifo->tail -= samples;
+	for(channel = 0; channel < encoder->protected_->channels; channel++) {
+		memcpy(block->signal[channel], fifo->data[channel], sizeof(FLAC__int32) * samples);
+		memmove(&fifo->data[channel][0], &fifo->data[channel][samples], fifo->tail * sizeof(fifo->data[0][0]));
+	}
+	block->samples = samples;
 
+	stage_queue_block_(&encoder->private_->verify_stage);
 	return true;
 }
+#endif
 
-FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block)
+FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *threadtask)
 {
 	FLAC__FrameHeader frame_header;
 	unsigned channel, min_partition_order = encoder->protected_->min_residual_partition_order, max_partition_order;
-	FLAC__bool do_independent, do_mid_side;
+	const FLAC__bool do_independent = threadtask->do_independent, do_mid_side = threadtask->do_mid_side;
+	FLAC__bool try_channel_assignment[4]; /* WATCHOUT - indexed by FLAC__ChannelAssignment */
+	FLAC__bool do_channel[FLAC__MAX_CHANNELS], do_mid_side_channel[2];
 
 	/*
 	 * Calculate the min,max Rice partition orders
 	 */
-	if(is_fractional_block) {
+	if(threadtask->is_fractional_block) {
 		max_partition_order = 0;
 	}
 	else {
-		max_partition_order = FLAC__format_get_max_rice_partition_order_from_blocksize(encoder->protected_->blocksize);
+		max_partition_order = FLAC__format_get_max_rice_partition_order_from_blocksize(threadtask->blocksize);
 		max_partition_order = min(max_partition_order, encoder->protected_->max_residual_partition_order);
 	}
 	min_partition_order = min(min_partition_order, max_partition_order);
@@ -2943,36 +4506,18 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	/*
 	 * Setup the frame
 	 */
-	frame_header.blocksize = encoder->protected_->blocksize;
+	frame_header.blocksize = threadtask->blocksize;
 	frame_header.sample_rate = encoder->protected_->sample_rate;
 	frame_header.channels = encoder->protected_->channels;
 	frame_header.channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT; /* the default unless the encoder determines otherwise */
 	frame_header.bits_per_sample = encoder->protected_->bits_per_sample;
-	frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
-	frame_header.number.frame_number = encoder->private_->current_frame_number;
-
-	/*
-	 * Figure out what channel assignments to try
-	 */
-	if(encoder->protected_->do_mid_side_stereo) {
-		if(encoder->protected_->loose_mid_side_stereo) {
-			if(encoder->private_->loose_mid_side_stereo_frame_count == 0) {
-				do_independent = true;
-				do_mid_side = true;
-			}
-			else {
-				do_independent = (encoder->private_->last_channel_assignment == FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT);
-				do_mid_side = !do_independent;
-			}
-		}
-		else {
-			do_independent = true;
-			do_mid_side = true;
-		}
+	if(encoder->private_->num_blocksize_levels > 1) {
+		frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER;
+		frame_header.number.sample_number = threadtask->sample_number;
 	}
 	else {
-		do_independent = true;
-		do_mid_side = false;
+		frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
+		frame_header.number.frame_number = threadtask->frame_number;
 	}
 
 	FLAC__ASSERT(do_independent || do_mid_side);
@@ -2982,38 +4527,84 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	 */
 	if(do_independent) {
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			const unsigned w = get_wasted_bits_(encoder->private_->integer_signal[channel], encoder->protected_->blocksize);
-			encoder->private_->subframe_workspace[channel][0].wasted_bits = encoder->private_->subframe_workspace[channel][1].wasted_bits = w;
-			encoder->private_->subframe_bps[channel] = encoder->protected_->bits_per_sample - w;
+			const unsigned w = get_wasted_bits_(threadtask->integer_signal[channel], threadtask->blocksize);
+			threadtask->subframe_workspace[channel][0].wasted_bits = threadtask->subframe_workspace[channel][1].wasted_bits = w;
+			threadtask->subframe_bps[channel] = encoder->protected_->bits_per_sample - w;
 		}
 	}
 	if(do_mid_side) {
 		FLAC__ASSERT(encoder->protected_->channels == 2);
 		for(channel = 0; channel < 2; channel++) {
-			const unsigned w = get_wasted_bits_(encoder->private_->integer_signal_mid_side[channel], encoder->protected_->blocksize);
-			encoder->private_->subframe_workspace_mid_side[channel][0].wasted_bits = encoder->private_->subframe_workspace_mid_side[channel][1].wasted_bits = w;
-			encoder->private_->subframe_bps_mid_side[channel] = encoder->protected_->bits_per_sample - w + (channel==0? 0:1);
+			const unsigned w = get_wasted_bits_(threadtask->integer_signal_mid_side[channel], threadtask->blocksize);
+			threadtask->subframe_workspace_mid_side[channel][0].wasted_bits = threadtask->subframe_workspace_mid_side[channel][1].wasted_bits = w;
+			threadtask->subframe_bps_mid_side[channel] = encoder->protected_->bits_per_sample - w + (channel==0? 0:1);
+		}
+	}
+
+	/*
+	 * Decide which subframes to encode
+	 */
+	try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = do_independent;
+	try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE] = try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE] = do_independent && do_mid_side;
+	try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE] = do_mid_side;
+	threadtask->channel_assignment_estimated = false;
+	if(encoder->protected_->fast_mid_side_stereo && do_independent && do_mid_side && threadtask->blocksize > FLAC__MAX_FIXED_ORDER) {
+		/* estimate the size of each channel assignment and only try the ones close to the best */
+		const FLAC__uint64 left_bits = estimate_subframe_bits_(encoder, threadtask->integer_signal[0], threadtask->blocksize);
+		const FLAC__uint64 right_bits = estimate_subframe_bits_(encoder, threadtask->integer_signal[1], threadtask->blocksize);
+		const FLAC__uint64 mid_bits = estimate_subframe_bits_(encoder, threadtask->integer_signal_mid_side[0], threadtask->blocksize);
+		const FLAC__uint64 side_bits = estimate_subframe_bits_(encoder, threadtask->integer_signal_mid_side[1], threadtask->blocksize);
+		FLAC__uint64 bits[4]; /* WATCHOUT - indexed by FLAC__ChannelAssignment */
+		int ca;
+
+		bits[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = left_bits + right_bits;
+		bits[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE  ] = left_bits + side_bits;
+		bits[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE ] = right_bits + side_bits;
+		bits[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE   ] = mid_bits + side_bits;
+
+		threadtask->channel_assignment_estimated = true;
+		threadtask->estimated_channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
+		for(ca = 1; ca <= 3; ca++) {
+			if(bits[ca] < bits[threadtask->estimated_channel_assignment])
+				threadtask->estimated_channel_assignment = (FLAC__ChannelAssignment)ca;
+		}
+		threadtask->num_channel_assignments_tried = 0;
+		for(ca = 0; ca <= 3; ca++) {
+			try_channel_assignment[ca] = bits[ca] - bits[threadtask->estimated_channel_assignment] <= bits[threadtask->estimated_channel_assignment] >> FLAC__STREAM_ENCODER_FAST_MID_SIDE_MARGIN_SHIFT;
+			if(try_channel_assignment[ca])
+				threadtask->num_channel_assignments_tried++;
 		}
 	}
+	for(channel = 0; channel < encoder->protected_->channels; channel++)
+		do_channel[channel] = do_independent;
+	if(do_mid_side) {
+		do_channel[0] = try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] || try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE];
+		do_channel[1] = try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] || try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE];
+		do_mid_side_channel[0] = try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE];
+		do_mid_side_channel[1] = try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE] || try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE] || try_channel_assignment[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE];
+	}
 
 	/*
 	 * First do a normal encoding pass of each independent channel
 	 */
 	if(do_independent) {
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
+			if(!do_channel[channel])
+				continue;
 			if(!
 				process_subframe_(
 					encoder,
+					threadtask,
 					min_partition_order,
 					max_partition_order,
 					&frame_header,
-					encoder->private_->subframe_bps[channel],
-					encoder->private_->integer_signal[channel],
-					encoder->private_->subframe_workspace_ptr[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr[channel],
-					encoder->private_->residual_workspace[channel],
-					encoder->private_->best_subframe+channel,
-					encoder->private_->best_subframe_bits+channel
+					threadtask->subframe_bps[channel],
+					threadtask->integer_signal[channel],
+					threadtask->subframe_workspace_ptr[channel],
+					threadtask->partitioned_rice_contents_workspace_ptr[channel],
+					threadtask->residual_workspace[channel],
+					threadtask->best_subframe+channel,
+					threadtask->best_subframe_bits+channel
 				)
 			)
 				return false;
@@ -3027,19 +4618,22 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 		FLAC__ASSERT(encoder->protected_->channels == 2);
 
 		for(channel = 0; channel < 2; channel++) {
+			if(!do_mid_side_channel[channel])
+				continue;
 			if(!
 				process_subframe_(
 					encoder,
+					threadtask,
 					min_partition_order,
 					max_partition_order,
 					&frame_header,
-					encoder->private_->subframe_bps_mid_side[channel],
-					encoder->private_->integer_signal_mid_side[channel],
-					encoder->private_->subframe_workspace_ptr_mid_side[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[channel],
-					encoder->private_->residual_workspace_mid_side[channel],
-					encoder->private_->best_subframe_mid_side+channel,
-					encoder->private_->best_subframe_bits_mid_side+channel
+					threadtask->subframe_bps_mid_side[channel],
+					threadtask->integer_signal_mid_side[channel],
+					threadtask->subframe_workspace_ptr_mid_side[channel],
+					threadtask->partitioned_rice_contents_workspace_ptr_mid_side[channel],
+					threadtask->residual_workspace_mid_side[channel],
+					threadtask->best_subframe_mid_side+channel,
+					threadtask->best_subframe_bits_mid_side+channel
 				)
 			)
 				return false;
@@ -3056,8 +4650,9 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 
 		FLAC__ASSERT(encoder->protected_->channels == 2);
 
-		if(encoder->protected_->loose_mid_side_stereo && encoder->private_->loose_mid_side_stereo_frame_count > 0) {
-			channel_assignment = (encoder->private_->last_channel_assignment == FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT? FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT : FLAC__CHANNEL_ASSIGNMENT_MID_SIDE);
+		if(!do_independent) {
+			/* loose mid/side stereo: the frame that chose this stereo mode for the next few frames used something other than independent coding */
+			channel_assignment = FLAC__CHANNEL_ASSIGNMENT_MID_SIDE;
 		}
 		else {
 			unsigned bits[4]; /* WATCHOUT - indexed by FLAC__ChannelAssignment */
@@ -3070,16 +4665,16 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 			FLAC__ASSERT(FLAC__CHANNEL_ASSIGNMENT_MID_SIDE    == 3);
 			FLAC__ASSERT(do_independent && do_mid_side);
 
-			/* We have to figure out which channel assignent results in the smallest frame */
-			bits[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = encoder->private_->best_subframe_bits         [0] + encoder->private_->best_subframe_bits         [1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE  ] = encoder->private_->best_subframe_bits         [0] + encoder->private_->best_subframe_bits_mid_side[1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE ] = encoder->private_->best_subframe_bits         [1] + encoder->private_->best_subframe_bits_mid_side[1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE   ] = encoder->private_->best_subframe_bits_mid_side[0] + encoder->private_->best_subframe_bits_mid_side[1];
+			/* We have to figure out which channel assignent results in the smallest frame; only the ones tried have valid sizes */
+			bits[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = threadtask->best_subframe_bits         [0] + threadtask->best_subframe_bits         [1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE  ] = threadtask->best_subframe_bits         [0] + threadtask->best_subframe_bits_mid_side[1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE ] = threadtask->best_subframe_bits         [1] + threadtask->best_subframe_bits_mid_side[1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE   ] = threadtask->best_subframe_bits_mid_side[0] + threadtask->best_subframe_bits_mid_side[1];
 
 			channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
-			min_bits = bits[channel_assignment];
-			for(ca = 1; ca <= 3; ca++) {
-				if(bits[ca] < min_bits) {
+			min_bits = UINT_MAX;
+			for(ca = 0; ca <= 3; ca++) {
+				if(try_channel_assignment[ca] && bits[ca] < min_bits) {
 					min_bits = bits[ca];
 					channel_assignment = (FLAC__ChannelAssignment)ca;
 				}
@@ -3088,27 +4683,27 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 
 		frame_header.channel_assignment = channel_assignment;
 
-		if(!FLAC__frame_add_header(&frame_header, encoder->private_->frame)) {
+		if(!FLAC__frame_add_header(&frame_header, threadtask->frame)) {
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return false;
 		}
 
 		switch(channel_assignment) {
 			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
-				left_subframe  = &encoder->private_->subframe_workspace         [0][encoder->private_->best_subframe         [0]];
-				right_subframe = &encoder->private_->subframe_workspace         [1][encoder->private_->best_subframe         [1]];
+				left_subframe  = &threadtask->subframe_workspace         [0][threadtask->best_subframe         [0]];
+				right_subframe = &threadtask->subframe_workspace         [1][threadtask->best_subframe         [1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace         [0][encoder->private_->best_subframe         [0]];
-				right_subframe = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
+				left_subframe  = &threadtask->subframe_workspace         [0][threadtask->best_subframe         [0]];
+				right_subframe = &threadtask->subframe_workspace_mid_side[1][threadtask->best_subframe_mid_side[1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
-				right_subframe = &encoder->private_->subframe_workspace         [1][encoder->private_->best_subframe         [1]];
+				left_subframe  = &threadtask->subframe_workspace_mid_side[1][threadtask->best_subframe_mid_side[1]];
+				right_subframe = &threadtask->subframe_workspace         [1][threadtask->best_subframe         [1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace_mid_side[0][encoder->private_->best_subframe_mid_side[0]];
-				right_subframe = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
+				left_subframe  = &threadtask->subframe_workspace_mid_side[0][threadtask->best_subframe_mid_side[0]];
+				right_subframe = &threadtask->subframe_workspace_mid_side[1][threadtask->best_subframe_mid_side[1]];
 				break;
 			default:
 				FLAC__ASSERT(0);
@@ -3116,58 +4711,53 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 
 		switch(channel_assignment) {
 			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
-				left_bps  = encoder->private_->subframe_bps         [0];
-				right_bps = encoder->private_->subframe_bps         [1];
+				left_bps  = threadtask->subframe_bps         [0];
+				right_bps = threadtask->subframe_bps         [1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-				left_bps  = encoder->private_->subframe_bps         [0];
-				right_bps = encoder->private_->subframe_bps_mid_side[1];
+				left_bps  = threadtask->subframe_bps         [0];
+				right_bps = threadtask->subframe_bps_mid_side[1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-				left_bps  = encoder->private_->subframe_bps_mid_side[1];
-				right_bps = encoder->private_->subframe_bps         [1];
+				left_bps  = threadtask->subframe_bps_mid_side[1];
+				right_bps = threadtask->subframe_bps         [1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-				left_bps  = encoder->private_->subframe_bps_mid_side[0];
-				right_bps = encoder->private_->subframe_bps_mid_side[1];
+				left_bps  = threadtask->subframe_bps_mid_side[0];
+				right_bps = threadtask->subframe_bps_mid_side[1];
 				break;
 			default:
 				FLAC__ASSERT(0);
 		}
 
 		/* note that encoder_add_subframe_ sets the state for us in case of an error */
-		if(!add_subframe_(encoder, frame_header.blocksize, left_bps , left_subframe , encoder->private_->frame))
+		if(!add_subframe_(encoder, frame_header.blocksize, left_bps , left_subframe , threadtask->frame))
 			return false;
-		if(!add_subframe_(encoder, frame_header.blocksize, right_bps, right_subframe, encoder->private_->frame))
+		if(!add_subframe_(encoder, frame_header.blocksize, right_bps, right_subframe, threadtask->frame))
 			return false;
 	}
 	else {
-		if(!FLAC__frame_add_header(&frame_header, encoder->private_->frame)) {
+		if(!FLAC__frame_add_header(&frame_header, threadtask->frame)) {
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return false;
 		}
 
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			if(!add_subframe_(encoder, frame_header.blocksize, encoder->private_->subframe_bps[channel], &encoder->private_->subframe_workspace[channel][encoder->private_->best_subframe[channel]], encoder->private_->frame)) {
+			if(!add_subframe_(encoder, frame_header.blocksize, threadtask->subframe_bps[channel], &threadtask->subframe_workspace[channel][threadtask->best_subframe[channel]], threadtask->frame)) {
 				/* the above function sets the state for us in case of an error */
 				return false;
 			}
 		}
 	}
 
-	if(encoder->protected_->loose_mid_side_stereo) {
-		encoder->private_->loose_mid_side_stereo_frame_count++;
-		if(encoder->private_->loose_mid_side_stereo_frame_count >= encoder->private_->loose_mid_side_stereo_frames)
-			encoder->private_->loose_mid_side_stereo_frame_count = 0;
-	}
-
-	encoder->private_->last_channel_assignment = frame_header.channel_assignment;
+	threadtask->channel_assignment = frame_header.channel_assignment;
 
 	return true;
 }
 
 FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	unsigned min_partition_order,
 	unsigned max_partition_order,
 	const FLAC__FrameHeader *frame_header,
@@ -3269,10 +4859,11 @@ FLAC__bool process_subframe_(
 					_candidate_bits =
 						evaluate_fixed_subframe_(
 							encoder,
+							threadtask,
 							integer_signal,
 							residual[!_best_subframe],
-							encoder->private_->abs_residual_partition_sums,
-							encoder->private_->raw_bits_per_partition,
+							threadtask->abs_residual_partition_sums,
+							threadtask->raw_bits_per_partition,
 							frame_header->blocksize,
 							subframe_bps,
 							fixed_order,
@@ -3300,13 +4891,28 @@ FLAC__bool process_subframe_(
 				else
 					max_lpc_order = encoder->protected_->max_lpc_order;
 				if(max_lpc_order > 0) {
-					unsigned a;
+					unsigned a, level, window_offset = 0;
+					/* forget the predictors tried on the last subframe */
+					if(++threadtask->lpc_subframe_number == 0) {
+						memset(threadtask->lpc_candidate, 0, sizeof(threadtask->lpc_candidate));
+						threadtask->lpc_subframe_number = 1;
+					}
+					/* a frame cut short by variable blocksize has a window of its own; see resize_buffers_() */
+					for(level = 1; level < encoder->private_->num_blocksize_levels; level++) {
+						if(frame_header->blocksize == encoder->protected_->blocksize >> level)
+							window_offset = window_offset_(encoder->protected_->blocksize, frame_header->blocksize);
+					}
 					for (a = 0; a < encoder->protected_->num_apodizations; a++) {
-						FLAC__lpc_window_data(integer_signal, encoder->private_->window[a], encoder->private_->windowed_signal, frame_header->blocksize);
-						encoder->private_->local_lpc_compute_autocorrelation(encoder->private_->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc);
+						const FLAC__real *window = encoder->private_->window[a] + window_offset;
+						if(0 != encoder->private_->local_lpc_compute_autocorrelation_windowed)
+							encoder->private_->local_lpc_compute_autocorrelation_windowed(integer_signal, window, frame_header->blocksize, max_lpc_order+1, autoc);
+						else {
+							FLAC__lpc_window_data(integer_signal, window, threadtask->windowed_signal, frame_header->blocksize);
+							encoder->private_->local_lpc_compute_autocorrelation(threadtask->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc);
+						}
 						/* if autoc[0] == 0.0, the signal is constant and we usually won't get here, but it can happen */
 						if(autoc[0] != 0.0) {
-							FLAC__lpc_compute_lp_coefficients(autoc, &max_lpc_order, encoder->private_->lp_coeff, lpc_error);
+							FLAC__lpc_compute_lp_coefficients(autoc, &max_lpc_order, threadtask->lp_coeff, lpc_error);
 							if(encoder->protected_->do_exhaustive_model_search) {
 								min_lpc_order = 1;
 							}
@@ -3355,11 +4961,12 @@ FLAC__bool process_subframe_(
 									_candidate_bits =
 										evaluate_lpc_subframe_(
 											encoder,
+											threadtask,
 											integer_signal,
 											residual[!_best_subframe],
-											encoder->private_->abs_residual_partition_sums,
-											encoder->private_->raw_bits_per_partition,
-											encoder->private_->lp_coeff[lpc_order-1],
+											threadtask->abs_residual_partition_sums,
+											threadtask->raw_bits_per_partition,
+											threadtask->lp_coeff[lpc_order-1],
 											frame_header->blocksize,
 											subframe_bps,
 											lpc_order,
@@ -3373,7 +4980,7 @@ FLAC__bool process_subframe_(
 											subframe[!_best_subframe],
 											partitioned_rice_contents[!_best_subframe]
 										);
-									if(_candidate_bits > 0) { /* if == 0, there was a problem quantizing the lpcoeffs */
+									if(_candidate_bits > 0) { /* if == 0, there was a problem quantizing the lpcoeffs or the predictor was already tried */
 										if(_candidate_bits < _best_bits) {
 											_best_subframe = !_best_subframe;
 											_best_bits = _candidate_bits;
@@ -3497,6 +5104,7 @@ unsigned evaluate_constant_subframe_(
 
 unsigned evaluate_fixed_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -3517,7 +5125,7 @@ unsigned evaluate_fixed_subframe_(
 	unsigned i, residual_bits, estimate;
 	const unsigned residual_samples = blocksize - order;
 
-	FLAC__fixed_compute_residual(signal+order, residual_samples, order, residual);
+	encoder->private_->local_fixed_compute_residual(signal+order, residual_samples, order, residual);
 
 	subframe->type = FLAC__SUBFRAME_TYPE_FIXED;
 
@@ -3527,7 +5135,8 @@ unsigned evaluate_fixed_subframe_(
 
 	residual_bits =
 		find_best_partition_order_(
-			encoder->private_,
+			encoder,
+			threadtask,
 			residual,
 			abs_residual_partition_sums,
 			raw_bits_per_partition,
@@ -3551,6 +5160,8 @@ unsigned evaluate_fixed_subframe_(
 
 #if SPOTCHECK_ESTIMATE
 	spotcheck_subframe_estimate_(encoder, blocksize, subframe_bps, subframe, estimate);
+#else
+	(void)encoder;
 #endif
 
 	return estimate;
@@ -3559,6 +5170,7 @@ unsigned evaluate_fixed_subframe_(
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 unsigned evaluate_lpc_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -3579,6 +5191,7 @@ unsigned evaluate_lpc_subframe_(
 )
 {
 	FLAC__int32 qlp_coeff[FLAC__MAX_LPC_ORDER];
+	FLAC__StreamEncoderLPCCandidate *candidate;
 	unsigned i, residual_bits, estimate;
 	int quantization, ret;
 	const unsigned residual_samples = blocksize - order;
@@ -3594,6 +5207,21 @@ unsigned evaluate_lpc_subframe_(
 	if(ret != 0)
 		return 0; /* this is a hack to indicate to the caller that we can't do lp at this order on this subframe */
 
+	/* the same hack for a predictor another window already came up with */
+	FLAC__ASSERT(qlp_coeff_precision >= FLAC__MIN_QLP_COEFF_PRECISION && qlp_coeff_precision <= FLAC__MAX_QLP_COEFF_PRECISION);
+	candidate = &threadtask->lpc_candidate[order-1][qlp_coeff_precision-FLAC__MIN_QLP_COEFF_PRECISION];
+	if(
+		candidate->subframe_number == threadtask->lpc_subframe_number &&
+		candidate->quantization == quantization &&
+		candidate->rice_parameter == rice_parameter &&
+		0 == memcmp(candidate->qlp_coeff, qlp_coeff, sizeof(FLAC__int32)*order)
+	)
+		return 0;
+	candidate->subframe_number = threadtask->lpc_subframe_number;
+	candidate->quantization = quantization;
+	candidate->rice_parameter = rice_parameter;
+	memcpy(candidate->qlp_coeff, qlp_coeff, sizeof(FLAC__int32)*order);
+
 	if(subframe_bps + qlp_coeff_precision + FLAC__bitmath_ilog2(order) <= 32)
 		if(subframe_bps <= 16 && qlp_coeff_precision <= 16)
 			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit(signal+order, residual_samples, qlp_coeff, order, quantization, residual);
@@ -3610,7 +5238,8 @@ unsigned evaluate_lpc_subframe_(
 
 	residual_bits =
 		find_best_partition_order_(
-			encoder->private_,
+			encoder,
+			threadtask,
 			residual,
 			abs_residual_partition_sums,
 			raw_bits_per_partition,
@@ -3669,7 +5298,8 @@ unsigned evaluate_verbatim_subframe_(
 }
 
 unsigned find_best_partition_order_(
-	FLAC__StreamEncoderPrivate *private_,
+	const FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *threadtask,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned raw_bits_per_partition[],
@@ -3693,10 +5323,10 @@ unsigned find_best_partition_order_(
 	max_partition_order = FLAC__format_get_max_rice_partition_order_from_blocksize_limited_max_and_predictor_order(max_partition_order, blocksize, predictor_order);
 	min_partition_order = min(min_partition_order, max_partition_order);
 
-	precompute_partition_info_sums_(residual, abs_residual_partition_sums, residual_samples, predictor_order, min_partition_order, max_partition_order, bps);
+	precompute_partition_info_sums_(encoder, residual, abs_residual_partition_sums, residual_samples, predictor_order, min_partition_order, max_partition_order, bps);
 
 	if(do_escape_coding)
-		precompute_partition_info_escapes_(residual, raw_bits_per_partition, residual_samples, predictor_order, min_partition_order, max_partition_order);
+		precompute_partition_info_escapes_(encoder, residual, raw_bits_per_partition, residual_samples, predictor_order, min_partition_order, max_partition_order);
 
 	{
 		int partition_order;
@@ -3705,9 +5335,8 @@ unsigned find_best_partition_order_(
 		for(partition_order = (int)max_partition_order, sum = 0; partition_order >= (int)min_partition_order; partition_order--) {
 			if(!
 				set_partitioned_rice_(
-#ifdef EXACT_RICE_BITS_CALCULATION
+					encoder,
 					residual,
-#endif
 					abs_residual_partition_sums+sum,
 					raw_bits_per_partition+sum,
 					residual_samples,
@@ -3717,7 +5346,7 @@ unsigned find_best_partition_order_(
 					rice_parameter_search_dist,
 					(unsigned)partition_order,
 					do_escape_coding,
-					&private_->partitioned_rice_contents_extra[!best_parameters_index],
+					&threadtask->partitioned_rice_contents_extra[!best_parameters_index],
 					&residual_bits
 				)
 			)
@@ -3746,9 +5375,9 @@ unsigned find_best_partition_order_(
 
 		/* save best parameters and raw_bits */
 		FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(prc, max(6, best_partition_order));
-		memcpy(prc->parameters, private_->partitioned_rice_contents_extra[best_parameters_index].parameters, sizeof(unsigned)*(1<<(best_partition_order)));
+		memcpy(prc->parameters, threadtask->partitioned_rice_contents_extra[best_parameters_index].parameters, sizeof(unsigned)*(1<<(best_partition_order)));
 		if(do_escape_coding)
-			memcpy(prc->raw_bits, private_->partitioned_rice_contents_extra[best_parameters_index].raw_bits, sizeof(unsigned)*(1<<(best_partition_order)));
+			memcpy(prc->raw_bits, threadtask->partitioned_rice_contents_extra[best_parameters_index].raw_bits, sizeof(unsigned)*(1<<(best_partition_order)));
 		/*
 		 * Now need to check if the type should be changed to
 		 * FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2 based on the
@@ -3777,6 +5406,7 @@ extern void precompute_partition_info_sums_32bit_asm_ia32_(
 #endif
 
 void precompute_partition_info_sums_(
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned residual_samples,
@@ -3786,48 +5416,19 @@ void precompute_partition_info_sums_(
 	unsigned bps
 )
 {
-	const unsigned default_partition_samples = (residual_samples + predictor_order) >> max_partition_order;
 	unsigned partitions = 1u << max_partition_order;
 
-	FLAC__ASSERT(default_partition_samples > predictor_order);
-
 #if defined(FLAC__CPU_IA32) && !defined FLAC__NO_ASM && defined FLAC__HAS_NASM
 	/* slightly pessimistic but still catches all common cases */
 	/* WATCHOUT: "+ bps" is an assumption that the average residual magnitude will not be more than "bps" bits */
-	if(FLAC__bitmath_ilog2(default_partition_samples) + bps < 32) {
+	if(FLAC__bitmath_ilog2((residual_samples + predictor_order) >> max_partition_order) + bps < 32) {
 		precompute_partition_info_sums_32bit_asm_ia32_(residual, abs_residual_partition_sums, residual_samples + predictor_order, predictor_order, min_partition_order, max_partition_order);
 		return;
 	}
 #endif
 
 	/* first do max_partition_order */
-	{
-		unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
-		/* slightly pessimistic but still catches all common cases */
-		/* WATCHOUT: "+ bps" is an assumption that the average residual magnitude will not be more than "bps" bits */
-		if(FLAC__bitmath_ilog2(default_partition_samples) + bps < 32) {
-			FLAC__uint32 abs_residual_partition_sum;
-
-			for(partition = residual_sample = 0; partition < partitions; partition++) {
-				end += default_partition_samples;
-				abs_residual_partition_sum = 0;
-				for( ; residual_sample < end; residual_sample++)
-					abs_residual_partition_sum += abs(residual[residual_sample]); /* abs(INT_MIN) is undefined, but if the residual is INT_MIN we have bigger problems */
-				abs_residual_partition_sums[partition] = abs_residual_partition_sum;
-			}
-		}
-		else { /* have to pessimistically use 64 bits for accumulator */
-			FLAC__uint64 abs_residual_partition_sum;
-
-			for(partition = residual_sample = 0; partition < partitions; partition++) {
-				end += default_partition_samples;
-				abs_residual_partition_sum = 0;
-				for( ; residual_sample < end; residual_sample++)
-					abs_residual_partition_sum += abs(residual[residual_sample]); /* abs(INT_MIN) is undefined, but if the residual is INT_MIN we have bigger problems */
-				abs_residual_partition_sums[partition] = abs_residual_partition_sum;
-			}
-		}
-	}
+	encoder->private_->local_precompute_partition_info_sums(residual, abs_residual_partition_sums, residual_samples, predictor_order, max_partition_order, bps);
 
 	/* now merge partitions for lower orders */
 	{
@@ -3846,7 +5447,49 @@ void precompute_partition_info_sums_(
 	}
 }
 
+void FLAC__precompute_partition_info_sums(
+	const FLAC__int32 residual[],
+	FLAC__uint64 abs_residual_partition_sums[],
+	unsigned residual_samples,
+	unsigned predictor_order,
+	unsigned partition_order,
+	unsigned bps
+)
+{
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+	const unsigned partitions = 1u << partition_order;
+	unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	/* slightly pessimistic but still catches all common cases */
+	/* WATCHOUT: "+ bps" is an assumption that the average residual magnitude will not be more than "bps" bits */
+	if(FLAC__bitmath_ilog2(default_partition_samples) + bps < 32) {
+		FLAC__uint32 abs_residual_partition_sum;
+
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			end += default_partition_samples;
+			abs_residual_partition_sum = 0;
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]); /* abs(INT_MIN) is undefined, but if the residual is INT_MIN we have bigger problems */
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+	else { /* have to pessimistically use 64 bits for accumulator */
+		FLAC__uint64 abs_residual_partition_sum;
+
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			end += default_partition_samples;
+			abs_residual_partition_sum = 0;
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]); /* abs(INT_MIN) is undefined, but if the residual is INT_MIN we have bigger problems */
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+}
+
 void precompute_partition_info_escapes_(
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
 	unsigned raw_bits_per_partition[],
 	unsigned residual_samples,
@@ -3856,41 +5499,13 @@ void precompute_partition_info_escapes_(
 )
 {
 	int partition_order;
-	unsigned from_partition, to_partition = 0;
-	const unsigned blocksize = residual_samples + predictor_order;
+	unsigned from_partition = 0, to_partition = 1u << max_partition_order;
 
 	/* first do max_partition_order */
-	for(partition_order = (int)max_partition_order; partition_order >= 0; partition_order--) {
-		FLAC__int32 r;
-		FLAC__uint32 rmax;
-		unsigned partition, partition_sample, partition_samples, residual_sample;
-		const unsigned partitions = 1u << partition_order;
-		const unsigned default_partition_samples = blocksize >> partition_order;
-
-		FLAC__ASSERT(default_partition_samples > predictor_order);
-
-		for(partition = residual_sample = 0; partition < partitions; partition++) {
-			partition_samples = default_partition_samples;
-			if(partition == 0)
-				partition_samples -= predictor_order;
-			rmax = 0;
-			for(partition_sample = 0; partition_sample < partition_samples; partition_sample++) {
-				r = residual[residual_sample++];
-				/* OPT: maybe faster: rmax |= r ^ (r>>31) */
-				if(r < 0)
-					rmax |= ~r;
-				else
-					rmax |= r;
-			}
-			/* now we know all residual values are in the range [-rmax-1,rmax] */
-			raw_bits_per_partition[partition] = rmax? FLAC__bitmath_ilog2(rmax) + 2 : 1;
-		}
-		to_partition = partitions;
-		break; /*@@@ yuck, should remove the 'for' loop instead */
-	}
+	encoder->private_->local_precompute_partition_info_escapes(residual, raw_bits_per_partition, residual_samples, predictor_order, max_partition_order);
 
 	/* now merge partitions for lower orders */
-	for(from_partition = 0, --partition_order; partition_order >= (int)min_partition_order; partition_order--) {
+	for(partition_order = (int)max_partition_order - 1; partition_order >= (int)min_partition_order; partition_order--) {
 		unsigned m;
 		unsigned i;
 		const unsigned partitions = 1u << partition_order;
@@ -3904,6 +5519,59 @@ void precompute_partition_info_escapes_(
 	}
 }
 
+void FLAC__precompute_partition_info_escapes(
+	const FLAC__int32 residual[],
+	unsigned raw_bits_per_partition[],
+	unsigned residual_samples,
+	unsigned predictor_order,
+	unsigned partition_order
+)
+{
+	FLAC__int32 r;
+	FLAC__uint32 rmax;
+	unsigned partition, partition_sample, partition_samples, residual_sample;
+	const unsigned partitions = 1u << partition_order;
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	for(partition = residual_sample = 0; partition < partitions; partition++) {
+		partition_samples = default_partition_samples;
+		if(partition == 0)
+			partition_samples -= predictor_order;
+		rmax = 0;
+		for(partition_sample = 0; partition_sample < partition_samples; partition_sample++) {
+			r = residual[residual_sample++];
+			/* OPT: maybe faster: rmax |= r ^ (r>>31) */
+			if(r < 0)
+				rmax |= ~r;
+			else
+				rmax |= r;
+		}
+		/* now we know all residual values are in the range [-rmax-1,rmax] */
+		raw_bits_per_partition[partition] = rmax? FLAC__bitmath_ilog2(rmax) + 2 : 1;
+	}
+}
+
+void FLAC__count_rice_msbs(
+	const FLAC__int32 residual[],
+	unsigned samples,
+	unsigned min_parameter,
+	unsigned parameters,
+	FLAC__uint64 msbs[]
+)
+{
+	unsigned i, j;
+
+	for(j = 0; j < parameters; j++)
+		msbs[j] = 0;
+	for(i = 0; i < samples; i++) {
+		const FLAC__uint32 u = (((FLAC__uint32)residual[i] << 1) ^ (FLAC__uint32)(residual[i] >> 31)) >> min_parameter;
+		for(j = 0; j < parameters; j++)
+			msbs[j] += u >> j;
+	}
+}
+
 #ifdef EXACT_RICE_BITS_CALCULATION
 static FLaC__INLINE unsigned count_rice_bits_in_partition_(
 	const unsigned rice_parameter,
@@ -3945,10 +5613,49 @@ static FLaC__INLINE unsigned count_rice_bits_in_partition_(
 }
 #endif
 
+unsigned search_rice_parameter_(
+	const FLAC__StreamEncoder *encoder,
+	const FLAC__int32 residual[],
+	const unsigned partition_samples,
+	const FLAC__uint64 abs_residual_partition_sum,
+	const unsigned suggested_rice_parameter,
+	const unsigned rice_parameter_limit,
+	const unsigned rice_parameter_search_dist,
+	unsigned *best_partition_bits
+)
+{
+	FLAC__uint64 msbs[FLAC__STREAM_ENCODER_MAX_RICE_PARAMETERS];
+	unsigned rice_parameter, partition_bits, best_rice_parameter = 0;
+	const unsigned min_rice_parameter = suggested_rice_parameter < rice_parameter_search_dist? 0 : suggested_rice_parameter - rice_parameter_search_dist;
+	const unsigned max_rice_parameter = rice_parameter_limit - 1 - suggested_rice_parameter > rice_parameter_search_dist? suggested_rice_parameter + rice_parameter_search_dist : rice_parameter_limit - 1;
+
+	FLAC__ASSERT(suggested_rice_parameter < rice_parameter_limit);
+	FLAC__ASSERT(rice_parameter_limit <= FLAC__STREAM_ENCODER_MAX_RICE_PARAMETERS);
+
+	/* the folded residual adds up to at most twice the magnitudes, which has to fit in the 32-bit counts of the SIMD versions */
+	if(abs_residual_partition_sum < ((FLAC__uint64)1 << 31))
+		encoder->private_->local_count_rice_msbs(residual, partition_samples, min_rice_parameter, max_rice_parameter - min_rice_parameter + 1, msbs);
+	else
+		FLAC__count_rice_msbs(residual, partition_samples, min_rice_parameter, max_rice_parameter - min_rice_parameter + 1, msbs);
+
+	*best_partition_bits = (unsigned)(-1);
+	for(rice_parameter = min_rice_parameter; rice_parameter <= max_rice_parameter; rice_parameter++) {
+		partition_bits =
+			FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_PARAMETER_LEN + /* actually could end up being FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_PARAMETER_LEN but err on side of 16bps */
+			(1+rice_parameter) * partition_samples + /* 1 for unary stop bit + rice_parameter for the binary portion */
+			(unsigned)msbs[rice_parameter - min_rice_parameter]
+		;
+		if(partition_bits < *best_partition_bits) {
+			best_rice_parameter = rice_parameter;
+			*best_partition_bits = partition_bits;
+		}
+	}
+	return best_rice_parameter;
+}
+
 FLAC__bool set_partitioned_rice_(
-#ifdef EXACT_RICE_BITS_CALCULATION
+	const FLAC__StreamEncoder *encoder,
 	const FLAC__int32 residual[],
-#endif
 	const FLAC__uint64 abs_residual_partition_sums[],
 	const unsigned raw_bits_per_partition[],
 	const unsigned residual_samples,
@@ -3963,14 +5670,9 @@ FLAC__bool set_partitioned_rice_(
 )
 {
 	unsigned rice_parameter, partition_bits;
-	unsigned best_partition_bits, best_rice_parameter = 0;
+	unsigned best_partition_bits, best_rice_parameter;
 	unsigned bits_ = FLAC__ENTROPY_CODING_METHOD_TYPE_LEN + FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ORDER_LEN;
 	unsigned *parameters, *raw_bits;
-#ifdef ENABLE_RICE_PARAMETER_SEARCH
-	unsigned min_rice_parameter, max_rice_parameter;
-#else
-	(void)rice_parameter_search_dist;
-#endif
 
 	FLAC__ASSERT(suggested_rice_parameter < FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_ESCAPE_PARAMETER);
 	FLAC__ASSERT(rice_parameter_limit <= FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_ESCAPE_PARAMETER);
@@ -3980,40 +5682,17 @@ FLAC__bool set_partitioned_rice_(
 	raw_bits = partitioned_rice_contents->raw_bits;
 
 	if(partition_order == 0) {
-		best_partition_bits = (unsigned)(-1);
-#ifdef ENABLE_RICE_PARAMETER_SEARCH
 		if(rice_parameter_search_dist) {
-			if(suggested_rice_parameter < rice_parameter_search_dist)
-				min_rice_parameter = 0;
-			else
-				min_rice_parameter = suggested_rice_parameter - rice_parameter_search_dist;
-			max_rice_parameter = suggested_rice_parameter + rice_parameter_search_dist;
-			if(max_rice_parameter >= rice_parameter_limit) {
-#ifdef DEBUG_VERBOSE
-				fprintf(stderr, "clipping rice_parameter (%u -> %u) @5\n", max_rice_parameter, rice_parameter_limit - 1);
-#endif
-				max_rice_parameter = rice_parameter_limit - 1;
-			}
+			best_rice_parameter = search_rice_parameter_(encoder, residual, residual_samples, abs_residual_partition_sums[0], suggested_rice_parameter, rice_parameter_limit, rice_parameter_search_dist, &best_partition_bits);
 		}
-		else
-			min_rice_parameter = max_rice_parameter = suggested_rice_parameter;
-
-		for(rice_parameter = min_rice_parameter; rice_parameter <= max_rice_parameter; rice_parameter++) {
-#else
-			rice_parameter = suggested_rice_parameter;
-#endif
+		else {
+			best_rice_parameter = suggested_rice_parameter;
 #ifdef EXACT_RICE_BITS_CALCULATION
-			partition_bits = count_rice_bits_in_partition_(rice_parameter, residual_samples, residual);
+			best_partition_bits = count_rice_bits_in_partition_(best_rice_parameter, residual_samples, residual);
 #else
-			partition_bits = count_rice_bits_in_partition_(rice_parameter, residual_samples, abs_residual_partition_sums[0]);
+			best_partition_bits = count_rice_bits_in_partition_(best_rice_parameter, residual_samples, abs_residual_partition_sums[0]);
 #endif
-			if(partition_bits < best_partition_bits) {
-				best_rice_parameter = rice_parameter;
-				best_partition_bits = partition_bits;
-			}
-#ifdef ENABLE_RICE_PARAMETER_SEARCH
 		}
-#endif
 		if(search_for_escapes) {
 			partition_bits = FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_PARAMETER_LEN + FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_RAW_LEN + raw_bits_per_partition[0] * residual_samples;
 			if(partition_bits <= best_partition_bits) {
@@ -4058,38 +5737,17 @@ FLAC__bool set_partitioned_rice_(
 				rice_parameter = rice_parameter_limit - 1;
 			}
 
-			best_partition_bits = (unsigned)(-1);
-#ifdef ENABLE_RICE_PARAMETER_SEARCH
 			if(rice_parameter_search_dist) {
-				if(rice_parameter < rice_parameter_search_dist)
-					min_rice_parameter = 0;
-				else
-					min_rice_parameter = rice_parameter - rice_parameter_search_dist;
-				max_rice_parameter = rice_parameter + rice_parameter_search_dist;
-				if(max_rice_parameter >= rice_parameter_limit) {
-#ifdef DEBUG_VERBOSE
-					fprintf(stderr, "clipping rice_parameter (%u -> %u) @7\n", max_rice_parameter, rice_parameter_limit - 1);
-#endif
-					max_rice_parameter = rice_parameter_limit - 1;
-				}
+				best_rice_parameter = search_rice_parameter_(encoder, residual+residual_sample, partition_samples, abs_residual_partition_sums[partition], rice_parameter, rice_parameter_limit, rice_parameter_search_dist, &best_partition_bits);
 			}
-			else
-				min_rice_parameter = max_rice_parameter = rice_parameter;
-
-			for(rice_parameter = min_rice_parameter; rice_parameter <= max_rice_parameter; rice_parameter++) {
-#endif
+			else {
+				best_rice_parameter = rice_parameter;
 #ifdef EXACT_RICE_BITS_CALCULATION
-				partition_bits = count_rice_bits_in_partition_(rice_parameter, partition_samples, residual+residual_sample);
+				best_partition_bits = count_rice_bits_in_partition_(rice_parameter, partition_samples, residual+residual_sample);
 #else
-				partition_bits = count_rice_bits_in_partition_(rice_parameter, partition_samples, abs_residual_partition_sums[partition]);
+				best_partition_bits = count_rice_bits_in_partition_(rice_parameter, partition_samples, abs_residual_partition_sums[partition]);
 #endif
-				if(partition_bits < best_partition_bits) {
-					best_rice_parameter = rice_parameter;
-					best_partition_bits = partition_bits;
-				}
-#ifdef ENABLE_RICE_PARAMETER_SEARCH
 			}
-#endif
 			if(search_for_escapes) {
 				partition_bits = FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_PARAMETER_LEN + FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_RAW_LEN + raw_bits_per_partition[partition] * partition_samples;
 				if(partition_bits <= best_partition_bits) {
@@ -4205,14 +5863,14 @@ FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder
 	(void)decoder;
 
 	for(channel = 0; channel < channels; channel++) {
-		if(0 != memcmp(buffer[channel], encoder->private_->verify.input_fifo.data[channel], bytes_per_block)) {
+		if(0 != memcmp(buffer[channel], encoder->private_->verify.expected[channel], bytes_per_block)) {
 			unsigned i, sample = 0;
 			FLAC__int32 expect = 0, got = 0;
 
 			for(i = 0; i < blocksize; i++) {
-				if(buffer[channel][i] != encoder->private_->verify.input_fifo.data[channel][i]) {
+				if(buffer[channel][i] != encoder->private_->verify.expected[channel][i]) {
 					sample = i;
-					expect = (FLAC__int32)encoder->private_->verify.input_fifo.data[channel][i];
+					expect = (FLAC__int32)encoder->private_->verify.expected[channel][i];
 					got = (FLAC__int32)buffer[channel][i];
 					break;
 				}
@@ -4225,10 +5883,15 @@ FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder
 			encoder->private_->verify.error_stats.sample = sample;
 			encoder->private_->verify.error_stats.expected = expect;
 			encoder->private_->verify.error_stats.got = got;
-			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA;
+			*verify_state_(encoder) = FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA;
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
 	}
+#ifdef FLAC__HAS_PTHREAD
+	/* queue_verify_block_() already took the frame off the fifo */
+	if(encoder->private_->verify_stage.running)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+#endif
 	/* dequeue the frame from the fifo */
 	encoder->private_->verify.input_fifo.tail -= blocksize;
 	FLAC__ASSERT(encoder->private_->verify.input_fifo.tail <= OVERREAD_);
@@ -4246,7 +5909,21 @@ void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 {
 	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)client_data;
 	(void)decoder, (void)status;
-	encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+	*verify_state_(encoder) = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+}
+
+/*
+ * While the verify stage is running, the verify decoder is driven from
+ * the stage thread, which must not touch the encoder state; errors are
+ * collected for verify_block_() instead.
+ */
+FLAC__StreamEncoderState *verify_state_(FLAC__StreamEncoder *encoder)
+{
+#ifdef FLAC__HAS_PTHREAD
+	if(encoder->private_->verify_stage.running)
+		return &encoder->private_->verify.stage_state;
+#endif
+	return &encoder->protected_->state;
 }
 
 FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
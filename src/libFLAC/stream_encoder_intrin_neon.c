@@ -0,0 +1,148 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__ARM64_NEON
+
+#include <stdlib.h> /* for abs() */
+#include <arm_neon.h>
+#include "FLAC/assert.h"
+#include "private/bitmath.h"
+#include "private/stream_encoder.h"
+
+/*
+ * These are the NEON versions of the routines in
+ * stream_encoder_intrin_sse41.c; see there for the details.  They
+ * handle 4 samples per iteration.
+ */
+
+void FLAC__precompute_partition_info_sums_intrin_neon(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps)
+{
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+	const unsigned partitions = 1u << partition_order;
+	unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	/* WATCHOUT: "+ bps" is the same assumption as in FLAC__precompute_partition_info_sums() */
+	if(FLAC__bitmath_ilog2(default_partition_samples) + bps < 32) {
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			uint32x4_t sum = vdupq_n_u32(0);
+			FLAC__uint32 abs_residual_partition_sum;
+			end += default_partition_samples;
+			for( ; residual_sample + 4 <= end; residual_sample += 4)
+				sum = vaddq_u32(sum, vreinterpretq_u32_s32(vabsq_s32(vld1q_s32(residual+residual_sample))));
+			abs_residual_partition_sum = vaddvq_u32(sum);
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]);
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+	else {
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			uint64x2_t sum = vdupq_n_u64(0);
+			FLAC__uint64 abs_residual_partition_sum;
+			end += default_partition_samples;
+			for( ; residual_sample + 4 <= end; residual_sample += 4)
+				sum = vpadalq_u32(sum, vreinterpretq_u32_s32(vabsq_s32(vld1q_s32(residual+residual_sample))));
+			abs_residual_partition_sum = vaddvq_u64(sum);
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]);
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+}
+
+void FLAC__precompute_partition_info_escapes_intrin_neon(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order)
+{
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+	const unsigned partitions = 1u << partition_order;
+	unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	for(partition = residual_sample = 0; partition < partitions; partition++) {
+		uint32x4_t acc = vdupq_n_u32(0);
+		FLAC__uint32 rmax;
+		end += default_partition_samples;
+		for( ; residual_sample + 4 <= end; residual_sample += 4) {
+			const int32x4_t r = vld1q_s32(residual+residual_sample);
+			acc = vorrq_u32(acc, vreinterpretq_u32_s32(veorq_s32(r, vshrq_n_s32(r, 31))));
+		}
+		/* there is no across-lanes OR, but the max has the same top bit, which is all that matters below */
+		rmax = vmaxvq_u32(acc);
+		for( ; residual_sample < end; residual_sample++) {
+			const FLAC__int32 r = residual[residual_sample];
+			rmax |= (FLAC__uint32)(r ^ (r >> 31));
+		}
+		raw_bits_per_partition[partition] = rmax? FLAC__bitmath_ilog2(rmax) + 2 : 1;
+	}
+}
+
+#define RICE_MSBS_TERM_(j) acc##j = vaddq_u32(acc##j, vshrq_n_u32(u, j));
+
+void FLAC__count_rice_msbs_intrin_neon(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[])
+{
+	unsigned i, j, n, parameter;
+	FLAC__uint32 count[8];
+
+	for(parameter = min_parameter; parameters > 0; parameter += n, parameters -= n, msbs += n) {
+		const int32x4_t cnt = vdupq_n_s32(-(int)parameter); /* a negative left shift is a right shift */
+		uint32x4_t acc0, acc1, acc2, acc3, acc4, acc5, acc6, acc7;
+		n = parameters < 8? parameters : 8;
+		acc0 = acc1 = acc2 = acc3 = acc4 = acc5 = acc6 = acc7 = vdupq_n_u32(0);
+		for(i = 0; i + 4 <= samples; i += 4) {
+			const int32x4_t r = vld1q_s32(residual+i);
+			const uint32x4_t u = vshlq_u32(vreinterpretq_u32_s32(veorq_s32(vshlq_n_s32(r, 1), vshrq_n_s32(r, 31))), cnt);
+			acc0 = vaddq_u32(acc0, u);
+			RICE_MSBS_TERM_(1) RICE_MSBS_TERM_(2) RICE_MSBS_TERM_(3)
+			RICE_MSBS_TERM_(4) RICE_MSBS_TERM_(5) RICE_MSBS_TERM_(6) RICE_MSBS_TERM_(7)
+		}
+		count[0] = vaddvq_u32(acc0); count[1] = vaddvq_u32(acc1);
+		count[2] = vaddvq_u32(acc2); count[3] = vaddvq_u32(acc3);
+		count[4] = vaddvq_u32(acc4); count[5] = vaddvq_u32(acc5);
+		count[6] = vaddvq_u32(acc6); count[7] = vaddvq_u32(acc7);
+		for( ; i < samples; i++) {
+			const FLAC__uint32 u = (((FLAC__uint32)residual[i] << 1) ^ (FLAC__uint32)(residual[i] >> 31)) >> parameter;
+			for(j = 0; j < n; j++)
+				count[j] += u >> j;
+		}
+		for(j = 0; j < n; j++)
+			msbs[j] = count[j];
+	}
+}
+
+#endif
@@ -0,0 +1,166 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifdef FLAC__X86_64_INTRIN
+
+#include <stdlib.h> /* for abs() */
+#include <smmintrin.h>
+#include "FLAC/assert.h"
+#include "private/bitmath.h"
+#include "private/stream_encoder.h"
+
+/*
+ * These are the SSE4.1 versions of the residual passes in
+ * stream_encoder.c.  They handle 4 samples per iteration; the few
+ * samples left at the end of each partition are done one at a time
+ * just like the plain C versions.
+ */
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__precompute_partition_info_sums_intrin_sse41(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order, unsigned bps)
+{
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+	const unsigned partitions = 1u << partition_order;
+	unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	/* WATCHOUT: "+ bps" is the same assumption as in FLAC__precompute_partition_info_sums() */
+	if(FLAC__bitmath_ilog2(default_partition_samples) + bps < 32) {
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			__m128i sum = _mm_setzero_si128();
+			FLAC__uint32 abs_residual_partition_sum;
+			end += default_partition_samples;
+			for( ; residual_sample + 4 <= end; residual_sample += 4)
+				sum = _mm_add_epi32(sum, _mm_abs_epi32(_mm_loadu_si128((const __m128i*)(residual+residual_sample))));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1,0,3,2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2,3,0,1)));
+			abs_residual_partition_sum = (FLAC__uint32)_mm_cvtsi128_si32(sum);
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]);
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+	else {
+		for(partition = residual_sample = 0; partition < partitions; partition++) {
+			__m128i sum = _mm_setzero_si128();
+			FLAC__uint64 abs_residual_partition_sum;
+			end += default_partition_samples;
+			for( ; residual_sample + 4 <= end; residual_sample += 4) {
+				const __m128i a = _mm_abs_epi32(_mm_loadu_si128((const __m128i*)(residual+residual_sample)));
+				sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(a));
+				sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(_mm_srli_si128(a, 8)));
+			}
+			sum = _mm_add_epi64(sum, _mm_srli_si128(sum, 8));
+			abs_residual_partition_sum = (FLAC__uint64)_mm_cvtsi128_si64(sum);
+			for( ; residual_sample < end; residual_sample++)
+				abs_residual_partition_sum += abs(residual[residual_sample]);
+			abs_residual_partition_sums[partition] = abs_residual_partition_sum;
+		}
+	}
+}
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__precompute_partition_info_escapes_intrin_sse41(const FLAC__int32 residual[], unsigned raw_bits_per_partition[], unsigned residual_samples, unsigned predictor_order, unsigned partition_order)
+{
+	const unsigned default_partition_samples = (residual_samples + predictor_order) >> partition_order;
+	const unsigned partitions = 1u << partition_order;
+	unsigned partition, residual_sample, end = (unsigned)(-(int)predictor_order);
+
+	FLAC__ASSERT(default_partition_samples > predictor_order);
+
+	for(partition = residual_sample = 0; partition < partitions; partition++) {
+		__m128i acc = _mm_setzero_si128();
+		FLAC__uint32 rmax;
+		end += default_partition_samples;
+		for( ; residual_sample + 4 <= end; residual_sample += 4) {
+			const __m128i r = _mm_loadu_si128((const __m128i*)(residual+residual_sample));
+			acc = _mm_or_si128(acc, _mm_xor_si128(r, _mm_srai_epi32(r, 31)));
+		}
+		acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+		acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+		rmax = (FLAC__uint32)_mm_cvtsi128_si32(acc);
+		for( ; residual_sample < end; residual_sample++) {
+			const FLAC__int32 r = residual[residual_sample];
+			rmax |= (FLAC__uint32)(r ^ (r >> 31));
+		}
+		/* now we know all residual values are in the range [-rmax-1,rmax] */
+		raw_bits_per_partition[partition] = rmax? FLAC__bitmath_ilog2(rmax) + 2 : 1;
+	}
+}
+
+/*
+ * Eight parameters are counted per pass over the residual: the folded
+ * value is shifted right by the first parameter once, and then by 0..7
+ * more with immediate shifts.  Counts for parameters past the end of
+ * the range (where the shift may even be 32 or more, which gives 0)
+ * are thrown away.
+ */
+#define RICE_MSBS_TERM_(j) acc##j = _mm_add_epi32(acc##j, _mm_srli_epi32(u, j));
+
+FLAC__INTRIN_TARGET("sse4.1")
+void FLAC__count_rice_msbs_intrin_sse41(const FLAC__int32 residual[], unsigned samples, unsigned min_parameter, unsigned parameters, FLAC__uint64 msbs[])
+{
+	unsigned i, j, n, parameter;
+	FLAC__uint32 count[8];
+
+	for(parameter = min_parameter; parameters > 0; parameter += n, parameters -= n, msbs += n) {
+		const __m128i cnt = _mm_cvtsi32_si128((int)parameter);
+		__m128i acc0, acc1, acc2, acc3, acc4, acc5, acc6, acc7;
+		n = parameters < 8? parameters : 8;
+		acc0 = acc1 = acc2 = acc3 = acc4 = acc5 = acc6 = acc7 = _mm_setzero_si128();
+		for(i = 0; i + 4 <= samples; i += 4) {
+			const __m128i r = _mm_loadu_si128((const __m128i*)(residual+i));
+			const __m128i u = _mm_srl_epi32(_mm_xor_si128(_mm_slli_epi32(r, 1), _mm_srai_epi32(r, 31)), cnt);
+			acc0 = _mm_add_epi32(acc0, u);
+			RICE_MSBS_TERM_(1) RICE_MSBS_TERM_(2) RICE_MSBS_TERM_(3)
+			RICE_MSBS_TERM_(4) RICE_MSBS_TERM_(5) RICE_MSBS_TERM_(6) RICE_MSBS_TERM_(7)
+		}
+		/* two rounds of horizontal adds leave each accumulator's total in one lane */
+		_mm_storeu_si128((__m128i*)count, _mm_hadd_epi32(_mm_hadd_epi32(acc0, acc1), _mm_hadd_epi32(acc2, acc3)));
+		_mm_storeu_si128((__m128i*)(count+4), _mm_hadd_epi32(_mm_hadd_epi32(acc4, acc5), _mm_hadd_epi32(acc6, acc7)));
+		for( ; i < samples; i++) {
+			const FLAC__uint32 u = (((FLAC__uint32)residual[i] << 1) ^ (FLAC__uint32)(residual[i] >> 31)) >> parameter;
+			for(j = 0; j < n; j++)
+				count[j] += u >> j;
+		}
+		for(j = 0; j < n; j++)
+			msbs[j] = count[j];
+	}
+}
+
+#endif
@@ -96,55 +96,18 @@ FLAC__bool do_shorthand_operation__add_seekpoints(const char *filename, FLAC__Me
  */
 
 typedef struct {
-	FLAC__StreamMetadata_SeekTable *seektable_template;
-	FLAC__uint64 samples_written;
-	FLAC__uint64 audio_offset, last_offset;
-	unsigned first_seekpoint_to_check;
 	FLAC__bool error_occurred;
 	FLAC__StreamDecoderErrorStatus error_status;
 } ClientData;
 
 static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
-	ClientData *cd = (ClientData*)client_data;
-
+	/* never called: the frames are only scanned, not decoded */
+	(void)decoder;
+	(void)frame;
 	(void)buffer;
-	FLAC__ASSERT(0 != cd);
-
-	if(!cd->error_occurred) {
-		const unsigned blocksize = frame->header.blocksize;
-		const FLAC__uint64 frame_first_sample = cd->samples_written;
-		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)blocksize - 1;
-		FLAC__uint64 test_sample;
-		unsigned i;
-		for(i = cd->first_seekpoint_to_check; i < cd->seektable_template->num_points; i++) {
-			test_sample = cd->seektable_template->points[i].sample_number;
-			if(test_sample > frame_last_sample) {
-				break;
-			}
-			else if(test_sample >= frame_first_sample) {
-				cd->seektable_template->points[i].sample_number = frame_first_sample;
-				cd->seektable_template->points[i].stream_offset = cd->last_offset - cd->audio_offset;
-				cd->seektable_template->points[i].frame_samples = blocksize;
-				cd->first_seekpoint_to_check++;
-				/* DO NOT: "break;" and here's why:
-				 * The seektable template may contain more than one target
-				 * sample for any given frame; we will keep looping, generating
-				 * duplicate seekpoints for them, and we'll clean it up later,
-				 * just before writing the seektable back to the metadata.
-				 */
-			}
-			else {
-				cd->first_seekpoint_to_check++;
-			}
-		}
-		cd->samples_written += blocksize;
-		if(!FLAC__stream_decoder_get_decode_position(decoder, &cd->last_offset))
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
-	}
-	else
-		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	(void)client_data;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 }
 
 static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
@@ -160,19 +123,41 @@ static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 	}
 }
 
+/*
+ * Points each seekpoint in the (sorted) template at the frame that
+ * contains its target sample.
+ */
+static void fill_seekpoints_(FLAC__StreamMetadata_SeekTable *seektable_template, const FLAC__StreamMetadata_SeekTable *frames)
+{
+	unsigned i, j = 0;
+
+	for(i = 0; i < seektable_template->num_points; i++) {
+		const FLAC__uint64 test_sample = seektable_template->points[i].sample_number;
+		while(j < frames->num_points && test_sample >= frames->points[j].sample_number + frames->points[j].frame_samples)
+			j++;
+		if(j == frames->num_points)
+			break;
+		/* DO NOT: skip to the next frame, and here's why:
+		 * The seektable template may contain more than one target
+		 * sample for any given frame; we will keep looping, generating
+		 * duplicate seekpoints for them, and we'll clean it up later,
+		 * just before writing the seektable back to the metadata.
+		 */
+		if(test_sample >= frames->points[j].sample_number)
+			seektable_template->points[i] = frames->points[j];
+	}
+}
+
 FLAC__bool populate_seekpoint_values(const char *filename, FLAC__StreamMetadata *block, FLAC__bool *needs_write)
 {
 	FLAC__StreamDecoder *decoder;
+	FLAC__StreamMetadata *frame_index = 0;
 	ClientData client_data;
 	FLAC__bool ok = true;
 
 	FLAC__ASSERT(0 != block);
 	FLAC__ASSERT(block->type == FLAC__METADATA_TYPE_SEEKTABLE);
 
-	client_data.seektable_template = &block->data.seek_table;
-	client_data.samples_written = 0;
-	/* client_data.audio_offset must be determined later */
-	client_data.first_seekpoint_to_check = 0;
 	client_data.error_occurred = false;
 
 	decoder = FLAC__stream_decoder_new();
@@ -190,27 +175,22 @@ FLAC__bool populate_seekpoint_values(const char *filename, FLAC__StreamMetadata
 		ok = false;
 	}
 
-	if(ok && !FLAC__stream_decoder_process_until_end_of_metadata(decoder)) {
-		fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file (%s)\n", filename, FLAC__stream_decoder_get_resolved_state_string(decoder));
-		ok = false;
-	}
-
-	if(ok && !FLAC__stream_decoder_get_decode_position(decoder, &client_data.audio_offset)) {
-		fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file\n", filename);
-		ok = false;
-	}
-	client_data.last_offset = client_data.audio_offset;
-
-	if(ok && !FLAC__stream_decoder_process_until_end_of_stream(decoder)) {
-		fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file (%s)\n", filename, FLAC__stream_decoder_get_resolved_state_string(decoder));
+	/* only the frame boundaries are needed, so the frames are scanned instead of decoded */
+	if(ok && !FLAC__stream_decoder_scan_frames(decoder, &frame_index)) {
+		fprintf(stderr, "%s: ERROR (--add-seekpoint) scanning file (%s)\n", filename, FLAC__stream_decoder_get_resolved_state_string(decoder));
 		ok = false;
 	}
 
 	if(ok && client_data.error_occurred) {
-		fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file (%u:%s)\n", filename, (unsigned)client_data.error_status, FLAC__StreamDecoderErrorStatusString[client_data.error_status]);
+		fprintf(stderr, "%s: ERROR (--add-seekpoint) scanning file (%u:%s)\n", filename, (unsigned)client_data.error_status, FLAC__StreamDecoderErrorStatusString[client_data.error_status]);
 		ok = false;
 	}
 
+	if(ok)
+		fill_seekpoints_(&block->data.seek_table, &frame_index->data.seek_table);
+
+	if(0 != frame_index)
+		FLAC__metadata_object_delete(frame_index);
 	*needs_write = true;
 	FLAC__stream_decoder_delete(decoder);
 	return ok;
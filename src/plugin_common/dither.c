@@ -26,11 +26,16 @@
 
 #include "dither.h"
 #include "FLAC/assert.h"
+#include "share/pcm.h"
 
 #ifdef max
 #undef max
 #endif
 #define max(a,b) ((a)>(b)?(a):(b))
+#ifdef min
+#undef min
+#endif
+#define min(a,b) ((a)<(b)?(a):(b))
 
 #ifndef FLaC__INLINE
 #define FLaC__INLINE
@@ -105,15 +110,14 @@ static FLAC__int32 linear_dither(unsigned source_bps, unsigned target_bps, FLAC_
 	return output >> scalebits;
 }
 
-size_t FLAC__plugin_common__pack_pcm_signed_big_endian(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps)
+/* the number of samples per channel dithered at a time before packing */
+#define DITHER_CHUNK_SAMPLES 256
+
+static size_t pack_pcm_signed_(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps, FLAC__bool is_big_endian, dither_state dither[])
 {
-	static dither_state dither[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS];
-	FLAC__byte * const start = data;
-	FLAC__int32 sample;
-	const FLAC__int32 *input_;
-	unsigned samples, channel;
+	/* 8-bit samples are written unsigned */
+	const FLAC__bool is_unsigned = (target_bps == 8);
 	const unsigned bytes_per_sample = target_bps / 8;
-	const unsigned incr = bytes_per_sample * channels;
 
 	FLAC__ASSERT(channels > 0 && channels <= FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS);
 	FLAC__ASSERT(source_bps < 32);
@@ -125,138 +129,38 @@ size_t FLAC__plugin_common__pack_pcm_signed_big_endian(FLAC__byte *data, const F
 	if(source_bps != target_bps) {
 		const FLAC__int32 MIN = -(1L << (source_bps - 1));
 		const FLAC__int32 MAX = ~MIN; /*(1L << (source_bps-1)) - 1 */
-
-		for(channel = 0; channel < channels; channel++) {
-			
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = linear_dither(source_bps, target_bps, *input_++, &dither[channel], MIN, MAX);
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 16:
-						data[0] = (FLAC__byte)(sample >> 8);
-						data[1] = (FLAC__byte)sample;
-						break;
-					case 24:
-						data[0] = (FLAC__byte)(sample >> 16);
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[2] = (FLAC__byte)sample;
-						break;
-				}
-
-				data += incr;
-			}
-		}
-	}
-	else {
-		for(channel = 0; channel < channels; channel++) {
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = *input_++;
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 16:
-						data[0] = (FLAC__byte)(sample >> 8);
-						data[1] = (FLAC__byte)sample;
-						break;
-					case 24:
-						data[0] = (FLAC__byte)(sample >> 16);
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[2] = (FLAC__byte)sample;
-						break;
-				}
-
-				data += incr;
+		FLAC__int32 dithered[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS][DITHER_CHUNK_SAMPLES];
+		const FLAC__int32 *dithered_[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS];
+		unsigned done, samples, sample, channel;
+
+		for(channel = 0; channel < channels; channel++)
+			dithered_[channel] = dithered[channel];
+
+		for(done = 0; done < wide_samples; done += samples) {
+			samples = min(wide_samples - done, DITHER_CHUNK_SAMPLES);
+			for(channel = 0; channel < channels; channel++) {
+				const FLAC__int32 *input_ = input[channel] + done;
+				for(sample = 0; sample < samples; sample++)
+					dithered[channel][sample] = linear_dither(source_bps, target_bps, input_[sample], &dither[channel], MIN, MAX);
 			}
+			data += pcm__pack_interleaved(data, dithered_, channels, samples, bytes_per_sample, /*shift=*/0, is_big_endian, is_unsigned);
 		}
+		return wide_samples * channels * bytes_per_sample;
 	}
-
-	return wide_samples * channels * (target_bps/8);
+	else
+		return pcm__pack_interleaved(data, input, channels, wide_samples, bytes_per_sample, /*shift=*/0, is_big_endian, is_unsigned);
 }
 
-size_t FLAC__plugin_common__pack_pcm_signed_little_endian(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps)
+size_t FLAC__plugin_common__pack_pcm_signed_big_endian(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps)
 {
 	static dither_state dither[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS];
-	FLAC__byte * const start = data;
-	FLAC__int32 sample;
-	const FLAC__int32 *input_;
-	unsigned samples, channel;
-	const unsigned bytes_per_sample = target_bps / 8;
-	const unsigned incr = bytes_per_sample * channels;
-
-	FLAC__ASSERT(channels > 0 && channels <= FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS);
-	FLAC__ASSERT(source_bps < 32);
-	FLAC__ASSERT(target_bps <= 24);
-	FLAC__ASSERT(target_bps <= source_bps);
-	FLAC__ASSERT((source_bps & 7) == 0);
-	FLAC__ASSERT((target_bps & 7) == 0);
 
-	if(source_bps != target_bps) {
-		const FLAC__int32 MIN = -(1L << (source_bps - 1));
-		const FLAC__int32 MAX = ~MIN; /*(1L << (source_bps-1)) - 1 */
+	return pack_pcm_signed_(data, input, wide_samples, channels, source_bps, target_bps, /*is_big_endian=*/true, dither);
+}
 
-		for(channel = 0; channel < channels; channel++) {
-			
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = linear_dither(source_bps, target_bps, *input_++, &dither[channel], MIN, MAX);
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 24:
-						data[2] = (FLAC__byte)(sample >> 16);
-						/* fall through */
-					case 16:
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[0] = (FLAC__byte)sample;
-				}
-
-				data += incr;
-			}
-		}
-	}
-	else {
-		for(channel = 0; channel < channels; channel++) {
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = *input_++;
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 24:
-						data[2] = (FLAC__byte)(sample >> 16);
-						/* fall through */
-					case 16:
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[0] = (FLAC__byte)sample;
-				}
-
-				data += incr;
-			}
-		}
-	}
+size_t FLAC__plugin_common__pack_pcm_signed_little_endian(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps)
+{
+	static dither_state dither[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS];
 
-	return wide_samples * channels * (target_bps/8);
+	return pack_pcm_signed_(data, input, wide_samples, channels, source_bps, target_bps, /*is_big_endian=*/false, dither);
 }
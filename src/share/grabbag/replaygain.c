@@ -49,7 +49,17 @@ static const char *reference_format_ = "%s=%2.1f dB";
 static const char *gain_format_ = "%s=%+2.2f dB";
 static const char *peak_format_ = "%s=%1.8f";
 
-static double album_peak_, title_peak_;
+/* using a small buffer improves data locality; we'd like it to fit easily in the dcache */
+#define REPLAYGAIN_BUFFER_SIZE 2048
+
+struct grabbag__ReplayGainContext {
+	ReplayGainContext *analysis;
+	double album_peak, title_peak;
+	Float_t lbuffer[REPLAYGAIN_BUFFER_SIZE], rbuffer[REPLAYGAIN_BUFFER_SIZE];
+};
+
+/* backs the context-less functions; 'analysis' is allocated on first init */
+static grabbag__ReplayGainContext default_context_;
 
 const unsigned GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED = 190;
 /*
@@ -141,15 +151,60 @@ FLAC__bool grabbag__replaygain_is_valid_sample_frequency(unsigned sample_frequen
 
 FLAC__bool grabbag__replaygain_init(unsigned sample_frequency)
 {
-	title_peak_ = album_peak_ = 0.0;
-	return InitGainAnalysis((long)sample_frequency) == INIT_GAIN_ANALYSIS_OK;
+	if(0 == default_context_.analysis && 0 == (default_context_.analysis = CreateGainAnalysis()))
+		return false;
+	return grabbag__replaygain_init_context(&default_context_, sample_frequency);
 }
 
 FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples)
 {
-	/* using a small buffer improves data locality; we'd like it to fit easily in the dcache */
-	static Float_t lbuffer[2048], rbuffer[2048];
-	static const unsigned nbuffer = sizeof(lbuffer) / sizeof(lbuffer[0]);
+	return grabbag__replaygain_analyze_context(&default_context_, input, is_stereo, bps, samples);
+}
+
+void grabbag__replaygain_get_album(float *gain, float *peak)
+{
+	grabbag__replaygain_get_album_context(&default_context_, gain, peak);
+}
+
+void grabbag__replaygain_get_title(float *gain, float *peak)
+{
+	grabbag__replaygain_get_title_context(&default_context_, gain, peak);
+}
+
+grabbag__ReplayGainContext *grabbag__replaygain_context_new(void)
+{
+	grabbag__ReplayGainContext *context = (grabbag__ReplayGainContext*)calloc(1, sizeof(grabbag__ReplayGainContext));
+
+	if(0 == context)
+		return 0;
+	if(0 == (context->analysis = CreateGainAnalysis())) {
+		free(context);
+		return 0;
+	}
+	return context;
+}
+
+void grabbag__replaygain_context_delete(grabbag__ReplayGainContext *context)
+{
+	if(0 == context)
+		return;
+	DestroyGainAnalysis(context->analysis);
+	free(context);
+}
+
+FLAC__bool grabbag__replaygain_init_context(grabbag__ReplayGainContext *context, unsigned sample_frequency)
+{
+	FLAC__ASSERT(0 != context);
+	FLAC__ASSERT(0 != context->analysis);
+
+	context->title_peak = context->album_peak = 0.0;
+	return InitGainAnalysisCtx(context->analysis, (long)sample_frequency) == INIT_GAIN_ANALYSIS_OK;
+}
+
+FLAC__bool grabbag__replaygain_analyze_context(grabbag__ReplayGainContext *context, const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples)
+{
+	Float_t *lbuffer = context->lbuffer, *rbuffer = context->rbuffer;
+	const unsigned nbuffer = REPLAYGAIN_BUFFER_SIZE;
 	FLAC__int32 block_peak = 0, s;
 	unsigned i, j;
 
@@ -179,7 +234,7 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 					block_peak = local_max(block_peak, s);
 				}
 				samples -= n;
-				if(AnalyzeSamples(lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
+				if(AnalyzeSamplesCtx(context->analysis, lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
 					return false;
 			}
 		}
@@ -194,7 +249,7 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 					block_peak = local_max(block_peak, s);
 				}
 				samples -= n;
-				if(AnalyzeSamples(lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
+				if(AnalyzeSamplesCtx(context->analysis, lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
 					return false;
 			}
 		}
@@ -222,7 +277,7 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 					block_peak = local_max(block_peak, s);
 				}
 				samples -= n;
-				if(AnalyzeSamples(lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
+				if(AnalyzeSamplesCtx(context->analysis, lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
 					return false;
 			}
 		}
@@ -237,7 +292,7 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 					block_peak = local_max(block_peak, s);
 				}
 				samples -= n;
-				if(AnalyzeSamples(lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
+				if(AnalyzeSamplesCtx(context->analysis, lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
 					return false;
 			}
 		}
@@ -246,27 +301,37 @@ FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__
 	{
 		const double peak_scale = (double)(1u << (bps - 1));
 		double peak = (double)block_peak / peak_scale;
-		if(peak > title_peak_)
-			title_peak_ = peak;
-		if(peak > album_peak_)
-			album_peak_ = peak;
+		if(peak > context->title_peak)
+			context->title_peak = peak;
+		if(peak > context->album_peak)
+			context->album_peak = peak;
 	}
 
 	return true;
 }
 
-void grabbag__replaygain_get_album(float *gain, float *peak)
+void grabbag__replaygain_get_album_context(grabbag__ReplayGainContext *context, float *gain, float *peak)
 {
-	*gain = (float)GetAlbumGain();
-	*peak = (float)album_peak_;
-	album_peak_ = 0.0;
+	*gain = (float)GetAlbumGainCtx(context->analysis);
+	*peak = (float)context->album_peak;
+	context->album_peak = 0.0;
 }
 
-void grabbag__replaygain_get_title(float *gain, float *peak)
+void grabbag__replaygain_get_title_context(grabbag__ReplayGainContext *context, float *gain, float *peak)
+{
+	*gain = (float)GetTitleGainCtx(context->analysis);
+	*peak = (float)context->title_peak;
+	context->title_peak = 0.0;
+}
+
+void grabbag__replaygain_merge_album(grabbag__ReplayGainContext *album, const grabbag__ReplayGainContext *track)
 {
-	*gain = (float)GetTitleGain();
-	*peak = (float)title_peak_;
-	title_peak_ = 0.0;
+	FLAC__ASSERT(0 != album);
+	FLAC__ASSERT(0 != track);
+
+	MergeGainAnalysis(album->analysis, track->analysis);
+	if(track->album_peak > album->album_peak)
+		album->album_peak = track->album_peak;
 }
 
 
@@ -275,6 +340,7 @@ typedef struct {
 	unsigned bits_per_sample;
 	unsigned sample_rate;
 	FLAC__bool error;
+	grabbag__ReplayGainContext *context;
 } DecoderInstance;
 
 static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
@@ -294,7 +360,7 @@ static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder
 		channels == instance->channels &&
 		sample_rate == instance->sample_rate
 	) {
-		instance->error = !grabbag__replaygain_analyze(buffer, channels==2, bits_per_sample, samples);
+		instance->error = !grabbag__replaygain_analyze_context(instance->context, buffer, channels==2, bits_per_sample, samples);
 	}
 	else {
 		instance->error = true;
@@ -339,6 +405,11 @@ static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 }
 
 const char *grabbag__replaygain_analyze_file(const char *filename, float *title_gain, float *title_peak)
+{
+	return grabbag__replaygain_analyze_file_context(&default_context_, filename, title_gain, title_peak);
+}
+
+const char *grabbag__replaygain_analyze_file_context(grabbag__ReplayGainContext *context, const char *filename, float *title_gain, float *title_peak)
 {
 	DecoderInstance instance;
 	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
@@ -347,6 +418,7 @@ const char *grabbag__replaygain_analyze_file(const char *filename, float *title_
 		return "memory allocation error";
 
 	instance.error = false;
+	instance.context = context;
 
 	/* It does these three by default but lets be explicit: */
 	FLAC__stream_decoder_set_md5_checking(decoder, false);
@@ -365,7 +437,7 @@ const char *grabbag__replaygain_analyze_file(const char *filename, float *title_
 
 	FLAC__stream_decoder_delete(decoder);
 
-	grabbag__replaygain_get_title(title_gain, title_peak);
+	grabbag__replaygain_get_title_context(context, title_gain, title_peak);
 
 	return 0;
 }
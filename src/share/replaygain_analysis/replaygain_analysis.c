@@ -74,6 +74,30 @@
  *    fprintf ("Recommended dB change for whole album: %+6.2f dB\n", GetAlbumGain() );
  */
 
+/*
+ *  The functions above all work on one hidden, static analysis state, so
+ *  only one song can be analyzed at a time.  Each of them has a twin
+ *  ending in "Ctx" that takes a ReplayGainContext* from
+ *  CreateGainAnalysis() instead, so songs can be analyzed side by side
+ *  (e.g. on several threads), one context per song:
+ *
+ *    album = CreateGainAnalysis ();
+ *    InitGainAnalysisCtx ( album, 44100 );
+ *    for each song, possibly in parallel {
+ *        ctx = CreateGainAnalysis ();
+ *        InitGainAnalysisCtx ( ctx, 44100 );
+ *        ... AnalyzeSamplesCtx ( ctx, ... ) ...
+ *        song_gain = GetTitleGainCtx ( ctx );
+ *        MergeGainAnalysis ( album, ctx );     (serialized by the caller)
+ *        DestroyGainAnalysis ( ctx );
+ *    }
+ *    album_gain = GetAlbumGainCtx ( album );
+ *
+ *  MergeGainAnalysis() adds the songs finished with GetTitleGainCtx() in
+ *  one context to the album of another, so the album gain comes out the
+ *  same as when all the songs go through one context, in any order.
+ */
+
 /*
  *  So here's the main source of potential code confusion:
  *
@@ -100,6 +124,18 @@
 
 #include "replaygain_analysis.h"
 
+/*
+ * SSE2 and NEON are part of the x86_64 and AArch64 baselines, so the
+ * vector filter needs no runtime check.
+ */
+#if !defined FLAC__NO_ASM && (defined __SSE2__ || defined _M_X64)
+#include <emmintrin.h>
+#define RG_SSE2
+#elif !defined FLAC__NO_ASM && defined __aarch64__ && defined __ARM_NEON
+#include <arm_neon.h>
+#define RG_NEON
+#endif
+
 Float_t ReplayGainReferenceLoudness = 89.0; /* in dB SPL */
 
 typedef unsigned short  Uint16_t;
@@ -130,31 +166,36 @@ typedef signed int      Int32_t;
 #define MAX_SAMPLES_PER_WINDOW  (size_t) (MAX_SAMP_FREQ * RMS_WINDOW_TIME / 1000 + 1)   /* max. Samples per Time slice */
 #define PINK_REF                64.82 /* 298640883795 */                          /* calibration value */
 
-static Float_t          linprebuf [MAX_ORDER * 2];
-static Float_t*         linpre;                                          /* left input samples, with pre-buffer */
-static Float_t          lstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static Float_t*         lstep;                                           /* left "first step" (i.e. post first filter) samples */
-static Float_t          loutbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static Float_t*         lout;                                            /* left "out" (i.e. post second filter) samples */
-static Float_t          rinprebuf [MAX_ORDER * 2];
-static Float_t*         rinpre;                                          /* right input samples ... */
-static Float_t          rstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static Float_t*         rstep;
-static Float_t          routbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-static Float_t*         rout;
-static unsigned int              sampleWindow;                           /* number of samples required to reach number of milliseconds required for RMS window */
-static unsigned long    totsamp;
-static double           lsum;
-static double           rsum;
-static int              freqindex;
+struct ReplayGainContext {
+    Float_t          linprebuf [MAX_ORDER * 2];
+    Float_t*         linpre;                                          /* left input samples, with pre-buffer */
+    Float_t          lstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    Float_t*         lstep;                                           /* left "first step" (i.e. post first filter) samples */
+    Float_t          loutbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    Float_t*         lout;                                            /* left "out" (i.e. post second filter) samples */
+    Float_t          rinprebuf [MAX_ORDER * 2];
+    Float_t*         rinpre;                                          /* right input samples ... */
+    Float_t          rstepbuf  [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    Float_t*         rstep;
+    Float_t          routbuf   [MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
+    Float_t*         rout;
+    unsigned int     sampleWindow;                                    /* number of samples required to reach number of milliseconds required for RMS window */
+    unsigned long    totsamp;
+    double           lsum;
+    double           rsum;
+    int              freqindex;
 #ifndef __sun
-static Uint32_t  A [(size_t)(STEPS_per_dB * MAX_dB)];
-static Uint32_t  B [(size_t)(STEPS_per_dB * MAX_dB)];
+    Uint32_t         A [(size_t)(STEPS_per_dB * MAX_dB)];
+    Uint32_t         B [(size_t)(STEPS_per_dB * MAX_dB)];
 #else
 /* [JEC] Solaris Forte compiler doesn't like float calc in array indices */
-static Uint32_t  A [12000];
-static Uint32_t  B [12000];
+    Uint32_t         A [12000];
+    Uint32_t         B [12000];
 #endif
+};
+
+/* the state used by the functions without a context argument */
+static ReplayGainContext  DefaultContext;
 
 /* for each filter:
    [0] 48 kHz, [1] 44.1 kHz, [2] 32 kHz, [3] 24 kHz, [4] 22050 Hz, [5] 16 kHz, [6] 12 kHz, [7] is 11025 Hz, [8] 8 kHz */
@@ -217,6 +258,7 @@ static const Float_t  BButter [9] [3] = {
 
 /* When calling this procedure, make sure that ip[-order] and op[-order] point to real data! */
 
+#if !defined RG_SSE2 && !defined RG_NEON
 static void
 filter ( const Float_t* input, Float_t* output, size_t nSamples, const Float_t* a, const Float_t* b, size_t order )
 {
@@ -232,63 +274,193 @@ filter ( const Float_t* input, Float_t* output, size_t nSamples, const Float_t*
     }
 }
 
+#else
+
+/*
+ * filter_stereo_yule() and filter_stereo_butter() do the same as calling
+ * filter() on the left and on the right channel, but with both channels
+ * running side by side in the two lanes of a vector, and with the last
+ * <order> inputs and outputs kept in registers rather than read back
+ * from memory.
+ *
+ * Each lane computes the same float terms as filter(), but adds them up
+ * from the oldest to the newest, so that only the very last addition
+ * has to wait for the previous output; in filter() the whole chain of
+ * additions does.  The terms are floats summed in a double, which is
+ * exact (so the order cannot matter) as long as they are within 2^29 of
+ * each other in magnitude; beyond that the output can only differ in
+ * the rare case that the sum lands on a float rounding boundary.
+ */
+
+#if defined RG_SSE2
+typedef __m128   Vec2f_t;   /* a left and a right Float_t, in the low two lanes */
+typedef __m128d  Vec2d_t;   /* a left and a right double */
+#define VEC_LOAD2(l, r)       _mm_unpacklo_ps ( _mm_load_ss ( l ), _mm_load_ss ( r ) )
+#define VEC_STORE2(l, r, v)   ( _mm_store_ss ( l, v ), _mm_store_ss ( r, _mm_shuffle_ps ( v, v, 1 ) ) )
+#define VEC_DUP(x)            _mm_set1_ps ( x )
+#define VEC_MUL(u, v)         _mm_mul_ps ( u, v )
+#define VEC_SUB(u, v)         _mm_sub_ps ( u, v )
+#define VEC_WIDEN(v)          _mm_cvtps_pd ( v )
+#define VEC_NARROW(d)         _mm_cvtpd_ps ( d )
+#define VEC_ADD_D(d, e)       _mm_add_pd ( d, e )
+#else
+/* the multiplies and subtracts are kept apart, as in filter(), rather than fused */
+typedef float32x2_t  Vec2f_t;
+typedef float64x2_t  Vec2d_t;
+#define VEC_LOAD2(l, r)       vset_lane_f32 ( *(r), vdup_n_f32 ( *(l) ), 1 )
+#define VEC_STORE2(l, r, v)   ( vst1_lane_f32 ( l, v, 0 ), vst1_lane_f32 ( r, v, 1 ) )
+#define VEC_DUP(x)            vdup_n_f32 ( x )
+#define VEC_MUL(u, v)         vmul_f32 ( u, v )
+#define VEC_SUB(u, v)         vsub_f32 ( u, v )
+#define VEC_WIDEN(v)          vcvt_f64_f32 ( v )
+#define VEC_NARROW(d)         vcvt_f32_f64 ( d )
+#define VEC_ADD_D(d, e)       vaddq_f64 ( d, e )
+#endif
+
+/* input[i-k]*b[k] - output[i-k]*a[k], added to acc */
+#define FILTER_TERM(k)        acc = VEC_ADD_D ( acc, VEC_WIDEN ( VEC_SUB ( VEC_MUL ( x##k, vb[k] ), VEC_MUL ( y##k, va[k] ) ) ) )
+#define FILTER_HISTORY(k)     ( x##k = VEC_LOAD2 ( linput - k, rinput - k ), y##k = VEC_LOAD2 ( loutput - k, routput - k ) )
+
+static void
+filter_stereo_yule ( const Float_t* linput, const Float_t* rinput, Float_t* loutput, Float_t* routput, size_t nSamples, const Float_t* a, const Float_t* b )
+{
+    Vec2f_t  x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10;   /* xk holds input[i-k] of both channels */
+    Vec2f_t  y0, y1, y2, y3, y4, y5, y6, y7, y8, y9, y10;   /* yk holds output[i-k] */
+    Vec2f_t  va [YULE_ORDER + 1];
+    Vec2f_t  vb [YULE_ORDER + 1];
+    Vec2d_t  acc;
+    size_t   i;
+
+    for ( i = 0; i <= YULE_ORDER; i++ ) {
+        va[i] = VEC_DUP ( a[i] );
+        vb[i] = VEC_DUP ( b[i] );
+    }
+    FILTER_HISTORY(1); FILTER_HISTORY(2); FILTER_HISTORY(3); FILTER_HISTORY(4); FILTER_HISTORY(5);
+    FILTER_HISTORY(6); FILTER_HISTORY(7); FILTER_HISTORY(8); FILTER_HISTORY(9); FILTER_HISTORY(10);
+
+    for ( i = 0; i < nSamples; i++ ) {
+        x0  = VEC_LOAD2 ( linput + i, rinput + i );
+        acc = VEC_WIDEN ( VEC_MUL ( x0, vb[0] ) );
+        FILTER_TERM(10); FILTER_TERM(9); FILTER_TERM(8); FILTER_TERM(7); FILTER_TERM(6);
+        FILTER_TERM(5);  FILTER_TERM(4); FILTER_TERM(3); FILTER_TERM(2); FILTER_TERM(1);
+        y0  = VEC_NARROW ( acc );
+        VEC_STORE2 ( loutput + i, routput + i, y0 );
+        x10 = x9; x9 = x8; x8 = x7; x7 = x6; x6 = x5; x5 = x4; x4 = x3; x3 = x2; x2 = x1; x1 = x0;
+        y10 = y9; y9 = y8; y8 = y7; y7 = y6; y6 = y5; y5 = y4; y4 = y3; y3 = y2; y2 = y1; y1 = y0;
+    }
+}
+
+static void
+filter_stereo_butter ( const Float_t* linput, const Float_t* rinput, Float_t* loutput, Float_t* routput, size_t nSamples, const Float_t* a, const Float_t* b )
+{
+    Vec2f_t  x0, x1, x2;
+    Vec2f_t  y0, y1, y2;
+    Vec2f_t  va [BUTTER_ORDER + 1];
+    Vec2f_t  vb [BUTTER_ORDER + 1];
+    Vec2d_t  acc;
+    size_t   i;
+
+    for ( i = 0; i <= BUTTER_ORDER; i++ ) {
+        va[i] = VEC_DUP ( a[i] );
+        vb[i] = VEC_DUP ( b[i] );
+    }
+    FILTER_HISTORY(1); FILTER_HISTORY(2);
+
+    for ( i = 0; i < nSamples; i++ ) {
+        x0  = VEC_LOAD2 ( linput + i, rinput + i );
+        acc = VEC_WIDEN ( VEC_MUL ( x0, vb[0] ) );
+        FILTER_TERM(2); FILTER_TERM(1);
+        y0  = VEC_NARROW ( acc );
+        VEC_STORE2 ( loutput + i, routput + i, y0 );
+        x2 = x1; x1 = x0;
+        y2 = y1; y1 = y0;
+    }
+}
+
+#endif
+
 /* returns a INIT_GAIN_ANALYSIS_OK if successful, INIT_GAIN_ANALYSIS_ERROR if not */
 
 int
-ResetSampleFrequency ( long samplefreq ) {
+ResetSampleFrequencyCtx ( ReplayGainContext* ctx, long samplefreq ) {
     int  i;
 
     /* zero out initial values */
     for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.;
+        ctx->linprebuf[i] = ctx->lstepbuf[i] = ctx->loutbuf[i] = ctx->rinprebuf[i] = ctx->rstepbuf[i] = ctx->routbuf[i] = 0.;
 
     switch ( (int)(samplefreq) ) {
-        case 48000: freqindex = 0; break;
-        case 44100: freqindex = 1; break;
-        case 32000: freqindex = 2; break;
-        case 24000: freqindex = 3; break;
-        case 22050: freqindex = 4; break;
-        case 16000: freqindex = 5; break;
-        case 12000: freqindex = 6; break;
-        case 11025: freqindex = 7; break;
-        case  8000: freqindex = 8; break;
+        case 48000: ctx->freqindex = 0; break;
+        case 44100: ctx->freqindex = 1; break;
+        case 32000: ctx->freqindex = 2; break;
+        case 24000: ctx->freqindex = 3; break;
+        case 22050: ctx->freqindex = 4; break;
+        case 16000: ctx->freqindex = 5; break;
+        case 12000: ctx->freqindex = 6; break;
+        case 11025: ctx->freqindex = 7; break;
+        case  8000: ctx->freqindex = 8; break;
         default:    return INIT_GAIN_ANALYSIS_ERROR;
     }
 
-    sampleWindow = (int) ceil ((double)samplefreq * (double)RMS_WINDOW_TIME / 1000.0);
+    ctx->sampleWindow = (int) ceil ((double)samplefreq * (double)RMS_WINDOW_TIME / 1000.0);
 
-    lsum         = 0.;
-    rsum         = 0.;
-    totsamp      = 0;
+    ctx->lsum         = 0.;
+    ctx->rsum         = 0.;
+    ctx->totsamp      = 0;
 
-    memset ( A, 0, sizeof(A) );
+    memset ( ctx->A, 0, sizeof(ctx->A) );
 
 	return INIT_GAIN_ANALYSIS_OK;
 }
 
 int
-InitGainAnalysis ( long samplefreq )
+ResetSampleFrequency ( long samplefreq ) {
+    return ResetSampleFrequencyCtx ( &DefaultContext, samplefreq );
+}
+
+int
+InitGainAnalysisCtx ( ReplayGainContext* ctx, long samplefreq )
 {
-	if (ResetSampleFrequency(samplefreq) != INIT_GAIN_ANALYSIS_OK) {
+	if (ResetSampleFrequencyCtx(ctx, samplefreq) != INIT_GAIN_ANALYSIS_OK) {
 		return INIT_GAIN_ANALYSIS_ERROR;
 	}
 
-    linpre       = linprebuf + MAX_ORDER;
-    rinpre       = rinprebuf + MAX_ORDER;
-    lstep        = lstepbuf  + MAX_ORDER;
-    rstep        = rstepbuf  + MAX_ORDER;
-    lout         = loutbuf   + MAX_ORDER;
-    rout         = routbuf   + MAX_ORDER;
+    ctx->linpre       = ctx->linprebuf + MAX_ORDER;
+    ctx->rinpre       = ctx->rinprebuf + MAX_ORDER;
+    ctx->lstep        = ctx->lstepbuf  + MAX_ORDER;
+    ctx->rstep        = ctx->rstepbuf  + MAX_ORDER;
+    ctx->lout         = ctx->loutbuf   + MAX_ORDER;
+    ctx->rout         = ctx->routbuf   + MAX_ORDER;
 
-    memset ( B, 0, sizeof(B) );
+    memset ( ctx->B, 0, sizeof(ctx->B) );
 
     return INIT_GAIN_ANALYSIS_OK;
 }
 
+int
+InitGainAnalysis ( long samplefreq )
+{
+    return InitGainAnalysisCtx ( &DefaultContext, samplefreq );
+}
+
+/* returns NULL if out of memory */
+
+ReplayGainContext*
+CreateGainAnalysis ( void )
+{
+    return (ReplayGainContext*) calloc ( 1, sizeof(ReplayGainContext) );
+}
+
+void
+DestroyGainAnalysis ( ReplayGainContext* ctx )
+{
+    free ( ctx );
+}
+
 /* returns GAIN_ANALYSIS_OK if successful, GAIN_ANALYSIS_ERROR if not */
 
 int
-AnalyzeSamples ( const Float_t* left_samples, const Float_t* right_samples, size_t num_samples, int num_channels )
+AnalyzeSamplesCtx ( ReplayGainContext* ctx, const Float_t* left_samples, const Float_t* right_samples, size_t num_samples, int num_channels )
 {
     const Float_t*  curleft;
     const Float_t*  curright;
@@ -310,19 +482,19 @@ AnalyzeSamples ( const Float_t* left_samples, const Float_t* right_samples, size
     }
 
     if ( num_samples < MAX_ORDER ) {
-        memcpy ( linprebuf + MAX_ORDER, left_samples , num_samples * sizeof(Float_t) );
-        memcpy ( rinprebuf + MAX_ORDER, right_samples, num_samples * sizeof(Float_t) );
+        memcpy ( ctx->linprebuf + MAX_ORDER, left_samples , num_samples * sizeof(Float_t) );
+        memcpy ( ctx->rinprebuf + MAX_ORDER, right_samples, num_samples * sizeof(Float_t) );
     }
     else {
-        memcpy ( linprebuf + MAX_ORDER, left_samples,  MAX_ORDER   * sizeof(Float_t) );
-        memcpy ( rinprebuf + MAX_ORDER, right_samples, MAX_ORDER   * sizeof(Float_t) );
+        memcpy ( ctx->linprebuf + MAX_ORDER, left_samples,  MAX_ORDER   * sizeof(Float_t) );
+        memcpy ( ctx->rinprebuf + MAX_ORDER, right_samples, MAX_ORDER   * sizeof(Float_t) );
     }
 
     while ( batchsamples > 0 ) {
-        cursamples = batchsamples > (long)(sampleWindow-totsamp)  ?  (long)(sampleWindow - totsamp)  :  batchsamples;
+        cursamples = batchsamples > (long)(ctx->sampleWindow-ctx->totsamp)  ?  (long)(ctx->sampleWindow - ctx->totsamp)  :  batchsamples;
         if ( cursamplepos < MAX_ORDER ) {
-            curleft  = linpre+cursamplepos;
-            curright = rinpre+cursamplepos;
+            curleft  = ctx->linpre+cursamplepos;
+            curright = ctx->rinpre+cursamplepos;
             if (cursamples > MAX_ORDER - cursamplepos )
                 cursamples = MAX_ORDER - cursamplepos;
         }
@@ -331,53 +503,64 @@ AnalyzeSamples ( const Float_t* left_samples, const Float_t* right_samples, size
             curright = right_samples + cursamplepos;
         }
 
-        filter ( curleft , lstep + totsamp, cursamples, AYule[freqindex], BYule[freqindex], YULE_ORDER );
-        filter ( curright, rstep + totsamp, cursamples, AYule[freqindex], BYule[freqindex], YULE_ORDER );
+#if defined RG_SSE2 || defined RG_NEON
+        filter_stereo_yule   ( curleft, curright, ctx->lstep + ctx->totsamp, ctx->rstep + ctx->totsamp, cursamples, AYule[ctx->freqindex], BYule[ctx->freqindex] );
+        filter_stereo_butter ( ctx->lstep + ctx->totsamp, ctx->rstep + ctx->totsamp, ctx->lout + ctx->totsamp, ctx->rout + ctx->totsamp, cursamples, AButter[ctx->freqindex], BButter[ctx->freqindex] );
+#else
+        filter ( curleft , ctx->lstep + ctx->totsamp, cursamples, AYule[ctx->freqindex], BYule[ctx->freqindex], YULE_ORDER );
+        filter ( curright, ctx->rstep + ctx->totsamp, cursamples, AYule[ctx->freqindex], BYule[ctx->freqindex], YULE_ORDER );
 
-        filter ( lstep + totsamp, lout + totsamp, cursamples, AButter[freqindex], BButter[freqindex], BUTTER_ORDER );
-        filter ( rstep + totsamp, rout + totsamp, cursamples, AButter[freqindex], BButter[freqindex], BUTTER_ORDER );
+        filter ( ctx->lstep + ctx->totsamp, ctx->lout + ctx->totsamp, cursamples, AButter[ctx->freqindex], BButter[ctx->freqindex], BUTTER_ORDER );
+        filter ( ctx->rstep + ctx->totsamp, ctx->rout + ctx->totsamp, cursamples, AButter[ctx->freqindex], BButter[ctx->freqindex], BUTTER_ORDER );
+#endif
 
         for ( i = 0; i < cursamples; i++ ) {             /* Get the squared values */
-            lsum += lout [totsamp+i] * lout [totsamp+i];
-            rsum += rout [totsamp+i] * rout [totsamp+i];
+            ctx->lsum += ctx->lout [ctx->totsamp+i] * ctx->lout [ctx->totsamp+i];
+            ctx->rsum += ctx->rout [ctx->totsamp+i] * ctx->rout [ctx->totsamp+i];
         }
 
         batchsamples -= cursamples;
         cursamplepos += cursamples;
-        totsamp      += cursamples;
-        if ( totsamp == sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
-            double  val  = STEPS_per_dB * 10. * log10 ( (lsum+rsum) / totsamp * 0.5 + 1.e-37 );
+        ctx->totsamp += cursamples;
+        if ( ctx->totsamp == ctx->sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
+            double  val  = STEPS_per_dB * 10. * log10 ( (ctx->lsum+ctx->rsum) / ctx->totsamp * 0.5 + 1.e-37 );
             int     ival = (int) val;
             if ( ival <                     0 ) ival = 0;
-            if ( ival >= (int)(sizeof(A)/sizeof(*A)) ) ival = (int)(sizeof(A)/sizeof(*A)) - 1;
-            A [ival]++;
-            lsum = rsum = 0.;
-            memmove ( loutbuf , loutbuf  + totsamp, MAX_ORDER * sizeof(Float_t) );
-            memmove ( routbuf , routbuf  + totsamp, MAX_ORDER * sizeof(Float_t) );
-            memmove ( lstepbuf, lstepbuf + totsamp, MAX_ORDER * sizeof(Float_t) );
-            memmove ( rstepbuf, rstepbuf + totsamp, MAX_ORDER * sizeof(Float_t) );
-            totsamp = 0;
+            if ( ival >= (int)(sizeof(ctx->A)/sizeof(*ctx->A)) ) ival = (int)(sizeof(ctx->A)/sizeof(*ctx->A)) - 1;
+            ctx->A [ival]++;
+            ctx->lsum = ctx->rsum = 0.;
+            memmove ( ctx->loutbuf , ctx->loutbuf  + ctx->totsamp, MAX_ORDER * sizeof(Float_t) );
+            memmove ( ctx->routbuf , ctx->routbuf  + ctx->totsamp, MAX_ORDER * sizeof(Float_t) );
+            memmove ( ctx->lstepbuf, ctx->lstepbuf + ctx->totsamp, MAX_ORDER * sizeof(Float_t) );
+            memmove ( ctx->rstepbuf, ctx->rstepbuf + ctx->totsamp, MAX_ORDER * sizeof(Float_t) );
+            ctx->totsamp = 0;
         }
-        if ( totsamp > sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
+        if ( ctx->totsamp > ctx->sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
             return GAIN_ANALYSIS_ERROR;
     }
     if ( num_samples < MAX_ORDER ) {
-        memmove ( linprebuf,                           linprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(Float_t) );
-        memmove ( rinprebuf,                           rinprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(Float_t) );
-        memcpy  ( linprebuf + MAX_ORDER - num_samples, left_samples,          num_samples             * sizeof(Float_t) );
-        memcpy  ( rinprebuf + MAX_ORDER - num_samples, right_samples,         num_samples             * sizeof(Float_t) );
+        memmove ( ctx->linprebuf,                           ctx->linprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(Float_t) );
+        memmove ( ctx->rinprebuf,                           ctx->rinprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(Float_t) );
+        memcpy  ( ctx->linprebuf + MAX_ORDER - num_samples, left_samples,               num_samples             * sizeof(Float_t) );
+        memcpy  ( ctx->rinprebuf + MAX_ORDER - num_samples, right_samples,              num_samples             * sizeof(Float_t) );
     }
     else {
-        memcpy  ( linprebuf, left_samples  + num_samples - MAX_ORDER, MAX_ORDER * sizeof(Float_t) );
-        memcpy  ( rinprebuf, right_samples + num_samples - MAX_ORDER, MAX_ORDER * sizeof(Float_t) );
+        memcpy  ( ctx->linprebuf, left_samples  + num_samples - MAX_ORDER, MAX_ORDER * sizeof(Float_t) );
+        memcpy  ( ctx->rinprebuf, right_samples + num_samples - MAX_ORDER, MAX_ORDER * sizeof(Float_t) );
     }
 
     return GAIN_ANALYSIS_OK;
 }
 
+int
+AnalyzeSamples ( const Float_t* left_samples, const Float_t* right_samples, size_t num_samples, int num_channels )
+{
+    return AnalyzeSamplesCtx ( &DefaultContext, left_samples, right_samples, num_samples, num_channels );
+}
+
 
 static Float_t
-analyzeResult ( Uint32_t* Array, size_t len )
+analyzeResult ( const Uint32_t* Array, size_t len )
 {
     Uint32_t  elems;
     Int32_t   upper;
@@ -400,31 +583,53 @@ analyzeResult ( Uint32_t* Array, size_t len )
 
 
 Float_t
-GetTitleGain ( void )
+GetTitleGainCtx ( ReplayGainContext* ctx )
 {
     Float_t  retval;
     unsigned int    i;
 
-    retval = analyzeResult ( A, sizeof(A)/sizeof(*A) );
+    retval = analyzeResult ( ctx->A, sizeof(ctx->A)/sizeof(*ctx->A) );
 
-    for ( i = 0; i < sizeof(A)/sizeof(*A); i++ ) {
-        B[i] += A[i];
-        A[i]  = 0;
+    for ( i = 0; i < sizeof(ctx->A)/sizeof(*ctx->A); i++ ) {
+        ctx->B[i] += ctx->A[i];
+        ctx->A[i]  = 0;
     }
 
     for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.f;
+        ctx->linprebuf[i] = ctx->lstepbuf[i] = ctx->loutbuf[i] = ctx->rinprebuf[i] = ctx->rstepbuf[i] = ctx->routbuf[i] = 0.f;
 
-    totsamp = 0;
-    lsum    = rsum = 0.;
+    ctx->totsamp = 0;
+    ctx->lsum    = ctx->rsum = 0.;
     return retval;
 }
 
+Float_t
+GetTitleGain ( void )
+{
+    return GetTitleGainCtx ( &DefaultContext );
+}
+
+
+Float_t
+GetAlbumGainCtx ( const ReplayGainContext* ctx )
+{
+    return analyzeResult ( ctx->B, sizeof(ctx->B)/sizeof(*ctx->B) );
+}
 
 Float_t
 GetAlbumGain ( void )
 {
-    return analyzeResult ( B, sizeof(B)/sizeof(*B) );
+    return GetAlbumGainCtx ( &DefaultContext );
+}
+
+
+void
+MergeGainAnalysis ( ReplayGainContext* album, const ReplayGainContext* songs )
+{
+    unsigned int    i;
+
+    for ( i = 0; i < sizeof(album->B)/sizeof(*album->B); i++ )
+        album->B[i] += songs->B[i];
 }
 
 /* end of replaygain_analysis.c */
@@ -39,7 +39,7 @@
 #endif
 #include "decoders.h"
 #include "FLAC/assert.h"
-#include "FLAC/metadata.h" // for ::FLAC__metadata_object_is_equal()
+#include "FLAC/metadata.h" // for ::FLAC__metadata_object_is_equal(), ::FLAC__metadata_object_delete()
 #include "FLAC++/decoder.h"
 #include "share/grabbag.h"
 extern "C" {
@@ -56,14 +56,16 @@ typedef enum {
 	LAYER_STREAM = 0, /* FLAC__stream_decoder_init_stream() without seeking */
 	LAYER_SEEKABLE_STREAM, /* FLAC__stream_decoder_init_stream() with seeking */
 	LAYER_FILE, /* FLAC__stream_decoder_init_FILE() */
-	LAYER_FILENAME /* FLAC__stream_decoder_init_file() */
+	LAYER_FILENAME, /* FLAC__stream_decoder_init_file() */
+	LAYER_MMAP /* FLAC__stream_decoder_init_mmap() */
 } Layer;
 
 static const char * const LayerString[] = {
 	"Stream",
 	"Seekable Stream",
 	"FILE*",
-	"Filename"
+	"Filename",
+	"Memory-mapped filename"
 };
 
 static ::FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, application2_, vorbiscomment_, cuesheet_, picture_, unknown_;
@@ -352,6 +354,7 @@ bool StreamDecoder::test_respond(bool is_ogg)
 class FileDecoder : public FLAC::Decoder::File, public DecoderCommon {
 public:
 	FileDecoder(Layer layer): FLAC::Decoder::File(), DecoderCommon(layer) { }
+	FileDecoder(Layer layer, FLAC::Decoder::Pool &pool): FLAC::Decoder::File(pool), DecoderCommon(layer) { }
 	~FileDecoder() { }
 
 	// from FLAC::Decoder::Stream
@@ -406,6 +409,10 @@ bool FileDecoder::test_respond(bool is_ogg)
 			printf("testing init%s()... ", is_ogg? "_ogg":"");
 			init_status = is_ogg? init_ogg(flacfilename(is_ogg)) : init(flacfilename(is_ogg));
 			break;
+		case LAYER_MMAP:
+			printf("testing init%s_mmap()... ", is_ogg? "_ogg":"");
+			init_status = is_ogg? init_ogg_mmap(flacfilename(is_ogg)) : init_mmap(flacfilename(is_ogg));
+			break;
 		default:
 			die_("internal error 001");
 			return false;
@@ -444,13 +451,17 @@ static FLAC::Decoder::Stream *new_by_layer(Layer layer)
 		return new FileDecoder(layer);
 }
 
-static bool test_stream_decoder(Layer layer, bool is_ogg)
+// With extras the decoder also runs on two threads with a pipeline
+// depth of four (if the build has them) and builds a frame index.
+static bool test_stream_decoder(Layer layer, bool is_ogg, bool extras)
 {
 	FLAC::Decoder::Stream *decoder;
 	::FLAC__StreamDecoderInitStatus init_status;
 	bool expect;
+	::FLAC__StreamMetadata *frame_index = 0;
+	unsigned num_threads = 1, pipeline_depth = 1;
 
-	printf("\n+++ libFLAC++ unit test: FLAC::Decoder::%s (layer: %s, format: %s)\n\n", layer<LAYER_FILE? "Stream":"File", LayerString[layer], is_ogg? "Ogg FLAC" : "FLAC");
+	printf("\n+++ libFLAC++ unit test: FLAC::Decoder::%s (layer: %s, format: %s%s)\n\n", layer<LAYER_FILE? "Stream":"File", LayerString[layer], is_ogg? "Ogg FLAC" : "FLAC", extras? ", threads, pipelining, frame indexing" : "");
 
 	//
 	// test new -> delete
@@ -509,6 +520,11 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_ogg(flacfilename(is_ogg)) :
 				dynamic_cast<FLAC::Decoder::File*>(decoder)->init(flacfilename(is_ogg));
 			break;
+		case LAYER_MMAP:
+			init_status = is_ogg?
+				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_ogg_mmap(flacfilename(is_ogg)) :
+				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_mmap(flacfilename(is_ogg));
+			break;
 		default:
 			die_("internal error 006");
 			return false;
@@ -554,6 +570,31 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		return false;
 	}
 
+	if(extras) {
+		printf("testing set_num_threads()... ");
+		if(decoder->set_num_threads(0))
+			return die_s_("returned true for 0 threads", decoder);
+		/* not all builds support multithreading */
+		num_threads = decoder->set_num_threads(2)? 2 : 1;
+		if(num_threads == 1 && !decoder->set_num_threads(1))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		printf("testing set_pipeline_depth()... ");
+		if(decoder->set_pipeline_depth(0))
+			return die_s_("returned true for a depth of 0", decoder);
+		/* not all builds support pipelining */
+		pipeline_depth = decoder->set_pipeline_depth(4)? 4 : 1;
+		if(pipeline_depth == 1 && !decoder->set_pipeline_depth(1))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		printf("testing set_frame_indexing()... ");
+		if(!decoder->set_frame_indexing(true))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+	}
+
 	switch(layer) {
 		case LAYER_STREAM:
 		case LAYER_SEEKABLE_STREAM:
@@ -590,6 +631,12 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_ogg(flacfilename(is_ogg)) :
 				dynamic_cast<FLAC::Decoder::File*>(decoder)->init(flacfilename(is_ogg));
 			break;
+		case LAYER_MMAP:
+			printf("testing init%s_mmap()... ", is_ogg? "_ogg":"");
+			init_status = is_ogg?
+				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_ogg_mmap(flacfilename(is_ogg)) :
+				dynamic_cast<FLAC::Decoder::File*>(decoder)->init_mmap(flacfilename(is_ogg));
+			break;
 		default:
 			die_("internal error 009");
 			return false;
@@ -613,6 +660,29 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing get_num_threads()... ");
+		if(decoder->get_num_threads() != num_threads) {
+			printf("FAILED, expected %u, got %u\n", num_threads, decoder->get_num_threads());
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing get_pipeline_depth()... ");
+		if(decoder->get_pipeline_depth() != pipeline_depth) {
+			printf("FAILED, expected %u, got %u\n", pipeline_depth, decoder->get_pipeline_depth());
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing get_frame_indexing()... ");
+		if(!decoder->get_frame_indexing()) {
+			printf("FAILED, returned false, expected true\n");
+			return false;
+		}
+		printf("OK\n");
+	}
+
 	printf("testing process_until_end_of_metadata()... ");
 	if(!decoder->process_until_end_of_metadata())
 		return die_s_("returned false", decoder);
@@ -653,12 +723,109 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		// there is no tell callback for LAYER_STREAM, and Ogg FLAC is not indexed
+		printf("testing get_frame_index()... ");
+		if(!decoder->get_frame_index(&frame_index))
+			return die_s_("returned false", decoder);
+		if((frame_index->data.seek_table.num_points > 0) != (layer != LAYER_STREAM && !is_ogg)) {
+			printf("FAILED, got %u frames\n", frame_index->data.seek_table.num_points);
+			return false;
+		}
+		printf("OK\n");
+	}
+
+	expect = (layer != LAYER_STREAM);
+	printf("testing process_range()... ");
+	{
+		// the test file holds sample n = n & 7
+		FLAC__int32 samples[1000];
+		bool md5_checked;
+		unsigned i;
+		if(decoder->process_range(1000, 1999, samples, &md5_checked) != expect)
+			return die_s_(expect? "returned false" : "returned true", decoder);
+		if(expect) {
+			for(i = 0; i < 1000; i++) {
+				if(samples[i] != (FLAC__int32)((1000 + i) & 7)) {
+					printf("FAILED, sample #%u is wrong\n", i);
+					return false;
+				}
+			}
+			if(md5_checked) {
+				printf("FAILED, claims to be MD5-checked\n");
+				return false;
+			}
+		}
+	}
+	printf("OK\n");
+
+	if(layer != LAYER_STREAM) {
+		printf("testing read_samples_interleaved()... ");
+		// the range ended in the frame holding 1728..2303, so reading goes on from 2304
+		FLAC__int32 samples[1000];
+		FLAC__int16 samples16[1000];
+		const unsigned shift = 16 - streaminfo_.data.stream_info.bits_per_sample;
+		unsigned samples_read, i;
+		if(!decoder->read_samples_interleaved(samples, 1000, &samples_read))
+			return die_s_("returned false", decoder);
+		if(samples_read == 1000 && !decoder->read_samples_interleaved(samples16, 1000, &samples_read))
+			return die_s_("returned false", decoder);
+		if(samples_read != 1000) {
+			printf("FAILED, read %u samples\n", samples_read);
+			return false;
+		}
+		for(i = 0; i < 1000; i++) {
+			if(samples[i] != (FLAC__int32)((2304 + i) & 7) || samples16[i] != (FLAC__int16)(((3304 + i) & 7) << shift)) {
+				printf("FAILED, sample #%u is wrong\n", i);
+				return false;
+			}
+		}
+		printf("OK\n");
+	}
+
 	expect = (layer != LAYER_STREAM);
 	printf("testing seek_absolute()... ");
 	if(decoder->seek_absolute(0) != expect)
 		return die_s_(expect? "returned false" : "returned true", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		// the seek has left the decoder just past the first frame
+		expect = (layer != LAYER_STREAM && !is_ogg);
+		printf("testing scan_frames()... ");
+		{
+			::FLAC__StreamMetadata *scan_index;
+			if(decoder->scan_frames(&scan_index) != expect)
+				return die_s_(expect? "returned false" : "returned true", decoder);
+			if(expect) {
+				const ::FLAC__StreamMetadata_SeekTable *frames = &scan_index->data.seek_table;
+				unsigned i;
+				if(frames->num_points == 0 || frames->points[0].sample_number == 0) {
+					printf("FAILED, index does not start with the second frame\n");
+					return false;
+				}
+				for(i = 1; i < frames->num_points; i++) {
+					if(frames->points[i].sample_number != frames->points[i-1].sample_number + frames->points[i-1].frame_samples) {
+						printf("FAILED, frame #%u does not follow the one before it\n", i);
+						return false;
+					}
+				}
+				if(streaminfo_.data.stream_info.total_samples && frames->points[i-1].sample_number + frames->points[i-1].frame_samples != streaminfo_.data.stream_info.total_samples) {
+					printf("FAILED, index does not end with the last frame\n");
+					return false;
+				}
+				// the index built while decoding has the first frame too
+				if(frame_index->data.seek_table.num_points != frames->num_points + 1) {
+					printf("FAILED, index does not match the one built while decoding\n");
+					return false;
+				}
+				::FLAC__metadata_object_delete(scan_index);
+			}
+			::FLAC__metadata_object_delete(frame_index);
+		}
+		printf("OK\n");
+	}
+
 	printf("testing get_channels()... ");
 	{
 		unsigned channels = decoder->get_channels();
@@ -1151,6 +1318,66 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 	return true;
 }
 
+static bool test_decoder_pool(bool is_ogg)
+{
+	FLAC::Decoder::Pool pool(/*max_idle=*/1);
+
+	printf("\n+++ libFLAC++ unit test: FLAC::Decoder::Pool (format: %s)\n\n", is_ogg? "Ogg FLAC" : "FLAC");
+
+	num_expected_ = 0;
+	expected_metadata_sequence_[num_expected_++] = &streaminfo_;
+
+	for(unsigned i = 0; i < 3; i++) {
+		printf("allocating decoder instance from the pool... ");
+		FileDecoder *decoder = new FileDecoder(LAYER_FILENAME, pool);
+		if(0 == decoder) {
+			printf("FAILED, new returned NULL\n");
+			return false;
+		}
+		if(!decoder->is_valid()) {
+			printf("FAILED, returned false\n");
+			return false;
+		}
+		if(pool.get_num_idle() != 0) {
+			printf("FAILED, pool still has %u idle decoder(s)\n", pool.get_num_idle());
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing init%s()... ", is_ogg? "_ogg":"");
+		if((is_ogg? decoder->init_ogg(flacfilename(is_ogg)) : decoder->init(flacfilename(is_ogg))) != ::FLAC__STREAM_DECODER_INIT_STATUS_OK)
+			return die_s_(0, decoder);
+		printf("OK\n");
+
+		decoder->current_metadata_number_ = 0;
+
+		printf("testing process_until_end_of_stream()... ");
+		if(!decoder->process_until_end_of_stream())
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		// the pool recycles the decoder itself, but it does no harm to do it first
+		if(i == 1) {
+			printf("testing recycle()... ");
+			if(!decoder->recycle())
+				return die_s_("returned false", decoder);
+			printf("OK\n");
+		}
+
+		printf("freeing decoder instance back to the pool... ");
+		delete decoder;
+		if(pool.get_num_idle() != 1) {
+			printf("FAILED, pool has %u idle decoder(s), expected 1\n", pool.get_num_idle());
+			return false;
+		}
+		printf("OK\n");
+	}
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
 bool test_decoders()
 {
 	FLAC__bool is_ogg = false;
@@ -1161,16 +1388,25 @@ bool test_decoders()
 		if(!generate_file_(is_ogg))
 			return false;
 
-		if(!test_stream_decoder(LAYER_STREAM, is_ogg))
-			return false;
+		// the second pass runs with the extras
+		for(unsigned pass = 0; pass < 2; pass++) {
+			if(!test_stream_decoder(LAYER_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_decoder(LAYER_SEEKABLE_STREAM, is_ogg))
-			return false;
+			if(!test_stream_decoder(LAYER_SEEKABLE_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_decoder(LAYER_FILE, is_ogg))
-			return false;
+			if(!test_stream_decoder(LAYER_FILE, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_FILENAME, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_MMAP, is_ogg, /*extras=*/pass == 1))
+				return false;
+		}
 
-		if(!test_stream_decoder(LAYER_FILENAME, is_ogg))
+		if(!test_decoder_pool(is_ogg))
 			return false;
 
 		(void) grabbag__file_remove_file(flacfilename(is_ogg));
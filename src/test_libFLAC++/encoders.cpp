@@ -18,6 +18,7 @@
 
 #include "encoders.h"
 #include "FLAC/assert.h"
+#include "FLAC/metadata.h" // for ::FLAC__metadata_object_delete()
 #include "FLAC++/encoder.h"
 #include "share/grabbag.h"
 extern "C" {
@@ -179,16 +180,21 @@ static FLAC::Encoder::Stream *new_by_layer(Layer layer)
 		return new FileEncoder(layer);
 }
 
-static bool test_stream_encoder(Layer layer, bool is_ogg)
+static void *workspace_ = 0;
+
+// With extras the encoder also runs on two threads (if the build has
+// them), in a workspace set by the caller and with frame indexing.
+static bool test_stream_encoder_(Layer layer, bool is_ogg, bool extras)
 {
 	FLAC::Encoder::Stream *encoder;
 	::FLAC__StreamEncoderInitStatus init_status;
 	FILE *file = 0;
 	FLAC__int32 samples[1024];
 	FLAC__int32 *samples_array[1] = { samples };
-	unsigned i;
+	unsigned i, num_threads = 1;
+	size_t workspace_size;
 
-	printf("\n+++ libFLAC++ unit test: FLAC::Encoder::%s (layer: %s, format: %s)\n\n", layer<LAYER_FILE? "Stream":"File", LayerString[layer], is_ogg? "Ogg FLAC":"FLAC");
+	printf("\n+++ libFLAC++ unit test: FLAC::Encoder::%s (layer: %s, format: %s%s)\n\n", layer<LAYER_FILE? "Stream":"File", LayerString[layer], is_ogg? "Ogg FLAC":"FLAC", extras? ", threads, workspace, frame indexing":"");
 
 	printf("allocating encoder instance... ");
 	encoder = new_by_layer(layer);
@@ -247,6 +253,11 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing set_variable_blocksize()... ");
+	if(!encoder->set_variable_blocksize(false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing set_do_mid_side_stereo()... ");
 	if(!encoder->set_do_mid_side_stereo(false))
 		return die_s_("returned false", encoder);
@@ -257,6 +268,11 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing set_fast_mid_side_stereo()... ");
+	if(!encoder->set_fast_mid_side_stereo(false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing set_max_lpc_order()... ");
 	if(!encoder->set_max_lpc_order(0))
 		return die_s_("returned false", encoder);
@@ -302,11 +318,43 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing set_num_threads()... ");
+		if(encoder->set_num_threads(0))
+			return die_s_("returned true for 0 threads", encoder);
+		/* not all builds support multithreading */
+		num_threads = encoder->set_num_threads(2)? 2 : 1;
+		if(num_threads == 1 && !encoder->set_num_threads(1))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+	}
+
 	printf("testing set_metadata()... ");
 	if(!encoder->set_metadata(metadata_sequence_, num_metadata_))
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing get_workspace_size()... ");
+		if(0 == (workspace_size = encoder->get_workspace_size()))
+			return die_s_("returned 0", encoder);
+		printf("OK\n");
+
+		printf("testing set_workspace()... ");
+		if(0 == (workspace_ = malloc(workspace_size))) {
+			printf("ERROR (malloc failed)\n");
+			return false;
+		}
+		if(!encoder->set_workspace(workspace_, workspace_size))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+
+		printf("testing set_frame_indexing()... ");
+		if(!encoder->set_frame_indexing(true))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+	}
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening file for FLAC output... ");
 		file = ::fopen(flacfilename(is_ogg), "w+b");
@@ -394,6 +442,13 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_fast_mid_side_stereo()... ");
+	if(encoder->get_fast_mid_side_stereo() != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing get_channels()... ");
 	if(encoder->get_channels() != streaminfo_.data.stream_info.channels) {
 		printf("FAILED, expected %u, got %u\n", streaminfo_.data.stream_info.channels, encoder->get_channels());
@@ -422,6 +477,13 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_variable_blocksize()... ");
+	if(encoder->get_variable_blocksize() != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing get_max_lpc_order()... ");
 	if(encoder->get_max_lpc_order() != 0) {
 		printf("FAILED, expected %u, got %u\n", 0, encoder->get_max_lpc_order());
@@ -487,6 +549,22 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing get_num_threads()... ");
+		if(encoder->get_num_threads() != num_threads) {
+			printf("FAILED, expected %u, got %u\n", num_threads, encoder->get_num_threads());
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing get_frame_indexing()... ");
+		if(!encoder->get_frame_indexing()) {
+			printf("FAILED, returned false, expected true\n");
+			return false;
+		}
+		printf("OK\n");
+	}
+
 	/* init the dummy sample buffer */
 	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
 		samples[i] = i & 7;
@@ -512,6 +590,22 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	if(layer < LAYER_FILE)
 		::fclose(dynamic_cast<StreamEncoder*>(encoder)->file_);
 
+	if(extras) {
+		// Ogg FLAC is not indexed
+		printf("testing get_frame_index()... ");
+		{
+			::FLAC__StreamMetadata *frame_index;
+			if(!encoder->get_frame_index(&frame_index))
+				return die_s_("returned false", encoder);
+			if((frame_index->data.seek_table.num_points > 0) == is_ogg) {
+				printf("FAILED, got %u frames\n", frame_index->data.seek_table.num_points);
+				return false;
+			}
+			::FLAC__metadata_object_delete(frame_index);
+		}
+		printf("OK\n");
+	}
+
 	printf("freeing encoder instance... ");
 	delete encoder;
 	printf("OK\n");
@@ -521,6 +615,15 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	return true;
 }
 
+static bool test_stream_encoder(Layer layer, bool is_ogg, bool extras)
+{
+	// freed here so the early returns in the test don't leak it
+	const bool ok = test_stream_encoder_(layer, is_ogg, extras);
+	free(workspace_);
+	workspace_ = 0;
+	return ok;
+}
+
 bool test_encoders()
 {
 	FLAC__bool is_ogg = false;
@@ -528,17 +631,20 @@ bool test_encoders()
 	while(1) {
 		init_metadata_blocks_();
 
-		if(!test_stream_encoder(LAYER_STREAM, is_ogg))
-			return false;
+		// the second pass runs with the extras
+		for(unsigned pass = 0; pass < 2; pass++) {
+			if(!test_stream_encoder(LAYER_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_SEEKABLE_STREAM, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_SEEKABLE_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_FILE, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_FILE, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_FILENAME, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_FILENAME, is_ogg, /*extras=*/pass == 1))
+				return false;
+		}
 
 		(void) grabbag__file_remove_file(flacfilename(is_ogg));
 
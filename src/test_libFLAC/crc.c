@@ -0,0 +1,104 @@
+/* test_libFLAC - Unit tester for libFLAC
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008,2009  Josh Coalson
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h> /* for rand() */
+#include "private/cpu.h" /* from the libFLAC private include area */
+#include "private/crc.h"
+#include "private/dispatch.h"
+#include "crc.h"
+
+/* bit-at-a-time versions to check the table and SIMD versions against */
+static FLAC__uint8 crc8_reference_(const FLAC__byte *data, unsigned len)
+{
+	unsigned crc = 0, i;
+	while(len--) {
+		crc ^= *data++;
+		for(i = 0; i < 8; i++)
+			crc = (crc & 0x80)? ((crc << 1) ^ 0x07) & 0xff : (crc << 1) & 0xff;
+	}
+	return (FLAC__uint8)crc;
+}
+
+static unsigned crc16_reference_(const FLAC__byte *data, unsigned len)
+{
+	unsigned crc = 0, i;
+	while(len--) {
+		crc ^= (unsigned)(*data++) << 8;
+		for(i = 0; i < 8; i++)
+			crc = (crc & 0x8000)? ((crc << 1) ^ 0x8005) & 0xffff : (crc << 1) & 0xffff;
+	}
+	return crc;
+}
+
+static FLAC__bool test_crc16_function_(const char *name, unsigned (*crc16)(const FLAC__byte *, unsigned), const FLAC__byte *data, unsigned max_len)
+{
+	unsigned offset, len;
+
+	printf("testing %s()... ", name);
+	/* every length up to max_len, at a few different alignments */
+	for(offset = 0; offset < 4; offset++) {
+		for(len = 0; len + offset <= max_len; len++) {
+			const unsigned expect = crc16_reference_(data + offset, len);
+			const unsigned got = crc16(data + offset, len);
+			if(got != expect) {
+				printf("FAILED, offset=%u len=%u, expected 0x%04x, got 0x%04x\n", offset, len, expect, got);
+				return false;
+			}
+		}
+	}
+	printf("OK\n");
+	return true;
+}
+
+FLAC__bool test_crc(void)
+{
+	static FLAC__byte data[2048];
+	FLAC__CPUInfo cpuinfo;
+	FLAC__CPUDispatch dispatch;
+	unsigned i;
+
+	printf("\n+++ libFLAC unit test: crc\n\n");
+
+	for(i = 0; i < sizeof(data); i++)
+		data[i] = (FLAC__byte)rand();
+
+	printf("testing FLAC__crc8()... ");
+	for(i = 0; i <= 64; i++) {
+		if(FLAC__crc8(data, i) != crc8_reference_(data, i)) {
+			printf("FAILED, len=%u\n", i);
+			return false;
+		}
+	}
+	printf("OK\n");
+
+	if(!test_crc16_function_("FLAC__crc16", FLAC__crc16, data, sizeof(data)))
+		return false;
+
+	FLAC__cpu_info(&cpuinfo);
+	FLAC__cpu_dispatch(&cpuinfo, &dispatch);
+	if(dispatch.crc16 != FLAC__crc16 && !test_crc16_function_("CPU-specific crc16", dispatch.crc16, data, sizeof(data)))
+		return false;
+
+	printf("\nPASSED!\n");
+	return true;
+}
@@ -39,6 +39,7 @@
 #endif
 #include "decoders.h"
 #include "FLAC/assert.h"
+#include "FLAC/metadata.h"
 #include "FLAC/stream_decoder.h"
 #include "share/grabbag.h"
 #include "test_libs_common/file_utils_flac.h"
@@ -48,14 +49,16 @@ typedef enum {
 	LAYER_STREAM = 0, /* FLAC__stream_decoder_init_[ogg_]stream() without seeking */
 	LAYER_SEEKABLE_STREAM, /* FLAC__stream_decoder_init_[ogg_]stream() with seeking */
 	LAYER_FILE, /* FLAC__stream_decoder_init_[ogg_]FILE() */
-	LAYER_FILENAME /* FLAC__stream_decoder_init_[ogg_]file() */
+	LAYER_FILENAME, /* FLAC__stream_decoder_init_[ogg_]file() */
+	LAYER_MMAP /* FLAC__stream_decoder_init_[ogg_]mmap() */
 } Layer;
 
 static const char * const LayerString[] = {
 	"Stream",
 	"Seekable Stream",
 	"FILE*",
-	"Filename"
+	"Filename",
+	"Memory-mapped filename"
 };
 
 typedef struct {
@@ -361,6 +364,12 @@ static FLAC__bool stream_decoder_test_respond_(FLAC__StreamDecoder *decoder, Str
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd);
 			break;
+		case LAYER_MMAP:
+			printf("testing FLAC__stream_decoder_init_%smmap()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mmap(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd) :
+				FLAC__stream_decoder_init_mmap(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd);
+			break;
 		default:
 			die_("internal error 000");
 			return false;
@@ -389,17 +398,23 @@ static FLAC__bool stream_decoder_test_respond_(FLAC__StreamDecoder *decoder, Str
 	return true;
 }
 
-static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
+/*
+ * With extras the decoder also runs on two threads with a pipeline
+ * depth of four (if the build has them) and builds a frame index.
+ */
+static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg, FLAC__bool extras)
 {
 	FLAC__StreamDecoder *decoder;
 	FLAC__StreamDecoderInitStatus init_status;
 	FLAC__StreamDecoderState state;
 	StreamDecoderClientData decoder_client_data;
+	FLAC__StreamMetadata *frame_index = 0;
 	FLAC__bool expect;
+	unsigned num_threads = 1, pipeline_depth = 1;
 
 	decoder_client_data.layer = layer;
 
-	printf("\n+++ libFLAC unit test: FLAC__StreamDecoder (layer: %s, format: %s)\n\n", LayerString[layer], is_ogg? "Ogg FLAC" : "FLAC");
+	printf("\n+++ libFLAC unit test: FLAC__StreamDecoder (layer: %s, format: %s%s)\n\n", LayerString[layer], is_ogg? "Ogg FLAC" : "FLAC", extras? ", threads, pipelining, frame indexing" : "");
 
 	printf("testing FLAC__stream_decoder_new()... ");
 	decoder = FLAC__stream_decoder_new();
@@ -441,6 +456,12 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0);
 			break;
+		case LAYER_MMAP:
+			printf("testing FLAC__stream_decoder_init_%smmap()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mmap(decoder, flacfilename(is_ogg), 0, 0, 0, 0) :
+				FLAC__stream_decoder_init_mmap(decoder, flacfilename(is_ogg), 0, 0, 0, 0);
+			break;
 		default:
 			die_("internal error 003");
 			return false;
@@ -476,6 +497,31 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_decoder_set_num_threads()... ");
+		if(FLAC__stream_decoder_set_num_threads(decoder, 0))
+			return die_s_("returned true for 0 threads", decoder);
+		/* not all builds support multithreading */
+		num_threads = FLAC__stream_decoder_set_num_threads(decoder, 2)? 2 : 1;
+		if(num_threads == 1 && !FLAC__stream_decoder_set_num_threads(decoder, 1))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_set_pipeline_depth()... ");
+		if(FLAC__stream_decoder_set_pipeline_depth(decoder, 0))
+			return die_s_("returned true for a depth of 0", decoder);
+		/* not all builds support pipelining */
+		pipeline_depth = FLAC__stream_decoder_set_pipeline_depth(decoder, 4)? 4 : 1;
+		if(pipeline_depth == 1 && !FLAC__stream_decoder_set_pipeline_depth(decoder, 1))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_set_frame_indexing()... ");
+		if(!FLAC__stream_decoder_set_frame_indexing(decoder, true))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+	}
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening %sFLAC file... ", is_ogg? "Ogg ":"");
 		decoder_client_data.file = fopen(flacfilename(is_ogg), "rb");
@@ -511,6 +557,12 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data);
 			break;
+		case LAYER_MMAP:
+			printf("testing FLAC__stream_decoder_init_%smmap()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mmap(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data) :
+				FLAC__stream_decoder_init_mmap(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data);
+			break;
 		default:
 			die_("internal error 009");
 			return false;
@@ -534,6 +586,29 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_decoder_get_num_threads()... ");
+		if(FLAC__stream_decoder_get_num_threads(decoder) != num_threads) {
+			printf("FAILED, expected %u, got %u\n", num_threads, FLAC__stream_decoder_get_num_threads(decoder));
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_get_pipeline_depth()... ");
+		if(FLAC__stream_decoder_get_pipeline_depth(decoder) != pipeline_depth) {
+			printf("FAILED, expected %u, got %u\n", pipeline_depth, FLAC__stream_decoder_get_pipeline_depth(decoder));
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_get_frame_indexing()... ");
+		if(!FLAC__stream_decoder_get_frame_indexing(decoder)) {
+			printf("FAILED, returned false, expected true\n");
+			return false;
+		}
+		printf("OK\n");
+	}
+
 	printf("testing FLAC__stream_decoder_process_until_end_of_metadata()... ");
 	if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
 		return die_s_("returned false", decoder);
@@ -574,12 +649,91 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		/* there is no tell callback for LAYER_STREAM, and Ogg FLAC is not indexed */
+		expect = (layer != LAYER_STREAM && !is_ogg);
+		printf("testing FLAC__stream_decoder_get_frame_index()... ");
+		{
+			const FLAC__StreamMetadata_SeekTable *frames;
+			unsigned i;
+			if(!FLAC__stream_decoder_get_frame_index(decoder, &frame_index))
+				return die_s_("returned false", decoder);
+			frames = &frame_index->data.seek_table;
+			if(!expect) {
+				if(frames->num_points != 0) {
+					printf("FAILED, got %u frames, expected none\n", frames->num_points);
+					return false;
+				}
+			}
+			else {
+				/* the stream was decoded from the start once the seek above went back there */
+				if(frames->num_points == 0 || frames->points[0].sample_number != 0 || frames->points[0].stream_offset != 0) {
+					printf("FAILED, index does not start with the first frame\n");
+					return false;
+				}
+				for(i = 1; i < frames->num_points; i++) {
+					if(frames->points[i].sample_number != frames->points[i-1].sample_number + frames->points[i-1].frame_samples || frames->points[i].stream_offset <= frames->points[i-1].stream_offset) {
+						printf("FAILED, frame #%u does not follow the one before it\n", i);
+						return false;
+					}
+				}
+			}
+		}
+		printf("OK\n");
+	}
+
 	expect = (layer != LAYER_STREAM);
 	printf("testing FLAC__stream_decoder_seek_absolute()... ");
 	if(FLAC__stream_decoder_seek_absolute(decoder, 0) != expect)
 		return die_s_(expect? "returned false" : "returned true", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		/* the seek has left the decoder just past the first frame */
+		expect = (layer != LAYER_STREAM && !is_ogg);
+		printf("testing FLAC__stream_decoder_scan_frames()... ");
+		{
+			FLAC__StreamMetadata *scan_index;
+			const FLAC__StreamMetadata_SeekTable *frames;
+			unsigned i;
+			if(FLAC__stream_decoder_scan_frames(decoder, &scan_index) != expect)
+				return die_s_(expect? "returned false" : "returned true", decoder);
+			if(expect) {
+				frames = &scan_index->data.seek_table;
+				if(frames->num_points == 0 || frames->points[0].sample_number == 0 || frames->points[0].stream_offset == 0) {
+					printf("FAILED, index does not start with the second frame\n");
+					return false;
+				}
+				for(i = 1; i < frames->num_points; i++) {
+					if(frames->points[i].sample_number != frames->points[i-1].sample_number + frames->points[i-1].frame_samples || frames->points[i].stream_offset <= frames->points[i-1].stream_offset) {
+						printf("FAILED, frame #%u does not follow the one before it\n", i);
+						return false;
+					}
+				}
+				if(streaminfo_.data.stream_info.total_samples && frames->points[i-1].sample_number + frames->points[i-1].frame_samples != streaminfo_.data.stream_info.total_samples) {
+					printf("FAILED, index does not end with the last frame\n");
+					return false;
+				}
+				/* the index built while decoding has the first frame too */
+				if(frame_index->data.seek_table.num_points != frames->num_points + 1) {
+					printf("FAILED, index does not match the one built while decoding\n");
+					return false;
+				}
+				for(i = 0; i < frames->num_points; i++) {
+					const FLAC__StreamMetadata_SeekPoint *point = &frame_index->data.seek_table.points[i+1];
+					if(point->sample_number != frames->points[i].sample_number || point->stream_offset != frames->points[i].stream_offset || point->frame_samples != frames->points[i].frame_samples) {
+						printf("FAILED, frame #%u does not match the one built while decoding\n", i);
+						return false;
+					}
+				}
+				if(FLAC__stream_decoder_get_state(decoder) != FLAC__STREAM_DECODER_END_OF_STREAM)
+					return die_s_("expected FLAC__STREAM_DECODER_END_OF_STREAM", decoder);
+				FLAC__metadata_object_delete(scan_index);
+			}
+		}
+		printf("OK\n");
+	}
+
 	printf("testing FLAC__stream_decoder_get_channels()... ");
 	{
 		unsigned channels = FLAC__stream_decoder_get_channels(decoder);
@@ -657,6 +811,22 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_decoder_get_frame_index() after finish... ");
+		{
+			FLAC__StreamMetadata *kept_index;
+			if(!FLAC__stream_decoder_get_frame_index(decoder, &kept_index))
+				return die_s_("returned false", decoder);
+			if(!FLAC__metadata_object_is_equal(kept_index, frame_index)) {
+				printf("FAILED, index changed\n");
+				return false;
+			}
+			FLAC__metadata_object_delete(kept_index);
+			FLAC__metadata_object_delete(frame_index);
+		}
+		printf("OK\n");
+	}
+
 	/*
 	 * respond all
 	 */
@@ -1020,9 +1190,702 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	return true;
 }
 
+typedef struct {
+	FLAC__bool got_frame;
+	FLAC__uint64 first_sample; /* of the first frame written since got_frame was cleared */
+	FLAC__bool error_occurred;
+} FrameIndexClientData;
+
+static FLAC__StreamDecoderWriteStatus frame_index_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	FrameIndexClientData *fcd = (FrameIndexClientData*)client_data;
+	(void)decoder, (void)buffer;
+	if(!fcd->got_frame) {
+		fcd->got_frame = true;
+		fcd->first_sample = frame->header.number.sample_number;
+	}
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void frame_index_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	FrameIndexClientData *fcd = (FrameIndexClientData*)client_data;
+	(void)decoder;
+	printf("ERROR: got error callback: err = %u (%s)\n", (unsigned)status, FLAC__StreamDecoderErrorStatusString[status]);
+	fcd->error_occurred = true;
+}
+
+/* Seeks to samples spread over the stream and checks each one lands exactly. */
+static FLAC__bool frame_index_seek_(FLAC__StreamDecoder *decoder, FrameIndexClientData *fcd, const FLAC__StreamMetadata_SeekTable *frames)
+{
+	unsigned i;
+	for(i = 0; i < frames->num_points; i += frames->num_points / 7 + 1) {
+		const FLAC__uint64 target = frames->points[i].sample_number + frames->points[i].frame_samples / 2;
+		fcd->got_frame = false;
+		if(!FLAC__stream_decoder_seek_absolute(decoder, target))
+			return die_s_("returned false", decoder);
+		if(!fcd->got_frame || fcd->first_sample != target || fcd->error_occurred) {
+			printf("FAILED, seek to sample %u did not land on it\n", (unsigned)target);
+			return false;
+		}
+	}
+	return true;
+}
+
+static FLAC__bool test_frame_index_(void)
+{
+	const char *indexfilename = "metadata.fli";
+	FLAC__StreamDecoder *decoder;
+	FrameIndexClientData fcd;
+	FLAC__StreamMetadata *frame_index, *read_index;
+	unsigned i;
+
+	printf("\n+++ libFLAC unit test: frame index\n\n");
+
+	fcd.got_frame = false;
+	fcd.error_occurred = false;
+
+	printf("testing FLAC__stream_decoder_new()... ");
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("building a frame index while decoding... ");
+	if(!FLAC__stream_decoder_set_frame_indexing(decoder, true))
+		return die_s_("FLAC__stream_decoder_set_frame_indexing() returned false", decoder);
+	if(FLAC__stream_decoder_init_file(decoder, flacfilename(/*is_ogg=*/false), frame_index_write_callback_, /*metadata_callback=*/0, frame_index_error_callback_, &fcd) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		return die_s_("FLAC__stream_decoder_init_file() failed", decoder);
+	if(!FLAC__stream_decoder_process_until_end_of_stream(decoder))
+		return die_s_("FLAC__stream_decoder_process_until_end_of_stream() returned false", decoder);
+	if(!FLAC__stream_decoder_finish(decoder))
+		return die_s_("FLAC__stream_decoder_finish() returned false", decoder);
+	if(!FLAC__stream_decoder_get_frame_index(decoder, &frame_index))
+		return die_s_("FLAC__stream_decoder_get_frame_index() returned false", decoder);
+	if(frame_index->data.seek_table.num_points < 2 || fcd.error_occurred) {
+		printf("FAILED, got %u frames\n", frame_index->data.seek_table.num_points);
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__metadata_write_frame_index()... ");
+	if(!FLAC__metadata_write_frame_index(indexfilename, frame_index))
+		return die_("returned false");
+	printf("OK\n");
+
+	printf("testing FLAC__metadata_read_frame_index()... ");
+	if(!FLAC__metadata_read_frame_index(indexfilename, &read_index))
+		return die_("returned false");
+	if(!FLAC__metadata_object_is_equal(read_index, frame_index)) {
+		printf("FAILED, index read back does not match the one written\n");
+		return false;
+	}
+	FLAC__metadata_object_delete(read_index);
+	(void) grabbag__file_remove_file(indexfilename);
+	if(FLAC__metadata_read_frame_index(flacfilename(/*is_ogg=*/false), &read_index) || 0 != read_index) {
+		printf("FAILED, read a frame index from a FLAC file\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_set_frame_index()... ");
+	if(FLAC__stream_decoder_set_frame_index(decoder, &streaminfo_))
+		return die_s_("returned true for a STREAMINFO block", decoder);
+	if(!FLAC__stream_decoder_set_frame_index(decoder, frame_index))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_seek_absolute() with the frame index... ");
+	if(FLAC__stream_decoder_init_file(decoder, flacfilename(/*is_ogg=*/false), frame_index_write_callback_, /*metadata_callback=*/0, frame_index_error_callback_, &fcd) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		return die_s_("FLAC__stream_decoder_init_file() failed", decoder);
+	if(!frame_index_seek_(decoder, &fcd, &frame_index->data.seek_table))
+		return false;
+	if(!FLAC__stream_decoder_finish(decoder))
+		return die_s_("FLAC__stream_decoder_finish() returned false", decoder);
+	printf("OK\n");
+
+	/* an index that points into the middle of each frame must not break seeking */
+	printf("testing FLAC__stream_decoder_seek_absolute() with a wrong frame index... ");
+	for(i = 0; i < frame_index->data.seek_table.num_points; i++)
+		frame_index->data.seek_table.points[i].stream_offset += 3;
+	if(!FLAC__stream_decoder_set_frame_index(decoder, frame_index))
+		return die_s_("FLAC__stream_decoder_set_frame_index() returned false", decoder);
+	for(i = 0; i < frame_index->data.seek_table.num_points; i++)
+		frame_index->data.seek_table.points[i].stream_offset -= 3;
+	if(FLAC__stream_decoder_init_file(decoder, flacfilename(/*is_ogg=*/false), frame_index_write_callback_, /*metadata_callback=*/0, frame_index_error_callback_, &fcd) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		return die_s_("FLAC__stream_decoder_init_file() failed", decoder);
+	if(!frame_index_seek_(decoder, &fcd, &frame_index->data.seek_table))
+		return false;
+	if(!FLAC__stream_decoder_finish(decoder))
+		return die_s_("FLAC__stream_decoder_finish() returned false", decoder);
+	printf("OK\n");
+
+	FLAC__metadata_object_delete(frame_index);
+
+	printf("testing FLAC__stream_decoder_delete()... ");
+	FLAC__stream_decoder_delete(decoder);
+	printf("OK\n");
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+/*
+ * Decodes the test file three times with one decoder, recycling it in
+ * between; MD5 checking makes the recycle fail if a decode went wrong
+ * on the kept buffers.
+ */
+static FLAC__bool test_stream_decoder_recycle_(FLAC__bool is_ogg)
+{
+	FLAC__StreamDecoder *decoder;
+	FrameIndexClientData fcd;
+	FLAC__StreamDecoderInitStatus init_status;
+	unsigned pass;
+
+	printf("\n+++ libFLAC unit test: FLAC__stream_decoder_recycle() (format: %s)\n\n", is_ogg? "Ogg FLAC" : "FLAC");
+
+	printf("testing FLAC__stream_decoder_new()... ");
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	for(pass = 0; pass < 3; pass++) {
+		printf("decoding stream #%u... ", pass+1);
+		fcd.got_frame = false;
+		fcd.error_occurred = false;
+		if(!FLAC__stream_decoder_set_md5_checking(decoder, true))
+			return die_s_("FLAC__stream_decoder_set_md5_checking() returned false", decoder);
+		init_status = is_ogg?
+			FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), frame_index_write_callback_, /*metadata_callback=*/0, frame_index_error_callback_, &fcd) :
+			FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), frame_index_write_callback_, /*metadata_callback=*/0, frame_index_error_callback_, &fcd);
+		if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+			return die_s_("FLAC__stream_decoder_init_[ogg_]file() failed", decoder);
+		if(!FLAC__stream_decoder_process_until_end_of_stream(decoder))
+			return die_s_("FLAC__stream_decoder_process_until_end_of_stream() returned false", decoder);
+		if(!fcd.got_frame || fcd.error_occurred) {
+			printf("FAILED, the stream did not decode\n");
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_recycle()... ");
+		if(!FLAC__stream_decoder_recycle(decoder))
+			return die_s_("returned false", decoder);
+		if(FLAC__stream_decoder_get_state(decoder) != FLAC__STREAM_DECODER_UNINITIALIZED)
+			return die_s_("expected FLAC__STREAM_DECODER_UNINITIALIZED", decoder);
+		if(FLAC__stream_decoder_get_md5_checking(decoder))
+			return die_s_("MD5 checking was not reset to the default", decoder);
+		printf("OK\n");
+	}
+
+	printf("testing FLAC__stream_decoder_delete()... ");
+	FLAC__stream_decoder_delete(decoder);
+	printf("OK\n");
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+typedef struct {
+	const FLAC__byte *data;
+	size_t length, position;
+	FLAC__uint32 checksum; /* of every frame written and every error reported, in order */
+	unsigned frames, errors;
+	FLAC__bool ok; /* what FLAC__stream_decoder_process_until_end_of_stream() returned */
+} DamagedStreamClientData;
+
+static void damaged_stream_add_(DamagedStreamClientData *dcd, FLAC__uint32 x)
+{
+	dcd->checksum = dcd->checksum * 31 + x;
+}
+
+static FLAC__StreamDecoderReadStatus damaged_stream_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	DamagedStreamClientData *dcd = (DamagedStreamClientData*)client_data;
+	(void)decoder;
+	if(dcd->position >= dcd->length) {
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+	if(*bytes > dcd->length - dcd->position)
+		*bytes = dcd->length - dcd->position;
+	memcpy(buffer, dcd->data + dcd->position, *bytes);
+	dcd->position += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderTellStatus damaged_stream_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	DamagedStreamClientData *dcd = (DamagedStreamClientData*)client_data;
+	(void)decoder;
+	*absolute_byte_offset = dcd->position;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderWriteStatus damaged_stream_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	DamagedStreamClientData *dcd = (DamagedStreamClientData*)client_data;
+	unsigned channel, i;
+	(void)decoder;
+	dcd->frames++;
+	damaged_stream_add_(dcd, (FLAC__uint32)frame->header.number.sample_number);
+	damaged_stream_add_(dcd, frame->header.blocksize);
+	for(channel = 0; channel < frame->header.channels; channel++)
+		for(i = 0; i < frame->header.blocksize; i++)
+			damaged_stream_add_(dcd, (FLAC__uint32)buffer[channel][i]);
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void damaged_stream_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	DamagedStreamClientData *dcd = (DamagedStreamClientData*)client_data;
+	(void)decoder;
+	dcd->errors++;
+	damaged_stream_add_(dcd, 0x80000000u | (FLAC__uint32)status);
+}
+
+/* Decodes data[] with num_threads threads, from a stream that can't seek, leaving the results in *dcd. */
+static FLAC__bool damaged_stream_decode_(FLAC__StreamDecoder *decoder, DamagedStreamClientData *dcd, const FLAC__byte *data, size_t length, unsigned num_threads)
+{
+	dcd->data = data;
+	dcd->length = length;
+	dcd->position = 0;
+	dcd->checksum = 0;
+	dcd->frames = dcd->errors = 0;
+
+	if(!FLAC__stream_decoder_set_num_threads(decoder, num_threads))
+		return die_s_("FLAC__stream_decoder_set_num_threads() returned false", decoder);
+	if(FLAC__stream_decoder_init_stream(decoder, damaged_stream_read_callback_, /*seek_callback=*/0, damaged_stream_tell_callback_, /*length_callback=*/0, /*eof_callback=*/0, damaged_stream_write_callback_, /*metadata_callback=*/0, damaged_stream_error_callback_, dcd) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		return die_s_("FLAC__stream_decoder_init_stream() failed", decoder);
+	dcd->ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
+	damaged_stream_add_(dcd, dcd->ok);
+	damaged_stream_add_(dcd, (FLAC__uint32)FLAC__stream_decoder_get_state(decoder));
+	/* the damage leaves the MD5 signature unchecked or wrong, so finish() can't tell us anything */
+	(void)FLAC__stream_decoder_finish(decoder);
+	return true;
+}
+
+/*
+ * The worker threads must not change what a client sees when the stream
+ * is damaged: the same frames, silence for the ones that fail their
+ * CRC, and the same errors in the same order as with one thread.
+ */
+static FLAC__bool test_damaged_stream_(void)
+{
+	static const char * const damage_string[] = {
+		"a flipped bit",
+		"several flipped bits",
+		"overwritten bytes",
+		"missing bytes",
+		"inserted junk",
+		"a truncated frame",
+		"trailing junk"
+	};
+	const unsigned num_damages = sizeof(damage_string) / sizeof(damage_string[0]);
+	FLAC__StreamDecoder *decoder;
+	DamagedStreamClientData dcd, dcd_threaded;
+	FLAC__byte *original, *data;
+	FLAC__uint64 first_frame_offset;
+	FLAC__uint32 random = 12345;
+	size_t length, audio_length, i;
+	unsigned damage, n;
+	FILE *f;
+
+	printf("\n+++ libFLAC unit test: damaged streams\n\n");
+
+	if(0 == (original = (FLAC__byte*)malloc((size_t)flacfilesize_)))
+		return die_("malloc() failed");
+	/* room for the inserted and trailing junk */
+	if(0 == (data = (FLAC__byte*)malloc((size_t)flacfilesize_ + 4096))) {
+		free(original);
+		return die_("malloc() failed");
+	}
+	if(0 == (f = fopen(flacfilename(/*is_ogg=*/false), "rb")) || fread(original, 1, (size_t)flacfilesize_, f) != (size_t)flacfilesize_) {
+		if(0 != f)
+			fclose(f);
+		free(data);
+		free(original);
+		return die_("reading the test file");
+	}
+	fclose(f);
+
+	printf("testing FLAC__stream_decoder_new()... ");
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		printf("FAILED, returned NULL\n");
+		free(data);
+		free(original);
+		return false;
+	}
+	printf("OK\n");
+
+	/* only damage the audio */
+	printf("finding the first frame... ");
+	dcd.data = original;
+	dcd.length = (size_t)flacfilesize_;
+	dcd.position = 0;
+	if(FLAC__stream_decoder_init_stream(decoder, damaged_stream_read_callback_, /*seek_callback=*/0, damaged_stream_tell_callback_, /*length_callback=*/0, /*eof_callback=*/0, damaged_stream_write_callback_, /*metadata_callback=*/0, damaged_stream_error_callback_, &dcd) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		return die_s_("FLAC__stream_decoder_init_stream() failed", decoder);
+	if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder) || !FLAC__stream_decoder_get_decode_position(decoder, &first_frame_offset))
+		return die_s_("could not get the position of the first frame", decoder);
+	(void)FLAC__stream_decoder_finish(decoder);
+	audio_length = (size_t)(flacfilesize_ - first_frame_offset);
+	printf("OK\n");
+
+	for(damage = 0; damage < num_damages; damage++) {
+		printf("testing FLAC__stream_decoder_process_until_end_of_stream() with %s and threads... ", damage_string[damage]);
+
+		memcpy(data, original, (size_t)flacfilesize_);
+		length = (size_t)flacfilesize_;
+		/* some bytes past the middle of the audio, not on a frame boundary */
+		i = (size_t)first_frame_offset + audio_length / 2 + 77;
+		switch(damage) {
+			case 0:
+				data[i] ^= 0x10;
+				break;
+			case 1:
+				for(n = 1; n <= 5; n++)
+					data[(size_t)first_frame_offset + audio_length * n / 6 + n * 13] ^= (FLAC__byte)(1u << n);
+				break;
+			case 2:
+				for(n = 0; n < 100; n++)
+					data[i + n] = (FLAC__byte)(n & 1? 0xff : 0xf8);
+				break;
+			case 3:
+				memmove(data + i, data + i + 1000, length - i - 1000);
+				length -= 1000;
+				break;
+			case 4:
+				memmove(data + i + 300, data + i, length - i);
+				for(n = 0; n < 300; n++) {
+					random = random * 1103515245 + 12345;
+					data[i + n] = n % 50 == 0? 0xff : (FLAC__byte)(random >> 16);
+				}
+				length += 300;
+				break;
+			case 5:
+				length = i;
+				break;
+			case 6:
+				for(n = 0; n < 4096; n++) {
+					random = random * 1103515245 + 12345;
+					data[length + n] = n % 100 == 0? 0xff : (FLAC__byte)(random >> 16);
+				}
+				length += 4096;
+				break;
+			default:
+				FLAC__ASSERT(0);
+				break;
+		}
+
+		if(!damaged_stream_decode_(decoder, &dcd, data, length, 1))
+			return false;
+		if(dcd.errors == 0 && dcd.ok) {
+			printf("FAILED, the damage went unnoticed\n");
+			return false;
+		}
+		if(!FLAC__stream_decoder_set_num_threads(decoder, 4)) {
+			printf("OK (no threads)\n");
+			continue;
+		}
+		if(!damaged_stream_decode_(decoder, &dcd_threaded, data, length, 4))
+			return false;
+		if(dcd_threaded.frames != dcd.frames || dcd_threaded.errors != dcd.errors || dcd_threaded.checksum != dcd.checksum) {
+			printf("FAILED, got %u frames and %u errors, expected %u frames and %u errors%s\n", dcd_threaded.frames, dcd_threaded.errors, dcd.frames, dcd.errors, dcd_threaded.checksum != dcd.checksum? " (or different ones)" : "");
+			return false;
+		}
+		printf("OK\n");
+	}
+
+	printf("testing FLAC__stream_decoder_delete()... ");
+	FLAC__stream_decoder_delete(decoder);
+	printf("OK\n");
+
+	free(data);
+	free(original);
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+typedef struct {
+	FLAC__uint64 next_sample; /* where the next frame written should start */
+	FLAC__uint64 samples; /* number of samples written */
+	FLAC__bool error_occurred;
+} SampleRangeClientData;
+
+static FLAC__StreamDecoderWriteStatus sample_range_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	SampleRangeClientData *rcd = (SampleRangeClientData*)client_data;
+	unsigned i;
+	(void)decoder;
+	/* the test file holds sample n = n & 7 */
+	if(frame->header.number.sample_number != rcd->next_sample)
+		rcd->error_occurred = true;
+	for(i = 0; i < frame->header.blocksize; i++) {
+		if(buffer[0][i] != (FLAC__int32)((frame->header.number.sample_number + i) & 7))
+			rcd->error_occurred = true;
+	}
+	rcd->next_sample += frame->header.blocksize;
+	rcd->samples += frame->header.blocksize;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void sample_range_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	SampleRangeClientData *rcd = (SampleRangeClientData*)client_data;
+	(void)decoder;
+	printf("ERROR: got error callback: err = %u (%s)\n", (unsigned)status, FLAC__StreamDecoderErrorStatusString[status]);
+	rcd->error_occurred = true;
+}
+
+/* Decodes a range into a buffer and checks it holds exactly the expected samples. */
+static FLAC__bool sample_range_decode_(FLAC__StreamDecoder *decoder, SampleRangeClientData *rcd, FLAC__uint64 first_sample, FLAC__uint64 last_sample, FLAC__int32 *buffer)
+{
+	const unsigned samples = (unsigned)(last_sample - first_sample + 1);
+	FLAC__bool md5_checked;
+	unsigned i;
+
+	rcd->samples = 0;
+	buffer[samples] = -1; /* guard */
+	if(!FLAC__stream_decoder_process_range(decoder, first_sample, last_sample, buffer, &md5_checked))
+		return die_s_("returned false", decoder);
+	for(i = 0; i < samples; i++) {
+		if(buffer[i] != (FLAC__int32)((first_sample + i) & 7)) {
+			printf("FAILED, sample %u of range %u..%u is wrong\n", i, (unsigned)first_sample, (unsigned)last_sample);
+			return false;
+		}
+	}
+	if(buffer[samples] != -1) {
+		printf("FAILED, range %u..%u overran the buffer\n", (unsigned)first_sample, (unsigned)last_sample);
+		return false;
+	}
+	if(rcd->samples != 0 || rcd->error_occurred) {
+		printf("FAILED, range %u..%u went through the write callback\n", (unsigned)first_sample, (unsigned)last_sample);
+		return false;
+	}
+	/* the test file has no MD5 signature */
+	if(md5_checked) {
+		printf("FAILED, range %u..%u claims to be MD5-checked\n", (unsigned)first_sample, (unsigned)last_sample);
+		return false;
+	}
+	return true;
+}
+
+static FLAC__bool test_sample_range_(FLAC__bool is_ogg)
+{
+	/* the test file is 512*1024 samples of mono in blocks of 576 */
+	const FLAC__uint64 total_samples = 512 * 1024;
+	FLAC__StreamDecoder *decoder;
+	SampleRangeClientData rcd;
+	FLAC__int32 *buffer;
+
+	printf("\n+++ libFLAC unit test: sample range (format: %s)\n\n", is_ogg? "Ogg FLAC" : "FLAC");
+
+	rcd.next_sample = 0;
+	rcd.samples = 0;
+	rcd.error_occurred = false;
+
+	if(0 == (buffer = (FLAC__int32*)malloc(sizeof(FLAC__int32) * (10000 + 1))))
+		return die_("malloc() failed");
+
+	printf("testing FLAC__stream_decoder_new()... ");
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_init_%sfile()... ", is_ogg? "ogg_":"");
+	if(
+		(is_ogg?
+			FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), sample_range_write_callback_, /*metadata_callback=*/0, sample_range_error_callback_, &rcd) :
+			FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), sample_range_write_callback_, /*metadata_callback=*/0, sample_range_error_callback_, &rcd)
+		) != FLAC__STREAM_DECODER_INIT_STATUS_OK
+	)
+		return die_s_("returned an error", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_process_range() from the start... ");
+	if(!sample_range_decode_(decoder, &rcd, 0, 999, buffer))
+		return false;
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_process_range() with bad ranges... ");
+	if(FLAC__stream_decoder_process_range(decoder, 2000, 1999, buffer, /*md5_checked=*/0))
+		return die_s_("returned true for an empty range", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_process_range() following a frame... ");
+	/* the last range ended in the frame holding 576..1151 */
+	if(!sample_range_decode_(decoder, &rcd, 1152, 1152 + 576 - 1, buffer))
+		return false;
+	if(!sample_range_decode_(decoder, &rcd, 1152 + 576, 1152 + 576 + 10, buffer))
+		return false;
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_process_range() with seeking... ");
+	if(!sample_range_decode_(decoder, &rcd, 1000, 1999, buffer))
+		return false;
+	if(!sample_range_decode_(decoder, &rcd, 300001, 310000, buffer))
+		return false;
+	if(!sample_range_decode_(decoder, &rcd, 123, 123, buffer))
+		return false;
+	if(!sample_range_decode_(decoder, &rcd, total_samples - 1000, total_samples - 1, buffer))
+		return false;
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_process_range() with the write callback... ");
+	rcd.next_sample = 40000;
+	rcd.samples = 0;
+	if(!FLAC__stream_decoder_process_range(decoder, 40000, 49999, /*buffer=*/0, /*md5_checked=*/0))
+		return die_s_("returned false", decoder);
+	if(rcd.samples != 10000 || rcd.error_occurred) {
+		printf("FAILED, got %u samples\n", (unsigned)rcd.samples);
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_finish()... ");
+	if(!FLAC__stream_decoder_finish(decoder))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_delete()... ");
+	FLAC__stream_decoder_delete(decoder);
+	printf("OK\n");
+
+	free(buffer);
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+static FLAC__bool test_read_samples_(FLAC__bool is_ogg)
+{
+	/* the test file is 512*1024 samples of mono in blocks of 576 */
+	const unsigned total_samples = 512 * 1024;
+	const unsigned shift = 16 - streaminfo_.data.stream_info.bits_per_sample;
+	FLAC__StreamDecoder *decoder;
+	SampleRangeClientData rcd;
+	FLAC__int32 buffer[1000 + 1];
+	FLAC__int16 buffer16[1000 + 1];
+	unsigned samples, samples_read, i;
+
+	printf("\n+++ libFLAC unit test: reading samples (format: %s)\n\n", is_ogg? "Ogg FLAC" : "FLAC");
+
+	rcd.next_sample = 0;
+	rcd.samples = 0;
+	rcd.error_occurred = false;
+
+	printf("testing FLAC__stream_decoder_new()... ");
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_init_%sfile()... ", is_ogg? "ogg_":"");
+	if(
+		(is_ogg?
+			FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), sample_range_write_callback_, /*metadata_callback=*/0, sample_range_error_callback_, &rcd) :
+			FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), sample_range_write_callback_, /*metadata_callback=*/0, sample_range_error_callback_, &rcd)
+		) != FLAC__STREAM_DECODER_INIT_STATUS_OK
+	)
+		return die_s_("returned an error", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_read_samples_interleaved()... ");
+	/* reads of 1000 samples end in the middle of the 576-sample frames */
+	for(samples = 0; samples < total_samples; samples += samples_read) {
+		buffer[1000] = -1; /* guard */
+		if(!FLAC__stream_decoder_read_samples_interleaved(decoder, buffer, 1000, &samples_read))
+			return die_s_("returned false", decoder);
+		if(samples_read != 1000 && samples + samples_read != total_samples) {
+			printf("FAILED, read %u samples at sample %u\n", samples_read, samples);
+			return false;
+		}
+		for(i = 0; i < samples_read; i++) {
+			if(buffer[i] != (FLAC__int32)((samples + i) & 7)) {
+				printf("FAILED, sample %u is wrong\n", samples + i);
+				return false;
+			}
+		}
+		if(buffer[1000] != -1) {
+			printf("FAILED, overran the buffer at sample %u\n", samples);
+			return false;
+		}
+	}
+	if(!FLAC__stream_decoder_read_samples_interleaved(decoder, buffer, 1000, &samples_read))
+		return die_s_("returned false at the end of the stream", decoder);
+	if(samples_read != 0 || FLAC__stream_decoder_get_state(decoder) != FLAC__STREAM_DECODER_END_OF_STREAM) {
+		printf("FAILED, read %u samples past the end of the stream\n", samples_read);
+		return false;
+	}
+	if(rcd.samples != 0 || rcd.error_occurred) {
+		printf("FAILED, frames went through the write callback\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_seek_absolute()... ");
+	rcd.next_sample = 300001;
+	if(!FLAC__stream_decoder_seek_absolute(decoder, 300001))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_read_samples_interleaved_int16()... ");
+	/* the seek gave the frame holding 300001 to the write callback */
+	rcd.samples = 0;
+	for(samples = 300001 - 300001 % 576 + 576; samples < total_samples; samples += samples_read) {
+		buffer16[1000] = -1; /* guard */
+		if(!FLAC__stream_decoder_read_samples_interleaved_int16(decoder, buffer16, 1000, &samples_read))
+			return die_s_("returned false", decoder);
+		if(samples_read != 1000 && samples + samples_read != total_samples) {
+			printf("FAILED, read %u samples at sample %u\n", samples_read, samples);
+			return false;
+		}
+		for(i = 0; i < samples_read; i++) {
+			if(buffer16[i] != (FLAC__int16)(((samples + i) & 7) << shift)) {
+				printf("FAILED, sample %u is wrong\n", samples + i);
+				return false;
+			}
+		}
+		if(buffer16[1000] != -1) {
+			printf("FAILED, overran the buffer at sample %u\n", samples);
+			return false;
+		}
+	}
+	if(rcd.samples != 0 || rcd.error_occurred) {
+		printf("FAILED, frames went through the write callback\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_finish()... ");
+	if(!FLAC__stream_decoder_finish(decoder))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_delete()... ");
+	FLAC__stream_decoder_delete(decoder);
+	printf("OK\n");
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
 FLAC__bool test_decoders(void)
 {
 	FLAC__bool is_ogg = false;
+	unsigned pass;
 
 	while(1) {
 		init_metadata_blocks_();
@@ -1030,16 +1893,37 @@ FLAC__bool test_decoders(void)
 		if(!generate_file_(is_ogg))
 			return false;
 
-		if(!test_stream_decoder(LAYER_STREAM, is_ogg))
+		/* the second pass runs with the extras */
+		for(pass = 0; pass < 2; pass++) {
+			if(!test_stream_decoder(LAYER_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_SEEKABLE_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_FILE, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_FILENAME, is_ogg, /*extras=*/pass == 1))
+				return false;
+
+			if(!test_stream_decoder(LAYER_MMAP, is_ogg, /*extras=*/pass == 1))
+				return false;
+		}
+
+		if(!test_stream_decoder_recycle_(is_ogg))
+			return false;
+
+		if(!is_ogg && !test_frame_index_())
 			return false;
 
-		if(!test_stream_decoder(LAYER_SEEKABLE_STREAM, is_ogg))
+		if(!is_ogg && !test_damaged_stream_())
 			return false;
 
-		if(!test_stream_decoder(LAYER_FILE, is_ogg))
+		if(!test_sample_range_(is_ogg))
 			return false;
 
-		if(!test_stream_decoder(LAYER_FILENAME, is_ogg))
+		if(!test_read_samples_(is_ogg))
 			return false;
 
 		(void) grabbag__file_remove_file(flacfilename(is_ogg));
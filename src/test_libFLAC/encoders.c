@@ -26,6 +26,7 @@
 #include <string.h>
 #include "encoders.h"
 #include "FLAC/assert.h"
+#include "FLAC/metadata.h"
 #include "FLAC/stream_encoder.h"
 #include "share/grabbag.h"
 #include "test_libs_common/file_utils_flac.h"
@@ -148,7 +149,13 @@ static void stream_encoder_progress_callback_(const FLAC__StreamEncoder *encoder
 	(void)encoder, (void)bytes_written, (void)samples_written, (void)frames_written, (void)total_frames_estimate, (void)client_data;
 }
 
-static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
+static void *workspace_ = 0;
+
+/*
+ * With extras the encoder also runs on two threads (if the build has
+ * them), in a workspace set by the caller and with frame indexing.
+ */
+static FLAC__bool test_stream_encoder_(Layer layer, FLAC__bool is_ogg, FLAC__bool extras)
 {
 	FLAC__StreamEncoder *encoder;
 	FLAC__StreamEncoderInitStatus init_status;
@@ -157,11 +164,12 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	FILE *file = 0;
 	FLAC__int32 samples[1024];
 	FLAC__int32 *samples_array[1];
-	unsigned i;
+	unsigned i, num_threads = 1;
+	size_t workspace_size;
 
 	samples_array[0] = samples;
 
-	printf("\n+++ libFLAC unit test: FLAC__StreamEncoder (layer: %s, format: %s)\n\n", LayerString[layer], is_ogg? "Ogg FLAC":"FLAC");
+	printf("\n+++ libFLAC unit test: FLAC__StreamEncoder (layer: %s, format: %s%s)\n\n", LayerString[layer], is_ogg? "Ogg FLAC":"FLAC", extras? ", threads, workspace, frame indexing":"");
 
 	printf("testing FLAC__stream_encoder_new()... ");
 	encoder = FLAC__stream_encoder_new();
@@ -213,6 +221,11 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_set_variable_blocksize()... ");
+	if(!FLAC__stream_encoder_set_variable_blocksize(encoder, false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_set_do_mid_side_stereo()... ");
 	if(!FLAC__stream_encoder_set_do_mid_side_stereo(encoder, false))
 		return die_s_("returned false", encoder);
@@ -223,6 +236,11 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_set_fast_mid_side_stereo()... ");
+	if(!FLAC__stream_encoder_set_fast_mid_side_stereo(encoder, false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_set_max_lpc_order()... ");
 	if(!FLAC__stream_encoder_set_max_lpc_order(encoder, 0))
 		return die_s_("returned false", encoder);
@@ -268,11 +286,43 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_encoder_set_num_threads()... ");
+		if(FLAC__stream_encoder_set_num_threads(encoder, 0))
+			return die_s_("returned true for 0 threads", encoder);
+		/* not all builds support multithreading */
+		num_threads = FLAC__stream_encoder_set_num_threads(encoder, 2)? 2 : 1;
+		if(num_threads == 1 && !FLAC__stream_encoder_set_num_threads(encoder, 1))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+	}
+
 	printf("testing FLAC__stream_encoder_set_metadata()... ");
 	if(!FLAC__stream_encoder_set_metadata(encoder, metadata_sequence_, num_metadata_))
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_encoder_get_workspace_size()... ");
+		if(0 == (workspace_size = FLAC__stream_encoder_get_workspace_size(encoder)))
+			return die_s_("returned 0", encoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_encoder_set_workspace()... ");
+		if(0 == (workspace_ = malloc(workspace_size))) {
+			printf("ERROR (malloc failed)\n");
+			return false;
+		}
+		if(!FLAC__stream_encoder_set_workspace(encoder, workspace_, workspace_size))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_encoder_set_frame_indexing()... ");
+		if(!FLAC__stream_encoder_set_frame_indexing(encoder, true))
+			return die_s_("returned false", encoder);
+		printf("OK\n");
+	}
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening file for FLAC output... ");
 		file = fopen(flacfilename(is_ogg), "w+b");
@@ -365,6 +415,13 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_get_fast_mid_side_stereo()... ");
+	if(FLAC__stream_encoder_get_fast_mid_side_stereo(encoder) != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_get_channels()... ");
 	if(FLAC__stream_encoder_get_channels(encoder) != streaminfo_.data.stream_info.channels) {
 		printf("FAILED, expected %u, got %u\n", streaminfo_.data.stream_info.channels, FLAC__stream_encoder_get_channels(encoder));
@@ -393,6 +450,13 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_get_variable_blocksize()... ");
+	if(FLAC__stream_encoder_get_variable_blocksize(encoder) != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_get_max_lpc_order()... ");
 	if(FLAC__stream_encoder_get_max_lpc_order(encoder) != 0) {
 		printf("FAILED, expected %u, got %u\n", 0, FLAC__stream_encoder_get_max_lpc_order(encoder));
@@ -458,6 +522,22 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	if(extras) {
+		printf("testing FLAC__stream_encoder_get_num_threads()... ");
+		if(FLAC__stream_encoder_get_num_threads(encoder) != num_threads) {
+			printf("FAILED, expected %u, got %u\n", num_threads, FLAC__stream_encoder_get_num_threads(encoder));
+			return false;
+		}
+		printf("OK\n");
+
+		printf("testing FLAC__stream_encoder_get_frame_indexing()... ");
+		if(!FLAC__stream_encoder_get_frame_indexing(encoder)) {
+			printf("FAILED, returned false, expected true\n");
+			return false;
+		}
+		printf("OK\n");
+	}
+
 	/* init the dummy sample buffer */
 	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
 		samples[i] = i & 7;
@@ -480,6 +560,214 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	if(layer < LAYER_FILE)
 		fclose(file);
 
+	if(extras) {
+		printf("testing FLAC__stream_encoder_get_frame_index()... ");
+		{
+			FLAC__StreamMetadata *frame_index;
+			const FLAC__StreamMetadata_SeekTable *frames;
+			if(!FLAC__stream_encoder_get_frame_index(encoder, &frame_index))
+				return die_s_("returned false", encoder);
+			frames = &frame_index->data.seek_table;
+			if(is_ogg) {
+				if(frames->num_points != 0) {
+					printf("FAILED, got %u frames for Ogg FLAC\n", frames->num_points);
+					return false;
+				}
+			}
+			else {
+				if(frames->num_points == 0 || frames->points[0].sample_number != 0 || frames->points[0].stream_offset != 0) {
+					printf("FAILED, index does not start with the first frame\n");
+					return false;
+				}
+				for(i = 1; i < frames->num_points; i++) {
+					if(frames->points[i].sample_number != frames->points[i-1].sample_number + frames->points[i-1].frame_samples || frames->points[i].stream_offset <= frames->points[i-1].stream_offset) {
+						printf("FAILED, frame #%u does not follow the one before it\n", i);
+						return false;
+					}
+				}
+			}
+			FLAC__metadata_object_delete(frame_index);
+		}
+		printf("OK\n");
+	}
+
+	printf("testing FLAC__stream_encoder_delete()... ");
+	FLAC__stream_encoder_delete(encoder);
+	printf("OK\n");
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg, FLAC__bool extras)
+{
+	/* freed here so the early returns in the test don't leak it */
+	const FLAC__bool ok = test_stream_encoder_(layer, is_ogg, extras);
+	free(workspace_);
+	workspace_ = 0;
+	return ok;
+}
+
+/*
+ * Encodes three short streams with one encoder, recycling it in between;
+ * the second stream has the same layout as the first so it runs on the
+ * kept buffers, the third does not so they have to be replaced.
+ */
+static FLAC__bool test_stream_encoder_recycle(void)
+{
+	static const unsigned channels[3] = { 1, 1, 2 };
+	FLAC__StreamEncoder *encoder;
+	FILE *file;
+	FLAC__int32 samples[2 * 3000];
+	unsigned i, pass;
+
+	printf("\n+++ libFLAC unit test: FLAC__stream_encoder_recycle()\n\n");
+
+	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
+		samples[i] = (FLAC__int32)((i * 37) % 1001) - 500;
+
+	printf("testing FLAC__stream_encoder_new()... ");
+	encoder = FLAC__stream_encoder_new();
+	if(0 == encoder) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("opening file for FLAC output... ");
+	file = fopen(flacfilename(/*is_ogg=*/false), "w+b");
+	if(0 == file) {
+		printf("ERROR (%s)\n", strerror(errno));
+		return false;
+	}
+	printf("OK\n");
+
+	for(pass = 0; pass < 3; pass++) {
+		printf("encoding stream #%u (%u channel%s)... ", pass+1, channels[pass], channels[pass] == 1? "":"s");
+		if(
+			!FLAC__stream_encoder_set_verify(encoder, true) ||
+			!FLAC__stream_encoder_set_channels(encoder, channels[pass]) ||
+			!FLAC__stream_encoder_set_bits_per_sample(encoder, 16) ||
+			!FLAC__stream_encoder_set_sample_rate(encoder, 44100) ||
+			!FLAC__stream_encoder_set_blocksize(encoder, 1024)
+		)
+			return die_s_("setting the encoder up failed", encoder);
+		(void)FLAC__stream_encoder_set_num_threads(encoder, 2); /* not all builds support multithreading */
+		if(FLAC__stream_encoder_init_stream(encoder, stream_encoder_write_callback_, /*seek_callback=*/0, /*tell_callback=*/0, /*metadata_callback=*/0, /*client_data=*/file) != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+			return die_s_(0, encoder);
+		if(!FLAC__stream_encoder_process_interleaved(encoder, samples, sizeof(samples) / sizeof(FLAC__int32) / channels[pass]))
+			return die_s_("FLAC__stream_encoder_process_interleaved() returned false", encoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_encoder_recycle()... ");
+		if(!FLAC__stream_encoder_recycle(encoder))
+			return die_s_("returned false", encoder);
+		if(FLAC__stream_encoder_get_state(encoder) != FLAC__STREAM_ENCODER_UNINITIALIZED)
+			return die_s_("expected FLAC__STREAM_ENCODER_UNINITIALIZED", encoder);
+		printf("OK\n");
+	}
+
+	fclose(file);
+
+	printf("testing FLAC__stream_encoder_delete()... ");
+	FLAC__stream_encoder_delete(encoder);
+	printf("OK\n");
+
+	(void) grabbag__file_remove_file(flacfilename(/*is_ogg=*/false));
+
+	printf("\nPASSED!\n");
+
+	return true;
+}
+
+typedef struct {
+	unsigned num_frames;
+	unsigned num_short_frames;
+	FLAC__uint64 samples;
+} variable_blocksize_client_data_;
+
+static FLAC__StreamEncoderWriteStatus variable_blocksize_write_callback_(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	variable_blocksize_client_data_ *data = (variable_blocksize_client_data_*)client_data;
+	(void)buffer, (void)bytes, (void)current_frame;
+	if(samples > 0) {
+		data->num_frames++;
+		if(samples < FLAC__stream_encoder_get_blocksize(encoder))
+			data->num_short_frames++;
+		data->samples += samples;
+	}
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+/*
+ * Encodes a quiet tone with a short burst of noise in the middle; with
+ * a variable blocksize the encoder should cut the burst into short
+ * frames and keep full-size frames elsewhere.  Verify checks that the
+ * frames decode to the input.
+ */
+static FLAC__bool test_stream_encoder_variable_blocksize(void)
+{
+	FLAC__StreamEncoder *encoder;
+	variable_blocksize_client_data_ data;
+	FLAC__int32 samples[10 * 4096];
+	FLAC__uint32 random = 1;
+	unsigned i;
+
+	printf("\n+++ libFLAC unit test: FLAC__stream_encoder_set_variable_blocksize()\n\n");
+
+	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++) {
+		samples[i] = (FLAC__int32)((i % 64) < 32? (i % 32) * 16 : (32 - i % 32) * 16) - 256;
+		if(i >= 4 * 4096 + 3000 && i < 4 * 4096 + 3300) {
+			random = random * 1103515245 + 12345;
+			samples[i] += (FLAC__int32)((random >> 16) & 0x3fff) - 0x2000;
+		}
+	}
+
+	printf("testing FLAC__stream_encoder_new()... ");
+	encoder = FLAC__stream_encoder_new();
+	if(0 == encoder) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_set_variable_blocksize()... ");
+	if(
+		!FLAC__stream_encoder_set_verify(encoder, true) ||
+		!FLAC__stream_encoder_set_channels(encoder, 1) ||
+		!FLAC__stream_encoder_set_bits_per_sample(encoder, 16) ||
+		!FLAC__stream_encoder_set_sample_rate(encoder, 44100) ||
+		!FLAC__stream_encoder_set_compression_level(encoder, 8) ||
+		!FLAC__stream_encoder_set_blocksize(encoder, 4096) ||
+		!FLAC__stream_encoder_set_variable_blocksize(encoder, true)
+	)
+		return die_s_("setting the encoder up failed", encoder);
+	if(!FLAC__stream_encoder_get_variable_blocksize(encoder))
+		return die_s_("expected true, got false", encoder);
+	printf("OK\n");
+
+	printf("encoding... ");
+	memset(&data, 0, sizeof(data));
+	if(FLAC__stream_encoder_init_stream(encoder, variable_blocksize_write_callback_, /*seek_callback=*/0, /*tell_callback=*/0, /*metadata_callback=*/0, /*client_data=*/&data) != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+		return die_s_(0, encoder);
+	if(!FLAC__stream_encoder_process_interleaved(encoder, samples, sizeof(samples) / sizeof(FLAC__int32)))
+		return die_s_("FLAC__stream_encoder_process_interleaved() returned false", encoder);
+	if(!FLAC__stream_encoder_finish(encoder))
+		return die_s_("FLAC__stream_encoder_finish() returned false", encoder);
+	printf("OK\n");
+
+	printf("checking the frames... ");
+	if(data.samples != sizeof(samples) / sizeof(FLAC__int32)) {
+		printf("FAILED, expected %u samples, got %u\n", (unsigned)(sizeof(samples) / sizeof(FLAC__int32)), (unsigned)data.samples);
+		return false;
+	}
+	if(data.num_short_frames == 0 || data.num_short_frames == data.num_frames) {
+		printf("FAILED, %u of %u frames are shorter than the blocksize\n", data.num_short_frames, data.num_frames);
+		return false;
+	}
+	printf("OK (%u of %u frames are shorter than the blocksize)\n", data.num_short_frames, data.num_frames);
+
 	printf("testing FLAC__stream_encoder_delete()... ");
 	FLAC__stream_encoder_delete(encoder);
 	printf("OK\n");
@@ -492,21 +780,25 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 FLAC__bool test_encoders(void)
 {
 	FLAC__bool is_ogg = false;
+	unsigned pass;
 
 	while(1) {
 		init_metadata_blocks_();
 
-		if(!test_stream_encoder(LAYER_STREAM, is_ogg))
-			return false;
+		/* the second pass runs with the extras */
+		for(pass = 0; pass < 2; pass++) {
+			if(!test_stream_encoder(LAYER_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_SEEKABLE_STREAM, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_SEEKABLE_STREAM, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_FILE, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_FILE, is_ogg, /*extras=*/pass == 1))
+				return false;
 
-		if(!test_stream_encoder(LAYER_FILENAME, is_ogg))
-			return false;
+			if(!test_stream_encoder(LAYER_FILENAME, is_ogg, /*extras=*/pass == 1))
+				return false;
+		}
 
 		(void) grabbag__file_remove_file(flacfilename(is_ogg));
 
@@ -517,5 +809,11 @@ FLAC__bool test_encoders(void)
 		is_ogg = true;
 	}
 
+	if(!test_stream_encoder_recycle())
+		return false;
+
+	if(!test_stream_encoder_variable_blocksize())
+		return false;
+
 	return true;
 }
@@ -21,6 +21,7 @@
 #endif
 
 #include "bitwriter.h"
+#include "crc.h"
 #include "decoders.h"
 #include "encoders.h"
 #include "format.h"
@@ -33,6 +34,9 @@ int main(int argc, char *argv[])
 	if(!test_bitwriter())
 		return 1;
 
+	if(!test_crc())
+		return 1;
+
 	if(!test_format())
 		return 1;
 
@@ -93,6 +93,10 @@ SOURCE=.\bitwriter.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\crc.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\decoders.c
 # End Source File
 # Begin Source File
@@ -129,6 +133,10 @@ SOURCE=.\bitwriter.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\crc.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\decoders.h
 # End Source File
 # Begin Source File
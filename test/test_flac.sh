@@ -307,6 +307,15 @@ done
 for f in rt-*.wav ; do
 	rt_test_flac $f
 done
+for f in rt-*.wav ; do
+	rt_test_wav $f '--variable-blocksize'
+done
+for f in rt-*.wav ; do
+	rt_test_wav $f '--fast-mid-side'
+done
+for f in rt-*.wav ; do
+	rt_test_wav $f '-R 2'
+done
 if [ $has_ogg = yes ] ; then
 	for f in rt-*.wav ; do
 		rt_test_ogg_flac $f
@@ -758,6 +767,34 @@ if [ $is_win = no ] ; then
 fi
 
 
+############################################################################
+# test --threads
+############################################################################
+
+echo -n "testing --threads... "
+run_flac --force $SILENT --no-padding --force-raw-format --endian=big --sign=signed --sample-rate=44100 --bps=16 --channels=2 --blocksize=576 -o z1.flac noise.raw || die "ERROR generating FLAC file"
+run_flac --force $SILENT --no-padding --force-raw-format --endian=big --sign=signed --sample-rate=44100 --bps=16 --channels=2 --blocksize=576 --verify --threads=4 -o z4.flac noise.raw || die "ERROR generating FLAC file with --threads=4"
+cmp z1.flac z4.flac || die "ERROR: file mismatch for encoding with --threads=4"
+run_flac $SILENT --test --threads=4 z4.flac || die "ERROR testing FLAC file with --threads=4"
+run_flac $raw_dopt --threads=4 -o z4.raw z4.flac || die "ERROR decoding FLAC file with --threads=4"
+cmp noise.raw z4.raw || die "ERROR: file mismatch for decoding with --threads=4"
+echo OK
+
+# a damaged file must give the same errors and, with -F, the same output with any number of threads
+echo -n "testing --threads with a damaged file... "
+dd if=/dev/zero of=z1.flac bs=1 seek=100000 count=16 conv=notrunc 2>/dev/null || $dddie
+dd if=/dev/zero of=z1.flac bs=1 seek=400000 count=3000 conv=notrunc 2>/dev/null || $dddie
+for threads in 1 4 ; do
+	run_flac $SILENT --test --threads=$threads z1.flac 2>z$threads.test.log && die "ERROR: damaged FLAC file tested OK with --threads=$threads"
+	run_flac $raw_dopt -F --threads=$threads -o z$threads.raw z1.flac 2>z$threads.decode.log
+done
+cmp z1.test.log z4.test.log || die "ERROR: testing a damaged FLAC file with --threads=4 reported different errors"
+cmp z1.decode.log z4.decode.log || die "ERROR: decoding a damaged FLAC file with --threads=4 reported different errors"
+cmp z1.raw z4.raw || die "ERROR: file mismatch for decoding a damaged FLAC file with --threads=4"
+rm -f z1.flac z4.flac z1.raw z4.raw z1.test.log z4.test.log z1.decode.log z4.decode.log
+echo OK
+
+
 ############################################################################
 # test --cue
 ############################################################################